@@ -32,6 +32,8 @@ def makeDensityMGE(tab, distance, length_unit, beta):
     '''
     Construct an agama.Density object corresponding to an axisymmetric MGE read from a text file
     and deprojected assuming the given inclination angle.
+    The same parameters (type='MGE', table=...) may be used to construct an agama.Potential
+    with an exact potential of the MGE model.
     Input:
     tab - array with 3 columns, as read from a text file produced by MGE fitting routines;
     each row contains data for one Gaussian components, columns are:
@@ -43,20 +45,20 @@ def makeDensityMGE(tab, distance, length_unit, beta):
     arcsec2kpc = distance * _numpy.pi / 648000   # conversion factor from arcseconds to kpc
     if 1 - min(tab[:,2])**2 > _numpy.sin(beta)**2:
         raise ValueError('Deprojection is impossible for the given inclination')
-    # construct the total composite density from the list of parameters of each component
-    components = [getDensityParamsMGE(
+    # construct the table of parameters of each component for the native MGE model,
+    # which provides both the density and the potential (no need for a potential expansion)
+    table = _numpy.column_stack((
         # for each Gaussian, the central surface density Sigma0 (1st column) expressed in Msun/pc^2
         # is converted to the total mass  M = 2 pi Sigma0 [pc/"]^2 L^2 q,
         # where L is the major axis length in arcsec (2nd column), q is the axis ratio (3rd column),
         # and an extra conversion factor is needed to transform from 1/pc^2 to 1/"^2
         # (why did ever anyone think of providing the input in these mixed-up units?)
-        mass = 2*_numpy.pi * t[0] * (1000*arcsec2kpc * t[1])**2 * t[2],
+        2*_numpy.pi * tab[:,0] * (1000*arcsec2kpc * tab[:,1])**2 * tab[:,2],
         # convert scale radii in arcseconds into the model length units
-        Sx   = t[1] * arcsec2kpc / length_unit,
-        Sy   = t[1] * arcsec2kpc / length_unit,   # two axes are identical
-        Sz   = t[1] * arcsec2kpc / length_unit * (1 - (1-t[2]**2) / _numpy.sin(beta)**2)**0.5)  # third is smaller
-        for t in tab]
-    return _agama.Density(*components)
+        tab[:,1] * arcsec2kpc / length_unit,
+        tab[:,1] * arcsec2kpc / length_unit,   # two axes are identical
+        tab[:,1] * arcsec2kpc / length_unit * (1 - (1-tab[:,2]**2) / _numpy.sin(beta)**2)**0.5))  # third is smaller
+    return _agama.Density(type='MGE', table=table)
 
 
 def surfaceDensityMGE(tab, xp, yp):
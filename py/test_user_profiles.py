@@ -57,6 +57,41 @@ pot_user = agama.Potential(potential=MyPlummerPot, symmetry='s')
 # or create a Multipole approximation for the user-defined potential function
 pot_app2 = agama.Potential(type="Multipole", potential=MyPlummerPot, symmetry='s')
 
+# the user-defined potential may also be a compiled C function with the signature
+# void(size_t npoints, const double* xyz, double* values), e.g. a numba.cfunc or a ctypes
+# function pointer; it is called directly from C++ without going through the Python interpreter.
+# here we use a ctypes callback wrapping the Python function, which has the same calling convention
+import ctypes
+RawSignature = ctypes.CFUNCTYPE(None, ctypes.c_size_t,
+    ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double))
+@RawSignature
+def MyPlummerRaw(npoints, xyz, values):
+    numpy.ctypeslib.as_array(values, shape=(npoints,))[:] = \
+        MyPlummerPot(numpy.ctypeslib.as_array(xyz, shape=(npoints, 3)))
+pot_raw  = agama.Potential(potential=MyPlummerRaw, symmetry='s')
+pot_app3 = agama.Potential(type="Multipole", potential=MyPlummerRaw, symmetry='s')
+# Multipole expansion of the built-in potential, which is evaluated point by point
+pot_app4 = agama.Potential(type="Multipole", potential=pot_orig, symmetry='s')
+# a compiled function with a wrong signature is rejected
+try:
+    agama.Potential(potential=ctypes.CFUNCTYPE(None, ctypes.c_double)(lambda x: None), symmetry='s')
+    wrongsig_ok = False
+except Exception: wrongsig_ok = True
+# compare the potential and force of the user-defined function evaluated point by point
+# and the expansions constructed from the stencils of all grid points evaluated in a single call
+points = numpy.random.default_rng(42).normal(size=(100,3)) * 3
+def maxdev(pot1, pot2):
+    return max(numpy.max(abs(pot1.potential(points) / pot2.potential(points) - 1)),
+        numpy.max(abs(pot1.force(points) - pot2.force(points))) /
+        numpy.max(abs(pot2.force(points))))
+dev_user = maxdev(pot_user, pot_orig)   # Python function vs built-in (finite-difference error)
+dev_raw  = maxdev(pot_raw,  pot_user)   # compiled vs Python function (identical stencils)
+dev_app2 = maxdev(pot_app2, pot_app4)   # batched Python vs per-point built-in potential
+dev_app3 = maxdev(pot_app3, pot_app2)   # batched compiled vs batched Python function
+print("Max deviation of user potential: %.3g, compiled vs Python: %.3g; "
+    "expansion of user potential: %.3g, compiled vs Python: %.3g" %
+    (dev_user, dev_raw, dev_app2, dev_app3))
+
 pot0_orig = pot_orig.potential(0,0,0)
 pot0_appr = pot_appr.potential(0,0,0)
 pot0_app2 = pot_app2.potential(0,0,0)
@@ -160,6 +195,7 @@ print("Total DF mass by sampling from this region: original=%.6g, user=%.6g" %
 
 if (abs(pot0_orig-pot0_appr)<1e-6    and
     abs(pot0_orig-pot0_app2)<1e-6    and
+    dev_user<1e-8 and dev_raw<1e-12 and dev_app2<1e-8 and dev_app3<1e-12 and wrongsig_ok and
     abs(mass_orig-mass_user)<1e-6    and
     abs(mass_orig-mass_gm_orig)<5e-3 and
     abs(mass_user-mass_gm_user)<5e-3 and
@@ -298,6 +298,12 @@ def createMakefile():
         if not MSVC and runCompiler(flags='-Werror '+WARNING_FLAG):
             CXXFLAGS += [WARNING_FLAG]
 
+    # [1h]: POSIX shared memory (shm_open) may require linking with librt on older Linux systems
+    SHM_CODE = '#include <sys/mman.h>\n#include <fcntl.h>\nint main(){ return shm_open("/agama", O_RDONLY, 0)>0; }\n'
+    if not MSVC and not runCompiler(code=SHM_CODE) and runCompiler(code=SHM_CODE, flags='-lrt'):
+        LINK_FLAGS += ['-lrt']
+        EXE_FLAGS  += ['-lrt']
+
     # [2a]: check that NumPy is present (required by the python interface)
     try:
         import numpy
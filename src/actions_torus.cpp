@@ -6,6 +6,10 @@
 #include "torus/Torus.h"
 #include "torus/Potential.h"
 #include <stdexcept>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #if __cplusplus >= 201103L
 // with C++11 use unordered map as it is faster
@@ -46,21 +50,48 @@ typedef std::map<actions::Actions, shared_ptr<torus::Torus>, ActionsLess> TorusC
 
 namespace actions{
 
-/// Auxiliary class for using any of BasePotential-derived potentials with Torus code
+/** Auxiliary class for using any of BasePotential-derived potentials with Torus code.
+    Torus fitting evaluates the potential repeatedly at exactly the same points (e.g., when
+    a trial step of Levenberg-Marquardt iterations is rejected and the previous parameters are
+    restored, or when the fit is restarted with a different number of terms), so the results
+    are memoized in a small direct-mapped cache. The fitting routines are OpenMP-parallelized,
+    hence each thread has its own cache; an instance of this class is created for each torus
+    and should not be shared between threads other than those of the parallel loops in the fit.
+*/
 class TorusPotentialWrapper: public torus::Potential{
 public:
-    TorusPotentialWrapper(const potential::BasePotential& _poten) : poten(_poten) {};
+    TorusPotentialWrapper(const potential::BasePotential& _poten) :
+        poten(_poten),
+#ifdef _OPENMP
+        cache(std::max(1, omp_get_max_threads()))
+#else
+        cache(1)
+#endif
+    {}
     virtual ~TorusPotentialWrapper() {};
     virtual double operator()(const double R, const double z) const {
-        return poten.value(coord::PosCyl(R, z, 0));
+        CacheEntry& entry = lookup(R, z);
+        if(!(entry.R == R && entry.z == z)) {
+            entry.Phi = poten.value(coord::PosCyl(R, z, 0));
+            entry.R = R;
+            entry.z = z;
+            entry.dPhidR = entry.dPhidz = NAN;  // not computed
+        }
+        return entry.Phi;
     }
     virtual double operator()(const double R, const double z, double& dPhidR, double& dPhidz) const {
-        double val;
-        coord::GradCyl grad;
-        poten.eval(coord::PosCyl(R, z, 0), &val, &grad);
-        dPhidR = grad.dR;
-        dPhidz = grad.dz;
-        return val;
+        CacheEntry& entry = lookup(R, z);
+        if(!(entry.R == R && entry.z == z && entry.dPhidR == entry.dPhidR)) {
+            coord::GradCyl grad;
+            poten.eval(coord::PosCyl(R, z, 0), &entry.Phi, &grad);
+            entry.R = R;
+            entry.z = z;
+            entry.dPhidR = grad.dR;
+            entry.dPhidz = grad.dz;
+        }
+        dPhidR = entry.dPhidR;
+        dPhidz = entry.dPhidz;
+        return entry.Phi;
     }
     virtual double RfromLc(double Lz, double* dRdLz=0) const {
         if(dRdLz!=0)
@@ -78,7 +109,27 @@ public:
         return freq;
     }
 private:
+    /// cached values of potential and its derivatives (NAN if only the potential was computed)
+    struct CacheEntry { double R, z, Phi, dPhidR, dPhidz; };
+    static const unsigned int CACHE_SIZE = 4096;  ///< number of entries per thread (power of two)
     const potential::BasePotential& poten;
+    mutable std::vector< std::vector<CacheEntry> > cache;  ///< separate cache for each thread
+
+    /// find the cache entry for the given point (it may be occupied by a different point)
+    CacheEntry& lookup(double R, double z) const {
+#ifdef _OPENMP
+        std::vector<CacheEntry>& threadCache =
+            cache[std::min<int>(omp_get_thread_num(), cache.size()-1)];
+#else
+        std::vector<CacheEntry>& threadCache = cache[0];
+#endif
+        if(threadCache.empty()) {  // allocate the cache for this thread on the first use
+            CacheEntry empty = { NAN, NAN, NAN, NAN, NAN };
+            threadCache.assign(CACHE_SIZE, empty);
+        }
+        double key[2] = {R, z};
+        return threadCache[math::hash(key, 2) & (CACHE_SIZE-1)];
+    }
 };
 
 /// Auxiliary class implementing on-the-fly creation of Torus instances and their caching
@@ -98,9 +149,20 @@ public:
             return NULL;  // invalid actions => no torus
 
         // check if a Torus object for the given triplet of actions has been constructed before
-        TorusCache::iterator it = cache.find(act);
-        if(it != cache.end())
-            return it->second.get();
+        torus::Torus* existing = NULL;
+        bool found = false;
+#ifdef _OPENMP
+#pragma omp critical(TorusCache)
+#endif
+        {
+            TorusCache::const_iterator it = cache.find(act);
+            if(it != cache.end()) {
+                found = true;
+                existing = it->second.get();
+            }
+        }
+        if(found)
+            return existing;
 
         // not found: create a new Torus
         shared_ptr<torus::Torus> newTorus;
@@ -126,14 +188,21 @@ public:
             newTorus.reset();  // assign a null pointer to this torus
         }
 
-        // add the newly created torus (even if it is NULL) to the cache
-        cache.insert(std::make_pair(act, newTorus));
-        return newTorus.get();
+        // add the newly created torus (even if it is NULL) to the cache;
+        // the fit is performed outside the critical section, so another thread may have
+        // constructed the same torus in the meantime - then the first inserted one is kept
+        torus::Torus* result = NULL;
+#ifdef _OPENMP
+#pragma omp critical(TorusCache)
+#endif
+        result = cache.insert(std::make_pair(act, newTorus)).first->second.get();
+        return result;
     }
 
     const potential::PtrPotential pot;  ///< the potential used to create new tori
     const double tol;                   ///< accuracy parameter for torus construction
-    TorusCache cache;                   ///< cache for previously constructed tori
+    TorusCache cache;                   ///< cache for previously constructed tori (shared
+                                        ///< between threads, accessed in a critical section)
 };
 
 ActionMapperTorus::ActionMapperTorus(const potential::PtrPotential& pot, double tol) :
@@ -31,7 +31,8 @@ public:
         If the triplet of actions has been provided in one of earlier calls,
         the corresponding Torus object will be retrieved from a cache,
         otherwise a new Torus will be created and stored in the cache table.
-        \note this method is not thread-safe because of fatal flaws in the Torus implementation!
+        This method is thread-safe: tori are constructed and mapped independently in each thread,
+        and only the access to the cache is serialized.
     */
     virtual coord::PosVelCyl map(const ActionAngles& actAng, Frequencies* freq=NULL) const;
 
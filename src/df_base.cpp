@@ -3,6 +3,14 @@
 #include "math_sample.h"
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
+#include <map>
+#include <typeinfo>
+#ifndef _MSC_VER
+#include <alloca.h>
+#else
+#include <malloc.h>
+#endif
 
 namespace df{
 
@@ -78,6 +86,9 @@ void ActionSpaceScalingRect::toScaled(const actions::Actions &acts, double vars[
     vars[2] = Jm==0 ? 0 : Jm==INFINITY ? 0 : acts.Jr / Jm;
 }
 
+/// number of points in a block for the vectorized evaluation of DF in the integrand
+static const size_t EVALMANY_BLOCK_SIZE = 64;
+
 /// helper class for computing the integral of distribution function f
 /// or -f * ln(f)  if LogTerm==true, in scaled coords in action space.
 template <bool LogTerm>
@@ -110,12 +121,67 @@ public:
         }
     }
 
+    /// compute the values of DF at many points in parallel: the input points are split into
+    /// blocks, and the DF is evaluated for all points of each block with a single call to evalmany
+    virtual void evalmany(const size_t npoints, const double vars[], double values[]) const
+    {
+        const int numBlocks = (npoints + EVALMANY_BLOCK_SIZE - 1) / EVALMANY_BLOCK_SIZE;
+        std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(numBlocks>1)
+#endif
+        for(int b=0; b<numBlocks; b++) {
+            try{
+                const size_t start = b * EVALMANY_BLOCK_SIZE,
+                    size = std::min<size_t>(EVALMANY_BLOCK_SIZE, npoints - start);
+                actions::Actions* acts = static_cast<actions::Actions*>(
+                    alloca(size * sizeof(actions::Actions)));
+                double* jac  = static_cast<double*>(alloca(size * sizeof(double)));
+                double* vals = static_cast<double*>(alloca(size * sizeof(double)));
+                // only the points with nonzero jacobian are passed to the DF
+                size_t count = 0;
+                for(size_t p=0; p<size; p++) {
+                    acts[count] = scaling.toActions(vars + (start+p) * 3, &jac[p]);
+                    if(jac[p]!=0)
+                        count++;
+                }
+                if(count>0)
+                    df.evalmany(count, acts, /*separate*/false, vals);
+                for(size_t p=0, c=0; p<size; p++) {
+                    double val = 0;
+                    if(jac[p]!=0) {
+                        val = vals[c++];
+                        if(!isFinite(val))
+                            val = 0;
+                        if(LogTerm && val>0)
+                            val *= -log(val);
+                    }
+                    values[start+p] = val * jac[p] * TWO_PI_CUBE;
+                }
+            }
+            catch(std::exception& e) {
+                errorMsg = e.what();
+            }
+        }
+        if(!errorMsg.empty())
+            throw std::runtime_error(errorMsg);
+    }
+
     /// number of variables (3 actions)
     virtual unsigned int numVars()   const { return 3; }
     /// number of values to compute (1 value of DF)
     virtual unsigned int numValues() const { return 1; }
 };
 
+/// maximum number of entries in the cache of DF normalizations
+static const size_t MASS_CACHE_SIZE = 1024;
+
+/// key in the cache of DF normalizations: the type of DF and its parameters
+typedef std::pair<std::string, std::vector<double> > MassCacheKey;
+
+/// cache of total masses per unit normalization, indexed by the DF type and parameters
+static std::map<MassCacheKey, double> massCache;
+
 double BaseDistributionFunction::totalMass(const double reqRelError, const int maxNumEval) const
 {
     double xlower[3] = {0, 0, 0};  // boundaries of integration region in scaled coordinates
@@ -125,6 +191,38 @@ double BaseDistributionFunction::totalMass(const double reqRelError, const int m
     return result;
 }
 
+double totalMassCached(const BaseDistributionFunction& DF, double norm,
+    const std::vector<double>& params, const double reqRelError, const int maxNumEval)
+{
+    // different DF classes may have the same number of parameters, so the key includes the type
+    MassCacheKey key(typeid(DF).name(), params);
+    key.second.push_back(reqRelError);
+    key.second.push_back(maxNumEval);
+    double massPerNorm = NAN;
+#ifdef _OPENMP
+#pragma omp critical(DFMassCache)
+#endif
+    {
+        std::map<MassCacheKey, double>::const_iterator iter = massCache.find(key);
+        if(iter != massCache.end())
+            massPerNorm = iter->second;
+    }
+    if(massPerNorm == massPerNorm)
+        return massPerNorm * norm;
+    // compute the mass outside the critical section (concurrent computations of the same entry
+    // by different threads are harmless)
+    massPerNorm = DF.BaseDistributionFunction::totalMass(reqRelError, maxNumEval) / norm;
+#ifdef _OPENMP
+#pragma omp critical(DFMassCache)
+#endif
+    {
+        if(massCache.size() >= MASS_CACHE_SIZE)
+            massCache.clear();
+        massCache[key] = massPerNorm;
+    }
+    return massPerNorm * norm;
+}
+
 double totalEntropy(const BaseDistributionFunction& DF, const double reqRelError, const int maxNumEval)
 {
     double xlower[3] = {0, 0, 0};
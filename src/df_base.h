@@ -125,6 +125,33 @@ public:
 double totalEntropy(const BaseDistributionFunction& DF,
     const double reqRelError=1e-4, const int maxNumEval=1e6);
 
+/** Compute the total mass of a DF whose dependence on parameters is separable:
+    the mass is proportional to the normalization factor `norm`, and the mass per unit norm
+    depends only on the remaining dimensionless parameters (e.g., the ratios of scale actions,
+    since the mass is invariant under a simultaneous rescaling of all actions), collected in `key`.
+    The mass per unit norm is computed by numerical integration (the default implementation of
+    `BaseDistributionFunction::totalMass`) only once for each combination of key, tolerance and
+    number of evaluations, and is retrieved from a cache on subsequent calls; in this way,
+    the normalization of a DF inside a fitting loop costs nothing if only the overall
+    normalization or the scale of the model is varied.
+    The key is combined with the type of DF, so that different DF classes do not share entries.
+    Note that the numerical integration is not exactly scale-invariant, so the cached value may
+    differ from a direct computation by an amount comparable to reqRelError. As a consequence,
+    the result depends on the history of calls: the cached value is the one computed for
+    the first DF with the given key (until the cache is cleared), and a DF that differs only by
+    its scale may receive a slightly different mass in a fresh process, or after the cache has
+    been cleared. Use `BaseDistributionFunction::totalMass` directly if this is undesirable.
+    The cache is shared between all threads and has a limited size (it is cleared when full).
+    \param[in]  DF   is the distribution function;
+    \param[in]  norm is its normalization factor;
+    \param[in]  key  is the array of other parameters that determine the mass per unit norm;
+    \param[in]  reqRelError - relative tolerance;
+    \param[in]  maxNumEval - maximum number of evaluations of DF during integration;
+    \return  the total mass of the DF.
+*/
+double totalMassCached(const BaseDistributionFunction& DF, double norm,
+    const std::vector<double>& key, const double reqRelError, const int maxNumEval);
+
 /** Sample the distribution function in actions.
     In other words, draw N sampling points from the action space, so that the density of points 
     in the neighborhood of any point is proportional to the value of DF at this point 
@@ -94,6 +94,111 @@ void QuasiIsothermal::evalDeriv(const actions::Actions &J,
     }
 }
 
+namespace{
+/// derivative of log(qexp(-x, -q)) w.r.t. q
+inline double dlogqexpdq(const double x, const double q)
+{
+    double qx = q*x;
+    if(fabs(qx) < 1e-4)  // asymptotic expansion for small q
+        return x*x * (0.5 + qx * (-2./3 + 0.75 * qx));
+    return (log(1 + qx) - qx / (1 + qx)) / (q*q);
+}
+}  // internal ns
+
+void QuasiIsothermal::evalParamDeriv(const size_t npoints, const actions::Actions J[],
+    double values[], QuasiIsothermalParam derivs[]) const
+{
+    for(size_t p=0; p<npoints; p++) {
+        QuasiIsothermalParam& der = derivs[p];
+        // same expressions as in evalDeriv
+        double coefJphi = J[p].Jphi >= 0 ? 1 : -1,
+        Jsum = coefJphi * J[p].Jphi + par.coefJr * J[p].Jr + par.coefJz * J[p].Jz,
+        Jhat = sqrt(pow_2(Jsum) + pow_2(par.Jmin)),
+        dRcirc_dJhat,
+        Rcirc = freq.R_from_Lz(Jhat, &dRcirc_dJhat),
+        kappa, nu, Omega;
+        freq.epicycleFreqs(Rcirc, kappa, nu, Omega);
+        double
+        sigmarsq    = pow_2(par.sigmar0 * exp (-Rcirc / par.Rsigmar) ),
+        sigmazsq    = par.Hdisk>0 ? 2 * pow_2(nu * par.Hdisk) : pow_2(par.sigmaz0 * exp (-Rcirc / par.Rsigmaz) ),
+        invsigmarsq = 1 / (sigmarsq + pow_2(par.sigmamin)),
+        invsigmazsq = 1 / (sigmazsq + pow_2(par.sigmamin)),
+        negJphi = J[p].Jphi>0 ? 0. : 2*Omega * J[p].Jphi,
+        argJr   = (kappa * J[p].Jr - negJphi) * invsigmarsq,
+        argJz   = nu * J[p].Jz * invsigmazsq,
+        argRc   = Rcirc / par.Rdisk;
+        values[p] = 1./(2*M_PI*M_PI) * par.Sigma0 * (1 - par.qJphi) * (1 - par.qJr) * (1 - par.qJz) *
+            nu * Omega / kappa * invsigmarsq * invsigmazsq *
+            math::qexp(-argRc, -par.qJphi) *
+            math::qexp(-argJr, -par.qJr) *
+            math::qexp(-argJz, -par.qJz);
+        if(!(values[p]>0)) {
+            der.Sigma0 = der.Rdisk = der.Hdisk = der.sigmar0 = der.sigmaz0 = der.sigmamin =
+            der.Rsigmar = der.Rsigmaz = der.coefJr = der.coefJz = der.qJr = der.qJz = der.qJphi =
+            der.Jmin = 0;
+            continue;
+        }
+        // derivatives of log(f) w.r.t. the inverse squared velocity dispersions
+        double
+        dlogf_dinvsigmarsq = (1 - argJr / (1 + par.qJr * argJr)) / invsigmarsq,
+        dlogf_dinvsigmazsq = (1 - argJz / (1 + par.qJz * argJz)) / invsigmazsq;
+        // derivative of log(f) w.r.t. Jhat (via Rcirc), with finite-differenced epicyclic frequencies
+        double EPS=1e-5;
+        double kappa1, nu1, Omega1, kappa2, nu2, Omega2;
+        freq.epicycleFreqs(Rcirc * (1-EPS), kappa1, nu1, Omega1);
+        freq.epicycleFreqs(Rcirc * (1+EPS), kappa2, nu2, Omega2);
+        double
+        dlnkappa_dRcirc = (kappa2-kappa1) / (2*Rcirc*EPS * kappa),
+        dlnnu_dRcirc    = (   nu2-   nu1) / (2*Rcirc*EPS * nu),
+        dlnOmega_dRcirc = (Omega2-Omega1) / (2*Rcirc*EPS * Omega),
+        dlnsigmarsq_dRcirc = -2 / par.Rsigmar * (1 - pow_2(par.sigmamin) * invsigmarsq),
+        dlnsigmazsq_dRcirc = -(par.Hdisk>0 ?
+            -pow_2(2 * nu * par.Hdisk) * invsigmazsq * dlnnu_dRcirc :
+            2 / par.Rsigmaz * (1 - pow_2(par.sigmamin) * invsigmazsq) ),
+        dlogf_dJhat = dRcirc_dJhat * (
+            dlnnu_dRcirc + dlnOmega_dRcirc - dlnkappa_dRcirc - dlnsigmarsq_dRcirc - dlnsigmazsq_dRcirc -
+            1 / (par.Rdisk + par.qJphi * Rcirc) -
+            kappa * invsigmarsq * (dlnkappa_dRcirc - dlnsigmarsq_dRcirc) * J[p].Jr / (1 + par.qJr * argJr) -
+            nu    * invsigmazsq * (   dlnnu_dRcirc - dlnsigmazsq_dRcirc) * J[p].Jz / (1 + par.qJz * argJz) );
+        if(negJphi)
+            dlogf_dJhat += dRcirc_dJhat * 2 * Omega * invsigmarsq *
+                (dlnOmega_dRcirc - dlnsigmarsq_dRcirc) * J[p].Jphi / (1 + par.qJr * argJr);
+        // derivatives of Jhat w.r.t. parameters that enter the linear combination of actions
+        double dJhat_dJsum = Jhat>0 ? Jsum / Jhat : 0, dJhat_dJmin = Jhat>0 ? par.Jmin / Jhat : 0;
+        der.Sigma0   = 1 / par.Sigma0;
+        der.Rdisk    = argRc / (par.Rdisk + par.qJphi * Rcirc);
+        der.sigmar0  = -dlogf_dinvsigmarsq * pow_2(invsigmarsq) * 2 * sigmarsq / par.sigmar0;
+        der.Rsigmar  = -dlogf_dinvsigmarsq * pow_2(invsigmarsq) * 2 * sigmarsq * Rcirc / pow_2(par.Rsigmar);
+        der.sigmamin = -(dlogf_dinvsigmarsq * pow_2(invsigmarsq) +
+            dlogf_dinvsigmazsq * pow_2(invsigmazsq)) * 2 * par.sigmamin;
+        if(par.Hdisk>0) {
+            der.Hdisk   = -dlogf_dinvsigmazsq * pow_2(invsigmazsq) * 2 * sigmazsq / par.Hdisk;
+            der.sigmaz0 = der.Rsigmaz = 0;
+        } else {
+            der.Hdisk   = 0;
+            der.sigmaz0 = -dlogf_dinvsigmazsq * pow_2(invsigmazsq) * 2 * sigmazsq / par.sigmaz0;
+            der.Rsigmaz = -dlogf_dinvsigmazsq * pow_2(invsigmazsq) * 2 * sigmazsq * Rcirc /
+                pow_2(par.Rsigmaz);
+        }
+        der.coefJr   = dlogf_dJhat * dJhat_dJsum * J[p].Jr;
+        der.coefJz   = dlogf_dJhat * dJhat_dJsum * J[p].Jz;
+        der.Jmin     = dlogf_dJhat * dJhat_dJmin;
+        der.qJphi    = -1 / (1 - par.qJphi) + dlogqexpdq(argRc, par.qJphi);
+        der.qJr      = -1 / (1 - par.qJr)   + dlogqexpdq(argJr, par.qJr);
+        der.qJz      = -1 / (1 - par.qJz)   + dlogqexpdq(argJz, par.qJz);
+        // convert the derivatives of log(f) into the derivatives of f
+        double QuasiIsothermalParam::* const fields[] = { &QuasiIsothermalParam::Sigma0,
+            &QuasiIsothermalParam::Rdisk, &QuasiIsothermalParam::Hdisk,
+            &QuasiIsothermalParam::sigmar0, &QuasiIsothermalParam::sigmaz0,
+            &QuasiIsothermalParam::sigmamin, &QuasiIsothermalParam::Rsigmar,
+            &QuasiIsothermalParam::Rsigmaz, &QuasiIsothermalParam::coefJr,
+            &QuasiIsothermalParam::coefJz, &QuasiIsothermalParam::qJr, &QuasiIsothermalParam::qJz,
+            &QuasiIsothermalParam::qJphi, &QuasiIsothermalParam::Jmin };
+        for(size_t f=0; f<sizeof(fields)/sizeof(fields[0]); f++)
+            der.*fields[f] *= values[p];
+    }
+}
+
 
 Exponential::Exponential(const ExponentialParam& params) :
     par(params)
@@ -110,6 +215,15 @@ Exponential::Exponential(const ExponentialParam& params) :
         throw std::invalid_argument("Exponential: q-coefficients must be >=0 and <1");
 }
 
+double Exponential::totalMass(const double reqRelError, const int maxNumEval) const
+{
+    // the mass is proportional to norm and is invariant under a rescaling of all actions
+    double key[] = { par.Jr0 / par.Jphi0, par.Jz0 / par.Jphi0, par.addJden / par.Jphi0,
+        par.addJvel / par.Jphi0, par.coefJr, par.coefJz, par.qJr, par.qJz, par.qJphi };
+    return totalMassCached(*this, par.norm,
+        std::vector<double>(key, key + sizeof(key)/sizeof(key[0])), reqRelError, maxNumEval);
+}
+
 void Exponential::evalDeriv(const actions::Actions &J,
     double *value, DerivByActions *deriv) const
 {
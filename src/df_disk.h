@@ -86,6 +86,18 @@ public:
     /** compute the value of DF for the given set of actions, and optionally its derivatives */
     virtual void evalDeriv(const actions::Actions &J,
         /*output*/ double *value, DerivByActions *deriv=NULL) const;
+
+    /** compute the values of DF and its derivatives w.r.t. parameters at several points at once.
+        \param[in]  npoints is the number of points;
+        \param[in]  J is the array of actions of length npoints;
+        \param[out] values will contain the values of DF at these points;
+        \param[out] derivs will contain the derivatives of DF w.r.t. each parameter (stored in
+        the corresponding field of the structure); the derivatives by sigmaz0 and Rsigmaz are zero
+        if the vertical velocity dispersion is set by Hdisk, and vice versa.
+        The epicyclic frequencies are considered to be fixed functions of radius.
+    */
+    void evalParamDeriv(const size_t npoints, const actions::Actions J[],
+        /*output*/ double values[], QuasiIsothermalParam derivs[]) const;
 };
 
 
@@ -131,6 +143,10 @@ class Exponential: public df::BaseDistributionFunction{
     const ExponentialParam par;     ///< parameters of the DF
 public:
     Exponential(const ExponentialParam& params);
+
+    /** compute the total mass, using the cache of mass per unit norm (see `totalMassCached`),
+        since it depends only on the ratios of scale actions and dimensionless parameters */
+    virtual double totalMass(const double reqRelError=1e-6, const int maxNumEval=1e6) const;
     virtual void evalDeriv(const actions::Actions &J,
         /*output*/ double *value, DerivByActions *deriv=NULL) const;
 };
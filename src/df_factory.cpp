@@ -183,10 +183,11 @@ PtrDistributionFunction createDistributionFunction(
             density = potential;
         double beta0 = kvmap.getDoubleAlt("beta", "beta0", 0);
         double r_a   = kvmap.getDoubleAlt("anisotropyRadius", "r_a", INFINITY) * converter.lengthUnit;
+        double tableAccuracy = kvmap.getDouble("tableAccuracy", 0);
         return PtrDistributionFunction(new QuasiSphericalCOM(
             potential::Sphericalized<potential::BaseDensity>  (*density),
             potential::Sphericalized<potential::BasePotential>(*potential),
-            beta0, r_a));
+            beta0, r_a, tableAccuracy));
     }
     else
         throw std::invalid_argument("Unknown type of distribution function");
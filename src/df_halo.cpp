@@ -48,6 +48,28 @@ double computeBeta(const DoublePowerLawParam &par)
     return math::findRoot(BetaFinder(par), 0.0, 2.0, /*root-finder tolerance*/ SQRT_DBL_EPSILON);
 }
 
+// derivatives of the coefficient beta w.r.t. the parameters J0, slopeIn, slopeOut, steepness and
+// Jcore, using the implicit function theorem for the equation F(beta, params) = 0 (F = BetaFinder):
+// dbeta/dp = -(dF/dp) / (dF/dbeta), where both partial derivatives of F are approximated by
+// symmetric finite differences (truncation error ~EPS^2 plus roundoff ~DBL_EPSILON/EPS)
+void computeBetaDerivs(const DoublePowerLawParam &par, const double beta, double dbeta[5])
+{
+    static const double EPS = 1e-5;  // relative step for the symmetric finite-difference scheme
+    double DoublePowerLawParam::* const fields[5] = { &DoublePowerLawParam::J0,
+        &DoublePowerLawParam::slopeIn, &DoublePowerLawParam::slopeOut,
+        &DoublePowerLawParam::steepness, &DoublePowerLawParam::Jcore };
+    const BetaFinder finder(par);
+    double dFdbeta = (finder.value(beta + EPS) - finder.value(beta - EPS)) / (2*EPS);
+    for(int i=0; i<5; i++) {
+        DoublePowerLawParam par1(par), par2(par);
+        double delta = EPS * fmax(fabs(par.*fields[i]), 1.);
+        par1.*fields[i] -= delta;
+        par2.*fields[i] += delta;
+        dbeta[i] = dFdbeta==0 ? 0 :
+            -(BetaFinder(par2).value(beta) - BetaFinder(par1).value(beta)) / (2*delta * dFdbeta);
+    }
+}
+
 }  // internal ns
 
 DoublePowerLaw::DoublePowerLaw(const DoublePowerLawParam &inparams) :
@@ -82,6 +104,16 @@ DoublePowerLaw::DoublePowerLaw(const DoublePowerLawParam &inparams) :
 
 }
 
+double DoublePowerLaw::totalMass(const double reqRelError, const int maxNumEval) const
+{
+    // the mass is proportional to norm and is invariant under a rescaling of all actions
+    double key[] = { par.Jcutoff / par.J0, par.slopeIn, par.slopeOut, par.steepness,
+        par.cutoffStrength, par.coefJrIn, par.coefJzIn, par.coefJrOut, par.coefJzOut,
+        par.rotFrac, par.Jphi0 / par.J0, par.Jcore / par.J0 };
+    return totalMassCached(*this, par.norm,
+        std::vector<double>(key, key + sizeof(key)/sizeof(key[0])), reqRelError, maxNumEval);
+}
+
 void DoublePowerLaw::evalDeriv(const actions::Actions &J,
     double *value, DerivByActions *deriv) const
 {
@@ -125,4 +157,71 @@ void DoublePowerLaw::evalDeriv(const actions::Actions &J,
     }
 }
 
+void DoublePowerLaw::evalParamDeriv(const size_t npoints, const actions::Actions J[],
+    double values[], DoublePowerLawParam derivs[]) const
+{
+    // derivatives of beta w.r.t. J0, slopeIn, slopeOut, steepness, Jcore (only for a cored model)
+    double dbeta[5] = {0};
+    if(par.Jcore>0)
+        computeBetaDerivs(par, beta, dbeta);
+    const double eta = par.steepness, Gamma = par.slopeIn, B = par.slopeOut;
+    for(size_t p=0; p<npoints; p++) {
+        evalDeriv(J[p], &values[p]);
+        DoublePowerLawParam& der = derivs[p];
+        const double absJphi = fabs(J[p].Jphi),
+        h = par.coefJrIn * J[p].Jr + par.coefJzIn * J[p].Jz + (3-par.coefJrIn -par.coefJzIn) * absJphi,
+        g = par.coefJrOut* J[p].Jr + par.coefJzOut* J[p].Jz + (3-par.coefJrOut-par.coefJzOut)* absJphi;
+        if(!(values[p]>0 && h>0 && g>0 && isFinite(h+g))) {
+            der.norm = der.J0 = der.Jcutoff = der.slopeIn = der.slopeOut = der.steepness =
+            der.cutoffStrength = der.coefJrIn = der.coefJzIn = der.coefJrOut = der.coefJzOut =
+            der.rotFrac = der.Jphi0 = der.Jcore = 0;
+            continue;
+        }
+        const double
+        J0he = math::pow(par.J0 / h, eta),
+        gJ0e = math::pow(g / par.J0, eta),
+        gJcz = par.Jcutoff>0 ? math::pow(g / par.Jcutoff, par.cutoffStrength) : 0,
+        logH = log(1 + J0he), logG = log(1 + gJ0e),
+        c    = par.Jcore / h,          // core-related quantities (zero if there is no core)
+        D    = 1 + c * (c - beta),
+        dlogfdbeta = 0.5 * Gamma * c / D,
+        // derivatives of log(f) w.r.t. h and g, as in evalDeriv
+        dlogHdh = -Gamma * (J0he + c * (0.5 * beta * (1 - J0he) - c)) / (h * (1 + J0he) * D),
+        dlogGdg = -(B * gJ0e + (par.Jcutoff>0 ? par.cutoffStrength * gJcz * (1 + gJ0e) : 0)) /
+            (g * (1 + gJ0e)),
+        // the odd-Jphi factor and its ingredients
+        tJphi = par.Jphi0==INFINITY ? 0 :
+            par.Jphi0==0 ? math::sign(J[p].Jphi) : tanh(J[p].Jphi / par.Jphi0),
+        rot   = par.rotFrac * tJphi;
+        // derivatives of log(f), converted to the derivatives of f at the end
+        der.norm      = 1 / par.norm;
+        der.J0        = (-3 + Gamma * J0he / (1 + J0he) + B * gJ0e / (1 + gJ0e)) / par.J0 +
+            dlogfdbeta * dbeta[0];
+        der.slopeIn   = logH / eta - (par.Jcore>0 ? 0.5 * log(D) : 0) + dlogfdbeta * dbeta[1];
+        der.slopeOut  = -logG / eta + dlogfdbeta * dbeta[2];
+        der.steepness = Gamma / eta * (J0he / (1 + J0he) * log(par.J0 / h) - logH / eta) -
+            B / eta * (gJ0e / (1 + gJ0e) * log(g / par.J0) - logG / eta) + dlogfdbeta * dbeta[3];
+        der.Jcore     = par.Jcore>0 ?
+            -0.5 * Gamma * (2*c - beta) / (h * D) + dlogfdbeta * dbeta[4] : 0;
+        der.Jcutoff   = par.Jcutoff>0 ? par.cutoffStrength * gJcz / par.Jcutoff : 0;
+        der.cutoffStrength = par.Jcutoff>0 ? -gJcz * log(g / par.Jcutoff) : 0;
+        der.coefJrIn  = dlogHdh * (J[p].Jr - absJphi);
+        der.coefJzIn  = dlogHdh * (J[p].Jz - absJphi);
+        der.coefJrOut = dlogGdg * (J[p].Jr - absJphi);
+        der.coefJzOut = dlogGdg * (J[p].Jz - absJphi);
+        der.rotFrac   = tJphi / (1 + rot);
+        der.Jphi0     = par.Jphi0>0 && par.Jphi0!=INFINITY ?
+            -par.rotFrac * (1 - pow_2(tJphi)) * J[p].Jphi / pow_2(par.Jphi0) / (1 + rot) : 0;
+        double DoublePowerLawParam::* const fields[] = { &DoublePowerLawParam::norm,
+            &DoublePowerLawParam::J0, &DoublePowerLawParam::Jcutoff, &DoublePowerLawParam::slopeIn,
+            &DoublePowerLawParam::slopeOut, &DoublePowerLawParam::steepness,
+            &DoublePowerLawParam::cutoffStrength, &DoublePowerLawParam::coefJrIn,
+            &DoublePowerLawParam::coefJzIn, &DoublePowerLawParam::coefJrOut,
+            &DoublePowerLawParam::coefJzOut, &DoublePowerLawParam::rotFrac,
+            &DoublePowerLawParam::Jphi0, &DoublePowerLawParam::Jcore };
+        for(size_t f=0; f<sizeof(fields)/sizeof(fields[0]); f++)
+            der.*fields[f] *= values[p];
+    }
+}
+
 }  // namespace df
@@ -64,9 +64,31 @@ public:
     */
     DoublePowerLaw(const DoublePowerLawParam &params);
 
+    /** compute the total mass, using the cache of mass per unit norm (see `totalMassCached`),
+        since it depends only on the ratios of scale actions and dimensionless parameters */
+    virtual double totalMass(const double reqRelError=1e-6, const int maxNumEval=1e6) const;
+
     /** compute the value of DF for the given set of actions, and optionally its derivatives */
     virtual void evalDeriv(const actions::Actions &J,
         /*output*/ double *value, DerivByActions *deriv=NULL) const;
+
+    /** compute the values of DF and its derivatives w.r.t. parameters at several points at once.
+        \param[in]  npoints is the number of points;
+        \param[in]  J is the array of actions of length npoints;
+        \param[out] values will contain the values of DF at these points;
+        \param[out] derivs will contain the derivatives of DF w.r.t. each parameter (stored in
+        the corresponding field of the structure), taking into account the implicit dependence
+        of the coefficient beta on other parameters in the case of a cored model.
+        The derivatives by Jcutoff and cutoffStrength are zero if Jcutoff=0, the derivative by
+        Jcore is zero if Jcore=0, and the derivative by Jphi0 is zero if Jphi0 is zero or infinite;
+        note also that the parameters coefJrIn, coefJzIn, coefJrOut, coefJzOut are varied while
+        keeping the sums h_r+h_z+h_phi and g_r+g_z+g_phi fixed.
+        The derivatives of beta (for a cored model) follow from the implicit function theorem
+        applied to its defining equation, whose partial derivatives are approximated by
+        finite differences, so they are not accurate to machine precision.
+    */
+    void evalParamDeriv(const size_t npoints, const actions::Actions J[],
+        /*output*/ double values[], DoublePowerLawParam derivs[]) const;
 };
 
 ///@}
@@ -0,0 +1,374 @@
+#include "df_likelihood.h"
+#include "math_core.h"
+#include "utils.h"
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#ifndef _MSC_VER
+#include <alloca.h>
+#else
+#include <malloc.h>
+#endif
+
+namespace df{
+
+namespace {  // internal
+
+/// number of particles processed together in a single task
+static const size_t BLOCK_SIZE = 256;
+
+/// names of the fields of DoublePowerLawParam that may be used as free parameters
+struct DoublePowerLawField { const char* name; double DoublePowerLawParam::* field; };
+static const DoublePowerLawField doublePowerLawFields[] = {
+    { "norm",           &DoublePowerLawParam::norm },
+    { "J0",             &DoublePowerLawParam::J0 },
+    { "Jcutoff",        &DoublePowerLawParam::Jcutoff },
+    { "slopeIn",        &DoublePowerLawParam::slopeIn },
+    { "slopeOut",       &DoublePowerLawParam::slopeOut },
+    { "steepness",      &DoublePowerLawParam::steepness },
+    { "cutoffStrength", &DoublePowerLawParam::cutoffStrength },
+    { "coefJrIn",       &DoublePowerLawParam::coefJrIn },
+    { "coefJzIn",       &DoublePowerLawParam::coefJzIn },
+    { "coefJrOut",      &DoublePowerLawParam::coefJrOut },
+    { "coefJzOut",      &DoublePowerLawParam::coefJzOut },
+    { "rotFrac",        &DoublePowerLawParam::rotFrac },
+    { "Jphi0",          &DoublePowerLawParam::Jphi0 },
+    { "Jcore",          &DoublePowerLawParam::Jcore } };
+
+/// same for QuasiIsothermalParam
+struct QuasiIsothermalField { const char* name; double QuasiIsothermalParam::* field; };
+static const QuasiIsothermalField quasiIsothermalFields[] = {
+    { "Sigma0",   &QuasiIsothermalParam::Sigma0 },
+    { "Rdisk",    &QuasiIsothermalParam::Rdisk },
+    { "Hdisk",    &QuasiIsothermalParam::Hdisk },
+    { "sigmar0",  &QuasiIsothermalParam::sigmar0 },
+    { "sigmaz0",  &QuasiIsothermalParam::sigmaz0 },
+    { "sigmamin", &QuasiIsothermalParam::sigmamin },
+    { "Rsigmar",  &QuasiIsothermalParam::Rsigmar },
+    { "Rsigmaz",  &QuasiIsothermalParam::Rsigmaz },
+    { "coefJr",   &QuasiIsothermalParam::coefJr },
+    { "coefJz",   &QuasiIsothermalParam::coefJz },
+    { "qJr",      &QuasiIsothermalParam::qJr },
+    { "qJz",      &QuasiIsothermalParam::qJz },
+    { "qJphi",    &QuasiIsothermalParam::qJphi },
+    { "Jmin",     &QuasiIsothermalParam::Jmin } };
+
+/// convert the list of parameter names into the list of pointers to the corresponding fields
+template<typename Param, typename Field, size_t N>
+std::vector<double Param::*> getFields(const Field (&table)[N],
+    const std::vector<std::string>& names, const char* errorPrefix)
+{
+    std::vector<double Param::*> fields;
+    for(size_t i=0; i<names.size(); i++) {
+        size_t f=0;
+        while(f<N && !utils::stringsEqual(names[i], table[f].name))
+            f++;
+        if(f==N)
+            throw std::invalid_argument(std::string(errorPrefix) +
+                ": unknown parameter name '" + names[i] + "'");
+        fields.push_back(table[f].field);
+    }
+    return fields;
+}
+
+/// helper class for integrating the derivatives of DF w.r.t. parameters over the action space,
+/// analogous to the one used in the computation of the total mass in df_base.cpp
+class DFParamDerivIntegrandNdim: public math::IFunctionNdim {
+    const BaseDFFamily& family;                ///< the family of DFs
+    const BaseDistributionFunction& df;        ///< the instance of DF
+    const ActionSpaceScalingTriangLog scaling; ///< scaling transformation
+public:
+    DFParamDerivIntegrandNdim(const BaseDFFamily& _family, const BaseDistributionFunction& _df) :
+        family(_family), df(_df), scaling() {}
+
+    virtual void eval(const double vars[], double values[]) const
+    {
+        evalmany(1, vars, values);
+    }
+
+    /// compute the derivatives of DF multiplied by the jacobian of scaling transformation
+    /// at many points in parallel, splitting the input points into blocks
+    virtual void evalmany(const size_t npoints, const double vars[], double values[]) const
+    {
+        const unsigned int K = family.numParams();
+        const int numBlocks = (npoints + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(numBlocks>1)
+#endif
+        for(int b=0; b<numBlocks; b++) {
+            try{
+                const size_t start = b * BLOCK_SIZE, size = std::min(BLOCK_SIZE, npoints - start);
+                actions::Actions* acts = static_cast<actions::Actions*>(
+                    alloca(size * sizeof(actions::Actions)));
+                double* jac  = static_cast<double*>(alloca(size * sizeof(double)));
+                double* vals = static_cast<double*>(alloca(size * sizeof(double)));
+                double* ders = static_cast<double*>(alloca(size * K * sizeof(double)));
+                // only the points with nonzero jacobian are passed to the DF
+                size_t count = 0;
+                for(size_t p=0; p<size; p++) {
+                    acts[count] = scaling.toActions(vars + (start+p) * 3, &jac[p]);
+                    if(jac[p]!=0)
+                        count++;
+                }
+                if(count>0)
+                    family.evalParamDeriv(df, count, acts, vals, ders);
+                for(size_t p=0, c=0; p<size; p++) {
+                    bool use = jac[p]!=0 && isFinite(vals[c]);
+                    for(unsigned int k=0; k<K; k++) {
+                        double val = use ? ders[c * K + k] * jac[p] * TWO_PI_CUBE : 0;
+                        values[(start+p) * K + k] = isFinite(val) ? val : 0;
+                    }
+                    if(jac[p]!=0)
+                        c++;
+                }
+            }
+            catch(std::exception& e) {
+                errorMsg = e.what();
+            }
+        }
+        if(!errorMsg.empty())
+            throw std::runtime_error(errorMsg);
+    }
+
+    virtual unsigned int numVars()   const { return 3; }
+    virtual unsigned int numValues() const { return family.numParams(); }
+};
+
+}  // internal ns
+
+//---- DF families ----//
+
+DoublePowerLawFamily::DoublePowerLawFamily(const DoublePowerLawParam& _baseParams,
+    const std::vector<std::string>& freeParams) :
+    baseParams(_baseParams),
+    fields(getFields<DoublePowerLawParam>(doublePowerLawFields, freeParams, "DoublePowerLawFamily"))
+{}
+
+PtrDistributionFunction DoublePowerLawFamily::createDF(const double params[]) const
+{
+    DoublePowerLawParam par(baseParams);
+    for(size_t k=0; k<fields.size(); k++)
+        par.*fields[k] = params[k];
+    return PtrDistributionFunction(new DoublePowerLaw(par));
+}
+
+void DoublePowerLawFamily::evalParamDeriv(const BaseDistributionFunction& df, const size_t npoints,
+    const actions::Actions J[], double values[], double derivs[]) const
+{
+    const DoublePowerLaw* dpl = dynamic_cast<const DoublePowerLaw*>(&df);
+    if(!dpl)
+        throw std::invalid_argument("DoublePowerLawFamily: incompatible type of DF");
+    std::vector<DoublePowerLawParam> der(npoints);
+    if(npoints>0)
+        dpl->evalParamDeriv(npoints, J, values, &der[0]);
+    const size_t K = fields.size();
+    for(size_t p=0; p<npoints; p++)
+        for(size_t k=0; k<K; k++)
+            derivs[p * K + k] = der[p].*fields[k];
+}
+
+QuasiIsothermalFamily::QuasiIsothermalFamily(const QuasiIsothermalParam& _baseParams,
+    const potential::Interpolator& _freq, const std::vector<std::string>& freeParams) :
+    baseParams(_baseParams), freq(_freq),
+    fields(getFields<QuasiIsothermalParam>(quasiIsothermalFields, freeParams, "QuasiIsothermalFamily"))
+{}
+
+PtrDistributionFunction QuasiIsothermalFamily::createDF(const double params[]) const
+{
+    QuasiIsothermalParam par(baseParams);
+    for(size_t k=0; k<fields.size(); k++)
+        par.*fields[k] = params[k];
+    return PtrDistributionFunction(new QuasiIsothermal(par, freq));
+}
+
+void QuasiIsothermalFamily::evalParamDeriv(const BaseDistributionFunction& df, const size_t npoints,
+    const actions::Actions J[], double values[], double derivs[]) const
+{
+    const QuasiIsothermal* qi = dynamic_cast<const QuasiIsothermal*>(&df);
+    if(!qi)
+        throw std::invalid_argument("QuasiIsothermalFamily: incompatible type of DF");
+    std::vector<QuasiIsothermalParam> der(npoints);
+    if(npoints>0)
+        qi->evalParamDeriv(npoints, J, values, &der[0]);
+    const size_t K = fields.size();
+    for(size_t p=0; p<npoints; p++)
+        for(size_t k=0; k<K; k++)
+            derivs[p * K + k] = der[p].*fields[k];
+}
+
+//---- Likelihood ----//
+
+DFLikelihood::DFLikelihood(const PtrDFFamily& _family,
+    const std::vector<actions::Actions>& actions, const std::vector<double>& weights,
+    const double _reqRelError, const int _maxNumEval) :
+    family(_family), reqRelError(_reqRelError), maxNumEval(_maxNumEval)
+{
+    if(!family)
+        throw std::invalid_argument("DFLikelihood: DF family must be provided");
+    if(actions.empty())
+        throw std::invalid_argument("DFLikelihood: empty array of actions");
+    if(!weights.empty() && weights.size() != actions.size())
+        throw std::invalid_argument("DFLikelihood: sizes of arrays of actions and weights differ");
+    const size_t size = actions.size();
+    Jr.resize(size);
+    Jz.resize(size);
+    Jphi.resize(size);
+    for(size_t i=0; i<size; i++) {
+        Jr  [i] = actions[i].Jr;
+        Jz  [i] = actions[i].Jz;
+        Jphi[i] = actions[i].Jphi;
+    }
+    weight = weights;
+    sumWeight = 0;
+    for(size_t i=0; i<size; i++)
+        sumWeight += weight.empty() ? 1 : weight[i];
+}
+
+void DFLikelihood::eval(const size_t numSets, const double params[],
+    double logL[], double gradient[]) const
+{
+    const unsigned int K = family->numParams();
+    const size_t numPoints = size(), numBlocks = (numPoints + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    utils::CtrlBreakHandler cbrk;
+    std::string errorMsg;
+    bool stop = false;
+
+    // first stage: construct the DF for each parameter set, and compute its normalization
+    // (and if needed, the derivatives of log(normalization) w.r.t. parameters);
+    // an empty DF pointer means that the parameters are invalid
+    std::vector<PtrDistributionFunction> dfs(numSets);
+    std::vector<double> logNorm(numSets, NAN), dlogNorm(gradient ? numSets * K : 0, NAN);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(numSets>1)
+#endif
+    for(int s=0; s<(int)numSets; s++) {
+        if(stop) continue;
+        if(cbrk.triggered()) stop = true;
+        try{
+            PtrDistributionFunction df;
+            try{
+                df = family->createDF(params + s * K);
+            }
+            catch(std::invalid_argument&) {
+                continue;   // leave the DF pointer empty
+            }
+            double mass = df->totalMass(reqRelError, maxNumEval);
+            if(!(mass>0 && isFinite(mass)))
+                continue;
+            logNorm[s] = log(mass);
+            if(gradient && K>0) {
+                const double xlower[3] = {0, 0, 0}, xupper[3] = {1, 1, 1};
+                math::integrateNdim(DFParamDerivIntegrandNdim(*family, *df),
+                    xlower, xupper, reqRelError, maxNumEval, &dlogNorm[s * K]);
+                for(unsigned int k=0; k<K; k++)
+                    dlogNorm[s * K + k] /= mass;
+            }
+            dfs[s] = df;
+        }
+        catch(std::exception& e) {
+            errorMsg = e.what();
+            stop = true;
+        }
+    }
+
+    // second stage: sum up the contributions of all particles, split into blocks;
+    // the partial sums from each block are stored separately and added up in a fixed order,
+    // so that the result does not depend on the number of threads
+    const size_t numTasks = numSets * numBlocks, stride = K+1;
+    std::vector<double> partial(stop ? 0 : numTasks * stride, 0.);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(long t=0; t<(long)numTasks; t++) {
+        const size_t s = t / numBlocks, b = t % numBlocks;
+        if(stop || !dfs[s]) continue;
+        if(cbrk.triggered()) stop = true;
+        try{
+            const size_t start = b * BLOCK_SIZE, size = std::min(BLOCK_SIZE, numPoints - start);
+            actions::Actions* acts = static_cast<actions::Actions*>(
+                alloca(size * sizeof(actions::Actions)));
+            double* vals = static_cast<double*>(alloca(size * sizeof(double)));
+            double* ders = gradient ? static_cast<double*>(alloca(size * K * sizeof(double))) : NULL;
+            for(size_t p=0; p<size; p++)
+                acts[p] = actions::Actions(Jr[start+p], Jz[start+p], Jphi[start+p]);
+            if(gradient)
+                family->evalParamDeriv(*dfs[s], size, acts, vals, ders);
+            else
+                dfs[s]->evalmany(size, acts, /*separate*/false, vals);
+            double* sum = &partial[t * stride];
+            for(size_t p=0; p<size; p++) {
+                double w = weight.empty() ? 1 : weight[start+p];
+                sum[0] += w * log(vals[p]);
+                if(gradient)
+                    for(unsigned int k=0; k<K; k++)
+                        sum[k+1] += w * ders[p * K + k] / vals[p];
+            }
+        }
+        catch(std::exception& e) {
+            errorMsg = e.what();
+            stop = true;
+        }
+    }
+    if(cbrk.triggered())
+        throw std::runtime_error(cbrk.message());
+    if(!errorMsg.empty())
+        throw std::runtime_error("DFLikelihood: " + errorMsg);
+
+    // final stage: collect the results
+    for(size_t s=0; s<numSets; s++) {
+        if(!dfs[s]) {
+            logL[s] = -INFINITY;
+            if(gradient)
+                std::fill(gradient + s * K, gradient + (s+1) * K, 0.);
+            continue;
+        }
+        logL[s] = -sumWeight * logNorm[s];
+        if(gradient)
+            for(unsigned int k=0; k<K; k++)
+                gradient[s * K + k] = -sumWeight * dlogNorm[s * K + k];
+        for(size_t b=0; b<numBlocks; b++) {
+            const double* sum = &partial[(s * numBlocks + b) * stride];
+            logL[s] += sum[0];
+            if(gradient)
+                for(unsigned int k=0; k<K; k++)
+                    gradient[s * K + k] += sum[k+1];
+        }
+    }
+}
+
+void DFLikelihood::evalParticles(const double params[], double logf[], DerivByActions derivs[]) const
+{
+    PtrDistributionFunction df = family->createDF(params);
+    const double logNorm = log(df->totalMass(reqRelError, maxNumEval));
+    const size_t numPoints = size(), numBlocks = (numPoints + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int b=0; b<(int)numBlocks; b++) {
+        try{
+            const size_t start = b * BLOCK_SIZE, size = std::min(BLOCK_SIZE, numPoints - start);
+            actions::Actions* acts = static_cast<actions::Actions*>(
+                alloca(size * sizeof(actions::Actions)));
+            for(size_t p=0; p<size; p++)
+                acts[p] = actions::Actions(Jr[start+p], Jz[start+p], Jphi[start+p]);
+            df->evalmany(size, acts, /*separate*/false, logf + start, derivs ? derivs + start : NULL);
+            for(size_t p=start; p<start+size; p++) {
+                if(derivs) {
+                    derivs[p].dbyJr   /= logf[p];
+                    derivs[p].dbyJz   /= logf[p];
+                    derivs[p].dbyJphi /= logf[p];
+                }
+                logf[p] = log(logf[p]) - logNorm;
+            }
+        }
+        catch(std::exception& e) {
+            errorMsg = e.what();
+        }
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error("DFLikelihood: " + errorMsg);
+}
+
+}  // namespace df
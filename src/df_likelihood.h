@@ -0,0 +1,161 @@
+/** \file    df_likelihood.h
+    \brief   Likelihood of a parametric family of distribution functions for a catalogue of tracers
+    \author  Eugene Vasiliev
+    \date    2026
+
+    The typical task of fitting an action-based DF to a set of tracer particles consists of
+    computing the actions of all particles in a given potential (which is the most expensive step,
+    but needs to be done only once if the potential is fixed), and then repeatedly evaluating
+    the log-likelihood  \f$  \ln L = \sum_i w_i \ln [ f(J_i | \theta) / M(\theta) ]  \f$
+    for many different sets of DF parameters theta proposed by an optimization or MCMC algorithm.
+    The class DFLikelihood keeps the actions of all particles in a structure-of-arrays storage
+    and evaluates the log-likelihood (including the normalization M = total mass of the DF)
+    for several parameter sets at once, in parallel over both the parameter sets and the particles,
+    and optionally computes its gradient w.r.t. parameters.
+    The mapping between the array of free parameters and the DF is provided by a "family" object,
+    which also supplies the derivatives of the DF w.r.t. its parameters.
+*/
+#pragma once
+#include "df_halo.h"
+#include "df_disk.h"
+#include "smart.h"
+#include <string>
+
+namespace df{
+
+/** Base class for a parametric family of distribution functions:
+    converts an array of free parameters into an instance of DF,
+    and computes the derivatives of the DF w.r.t. these parameters */
+class BaseDFFamily{
+public:
+    virtual ~BaseDFFamily() {}
+
+    /// number of free parameters
+    virtual unsigned int numParams() const = 0;
+
+    /** create an instance of DF for the given values of free parameters.
+        \param[in]  params  is the array of parameters of length numParams();
+        \return  a shared pointer to the DF;
+        \throws  std::invalid_argument if the parameters are not valid.
+    */
+    virtual PtrDistributionFunction createDF(const double params[]) const = 0;
+
+    /** compute the values of DF and its derivatives w.r.t. free parameters at several points.
+        \param[in]  df  is the instance of DF previously created by `createDF`;
+        \param[in]  npoints  is the number of points;
+        \param[in]  J  is the array of actions of length npoints;
+        \param[out] values  will contain the values of DF at these points;
+        \param[out] derivs  will contain the derivatives of DF w.r.t. free parameters:
+        derivs[p * numParams() + k] is the derivative at p-th point w.r.t. k-th parameter.
+    */
+    virtual void evalParamDeriv(const BaseDistributionFunction& df, const size_t npoints,
+        const actions::Actions J[], double values[], double derivs[]) const = 0;
+};
+
+/// shared pointer to a DF family
+typedef shared_ptr<const BaseDFFamily> PtrDFFamily;
+
+/** Family of DoublePowerLaw DFs, in which a subset of parameters (identified by the names of
+    the fields in DoublePowerLawParam) is varied, and the remaining ones are kept fixed */
+class DoublePowerLawFamily: public BaseDFFamily{
+    const DoublePowerLawParam baseParams;           ///< values of all parameters
+    std::vector<double DoublePowerLawParam::*> fields;  ///< pointers to the free parameters
+public:
+    /** create the family.
+        \param[in]  baseParams  are the values of all parameters (those listed among the free
+        parameters will be replaced by the values provided to createDF);
+        \param[in]  freeParams  are the names of free parameters (e.g., "slopeIn", "J0");
+        \throws std::invalid_argument if a name is not recognized.
+    */
+    DoublePowerLawFamily(const DoublePowerLawParam& baseParams,
+        const std::vector<std::string>& freeParams);
+    virtual unsigned int numParams() const { return fields.size(); }
+    virtual PtrDistributionFunction createDF(const double params[]) const;
+    virtual void evalParamDeriv(const BaseDistributionFunction& df, const size_t npoints,
+        const actions::Actions J[], double values[], double derivs[]) const;
+};
+
+/** Family of QuasiIsothermal DFs with a subset of free parameters and a fixed potential
+    (the latter is represented by an Interpolator object shared between all DF instances) */
+class QuasiIsothermalFamily: public BaseDFFamily{
+    const QuasiIsothermalParam baseParams;          ///< values of all parameters
+    const potential::Interpolator freq;             ///< epicyclic frequencies
+    std::vector<double QuasiIsothermalParam::*> fields; ///< pointers to the free parameters
+public:
+    /** create the family.
+        \param[in]  baseParams  are the values of all parameters;
+        \param[in]  freq  is the interpolator for epicyclic frequencies;
+        \param[in]  freeParams  are the names of free parameters (e.g., "Rdisk", "sigmar0");
+        \throws std::invalid_argument if a name is not recognized.
+    */
+    QuasiIsothermalFamily(const QuasiIsothermalParam& baseParams,
+        const potential::Interpolator& freq, const std::vector<std::string>& freeParams);
+    virtual unsigned int numParams() const { return fields.size(); }
+    virtual PtrDistributionFunction createDF(const double params[]) const;
+    virtual void evalParamDeriv(const BaseDistributionFunction& df, const size_t npoints,
+        const actions::Actions J[], double values[], double derivs[]) const;
+};
+
+
+/** Log-likelihood of a catalogue of tracer particles with fixed actions
+    for a parametric family of distribution functions */
+class DFLikelihood{
+public:
+    /** create the likelihood object.
+        \param[in]  family  is the parametric family of DFs;
+        \param[in]  actions is the array of actions of all particles (copied internally);
+        \param[in]  weights (optional) is the array of particle weights of the same length,
+        if empty then all particles have unit weight;
+        \param[in]  reqRelError  is the relative accuracy of computing the DF normalization;
+        \param[in]  maxNumEval  is the maximum number of DF evaluations in this computation;
+        \throws std::invalid_argument if the array sizes do not match or the array is empty.
+    */
+    DFLikelihood(const PtrDFFamily& family,
+        const std::vector<actions::Actions>& actions,
+        const std::vector<double>& weights = std::vector<double>(),
+        const double reqRelError=1e-6, const int maxNumEval=1e6);
+
+    /// number of free parameters of the DF family
+    unsigned int numParams() const { return family->numParams(); }
+
+    /// number of particles
+    size_t size() const { return Jr.size(); }
+
+    /** compute the log-likelihood for several sets of parameters in a single call,
+        parallelized over both parameter sets and particles.
+        \param[in]  numSets  is the number of parameter sets;
+        \param[in]  params  is the array of length numSets * numParams(), containing the parameter
+        sets one after another;
+        \param[out] logL  will contain numSets values of log-likelihood (normalized by the total
+        mass of the DF); if the parameters are invalid (the DF could not be constructed),
+        the corresponding value is -INFINITY;
+        \param[out] gradient (optional)  if not NULL, will contain numSets * numParams() values
+        of derivatives of logL w.r.t. parameters; this requires an additional multidimensional
+        integration of the derivatives of DF to obtain the derivatives of the normalization.
+    */
+    void eval(const size_t numSets, const double params[],
+        /*output*/ double logL[], double gradient[]=NULL) const;
+
+    /** compute log(f) for each particle and optionally its derivatives w.r.t. actions,
+        for a single set of parameters (e.g., to propagate the gradient to potential parameters
+        through the derivatives of actions).
+        \param[in]  params  is the array of parameters;
+        \param[out] logf  is the array of length size(), which will contain the logarithm of
+        the normalized DF  f(J_i) / M  for each particle;
+        \param[out] derivs (optional)  if not NULL, will contain the derivatives of log(f)
+        w.r.t. actions for each particle.
+        \throws std::invalid_argument if the parameters are invalid.
+    */
+    void evalParticles(const double params[],
+        /*output*/ double logf[], DerivByActions derivs[]=NULL) const;
+
+private:
+    const PtrDFFamily family;        ///< the parametric family of DFs
+    std::vector<double> Jr, Jz, Jphi;  ///< actions of particles stored in separate arrays
+    std::vector<double> weight;      ///< particle weights (empty if all are equal to unity)
+    double sumWeight;                ///< sum of all weights
+    const double reqRelError;        ///< accuracy of normalization
+    const int maxNumEval;            ///< max number of DF evaluations in normalization
+};
+
+}  // namespace df
@@ -580,12 +580,186 @@ math::LogLogSpline fitSphericalIsotropicDF(
 
 //------ QuasiSphericalCOM DF class for Cuddeford-Osipkov-Merritt models -------//
 
+namespace{
+
+/// number of nodes in the grid in q = L/(Jr+L) for the interpolation table of QuasiSphericalCOM
+static const int TABLE_SIZE_Q = 32;
+
+/// accuracy parameter for the radial grid that determines the nodes in p = ln(Jr+L)
+static const double TABLE_ACCURACY_GRID = 1e-4;
+
+/// maximum number of refinements of the table (each one doubles the number of nodes in each dimension)
+static const int TABLE_MAX_REFINE = 3;
+
+/// the interpolation error is checked only at a few points in each cell, and may be larger
+/// elsewhere in the cell, so it is compared with the requested accuracy times this safety factor
+static const double TABLE_CHECK_FACTOR = 0.5;
+
+}  // internal namespace
+
 QuasiSphericalCOM::QuasiSphericalCOM(
-    const math::IFunction& density, const math::IFunction& potential, double _beta0, double _r_a)
+    const math::IFunction& density, const math::IFunction& potential,
+    double _beta0, double _r_a, double accuracy)
 :
     QuasiSpherical(potential), invPhi0(1./potential(0)), beta0(_beta0), r_a(_r_a),
     df(createSphericalDF(density, potential, beta0, r_a))
-{}
+{
+    if(accuracy > 0)
+        createTable(potential, accuracy);
+}
+
+double QuasiSphericalCOM::logDFscaled(const actions::Actions& J) const
+{
+    double L = J.Jz + fabs(J.Jphi), Q = af.E(J) + 0.5 * pow_2(L/r_a), P = invPhi0 - 1./Q;
+    if(!(Q<0 && P>=0))
+        return NAN;
+    return log(df(P));
+}
+
+void QuasiSphericalCOM::createTable(const math::IFunction& potential, double accuracy)
+{
+    // the initial grid in p = ln(Jr+L) is given by the angular momenta of circular orbits
+    // at the nodes of a radial grid suitable for interpolating the potential
+    std::vector<double> gridR = potential::createInterpolationGrid(
+        potential::FunctionToPotentialWrapper(potential), TABLE_ACCURACY_GRID);
+    std::vector<double> tmpGridP(gridR.size()), tmpGridQ(TABLE_SIZE_Q);
+    for(size_t iP=0; iP<gridR.size(); iP++) {
+        double dPhi;
+        potential.evalDeriv(gridR[iP], NULL, &dPhi);
+        tmpGridP[iP] = log(gridR[iP] * sqrt(gridR[iP] * dPhi));
+        if(!isFinite(tmpGridP[iP]) || (iP>0 && tmpGridP[iP] <= tmpGridP[iP-1]))
+            throw std::runtime_error("QuasiSphericalCOM: cannot construct the interpolation table");
+    }
+    // the initial grid in q = L/(Jr+L) is denser towards both ends of the interval [0:1]
+    math::ScalingQui scaling(0, 1);
+    for(int iQ=0; iQ<TABLE_SIZE_Q; iQ++)
+        tmpGridQ[iQ] = math::unscale(scaling, iQ / (TABLE_SIZE_Q-1.));
+
+    for(int iter=0; ; iter++) {
+        const int sizeP = tmpGridP.size(), sizeQ = tmpGridQ.size();
+        // compute ln(f * L^{2 beta0}) at the nodes of the table
+        math::Matrix<double> values(sizeP, sizeQ);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for(int iP=0; iP<sizeP; iP++) {
+            double Jtot = exp(tmpGridP[iP]);
+            for(int iQ=0; iQ<sizeQ; iQ++)
+                values(iP, iQ) = logDFscaled(actions::Actions(
+                    Jtot * (1-tmpGridQ[iQ]), Jtot * tmpGridQ[iQ], 0));
+        }
+
+        // replace the values at invalid nodes (where the DF is not positive) with the nearest
+        // valid value in the same row, or copy the nearest valid row (the cells adjacent to
+        // these nodes will use the exact evaluation)
+        std::vector<bool> validNode(sizeP * sizeQ), validRow(sizeP, false);
+        for(int iP=0; iP<sizeP; iP++) {
+            for(int iQ=0; iQ<sizeQ; iQ++) {
+                validNode[iP * sizeQ + iQ] = isFinite(values(iP, iQ));
+                validRow[iP] = validRow[iP] || validNode[iP * sizeQ + iQ];
+            }
+            if(!validRow[iP])
+                continue;
+            for(int iQ=0; iQ<sizeQ; iQ++) {
+                for(int d=1; !validNode[iP * sizeQ + iQ]; d++) {
+                    if(iQ-d >= 0 && validNode[iP * sizeQ + iQ-d]) {
+                        values(iP, iQ) = values(iP, iQ-d);
+                        break;
+                    }
+                    if(iQ+d < sizeQ && validNode[iP * sizeQ + iQ+d]) {
+                        values(iP, iQ) = values(iP, iQ+d);
+                        break;
+                    }
+                }
+            }
+        }
+        int lastValidRow = std::find(validRow.begin(), validRow.end(), true) - validRow.begin();
+        if(lastValidRow == sizeP)
+            return;   // the DF is not positive anywhere on the grid: the table cannot be used
+        for(int iP=0; iP<sizeP; iP++) {
+            if(validRow[iP])
+                lastValidRow = iP;
+            else
+                for(int iQ=0; iQ<sizeQ; iQ++)
+                    values(iP, iQ) = values(lastValidRow, iQ);
+        }
+        table = math::CubicSpline2d(tmpGridP, tmpGridQ, values);
+
+        // check the accuracy of interpolation in the middle of each cell and of its lower and
+        // left edges; cells with invalid nodes or insufficient accuracy use the exact evaluation
+        exactCell.assign((sizeP-1) * (sizeQ-1), false);
+        int numInaccurate = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:numInaccurate)
+#endif
+        for(int iP=0; iP<sizeP-1; iP++) {
+            for(int iQ=0; iQ<sizeQ-1; iQ++) {
+                if(!validNode[ iP    * sizeQ + iQ] || !validNode[ iP    * sizeQ + iQ+1] ||
+                   !validNode[(iP+1) * sizeQ + iQ] || !validNode[(iP+1) * sizeQ + iQ+1]) {
+                    exactCell[iP * (sizeQ-1) + iQ] = true;
+                    continue;
+                }
+                for(int k=0; k<3; k++) {
+                    double
+                    p = k==1 ? tmpGridP[iP] : 0.5 * (tmpGridP[iP] + tmpGridP[iP+1]),
+                    q = k==2 ? tmpGridQ[iQ] : 0.5 * (tmpGridQ[iQ] + tmpGridQ[iQ+1]),
+                    exact = logDFscaled(actions::Actions(exp(p) * (1-q), exp(p) * q, 0));
+                    if(!(fabs(table.value(p, q) - exact) <= accuracy * TABLE_CHECK_FACTOR)) {  // or NAN
+                        exactCell[iP * (sizeQ-1) + iQ] = true;
+                        numInaccurate++;
+                        break;
+                    }
+                }
+            }
+        }
+        if(numInaccurate == 0 || iter == TABLE_MAX_REFINE) {
+            gridP = tmpGridP;
+            gridQ = tmpGridQ;
+            return;
+        }
+        // otherwise refine the grid by inserting midpoints in both dimensions
+        std::vector<double> newGridP(2*sizeP-1), newGridQ(2*sizeQ-1);
+        for(int iP=0; iP<sizeP; iP++) {
+            newGridP[2*iP] = tmpGridP[iP];
+            if(iP<sizeP-1)
+                newGridP[2*iP+1] = 0.5 * (tmpGridP[iP] + tmpGridP[iP+1]);
+        }
+        for(int iQ=0; iQ<sizeQ; iQ++) {
+            newGridQ[2*iQ] = tmpGridQ[iQ];
+            if(iQ<sizeQ-1)
+                newGridQ[2*iQ+1] = 0.5 * (tmpGridQ[iQ] + tmpGridQ[iQ+1]);
+        }
+        tmpGridP.swap(newGridP);
+        tmpGridQ.swap(newGridQ);
+    }
+}
+
+void QuasiSphericalCOM::evalDeriv(const actions::Actions &J, double *value,
+    DerivByActions *deriv) const
+{
+    double L = J.Jz + fabs(J.Jphi), Jtot = J.Jr + L, p = log(Jtot), q = L / Jtot;
+    const ptrdiff_t sizeP = gridP.size(), sizeQ = gridQ.size();
+    ptrdiff_t iP = -1, iQ = -1;
+    if(sizeP > 0 && J.Jr >= 0 && J.Jz >= 0 && Jtot > 0) {
+        iP = math::binSearch(p, &gridP[0], sizeP);
+        iQ = math::binSearch(q, &gridQ[0], sizeQ);
+    }
+    if(iP < 0 || iP >= sizeP-1 || iQ < 0 || iQ >= sizeQ-1 || exactCell[iP * (sizeQ-1) + iQ]) {
+        // no table, or the point is outside the table, or in a cell with insufficient accuracy
+        QuasiSpherical::evalDeriv(J, value, deriv);
+        return;
+    }
+    double g, dgdp, dgdq;
+    table.evalDeriv(p, q, &g, deriv ? &dgdp : NULL, deriv ? &dgdq : NULL);
+    *value = exp(g) * (beta0 ? math::pow(L, -2*beta0) : 1);
+    if(deriv) {
+        // chain rule: dp/dJr = dp/dL = 1/Jtot, dq/dJr = -q/Jtot, dq/dL = (1-q)/Jtot
+        double dfdL = *value * (dgdp + dgdq * (1-q)) / Jtot - (beta0 ? 2*beta0 * (*value) / L : 0);
+        deriv->dbyJr   = *value * (dgdp - dgdq * q) / Jtot;
+        deriv->dbyJz   = dfdL;
+        deriv->dbyJphi = J.Jphi >= 0 ? dfdL : -dfdL;
+    }
+}
 
 void QuasiSphericalCOM::evalDeriv(const ClassicalIntegrals& ints,
     double *value, DerivByClassicalIntegrals *deriv) const
@@ -190,6 +190,18 @@ public:
 class QuasiSphericalCOM: public QuasiSpherical {
     const double invPhi0, beta0, r_a;
     const math::LogLogSpline df;
+    /// optional interpolation table for ln(f * L^{2 beta0}) as a function of scaled actions
+    /// p = ln(Jr+L) and q = L/(Jr+L), defined on the grids gridP, gridQ
+    std::vector<double> gridP, gridQ;
+    math::CubicSpline2d table;
+    /// flags for cells of the table where the interpolation is not accurate enough
+    std::vector<char> exactCell;
+
+    /// compute ln(f * L^{2 beta0}) exactly for the given actions (NAN if the DF is not positive)
+    double logDFscaled(const actions::Actions& J) const;
+
+    /// construct the interpolation table with the given tolerance on ln(f)
+    void createTable(const math::IFunction& potential, double accuracy);
 public:
     /** construct the DF for the provided density/potential pair and anisotropy parameters:
         \param[in]  density    is the spherically-symmetric density profile specified by a function
@@ -201,11 +213,22 @@ public:
         class into a function of one variable;
         \param[in]  beta0      is the value of anisotropy coefficient at r-->0, should be -1/2<=beta0<=1
         \param[in]  r_a        is the Osipkov-Merritt anisotropy radius (may be infinite).
+        \param[in]  accuracy   (optional) if positive, construct an interpolation table for ln(f)
+        as a function of scaled actions, which replaces the conversion J => E and the evaluation
+        of f(E,L) in the action-based interface, and also provides the derivatives w.r.t. actions
+        at no extra cost. The table is compared with the exact DF in the middle of each cell and
+        of its edges, and the cells where the error in ln(f) exceeds half of this tolerance
+        (it may be larger elsewhere in the cell), e.g., close to the boundary of the region
+        where the DF is positive, as well as points outside the table, are evaluated exactly.
+        Default 0 means no table.
     */
     QuasiSphericalCOM(const math::IFunction& density, const math::IFunction& potential,
-        double beta0=0, double r_a=INFINITY);
+        double beta0=0, double r_a=INFINITY, double accuracy=0);
 
-    using QuasiSpherical::evalDeriv;  // bring both overloaded functions into scope
+    /** compute the DF and optionally its derivatives w.r.t. actions,
+        using the interpolation table if it was constructed */
+    virtual void evalDeriv(const actions::Actions &J, double *value,
+        DerivByActions *deriv=NULL) const;
 
     virtual void evalDeriv(const ClassicalIntegrals& ints,
         double *value, DerivByClassicalIntegrals *deriv=NULL) const;
@@ -32,6 +32,21 @@ static const unsigned int GLORDER_ANG  = 4;
 /// minimum order of spherical-harmonic or Fourier expansion for computing the density projection
 static const int LMIN_SPHHARM = 16;
 
+/// max number of points processed together in the batched addPoints() methods
+/// (determines the size of temporary arrays allocated on the stack)
+static const size_t ADDPOINTS_CHUNK = 64;
+
+/// locate the grid segment containing x, first checking the segment `hint` found for the previous
+/// point (consecutive points sampled from a trajectory usually fall into the same segment);
+/// the result is the same as returned by math::binSearch(x, grid, size)
+inline ptrdiff_t binSearchHint(const double x, const double grid[], const ptrdiff_t size,
+    const ptrdiff_t hint)
+{
+    if(hint >= 0 && hint < size-1 && x >= grid[hint] && x < grid[hint+1])
+        return hint;
+    return math::binSearch(x, grid, size);
+}
+
 /// Helper class for 3-dimensional integration of a density multiplied by basis functions of the grid
 class TargetDensityIntegrand: public math::IFunctionNdim {
     const potential::BaseDensity& dens;
@@ -116,6 +131,44 @@ template<> inline void getCornerIndicesCylindrical<1>(
     induu = indlu + 1;
 }
 
+// add the contributions of points accumulated in the radial shell `indr` for each angular harmonic
+// to the output array of TargetDensitySphHarm (the storage scheme is described in its addPoint method)
+inline void flushAccumulatedSphHarm(int indr, int gridrsize, int lmax, int mmax,
+    const double accUpper[], const double accLower[], double values[])
+{
+    for(int m=0, k=0, offset=indr+1; m<=mmax; m+=2) {
+        for(int l=m; l<=lmax; l+=2, k++, offset+=gridrsize) {
+            values[offset] += accUpper[k];
+            if(indr>0 || l==0)
+                values[offset-1] += accLower[k];
+        }
+    }
+}
+
+// add the contributions of points accumulated in the cell (indR,indz) of the meridional grid
+// for each azimuthal harmonic to the output array of TargetDensityCylindrical<N>;
+// acc contains four numbers per harmonic (only the first one is used for N=0)
+template<int N>
+void flushAccumulatedCylindrical(int indR, int indz, int gridRsize, int gridzsize, int mmax,
+    const double acc[], double values[])
+{
+    for(int m=0; m<=mmax; m+=2, acc+=4) {
+        int indll, indul, indlu, induu;
+        getCornerIndicesCylindrical<N>(m, indR, indz, gridRsize, gridzsize,
+            /*output*/ indll, indul, indlu, induu);
+        if(N==0) {
+            values[indll] += acc[0];
+        } else {
+            values[indul] += acc[0];
+            values[induu] += acc[1];
+            if(m==0 || indR>0) {
+                values[indll] += acc[2];
+                values[indlu] += acc[3];
+            }
+        }
+    }
+}
+
 } // internal ns
 
 
@@ -169,12 +222,44 @@ TargetDensityClassic<N>::TargetDensityClassic(
 template<int N>
 void TargetDensityClassic<N>::addPoint(const double point[3], const double mult, double values[]) const
 {
-    const int numShells = shellRadii.size();
     double X = fabs(point[0] / axisX), Y = fabs(point[1]) / axisY, Z = fabs(point[2]) / axisZ;
     double r = sqrt(X*X + Y*Y + Z*Z);
-    int indShell = math::binSearch(r, &shellRadii[0], numShells) + 1;
+    int indShell = math::binSearch(r, &shellRadii[0], shellRadii.size()) + 1;
+    addPointInShell(X, Y, Z, r, indShell, mult, values);
+}
+
+template<int N>
+void TargetDensityClassic<N>::addPoints(const size_t npoints, const double points[],
+    const double mults[], double values[]) const
+{
+    const int numShells = shellRadii.size();
+    double X[ADDPOINTS_CHUNK], Y[ADDPOINTS_CHUNK], Z[ADDPOINTS_CHUNK], r[ADDPOINTS_CHUNK];
+    int indShell = 0;
+    for(size_t start=0; start<npoints; start+=ADDPOINTS_CHUNK) {
+        const size_t count = std::min(npoints-start, ADDPOINTS_CHUNK);
+        const double* pts = points + start*6;
+        // 1st pass: scaled coordinates and spheroidal radii of all points (a vectorizable loop)
+        for(size_t p=0; p<count; p++) {
+            X[p] = fabs(pts[p*6  ]) / axisX;
+            Y[p] = fabs(pts[p*6+1]) / axisY;
+            Z[p] = fabs(pts[p*6+2]) / axisZ;
+            r[p] = sqrt(X[p]*X[p] + Y[p]*Y[p] + Z[p]*Z[p]);
+        }
+        // 2nd pass: locate the radial shell, starting the search from the previous one,
+        // and add the contribution to the relevant basis functions
+        for(size_t p=0; p<count; p++) {
+            indShell = binSearchHint(r[p], &shellRadii[0], numShells, indShell-1) + 1;
+            addPointInShell(X[p], Y[p], Z[p], r[p], indShell, mults[start+p], values);
+        }
+    }
+}
+
+template<int N>
+void TargetDensityClassic<N>::addPointInShell(double X, double Y, double Z, double r, int indShell,
+    const double mult, double values[]) const
+{
     assert(indShell>=0);
-    if(indShell >= numShells || mult == 0) {
+    if(indShell >= (int)shellRadii.size() || mult == 0) {
         return;  // outside the grid
     }
     int pane;
@@ -410,6 +495,61 @@ void TargetDensitySphHarm::addPoint(const double point[3], double mult, double v
     }
 }
 
+void TargetDensitySphHarm::addPoints(const size_t npoints, const double points[],
+    const double mults[], double values[]) const
+{
+    const int gridrsize = gridr.size();
+    double r[ADDPOINTS_CHUNK], tau[ADDPOINTS_CHUNK], phi[ADDPOINTS_CHUNK];
+    // temporary arrays for storing the values of Legendre and trigonometric functions,
+    // and the contributions of all points in the current radial shell to each angular harmonic,
+    // separately for the basis functions at the upper and lower boundaries of the shell
+    double* leg = static_cast<double*>(alloca((1 + lmax + mmax + 2 * angularCoefs) * sizeof(double)));
+    double* trig = leg + lmax+1, *accUpper = trig + mmax, *accLower = accUpper + angularCoefs;
+    int indr = 0;        // index of the radial shell, retained between points as a search hint
+    int indrAcc = -1;    // index of the shell for which the contributions are currently accumulated
+    for(size_t start=0; start<npoints; start+=ADDPOINTS_CHUNK) {
+        const size_t count = std::min(npoints-start, ADDPOINTS_CHUNK);
+        const double* pts = points + start*6;
+        // 1st pass: spherical coordinates of all points
+        for(size_t p=0; p<count; p++) {
+            double R = sqrt(pow_2(pts[p*6]) + pow_2(pts[p*6+1]));
+            r  [p] = sqrt(pow_2(R) + pow_2(pts[p*6+2]));
+            tau[p] = pts[p*6+2] / (r[p] + R);
+            phi[p] = atan2(pts[p*6+1], pts[p*6]);
+        }
+        // 2nd pass: accumulate the contributions of points while they stay in the same shell
+        for(size_t p=0; p<count; p++) {
+            const double mult = mults[start+p];
+            if(r[p]==0) {
+                values[0] += mult;
+                continue;
+            }
+            indr = binSearchHint(r[p], &gridr[0], gridrsize, indr-1) + 1;
+            assert(indr>=0);
+            if(indr >= gridrsize || mult == 0)
+                continue;  // outside the grid
+            double offr = indr==0 ? r[p] / gridr[0] : (r[p] - gridr[indr-1]) / (gridr[indr] - gridr[indr-1]);
+            if(indr != indrAcc) {
+                if(indrAcc >= 0)
+                    flushAccumulatedSphHarm(indrAcc, gridrsize, lmax, mmax, accUpper, accLower, values);
+                std::fill(accUpper, accUpper + 2 * angularCoefs, 0.);
+                indrAcc = indr;
+            }
+            math::trigMultiAngle(phi[p], mmax, false, trig);
+            for(int m=0, k=0; m<=mmax; m+=2) {
+                math::sphHarmArray(lmax, m, tau[p], leg);
+                for(int l=m; l<=lmax; l+=2, k++) {
+                    double val = mult * leg[l-m] * 2*M_SQRTPI * (m==0 ? 1. : M_SQRT2 * trig[m-1]);
+                    accUpper[k] += val * offr;
+                    accLower[k] += val * (1-offr);
+                }
+            }
+        }
+    }
+    if(indrAcc >= 0)
+        flushAccumulatedSphHarm(indrAcc, gridrsize, lmax, mmax, accUpper, accLower, values);
+}
+
 std::vector<double> TargetDensitySphHarm::computeDensityProjection(
     const potential::BaseDensity& density) const
 {
@@ -543,6 +683,67 @@ void TargetDensityCylindrical<N>::addPoint(const double point[3], double mult, d
     }
 }
 
+template<int N>
+void TargetDensityCylindrical<N>::addPoints(const size_t npoints, const double points[],
+    const double mults[], double values[]) const
+{
+    const int gridRsize = gridR.size(), gridzsize = gridz.size();
+    double R[ADDPOINTS_CHUNK], z[ADDPOINTS_CHUNK], phi[ADDPOINTS_CHUNK];
+    // temporary arrays for storing the values of trigonometric functions (cosines only),
+    // and the contributions of all points in the current cell to the basis functions at its corners
+    // (four numbers for each azimuthal harmonic)
+    double* trig = static_cast<double*>(alloca((mmax + 4 * (mmax/2+1)) * sizeof(double)));
+    double* acc  = trig + mmax;
+    int indR = 0, indz = 0;            // indices of the current cell, retained as search hints
+    int indRacc = -1, indzacc = -1;    // indices of the cell with currently accumulated contributions
+    for(size_t start=0; start<npoints; start+=ADDPOINTS_CHUNK) {
+        const size_t count = std::min(npoints-start, ADDPOINTS_CHUNK);
+        const double* pts = points + start*6;
+        // 1st pass: cylindrical coordinates of all points (reflected to z>=0)
+        for(size_t p=0; p<count; p++) {
+            R  [p] = sqrt(pow_2(pts[p*6]) + pow_2(pts[p*6+1]));
+            z  [p] = fabs(pts[p*6+2]);
+            phi[p] = atan2(pts[p*6+1], pts[p*6]);
+        }
+        // 2nd pass: accumulate the contributions of points while they stay in the same cell
+        for(size_t p=0; p<count; p++) {
+            const double mult = mults[start+p];
+            indR = binSearchHint(R[p], &gridR[0], gridRsize, indR-1) + 1;
+            indz = binSearchHint(z[p], &gridz[0], gridzsize, indz-1) + 1;
+            assert(indR>=0 && indz>=0);
+            if(indR >= gridRsize || indz >= gridzsize || mult == 0)
+                continue;  // outside the grid
+            double prevR = indR>0 ? gridR[indR-1] : 0.;
+            double prevz = indz>0 ? gridz[indz-1] : 0.;
+            double offR  = (R[p] - prevR) / ( gridR[indR] - prevR );
+            double offz  = (z[p] - prevz) / ( gridz[indz] - prevz );
+            if(indR != indRacc || indz != indzacc) {
+                if(indRacc >= 0)
+                    flushAccumulatedCylindrical<N>(indRacc, indzacc, gridRsize, gridzsize, mmax, acc, values);
+                std::fill(acc, acc + 4 * (mmax/2+1), 0.);
+                indRacc = indR;
+                indzacc = indz;
+            }
+            math::trigMultiAngle(phi[p], mmax, false, trig);
+            for(int m=0; m<=mmax; m+=2) {
+                double val = mult * (m==0 ? 1. : 2*trig[m-1]);
+                double* accm = acc + m/2 * 4;
+                if(N==0) {
+                    accm[0] += val;
+                } else if(N==1) {
+                    accm[0] += val *    offR  * (1-offz);
+                    accm[1] += val *    offR  *    offz;
+                    accm[2] += val * (1-offR) * (1-offz);
+                    accm[3] += val * (1-offR) *    offz;
+                } else
+                    assert(!"TargetDensityCylindrical: unimplemented N");
+            }
+        }
+    }
+    if(indRacc >= 0)
+        flushAccumulatedCylindrical<N>(indRacc, indzacc, gridRsize, gridzsize, mmax, acc, values);
+}
+
 template<int N>
 std::vector<double> TargetDensityCylindrical<N>::computeDensityProjection(
     const potential::BaseDensity& density) const
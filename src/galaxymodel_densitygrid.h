@@ -68,6 +68,11 @@ class TargetDensityClassic: public BaseTargetDensity {
     const unsigned int valuesPerShell;    ///< number of basis functions in each spheroidal shell
     const std::vector<double> shellRadii; ///< spheroidal radii of the shells
     const double axisX, axisY, axisZ;     ///< flattening of the grid in each cartesian direction
+
+    /// add the contribution of a point with the given scaled coordinates X,Y,Z (all non-negative),
+    /// spheroidal radius r, and the index of the radial shell containing it, to the output array
+    void addPointInShell(double X, double Y, double Z, double r, int indShell,
+        const double mult, double values[]) const;
 public:
     /** construct the grid with given parameters.
         \param[in]  stripsPerPane  is the number of strips in each direction in one pane
@@ -94,6 +99,10 @@ public:
     /// to the output array; at most 1 (for N=0) or 8 (for N=1) values are non-zero at any point.
     virtual void addPoint(const double point[3], const double mult, double values[]) const;
 
+    /// add several points at once, first computing the spheroidal radii and shell indices for all
+    virtual void addPoints(const size_t npoints, const double points[], const double mults[],
+        double values[]) const;
+
     /// an optimized routine for computing the projection of the density profile
     /// onto the basis functions (in the case N=0 these are the masses contained in each cell)
     virtual std::vector<double> computeDensityProjection(const potential::BaseDensity& density) const;
@@ -134,6 +143,11 @@ public:
     /// compute the values of all basis functions at the point specified by its cartesian coordinates
     virtual void addPoint(const double point[3], const double mult, double values[]) const;
 
+    /// add several points at once; contributions of consecutive points lying in the same
+    /// radial shell are summed up for each harmonic before being added to the output array
+    virtual void addPoints(const size_t npoints, const double points[], const double mults[],
+        double values[]) const;
+
     /// an optimized routine for computing the projection of the density profile
     /// onto the basis functions
     virtual std::vector<double> computeDensityProjection(const potential::BaseDensity& density) const;
@@ -178,6 +192,11 @@ public:
     /// compute the values of all basis functions at the point specified by its cartesian coordinates
     virtual void addPoint(const double point[3], const double mult, double values[]) const;
 
+    /// add several points at once; contributions of consecutive points lying in the same
+    /// cell of the meridional grid are summed up for each harmonic before being added to the output
+    virtual void addPoints(const size_t npoints, const double points[], const double mults[],
+        double values[]) const;
+
     /// compute the projections of the density profile onto the basis functions
     virtual std::vector<double> computeDensityProjection(const potential::BaseDensity& density) const;
 };
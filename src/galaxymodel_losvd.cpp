@@ -278,6 +278,18 @@ TargetLOSVD<N>::TargetLOSVD(const LOSVDParams& params) :
 }
 
 namespace{
+// append a symmetrized point (projected coordinates, line-of-sight velocity and weight)
+// to the array, incrementing the number of stored points
+inline void storePoint(const double X, const double Y, const double V, const double mult,
+    double* output, int& count)
+{
+    output[count*4  ] = X;
+    output[count*4+1] = Y;
+    output[count*4+2] = V;
+    output[count*4+3] = mult;
+    count++;
+}
+
 // common fragment for adding a point
 template<int N>
 inline void reallyAddPoint(const math::BsplineInterpolator1d<N>& bsplx,
@@ -308,11 +320,14 @@ inline void reallyAddPoint(const math::BsplineInterpolator1d<N>& bsplx,
 }
 }
 
-/*  Add a point sampled from the orbit during the current timestep to the datacube,
-    performing various symmetrization procedures depending on the properties of the potential.
+/*  Convert a point sampled from the orbit during the current timestep into one or more
+    points in the datacube, performing various symmetrization procedures depending on
+    the properties of the potential.
     \param[in]  point  is a 6d pos/vel point on the actual orbit;
     \param[in]  _mult  is its weight (interval of time associated with this orbital segment);
-    \param[in/out]  datacube  stores the flattened 3d datacube (X, Y, V_Z).
+    \param[out] output  receives up to 8 symmetrized points, each represented by four numbers:
+    the projected coordinates X, Y, the line-of-sight velocity V_Z, and the weight;
+    \return  the number of points stored in the output array.
     The symmetrization procedure involves several stages:
     0) if the potential is axisymmetric, the input point is rotated about the z axis by
     a random angle, and likewise if it is spherical, the point is rotated about a random axis
@@ -333,7 +348,7 @@ inline void reallyAddPoint(const math::BsplineInterpolator1d<N>& bsplx,
     x',y',z' are related to the original point x,y,z in a rather nontrivial way.
 */
 template<int N>
-void TargetLOSVD<N>::addPoint(const double point[6], double _mult, double* datacube) const
+int TargetLOSVD<N>::symmetrizePoint(const double point[6], double _mult, double output[]) const
 {
     double mult=_mult;  // for some strange reason, Intel compiler complains about modifying _mult
     double pt[6];
@@ -396,34 +411,75 @@ void TargetLOSVD<N>::addPoint(const double point[6], double _mult, double* datac
     // there is no trivial relation between the original point x,y,z and this new point x',y',z'
     if(isAxisymmetric(symmetry)) mult *= 0.5;
 
+    int count = 0;
     if(true) {
         if(true) {
             if(true)                      //  x,  y,  z
-                reallyAddPoint(bsplx, bsply, bsplv, X0+X1+X2, Y0+Y1+Y2, V01+V2, mult, datacube);
+                storePoint(X0+X1+X2, Y0+Y1+Y2, V01+V2, mult, output, count);
             if(isAxisymmetric(symmetry))  //  x', y', z'
-                reallyAddPoint(bsplx, bsply, bsplv, X0-X1+X2, Y0-Y1+Y2, V01-V2, mult, datacube);
+                storePoint(X0-X1+X2, Y0-Y1+Y2, V01-V2, mult, output, count);
         }
         if(flipZ) {
             if(true)                      //  x,  y, -z
-                reallyAddPoint(bsplx, bsply, bsplv, X0+X1-X2, Y0+Y1-Y2, V01-V2, mult, datacube);
+                storePoint(X0+X1-X2, Y0+Y1-Y2, V01-V2, mult, output, count);
             if(isAxisymmetric(symmetry))  //  x', y',-z'
-                reallyAddPoint(bsplx, bsply, bsplv, X0-X1-X2, Y0-Y1-Y2, V01+V2, mult, datacube);
+                storePoint(X0-X1-X2, Y0-Y1-Y2, V01+V2, mult, output, count);
         }
     }
     if(addMirrorPoint) {  // only if grids are not symmetric but we do need to point-symmetrize
         if(true) {
             if(true)                      // -x, -y, -z
-                reallyAddPoint(bsplx, bsply, bsplv,-X0-X1-X2,-Y0-Y1-Y2,-V01-V2, mult, datacube);
+                storePoint(-X0-X1-X2,-Y0-Y1-Y2,-V01-V2, mult, output, count);
             if(isAxisymmetric(symmetry))  // -x',-y',-z'
-                reallyAddPoint(bsplx, bsply, bsplv,-X0+X1-X2,-Y0+Y1-Y2,-V01+V2, mult, datacube);
+                storePoint(-X0+X1-X2,-Y0+Y1-Y2,-V01+V2, mult, output, count);
         }
         if(flipZ) {
             if(true)                      // -x, -y,  z
-                reallyAddPoint(bsplx, bsply, bsplv,-X0-X1+X2,-Y0-Y1+Y2,-V01+V2, mult, datacube);
+                storePoint(-X0-X1+X2,-Y0-Y1+Y2,-V01+V2, mult, output, count);
             if(isAxisymmetric(symmetry))  // -x',-y', z'
-                reallyAddPoint(bsplx, bsply, bsplv,-X0+X1+X2,-Y0+Y1+Y2,-V01-V2, mult, datacube);
+                storePoint(-X0+X1+X2,-Y0+Y1+Y2,-V01-V2, mult, output, count);
         }
     }
+    return count;
+}
+
+template<int N>
+void TargetLOSVD<N>::addPoint(const double point[6], double mult, double* datacube) const
+{
+    double pts[8*4];
+    for(int i=0, count=symmetrizePoint(point, mult, pts); i<count; i++)
+        reallyAddPoint(bsplx, bsply, bsplv, pts[i*4], pts[i*4+1], pts[i*4+2], pts[i*4+3], datacube);
+}
+
+template<int N>
+void TargetLOSVD<N>::addPoints(const size_t npoints, const double points[], const double mults[],
+    double* datacube) const
+{
+    // 1st pass: symmetrize and project all input points, storing only those that fall inside the grid
+    // (at most 8 output points per input point, processed in chunks to limit the temporary storage)
+    static const size_t CHUNK = 16;
+    double pts[CHUNK*8*4];
+    const double xmin = bsplx.xmin(), xmax = bsplx.xmax(), ymin = bsply.xmin(), ymax = bsply.xmax(),
+        vmin = bsplv.xmin(), vmax = bsplv.xmax();
+    for(size_t start=0; start<npoints; start+=CHUNK) {
+        int count = 0;
+        for(size_t p=start; p<npoints && p<start+CHUNK; p++) {
+            int first = count, last = count + symmetrizePoint(points + p*6, mults[p], pts + count*4);
+            for(int i=first; i<last; i++) {
+                const double* pt = pts + i*4;
+                if( pt[0] >= xmin && pt[0] <= xmax && pt[1] >= ymin && pt[1] <= ymax &&
+                    pt[2] >= vmin && pt[2] <= vmax && pt[3] != 0)
+                {   // compact the array, keeping only the points inside the datacube
+                    if(i != count)
+                        std::copy(pt, pt+4, pts + count*4);
+                    count++;
+                }
+            }
+        }
+        // 2nd pass: add the contributions of all retained points to the datacube
+        for(int i=0; i<count; i++)
+            reallyAddPoint(bsplx, bsply, bsplv, pts[i*4], pts[i*4+1], pts[i*4+2], pts[i*4+3], datacube);
+    }
 }
 
 template<int N>
@@ -575,6 +631,37 @@ void TargetKinemShell<N>::addPoint(const double point[6], double mult, double ou
     bspl.addPoint(&r, mult * vt2, output + bspl.numValues());
 }
 
+template<int N>
+void TargetKinemShell<N>::addPoints(const size_t npoints, const double points[], const double mults[],
+    double output[]) const
+{
+    static const size_t CHUNK = 64;
+    double r[CHUNK], vr2[CHUNK], vt2[CHUNK], weights[N+1];
+    const unsigned int nval = bspl.numValues();
+    for(size_t start=0; start<npoints; start+=CHUNK) {
+        const size_t count = std::min(npoints-start, CHUNK);
+        const double* pts = points + start*6;
+        // 1st pass: radius and squared radial and tangential velocities of all points (vectorizable)
+        for(size_t p=0; p<count; p++) {
+            double r2 = pow_2(pts[p*6]) + pow_2(pts[p*6+1]) + pow_2(pts[p*6+2]);
+            r  [p] = sqrt(r2);
+            vr2[p] = pow_2(pts[p*6] * pts[p*6+3] + pts[p*6+1] * pts[p*6+4] + pts[p*6+2] * pts[p*6+5]) / r2;
+            vt2[p] = pow_2(pts[p*6+3]) + pow_2(pts[p*6+4]) + pow_2(pts[p*6+5]) - vr2[p];
+        }
+        // 2nd pass: evaluate the B-splines once per point and add both components
+        for(size_t p=0; p<count; p++) {
+            if(r[p] < bspl.xmin() || r[p] > bspl.xmax())
+                continue;
+            unsigned int ind = bspl.nonzeroComponents(r[p], 0, weights);
+            double mvr2 = mults[start+p] * vr2[p], mvt2 = mults[start+p] * vt2[p];
+            for(int k=0; k<=N; k++) {
+                output[ind + k]        += weights[k] * mvr2;
+                output[ind + k + nval] += weights[k] * mvt2;
+            }
+        }
+    }
+}
+
 template<int N>
 void TargetKinemShell<N>::computeDFProjection(const GalaxyModel& model, StorageNumT* output) const
 {
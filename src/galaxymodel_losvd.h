@@ -64,6 +64,10 @@ class TargetLOSVD: public BaseTarget {
     math::Matrix<double> velocityConvolutionMatrix;  ///< velocity convolution matrix
     const coord::SymmetryType symmetry;   ///< symmetry of the potential and the orbital shape
     bool symmetricGrids;                  ///< whether the input grids are reflection-symmetric
+
+    /// convert a 6d point into up to 8 symmetrized points (X, Y, V_los, weight) in the output array,
+    /// returning their number
+    int symmetrizePoint(const double point[6], double mult, double output[]) const;
 public:
     /// construct the grid with given parameters.
     /// \throw std::invalid_argument if the parameters are incorrect.
@@ -98,6 +102,11 @@ public:
     /// the weights of corresponding basis functions multiplied by the input factor 'mult'.
     virtual void addPoint(const double point[6], const double mult, double* datacube) const;
 
+    /// add several points at once: first symmetrize and project all of them,
+    /// discarding those that fall outside the grids, then add the remaining ones to the datacube
+    virtual void addPoints(const size_t npoints, const double points[], const double mults[],
+        double* datacube) const;
+
     /// convert the intermediate data stored in the regular 3d data cube
     /// into the array of basis function amplitudes for the LOSVD in each aperture
     virtual void finalizeDatacube(math::Matrix<double> &datacube, StorageNumT* output) const;
@@ -126,6 +135,11 @@ public:
     virtual const char* name() const;
     virtual std::string coefName(unsigned int index) const;
     virtual void addPoint(const double point[6], double mult, double output[]) const;
+
+    /// add several points at once, first computing the radii and squared velocity components
+    /// for all of them, then locating each point on the radial grid only once for both profiles
+    virtual void addPoints(const size_t npoints, const double points[], const double mults[],
+        double output[]) const;
     virtual unsigned int numVars() const { return 6; }
     virtual unsigned int numValues() const { return bspl.numValues() * 2; }
 
@@ -4,10 +4,16 @@
 #include "potential_composite.h"
 #include "potential_multipole.h"
 #include "potential_cylspline.h"
+#include "potential_factory.h"
+#include "df_factory.h"
+#include "utils.h"
 #include <stdexcept>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 
 namespace galaxymodel{
 
@@ -35,10 +41,26 @@ ComponentWithSpheroidalDF::ComponentWithSpheroidalDF(
 void ComponentWithSpheroidalDF::update(
     const potential::BasePotential& totalPotential,
     const actions::BaseActionFinder& actionFinder)
+{
+    updateDensity(
+        DensityFromDF(GalaxyModel(totalPotential, actionFinder, *distrFunc), relError, maxNumEval));
+}
+
+void ComponentWithSpheroidalDF::updateDensity(const potential::BaseDensity& src)
 {
     density = potential::DensitySphericalHarmonic::create(
-        DensityFromDF(GalaxyModel(totalPotential, actionFinder, *distrFunc), relError, maxNumEval),
-        lmax, mmax, gridSizeR, rmin, rmax, /*fixOrder*/true);
+        src, lmax, mmax, gridSizeR, rmin, rmax, /*fixOrder*/true);
+}
+
+bool ComponentWithSpheroidalDF::isCompatible(const BaseComponentWithDF& other) const
+{
+    const ComponentWithSpheroidalDF* comp = dynamic_cast<const ComponentWithSpheroidalDF*>(&other);
+    // if the grid extent is not specified, it is determined from the density itself,
+    // and will be different between components
+    return comp && rmin>0 && rmax>0 &&
+        lmax == comp->lmax && mmax == comp->mmax && gridSizeR == comp->gridSizeR &&
+        rmin == comp->rmin && rmax == comp->rmax &&
+        relError == comp->relError && maxNumEval == comp->maxNumEval;
 }
 
 ComponentWithDisklikeDF::ComponentWithDisklikeDF(
@@ -57,12 +79,241 @@ ComponentWithDisklikeDF::ComponentWithDisklikeDF(
 void ComponentWithDisklikeDF::update(
     const potential::BasePotential& totalPotential,
     const actions::BaseActionFinder& actionFinder)
+{
+    updateDensity(
+        DensityFromDF(GalaxyModel(totalPotential, actionFinder, *distrFunc), relError, maxNumEval));
+}
+
+void ComponentWithDisklikeDF::updateDensity(const potential::BaseDensity& src)
 {
     density = potential::DensityAzimuthalHarmonic::create(
-        DensityFromDF(GalaxyModel(totalPotential, actionFinder, *distrFunc), relError, maxNumEval),
-        mmax, gridSizeR, Rmin, Rmax, gridSizez, zmin, zmax, /*fixOrder*/true);
+        src, mmax, gridSizeR, Rmin, Rmax, gridSizez, zmin, zmax, /*fixOrder*/true);
 }
 
+bool ComponentWithDisklikeDF::isCompatible(const BaseComponentWithDF& other) const
+{
+    const ComponentWithDisklikeDF* comp = dynamic_cast<const ComponentWithDisklikeDF*>(&other);
+    return comp && Rmin>0 && Rmax>0 && zmin>0 && zmax>0 &&
+        mmax == comp->mmax && gridSizeR == comp->gridSizeR && gridSizez == comp->gridSizez &&
+        Rmin == comp->Rmin && Rmax == comp->Rmax && zmin == comp->zmin && zmax == comp->zmax &&
+        relError == comp->relError && maxNumEval == comp->maxNumEval;
+}
+
+
+//------ Joint update of several components ------//
+
+namespace{
+
+/** Densities of several components computed jointly from their combined DF.
+    At each point, the integration over velocities is performed once for all components,
+    so the actions at each integration node are computed only once, and the values of all DFs
+    are collected in a single call to CompositeDF::evalmany.
+    The densities at the last requested array of points are cached, so that each component
+    retrieves its own values without repeating the computation; this relies on all components
+    requesting the density at the same set of points, which is ensured by their compatibility.
+    The cache may also be filled in advance: the list of points is assigned by `prepare`,
+    and the values at each point are computed by `computeAt`, which may be called concurrently
+    for different points (this is used to interleave the computation for several groups).
+    \note the cache is not thread-safe otherwise, and the components should be updated
+    sequentially (each update is internally parallelized over points).
+*/
+class JointDensityFromDF {
+public:
+    JointDensityFromDF(const GalaxyModel& _model, double _relError, unsigned int _maxNumEval) :
+        model(_model), numComp(model.distrFunc.numValues()),
+        relError(_relError), maxNumEval(_maxNumEval) {}
+
+    const GalaxyModel model;     ///< aggregate of potential, action finder and composite DF
+    const unsigned int numComp;  ///< number of components in the composite DF
+
+    /// compute (or retrieve from cache) the densities of all components at the given points;
+    /// return the pointer to the array of values with indexing scheme [i * numComp + c]
+    const double* evalmany(const size_t npoints, const coord::PosCyl pos[]) const
+    {
+        bool cached = npoints == points.size();
+        for(size_t i=0; cached && i<npoints; i++)
+            cached &= pos[i].R == points[i].R && pos[i].z == points[i].z && pos[i].phi == points[i].phi;
+        if(cached)
+            return &values[0];
+        points.assign(pos, pos+npoints);
+        values.assign(npoints * numComp, NAN);
+        std::string errorMsg;
+        utils::CtrlBreakHandler cbrk;  // catch Ctrl-Break keypress
+        bool stop = false;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for(int i=0; i<(int)npoints; i++) {
+            if(stop) continue;
+            if(cbrk.triggered()) stop = true;
+            try{
+                computeMoments(model, toPosCar(pos[i]), &values[i * numComp], NULL, NULL,
+                    /*separate*/ true, coord::Orientation(), relError, maxNumEval);
+            }
+            catch(std::exception& e) {
+                errorMsg = e.what();
+                stop = true;
+            }
+        }
+        if(cbrk.triggered() || !errorMsg.empty())
+            points.clear();  // invalidate the cache
+        if(cbrk.triggered())
+            throw std::runtime_error(cbrk.message());
+        if(!errorMsg.empty())
+            throw std::runtime_error("Error in JointDensityFromDF: "+errorMsg);
+        return &values[0];
+    }
+
+    /// assign the list of points for the subsequent computation of densities by `computeAt`
+    void prepare(const std::vector<coord::PosCyl>& pos) const
+    {
+        points = pos;
+        values.assign(pos.size() * numComp, NAN);
+    }
+
+    /// number of points in the list
+    size_t numPoints() const { return points.size(); }
+
+    /// compute the densities of all components at the given point from the list
+    void computeAt(size_t i) const
+    {
+        computeMoments(model, toPosCar(points[i]), &values[i * numComp], NULL, NULL,
+            /*separate*/ true, coord::Orientation(), relError, maxNumEval);
+    }
+
+private:
+    const double relError;
+    const unsigned int maxNumEval;
+    mutable std::vector<coord::PosCyl> points;  ///< points at which the densities were last computed
+    mutable std::vector<double> values;         ///< cached values of densities of all components
+};
+
+/** Density of a single component retrieved from the joint computation for arrays of points,
+    or computed individually for isolated points */
+class DensityOfComponent: public potential::BaseDensity {
+public:
+    DensityOfComponent(const JointDensityFromDF& _joint, unsigned int _index,
+        const df::BaseDistributionFunction& df, double relError, unsigned int maxNumEval) :
+        joint(_joint), index(_index),
+        single(GalaxyModel(joint.model.potential, joint.model.actFinder, df), relError, maxNumEval) {}
+
+    virtual coord::SymmetryType symmetry() const { return coord::ST_AXISYMMETRIC; }
+    virtual std::string name() const { return "DensityFromDF"; }
+    virtual double enclosedMass(const double) const { return NAN; }
+
+    virtual void evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double values[], /*input*/ double /*time*/=0) const
+    {
+        const double* jointValues = joint.evalmany(npoints, pos);
+        for(size_t i=0; i<npoints; i++)
+            values[i] = jointValues[i * joint.numComp + index];
+    }
+    virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double values[], /*input*/ double time=0) const
+    {
+        std::vector<coord::PosCyl> posCyl(npoints);
+        for(size_t i=0; i<npoints; i++)
+            posCyl[i] = toPosCyl(pos[i]);
+        evalmanyDensityCyl(npoints, &posCyl[0], values, time);
+    }
+    virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
+        /*output*/ double values[], /*input*/ double time=0) const
+    {
+        std::vector<coord::PosCyl> posCyl(npoints);
+        for(size_t i=0; i<npoints; i++)
+            posCyl[i] = toPosCyl(pos[i]);
+        evalmanyDensityCyl(npoints, &posCyl[0], values, time);
+    }
+
+private:
+    const JointDensityFromDF& joint;  ///< the object that computes densities of all components
+    const unsigned int index;         ///< index of this component in the joint DF
+    const DensityFromDF single;       ///< density of this component alone (for isolated points)
+
+    virtual double densityCar(const coord::PosCar &pos, double time) const {
+        return single.density(pos, time); }
+    virtual double densityCyl(const coord::PosCyl &pos, double time) const {
+        return single.density(pos, time); }
+    virtual double densitySph(const coord::PosSph &pos, double time) const {
+        return single.density(pos, time); }
+};
+
+/** A placeholder density that records the points at which it is evaluated.
+    The expansion of a component's density is first constructed from this placeholder,
+    to obtain the list of points at which the actual density will be needed;
+    the returned values are irrelevant */
+class DensityPointRecorder: public potential::BaseDensity {
+public:
+    mutable std::vector<coord::PosCyl> points;  ///< all points at which the density was requested
+
+    virtual coord::SymmetryType symmetry() const { return coord::ST_AXISYMMETRIC; }
+    virtual std::string name() const { return "DensityFromDF"; }
+    virtual double enclosedMass(const double) const { return NAN; }
+
+    virtual void evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double values[], /*input*/ double /*time*/=0) const
+    {
+        points.insert(points.end(), pos, pos+npoints);
+        std::fill(values, values+npoints, 1.);
+    }
+    virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double values[], /*input*/ double /*time*/=0) const
+    {
+        for(size_t i=0; i<npoints; i++)
+            points.push_back(toPosCyl(pos[i]));
+        std::fill(values, values+npoints, 1.);
+    }
+    virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
+        /*output*/ double values[], /*input*/ double /*time*/=0) const
+    {
+        for(size_t i=0; i<npoints; i++)
+            points.push_back(toPosCyl(pos[i]));
+        std::fill(values, values+npoints, 1.);
+    }
+
+private:
+    virtual double densityCar(const coord::PosCar&, double) const { return 1.; }
+    virtual double densityCyl(const coord::PosCyl&, double) const { return 1.; }
+    virtual double densitySph(const coord::PosSph&, double) const { return 1.; }
+};
+
+/// a group of mutually compatible components with DF, whose densities are computed jointly
+struct ComponentGroup {
+    std::vector<BaseComponentWithDF*> comps;     ///< components in the group
+    std::vector<df::PtrDistributionFunction> dfs;///< their DFs
+    std::string indices;                         ///< their indices in the model (for printing)
+    bool disklike;                               ///< whether the components are disklike
+    shared_ptr<const df::CompositeDF> compositeDF;     ///< combined DF of all components
+    shared_ptr<const JointDensityFromDF> joint;        ///< joint density computation
+
+    /// initialize the joint density computation and collect the list of points
+    /// at which the densities of components will be needed
+    void prepare(const potential::BasePotential& totalPotential,
+        const actions::BaseActionFinder& actionFinder)
+    {
+        compositeDF.reset(new df::CompositeDF(dfs));
+        joint.reset(new JointDensityFromDF(GalaxyModel(totalPotential, actionFinder, *compositeDF),
+            comps[0]->getRelError(), comps[0]->getMaxNumEval()));
+        // all components in the group request the density at the same points,
+        // so it is sufficient to perform a mock update of the first one and restore its density
+        DensityPointRecorder recorder;
+        PtrDensity prevDensity = comps[0]->getDensity();
+        comps[0]->updateDensity(recorder);
+        comps[0]->setDensity(prevDensity);
+        joint->prepare(recorder.points);
+    }
+
+    /// update the densities of all components from the values computed in advance
+    void update() const
+    {
+        for(size_t c=0; c<comps.size(); c++)
+            comps[c]->updateDensity(DensityOfComponent(*joint, c, *dfs[c],
+                comps[c]->getRelError(), comps[c]->getMaxNumEval()));
+    }
+};
+
+}  // internal namespace
+
 
 //------------ Driver routines for self-consistent modelling ------------//
 
@@ -77,6 +328,157 @@ static void updateActionFinder(SelfConsistentModel& model)
         std::cout << "done" << std::endl;
 }
 
+/// construct the potential expansion from the total density of components of the given kind
+/// (spheroidal - Multipole, disklike - CylSpline), or return an empty pointer if there are none
+static PtrPotential createPotentialExpansion(const SelfConsistentModel& model, bool disklike)
+{
+    // retrieve non-zero density objects from all components of the given kind
+    std::vector<PtrDensity> compDens;
+    for(unsigned int i=0; i<model.components.size(); i++) {
+        PtrDensity den = model.components[i]->getDensity();
+        if(den && model.components[i]->isDensityDisklike == disklike)
+            compDens.push_back(den);
+    }
+
+    // the total density to be used in the potential expansion;
+    // if more than one density component is present, create a temporary composite density object;
+    // if only one component is present, simply copy it;
+    // otherwise don't use the potential expansion at all
+    PtrDensity totalDensity;
+    if(compDens.size()>1)
+        totalDensity.reset(new potential::CompositeDensity(compDens));
+    else if(compDens.size()>0)
+        totalDensity = compDens[0];
+    else
+        return PtrPotential();
+
+    if(disklike)
+        return potential::CylSpline::create(*totalDensity,
+            model.mmaxAngularCyl,
+            model.sizeRadialCyl,   model.RminCyl, model.RmaxCyl,
+            model.sizeVerticalCyl, model.zminCyl, model.zmaxCyl);
+    else
+        return potential::Multipole::create(*totalDensity,
+            model.lmaxAngularSph, model.mmaxAngularSph,
+            model.sizeRadialSph, model.rminSph, model.rmaxSph);
+}
+
+/// combine the potentials provided by components with the potential expansions
+/// constructed from their densities, and assign the total potential of the model
+static void assembleTotalPotential(SelfConsistentModel& model,
+    const PtrPotential& multipole, const PtrPotential& cylspline)
+{
+    std::vector<PtrPotential> compPot;
+    for(unsigned int i=0; i<model.components.size(); i++) {
+        PtrPotential pot = model.components[i]->getPotential();
+        if(pot)
+            compPot.push_back(pot);
+    }
+    if(multipole)
+        compPot.push_back(multipole);
+    if(cylspline)
+        compPot.push_back(cylspline);
+
+    // now check if the total potential is elementary or composite
+    if(compPot.size()==0)
+        throw std::runtime_error("No potential is present in SelfConsistentModel");
+    if(compPot.size()==1)
+        model.totalPotential = compPot[0];
+    else
+        model.totalPotential.reset(new potential::Composite(compPot));
+}
+
+/// update the densities of groups of compatible components concurrently,
+/// and then the total potential
+static void updateGroupsConcurrently(SelfConsistentModel& model, std::vector<ComponentGroup>& groups)
+{
+    // list of tasks: each one is the computation of densities of one group at one point;
+    // spheroidal groups come first, so that the Multipole expansion can be constructed
+    // while the densities of disklike groups are still being computed
+    std::vector<std::pair<unsigned int, unsigned int> > tasks;
+    std::string indices;
+    for(int pass=0; pass<2; pass++) {
+        for(unsigned int g=0; g<groups.size(); g++) {
+            if(groups[g].disklike != (pass==1))
+                continue;
+            groups[g].prepare(*model.totalPotential, *model.actionFinder);
+            for(unsigned int p=0; p<groups[g].joint->numPoints(); p++)
+                tasks.push_back(std::make_pair(g, p));
+            indices += (indices.empty() ? "" : ",") + groups[g].indices;
+        }
+    }
+    int numTasks = tasks.size(), numTasksSph = 0;
+    while(numTasksSph < numTasks && !groups[tasks[numTasksSph].first].disklike)
+        numTasksSph++;
+    if(model.verbose)
+        std::cout << "Computing density for components " << indices << "..." << std::flush;
+
+    // if there are both spheroidal and disklike groups, the thread that completes the last
+    // spheroidal task updates the densities of spheroidal components and constructs
+    // the Multipole expansion from them, while other threads continue with disklike tasks;
+    // the spheroidal tasks are handed out first, so this happens well before the loop ends.
+    // This thread works inside the parallel region, hence the construction is not parallelized,
+    // but it only needs to be faster than the remaining disklike tasks.
+    // All spheroidal densities are final at this point (components not belonging to any group
+    // have been updated before, and disklike ones are not used in the Multipole).
+    const bool overlap = numTasksSph > 0 && numTasksSph < numTasks;
+    int remainingSph = numTasksSph;
+    PtrPotential multipole;
+    std::string errorMsg;
+    utils::CtrlBreakHandler cbrk;  // catch Ctrl-Break keypress
+    bool stop = false;
+    // the tasks are distributed dynamically among threads, so that the work is balanced
+    // between groups with different cost per point
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int t=0; t<numTasks; t++) {
+        if(stop) continue;
+        if(cbrk.triggered()) stop = true;
+        try{
+            groups[tasks[t].first].joint->computeAt(tasks[t].second);
+            if(overlap && t < numTasksSph) {
+                int remaining;
+#ifdef _OPENMP
+#pragma omp critical(SelfConsistentModelCounter)
+#endif
+                remaining = --remainingSph;
+                if(remaining == 0) {
+                    for(unsigned int g=0; g<groups.size(); g++)
+                        if(!groups[g].disklike)
+                            groups[g].update();
+                    multipole = createPotentialExpansion(model, false);
+                }
+            }
+        }
+        catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(SelfConsistentModelUpdate)
+#endif
+            errorMsg = e.what();
+            stop = true;
+        }
+    }
+    if(cbrk.triggered())
+        throw std::runtime_error(cbrk.message());
+    if(!errorMsg.empty())
+        throw std::runtime_error("Error in doIteration: "+errorMsg);
+
+    // construct the density expansions of the remaining components from the computed values,
+    // and then the remaining potential expansions (each of these steps is parallelized internally)
+    for(unsigned int g=0; g<groups.size(); g++)
+        if(groups[g].disklike || !overlap)
+            groups[g].update();
+    if(model.verbose)
+        std::cout << "done" << std::endl << "Updating potential..." << std::flush;
+    if(!overlap)
+        multipole = createPotentialExpansion(model, false);
+    assembleTotalPotential(model, multipole, createPotentialExpansion(model, true));
+    if(model.verbose)
+        std::cout << "done" << std::endl;
+    updateActionFinder(model);
+}
+
 void doIteration(SelfConsistentModel& model)
 {
     // need to initialize the potential and the action finder before the first iteration
@@ -86,86 +488,222 @@ void doIteration(SelfConsistentModel& model)
         if(!model.actionFinder)
             updateActionFinder(model);
 
+    // components with DF that compute their density on a fixed grid are collected into groups of
+    // compatible ones, which are updated concurrently after all other components
+    std::vector<ComponentGroup> groups;
+    std::vector<bool> grouped(model.components.size(), false);
     for(unsigned int index=0; index<model.components.size(); index++) {
-        // update the density of each component (this may be a no-op if the component is 'dead',
-        // i.e. provides only a fixed density or potential, but does not possess a DF) -- 
-        // the implementation is at the discretion of each component individually.
+        if(grouped[index])
+            continue;
+        BaseComponentWithDF* comp = dynamic_cast<BaseComponentWithDF*>(model.components[index].get());
+        if(comp && model.useJointUpdate && comp->isCompatible(*comp)) {
+            ComponentGroup group;
+            group.disklike = comp->isDensityDisklike;
+            group.indices  = utils::toString(index);
+            for(unsigned int other=index; other<model.components.size(); other++) {
+                BaseComponentWithDF* comp2 =
+                    dynamic_cast<BaseComponentWithDF*>(model.components[other].get());
+                if(!grouped[other] && comp2 && comp->isCompatible(*comp2)) {
+                    group.comps.push_back(comp2);
+                    group.dfs.push_back(comp2->getDF());
+                    grouped[other] = true;
+                    if(other != index)
+                        group.indices += "," + utils::toString(other);
+                }
+            }
+            groups.push_back(group);
+            continue;
+        }
         if(model.verbose)
-            std::cout << "Computing density for component "<<index<<"..."<<std::flush;
+            std::cout << "Computing density for component " << index << "..." << std::flush;
+        // update the density of each component (this may be a no-op if the component is
+        // 'dead', i.e. provides only a fixed density or potential, but does not possess a DF) --
+        // the implementation is at the discretion of each component individually.
         model.components[index]->update(*model.totalPotential, *model.actionFinder);
         if(model.verbose)
             std::cout << "done"<<std::endl;
     }
 
-    // now update the overall potential and reinit the action finder
-    updateTotalPotential(model);
+    // now update the remaining components and the overall potential, and reinit the action finder
+    if(groups.empty())
+        updateTotalPotential(model);
+    else
+        updateGroupsConcurrently(model, groups);
 }
 
 void updateTotalPotential(SelfConsistentModel& model)
 {
     if(model.verbose)
         std::cout << "Updating potential..."<<std::flush;
+    assembleTotalPotential(model,
+        createPotentialExpansion(model, false), createPotentialExpansion(model, true));
+    if(model.verbose)
+        std::cout << "done" << std::endl;
+    // finally, create the action finder for the new potential
+    updateActionFinder(model);
+}
 
-    // temporary array of density and potential objects from components
-    std::vector<PtrDensity> compDensSph;
-    std::vector<PtrDensity> compDensDisk;
-    std::vector<PtrPotential> compPot;
 
-    // first retrieve non-zero density and potential objects from all components
-    for(unsigned int i=0; i<model.components.size(); i++) {
-        PtrDensity den = model.components[i]->getDensity();
-        if(den) {
-            if(model.components[i]->isDensityDisklike)
-                compDensDisk.push_back(den);
-            else
-                compDensSph.push_back(den);
+//------------ Saving and restoring the model state ------------//
+
+namespace{
+
+/// signature at the beginning of the binary file with the model state
+const char MODEL_STATE_SIGNATURE[] = "AgamaSCM";
+
+/// version of the file format
+const long MODEL_STATE_VERSION = 2;
+
+/** The file with the model state consists of the signature, the version, the number of records,
+    and the records themselves, each one preceded by its length in bytes.
+    A record is either empty or contains a density or potential in the binary format of
+    `potential::serializeDensity`; there is one record per model component (empty for components
+    without DF or whose density has not been computed yet), followed by one record for
+    the potential expansions that are part of the total potential (empty if there are none).
+*/
+void writeRecord(std::ofstream& strm, const std::string& record)
+{
+    long length = record.size();
+    strm.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    strm.write(record.data(), record.size());
+}
+
+/// helper class for extracting the records from the file contents with bound checks
+class StateReader {
+    std::string data;   ///< the entire file
+    size_t offset;      ///< current position in the data
+public:
+    explicit StateReader(const std::string& fileName) : offset(0)
+    {
+        std::ifstream strm(fileName.c_str(), std::ios::binary);
+        if(!strm)
+            throw std::runtime_error("readModelState: cannot read file " + fileName);
+        data.assign(std::istreambuf_iterator<char>(strm), std::istreambuf_iterator<char>());
+        const size_t sigSize = sizeof(MODEL_STATE_SIGNATURE)-1;
+        if(data.compare(0, sigSize, MODEL_STATE_SIGNATURE) != 0)
+            throw std::runtime_error("readModelState: " + fileName + " is not a model state file");
+        offset = sigSize;
+        if(readLength() != MODEL_STATE_VERSION)
+            throw std::runtime_error("readModelState: unsupported file version");
+    }
+    /// read a non-negative integer not exceeding the length of the remaining data
+    long readLength()
+    {
+        long val = -1;
+        if(data.size() - offset >= sizeof(val)) {
+            std::copy(data.begin() + offset, data.begin() + offset + sizeof(val),
+                reinterpret_cast<char*>(&val));
+            offset += sizeof(val);
         }
-        PtrPotential pot = model.components[i]->getPotential();
-        if(pot)
-            compPot.push_back(pot);
+        if(val < 0 || static_cast<size_t>(val) > data.size() - offset)
+            throw std::runtime_error("readModelState: file is truncated or corrupted");
+        return val;
     }
+    /// read the next record and deserialize it (return an empty pointer for an empty record)
+    PtrDensity readRecord()
+    {
+        size_t length = readLength();
+        offset += length;
+        return length == 0 ? PtrDensity() :
+            potential::deserializeDensity(data.data() + offset - length, length);
+    }
+    bool finished() const { return offset == data.size(); }
+};
 
-    // the total density to be used in multipole expansion for spheroidal components
-    PtrDensity totalDensitySph;
-    // if more than one density component is present, create a temporary composite density object;
-    if(compDensSph.size()>1)
-        totalDensitySph.reset(new potential::CompositeDensity(compDensSph));
-    else if(compDensSph.size()>0)
-    // if only one component is present, simply copy it;
-        totalDensitySph = compDensSph[0];
-    // otherwise don't use multipole expansion at all
+}  // internal namespace
 
-    // construct potential expansion from the total density
-    // and add it as one of potential components (possibly the only one)
-    if(totalDensitySph != NULL)
-        compPot.push_back(potential::Multipole::create(*totalDensitySph,
-            model.lmaxAngularSph, model.mmaxAngularSph,
-            model.sizeRadialSph, model.rminSph, model.rmaxSph));
+void writeModelState(const SelfConsistentModel& model, const std::string& fileName)
+{
+    if(!model.totalPotential)
+        throw std::invalid_argument("writeModelState: model is not initialized");
+    // densities of components with DF
+    std::vector<std::string> records;
+    for(unsigned int i=0; i<model.components.size(); i++) {
+        PtrDensity dens = model.components[i]->getDensity();
+        if(dens && dynamic_cast<const BaseComponentWithDF*>(model.components[i].get()) &&
+            (dynamic_cast<const potential::DensitySphericalHarmonic*>(dens.get()) ||
+             dynamic_cast<const potential::DensityAzimuthalHarmonic*>(dens.get())))
+            records.push_back(potential::serializeDensity(*dens));
+        else
+            records.push_back("");  // static component or the initial guess for the density
+    }
+    // potential expansions that are part of the total potential, but not provided by components
+    std::vector<PtrPotential> expansions;
+    const potential::Composite* comp =
+        dynamic_cast<const potential::Composite*>(model.totalPotential.get());
+    for(unsigned int c=0, size = comp ? comp->size() : 1; c<size; c++) {
+        PtrPotential pot = comp ? comp->component(c) : model.totalPotential;
+        bool fromComponent = false;
+        for(unsigned int i=0; i<model.components.size(); i++)
+            fromComponent |= model.components[i]->getPotential() == pot;
+        if(!fromComponent)
+            expansions.push_back(pot);
+    }
+    records.push_back(expansions.empty() ? "" :
+        potential::serializePotential(potential::Composite(expansions)));
 
-    // now the same for the total density to be used in CylSpline for the flattened components
-    PtrDensity totalDensityDisk;
-    if(compDensDisk.size()>1)
-        totalDensityDisk.reset(new potential::CompositeDensity(compDensDisk));
-    else if(compDensDisk.size()>0)
-        totalDensityDisk = compDensDisk[0];
+    std::ofstream strm(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    if(!strm)
+        throw std::runtime_error("writeModelState: cannot write to file " + fileName);
+    strm.write(MODEL_STATE_SIGNATURE, sizeof(MODEL_STATE_SIGNATURE)-1);
+    strm.write(reinterpret_cast<const char*>(&MODEL_STATE_VERSION), sizeof(MODEL_STATE_VERSION));
+    long numRecords = records.size();
+    strm.write(reinterpret_cast<const char*>(&numRecords), sizeof(numRecords));
+    for(unsigned int r=0; r<records.size(); r++)
+        writeRecord(strm, records[r]);
+    strm.close();
+    if(!strm)
+        throw std::runtime_error("writeModelState: error writing the file");
+}
 
-    if(totalDensityDisk != NULL)
-        compPot.push_back(potential::CylSpline::create(*totalDensityDisk,
-            model.mmaxAngularCyl,
-            model.sizeRadialCyl,   model.RminCyl, model.RmaxCyl,
-            model.sizeVerticalCyl, model.zminCyl, model.zmaxCyl));
+void readModelState(SelfConsistentModel& model, const std::string& fileName)
+{
+    StateReader reader(fileName);
+    if(reader.readLength() != static_cast<long>(model.components.size()+1))
+        throw std::runtime_error("readModelState: number of components does not match");
+    // first read all data, and only then modify the model
+    std::vector<PtrDensity> densities(model.components.size());
+    for(unsigned int i=0; i<model.components.size(); i++) {
+        densities[i] = reader.readRecord();
+        if(!densities[i])
+            continue;
+        const BaseComponentWithDF* comp =
+            dynamic_cast<const BaseComponentWithDF*>(model.components[i].get());
+        bool disklike = dynamic_cast<const potential::DensityAzimuthalHarmonic*>(densities[i].get());
+        if(!comp || comp->isDensityDisklike != disklike || (!disklike &&
+            !dynamic_cast<const potential::DensitySphericalHarmonic*>(densities[i].get())))
+            throw std::runtime_error("readModelState: type of component " +
+                utils::toString(i) + " does not match");
+    }
+    // potentials of components followed by the stored expansions, in the same order
+    // as assembled by updateTotalPotential
+    std::vector<PtrPotential> compPot;
+    for(unsigned int i=0; i<model.components.size(); i++) {
+        PtrPotential pot = model.components[i]->getPotential();
+        if(pot)
+            compPot.push_back(pot);
+    }
+    PtrDensity stored = reader.readRecord();
+    if(stored) {
+        const potential::Composite* expansions =
+            dynamic_cast<const potential::Composite*>(stored.get());
+        if(!expansions)
+            throw std::runtime_error("readModelState: file is corrupted");
+        for(unsigned int c=0; c<expansions->size(); c++)
+            compPot.push_back(expansions->component(c));
+    }
+    if(!reader.finished())
+        throw std::runtime_error("readModelState: file is corrupted");
+    if(compPot.empty())
+        throw std::runtime_error("readModelState: no potential is present");
 
-    // now check if the total potential is elementary or composite
-    if(compPot.size()==0)
-        throw std::runtime_error("No potential is present in SelfConsistentModel");
+    for(unsigned int i=0; i<model.components.size(); i++)
+        if(densities[i])
+            dynamic_cast<BaseComponentWithDF&>(*model.components[i]).setDensity(densities[i]);
     if(compPot.size()==1)
         model.totalPotential = compPot[0];
     else
         model.totalPotential.reset(new potential::Composite(compPot));
-
-    if(model.verbose)
-        std::cout << "done" << std::endl;
-    // finally, create the action finder for the new potential
     updateActionFinder(model);
 }
 
@@ -51,7 +51,8 @@ and the action finder as arguments.
 (4) is performed by a non-member function `updateTotalPotential` that operates on
 an instance of SelfConsistentModel structure.
 Alternatively, steps 3 and 4 together (and optionally step 2 if it hasn't been done before)
-are performed by another function `doIteration`.
+are performed by another function `doIteration`, which may also update several components
+jointly to avoid recomputing the same actions for each of them.
 There are presently no methods for testing the convergence (step 5), so the end-user
 may simply repeat the loop a few times and hope that it converged.
 Steps 1 and 6 are left at the discretion of the end-user.
@@ -177,6 +178,25 @@ public:
     /* return the pointer to the DF */
     virtual df::PtrDistributionFunction getDF() const { return distrFunc; }
 
+    /** reinitialize the density profile from the given source density (normally the density
+        computed by integrating the DF of this component over velocities), using the grid
+        parameters of this component; this is the second half of the `update` method */
+    virtual void updateDensity(const potential::BaseDensity& src) = 0;
+
+    /** check whether this and another component compute their densities at the same set of
+        points with the same accuracy parameters; in this case they may be updated jointly,
+        evaluating the actions only once for all their DFs (see `doIteration`) */
+    virtual bool isCompatible(const BaseComponentWithDF& other) const = 0;
+
+    /// required relative error in density computation
+    double getRelError() const { return relError; }
+
+    /// maximum number of DF evaluations during density computation at a single point
+    unsigned int getMaxNumEval() const { return maxNumEval; }
+
+    /// replace the density profile (used when restoring the model from a saved state)
+    void setDensity(const potential::PtrDensity& dens) { density = dens; }
+
 protected:
     /// shared pointer to the action-based distribution function (remains unchanged)
     const df::PtrDistributionFunction distrFunc;
@@ -223,6 +243,12 @@ public:
     */
     virtual void update(const potential::BasePotential& pot, const actions::BaseActionFinder& af);
 
+    virtual void updateDensity(const potential::BaseDensity& src);
+
+    /** another component is compatible if it is also spheroidal and has the same
+        (explicitly specified) grid and accuracy parameters */
+    virtual bool isCompatible(const BaseComponentWithDF& other) const;
+
 private:
     /// definition of spatial grid for computing the density profile:
     const unsigned int lmax, mmax; ///< order of angular-harmonic expansion
@@ -260,6 +286,12 @@ public:
         \note OpenMP-parallelized loop over points in R,z when computing density by integration.
     */
     virtual void update(const potential::BasePotential& pot, const actions::BaseActionFinder& af);
+
+    virtual void updateDensity(const potential::BaseDensity& src);
+
+    /** another component is compatible if it is also disk-like and has the same
+        (explicitly specified) grid and accuracy parameters */
+    virtual bool isCompatible(const BaseComponentWithDF& other) const;
 private:
     const unsigned int mmax;       ///< order of Fourier expansion
     const unsigned int gridSizeR;  ///< size of the grid in cylindrical radius
@@ -303,6 +335,10 @@ public:
     /// whether to print out progress report messages
     bool verbose;
 
+    /// whether to update compatible components with DF jointly and concurrently
+    /// (see `doIteration`; off by default)
+    bool useJointUpdate;
+
     /** parameters of grid for computing the multipole expansion of the combined
         density profile of spheroidal components;
         in general, these parameters should encompass the range of analogous parameters 
@@ -329,6 +365,7 @@ public:
     SelfConsistentModel() :
         useActionInterpolation(true),
         verbose(true),
+        useJointUpdate(false),
         lmaxAngularSph(0), mmaxAngularSph(0), sizeRadialSph(25), rminSph(0), rmaxSph(0),
         mmaxAngularCyl(0), sizeRadialCyl(20), RminCyl(0), RmaxCyl(0),
         sizeVerticalCyl(20), zminCyl(0), zmaxCyl(0)
@@ -344,8 +381,52 @@ void updateTotalPotential(SelfConsistentModel& model);
 /** Main iteration step: recompute the densities of all components, and then call 
     `updateTotalPotential`; if no potential is present at the beginning, it is initialized
     by a call to the same `updateTotalPotential` before recomputing the densities.
-    \note OpenMP-parallelized loops in Component***::update().
+    If model.useJointUpdate is true, components with DF that are compatible with each other
+    (i.e., compute their densities on the same grid, see `BaseComponentWithDF::isCompatible`)
+    are updated together: their DFs are combined into a single CompositeDF, and the integration
+    over velocities is performed once for all of them, so that the actions at each integration
+    node are computed only once, and the densities of all components are obtained separately
+    from a single multi-valued integral. Moreover, all such groups are updated concurrently:
+    the points at which the densities of each group are needed are collected in advance,
+    and the computations at all points of all groups are distributed dynamically among threads,
+    so that groups with a smaller number of points or a cheaper DF do not leave threads idle.
+    The points of spheroidal groups are handed out first, and if there are also disklike groups,
+    the thread that completes the last spheroidal point constructs the Multipole expansion
+    while other threads continue with the disklike points; the remaining density and potential
+    expansions are constructed after all these computations are finished. The result agrees with the individual update of each component (the default)
+    to within the accuracy of density computation. Other components (static ones, or those
+    that determine their grid extent adaptively) are updated individually before that.
+    \note OpenMP-parallelized loops in Component***::update() or in the joint update.
 */
 void doIteration(SelfConsistentModel& model);
 
+/** Save the evolving state of the model into a binary file.
+    The state consists of the density profiles of all components with DF (which are expensive to
+    compute), and the Multipole and CylSpline potential expansions constructed from the densities
+    of all components, which form the total potential together with the potentials of components.
+    The DFs and static profiles of components, and the parameters of the model are not stored,
+    since they are provided by the user when setting up the model.
+    Each of them is stored in the binary format of `potential::serializeDensity`, so the file
+    uses the native byte order and is not portable between platforms with a different endianness.
+    \param[in]  model  is the model, which must have been initialized (have a total potential);
+    \param[in]  fileName  is the name of the output file.
+    \throws std::invalid_argument if the model is not initialized, or std::runtime_error if the
+    total potential contains expansions of unsupported types or the file cannot be written.
+*/
+void writeModelState(const SelfConsistentModel& model, const std::string& fileName);
+
+/** Restore the state of the model previously saved by `writeModelState`.
+    The model must contain the same number of components of the same kind as the one being saved
+    (their DFs may differ, e.g., when starting a variant run with a perturbed DF from a converged
+    potential); the densities of components with DF are replaced with the stored ones,
+    the total potential is assembled from the potentials of components and the stored expansions,
+    and the action finder is reinitialized for this potential (its interpolation tables are not
+    stored, as their construction takes a negligible time compared to the density computation).
+    The subsequent calls to `doIteration` then continue from the restored state.
+    \param[in,out]  model  is the model whose components will be updated;
+    \param[in]  fileName  is the name of the input file.
+    \throws std::runtime_error if the file cannot be read or does not match the model.
+*/
+void readModelState(SelfConsistentModel& model, const std::string& fileName);
+
 }  // namespace
@@ -78,6 +78,28 @@ public:
     */
     virtual void addPoint(const double point[], const double mult, double datacube[]) const = 0;
 
+    /** accumulate the contributions of several points in a single call.
+        The default implementation simply calls addPoint() for each input point in turn,
+        but derived classes may provide an optimized version that first computes the grid indices
+        and basis-function weights for all points in tight (vectorizable) loops, and then adds
+        the contributions of consecutive points falling into the same grid cell in one go,
+        reducing the number of scattered writes into the datacube.
+        This method is used by the orbit runtime function to process all points sampled
+        from the trajectory during one timestep of the ODE solver.
+        \param[in]  npoints  is the number of input points;
+        \param[in]  points  is the flattened array of 6d points (position and velocity in
+        cartesian coordinates), i.e. the p-th point occupies points[p*6 .. p*6+5],
+        regardless of the value of numVars() (targets that only need the position ignore velocity);
+        \param[in]  mults  is the array of weights of each point;
+        \param[in,out] datacube  is the same as in addPoint().
+    */
+    virtual void addPoints(const size_t npoints, const double points[], const double mults[],
+        double datacube[]) const
+    {
+        for(size_t p=0; p<npoints; p++)
+            addPoint(points + p*6, mults[p], datacube);
+    }
+
     /** compute target-specific data (projection of a DF); NOT YET IMPLEMENTED!
         \param[in] model  is the interface for computing the value(s) of a distribution function,
         possibly a multi-component DF
@@ -142,13 +164,15 @@ public:
     {
         time += tend-tbegin;
         double substep = (tend-tbegin) / NUM_SAMPLES_PER_STEP;  // duration of each sub-step
-        double *dataptr = datacube.data();
+        // positions and velocities in cartesian coordinates at all sub-steps
+        double points[NUM_SAMPLES_PER_STEP * 6], mults[NUM_SAMPLES_PER_STEP];
         for(int s=0; s<NUM_SAMPLES_PER_STEP; s++) {
             double tsubstep = tbegin + substep * (s+0.5);  // equally-spaced samples in time
-            double point[6];  // position and velocity in cartesian coordinates at the current sub-step
-            orbint.getSol(tsubstep).unpack_to(point);
-            target.addPoint(point, substep, dataptr);
+            orbint.getSol(tsubstep).unpack_to(points + s*6);
+            mults[s] = substep;
         }
+        // add all points from this timestep to the datacube in one call
+        target.addPoints(NUM_SAMPLES_PER_STEP, points, mults, datacube.data());
         return true;
     }
 };
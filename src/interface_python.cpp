@@ -56,6 +56,7 @@
 #include "potential_analytic.h"
 #include "potential_composite.h"
 #include "potential_factory.h"
+#include "potential_mge.h"
 #include "potential_multipole.h"
 #include "potential_utils.h"
 #include "orbit.h"
@@ -63,9 +64,6 @@
 #include "units.h"
 #include "utils.h"
 #include "utils_config.h"
-// text string embedded into the python module as the __version__ attribute
-#define AGAMA_VERSION "1.0 compiled on " __DATE__
-
 // older versions of numpy have different macro names
 // (will need to expand this list if other similar macros are used in the code)
 #ifndef NPY_ARRAY_IN_ARRAY
@@ -371,6 +369,103 @@ std::string toString(PyObject* obj)
     return str;
 }
 
+/// signature of a user-defined function compiled into machine code, which computes the values
+/// at npoints points with coordinates given by the array xyz of length npoints*3
+typedef void (*RawFunction)(size_t npoints, const double xyz[], /*output*/ double values[]);
+
+/// ctypes objects used to recognize compiled C functions and check their signature;
+/// the module is imported once on the first use (always with the GIL held),
+/// and the references are kept for the lifetime of the interpreter
+static PyObject *ctypesFuncPtrType = NULL, *ctypesVoidPtrType = NULL, *ctypesCast = NULL,
+    *ctypesSizeType = NULL, *ctypesSsizeType = NULL, *ctypesDoublePtrType = NULL;
+
+/// import the ctypes module and store the objects needed by getRawFunction;
+/// return false if the module is not available
+static bool initCtypes()
+{
+    static bool initialized = false, available = false;
+    if(initialized)
+        return available;
+    initialized = true;
+    PyObject* ctypes = PyImport_ImportModule("ctypes");
+    if(!ctypes) {
+        PyErr_Clear();
+        return false;
+    }
+    ctypesFuncPtrType = PyObject_GetAttrString(ctypes, "_CFuncPtr");
+    ctypesVoidPtrType = PyObject_GetAttrString(ctypes, "c_void_p");
+    ctypesCast        = PyObject_GetAttrString(ctypes, "cast");
+    ctypesSizeType    = PyObject_GetAttrString(ctypes, "c_size_t");
+    ctypesSsizeType   = PyObject_GetAttrString(ctypes, "c_ssize_t");
+    PyObject* doubleType = PyObject_GetAttrString(ctypes, "c_double");
+    ctypesDoublePtrType  = doubleType ?
+        PyObject_CallMethod(ctypes, const_cast<char*>("POINTER"), const_cast<char*>("O"), doubleType) : NULL;
+    Py_XDECREF(doubleType);
+    Py_DECREF(ctypes);
+    available = ctypesFuncPtrType && ctypesVoidPtrType && ctypesCast &&
+        ctypesSizeType && ctypesSsizeType && ctypesDoublePtrType;
+    PyErr_Clear();
+    return available;
+}
+
+/// check that a ctypes function pointer has the signature of RawFunction,
+/// i.e. restype is None and argtypes are (c_size_t or c_ssize_t, POINTER(c_double), POINTER(c_double))
+static bool checkRawSignature(PyObject* fnc)
+{
+    PyObject* restype  = PyObject_GetAttrString(fnc, "restype");
+    PyObject* argtypes = PyObject_GetAttrString(fnc, "argtypes");
+    bool result = restype == Py_None && argtypes && PySequence_Check(argtypes) &&
+        PySequence_Size(argtypes) == 3;
+    for(Py_ssize_t i=0; result && i<3; i++) {
+        PyObject* arg = PySequence_GetItem(argtypes, i);
+        result = i==0 ?
+            arg == ctypesSizeType || arg == ctypesSsizeType :
+            arg == ctypesDoublePtrType;
+        Py_XDECREF(arg);
+    }
+    Py_XDECREF(restype);
+    Py_XDECREF(argtypes);
+    PyErr_Clear();
+    return result;
+}
+
+/// check if a Python object represents a compiled C function (a numba.cfunc with the signature
+/// `void(intp, CPointer(float64), CPointer(float64))`, or a ctypes function pointer with the
+/// equivalent signature), and return its address, or NULL if this is not the case.
+/// Such functions are called directly from C++ without acquiring the GIL.
+/// \throw std::invalid_argument if the object is a compiled function with a different signature.
+RawFunction getRawFunction(PyObject* fnc)
+{
+    if(!initCtypes())
+        return NULL;
+    // numba cfunc provides a ctypes wrapper with the argument types derived from its signature
+    PyObject* cfnc = NULL;
+    if(PyObject_HasAttrString(fnc, "address") && PyObject_HasAttrString(fnc, "native_name"))
+        cfnc = PyObject_GetAttrString(fnc, "ctypes");
+    else if(PyObject_IsInstance(fnc, ctypesFuncPtrType) == 1) {
+        cfnc = fnc;
+        Py_INCREF(cfnc);
+    }
+    PyErr_Clear();
+    if(!cfnc)
+        return NULL;
+    if(!checkRawSignature(cfnc)) {
+        Py_DECREF(cfnc);
+        throw std::invalid_argument("Compiled function " + toString(fnc) +
+            " must have the signature void(size_t npoints, double* xyz, double* values)");
+    }
+    PyObject* voidPtr = PyObject_CallFunctionObjArgs(ctypesCast, cfnc, ctypesVoidPtrType, NULL);
+    PyObject* address = voidPtr ? PyObject_GetAttrString(voidPtr, "value") : NULL;
+    RawFunction result = NULL;
+    if(address && PyNumber_Check(address))
+        result = reinterpret_cast<RawFunction>(PyLong_AsVoidPtr(address));
+    Py_XDECREF(address);
+    Py_XDECREF(voidPtr);
+    Py_DECREF(cfnc);
+    PyErr_Clear();
+    return result;
+}
+
 /// return an integer representation of a Python object, or a default value in case of error
 int toInt(PyObject* obj, int defaultValue=-1)
 {
@@ -812,6 +907,36 @@ PyObject* getUnits(PyObject* /*self*/, PyObject* /*args*/)
     return result;
 }
 
+/// description of setCacheDir function
+static const char* docstringSetCacheDir =
+    "Set or retrieve the directory for caching potential expansions on disk.\n"
+    "When it is set, every Multipole, CylSpline or BasisSet potential constructed from an analytic "
+    "density or potential model (e.g., Potential(type='Multipole', density='Sersic', ...)) is "
+    "stored in this directory under a name derived from the hash of all its parameters, "
+    "the unit conversion settings and the library version (agama.__version__, which includes "
+    "the compilation date), and is loaded from there when the same potential is requested again "
+    "(possibly in a different script), instead of being recomputed. Upgrading or rebuilding "
+    "the library thus invalidates the cache; unreadable cache files are recomputed with a warning.\n"
+    "Arguments: the path to an existing directory, or an empty string or None to disable caching "
+    "(default, unless the environment variable AGAMA_CACHE_DIR is set). "
+    "Without arguments, the current setting is not changed.\n"
+    "Returns: the current cache directory (empty string if caching is disabled).\n";
+
+/// set or retrieve the cache directory
+PyObject* setCacheDir(PyObject* /*self*/, PyObject* args)
+{
+    PyObject* dir = NULL;
+    if(!PyArg_ParseTuple(args, "|O", &dir))
+        return NULL;
+    if(dir && dir != Py_None && !PyString_Check(dir)) {
+        PyErr_SetString(PyExc_TypeError, "setCacheDir: argument must be a string or None");
+        return NULL;
+    }
+    if(dir)
+        potential::setCacheDirectory(dir == Py_None ? "" : PyString_AsString(dir));
+    return Py_BuildValue("s", potential::getCacheDirectory().c_str());
+}
+
 /// helper function for converting position to internal units
 inline coord::PosCar convertPos(const double input[]) {
     return coord::PosCar(
@@ -1325,6 +1450,9 @@ PyObject* allocateOutput(npy_intp numPoints, double* buffer[3]=NULL, int C=0)
     "they are converted into equivalent Spheroid models).\n" \
     "  q=...   or  axisRatioZ=...   short to long axis (z/x).\n" \
     "  gamma=...  central cusp slope (applicable for Dehnen, Spheroid or Nuker).\n" \
+    "  exact=...  (bool, default False) whether to evaluate non-spherical Dehnen or Ferrers potentials " \
+    "by the original, slower method (adaptive integration or exact computation of coefficients) " \
+    "instead of a fixed-order quadrature rule or interpolation tables with relative error ~1e-7.\n" \
     "  beta=...   outer density slope (Spheroid or Nuker).\n" \
     "  alpha=...  strength of transition from the inner to the outer slopes (Spheroid or Nuker).\n" \
     "  sersicIndex=...   profile shape parameter 'n' (Sersic or Disk).\n" \
@@ -1336,6 +1464,8 @@ PyObject* allocateOutput(npy_intp numPoints, double* buffer[3]=NULL, int C=0)
     "  densityNorm=...   normalization of density profile (Spheroid).\n" \
     "  W0=...  dimensionless central potential in King models.\n" \
     "  trunc=...  truncation strength in King models.\n" \
+    "  table=...  parameters of all components of a Multi-Gaussian Expansion (MGE): " \
+    "a 2d array with four columns (mass, sigmaX, sigmaY, sigmaZ) or a file name.\n" \
     "  center=...  offset of the potential from origin, can be either " \
     "a triplet of numbers, or an array of time-dependent offsets " \
     "(t,x,y,z, and optionally vx,vy,vz) provided directly or as a file name.\n" \
@@ -1353,7 +1483,7 @@ static const char* docstringDensity =
     "An instance of Density class is constructed using the following keyword arguments:\n"
     "  type='...' or density='...'   the name of density profile (required), "
     "can be one of the following:\n"
-    "    Denhen, Plummer, PerfectEllipsoid, Ferrers, MiyamotoNagai, NFW, "
+    "    Denhen, Plummer, PerfectEllipsoid, Ferrers, MGE, MiyamotoNagai, NFW, "
     "Disk, Spheroid, Nuker, Sersic, King.\n"
     DOCSTRING_DENSITY_PARAMS
     "Most of these parameters have reasonable default values.\n"
@@ -1375,6 +1505,13 @@ static const char* docstringDensity =
     "Such a function can be provided as a single positional argument or as a `density` argument, "
     "followed by `symmetry` (if the latter is not given, the symmetry remains unknown "
     "and some methods will not work).\n"
+    "Instead of a Python function, one may provide a function compiled into machine code, "
+    "e.g., with `numba.cfunc('void(intp, CPointer(float64), CPointer(float64))', nopython=True)` "
+    "or as a ctypes function pointer with the equivalent signature `void f(size_t N, const double* xyz, "
+    "double* result)`, where xyz is the flattened array of 3N coordinates; such a function is called "
+    "directly from the C++ code without acquiring the Python global interpreter lock (GIL), "
+    "which eliminates the overhead of Python calls and allows it to run in parallel in many threads. "
+    "The same applies to a user-defined potential function.\n"
     "If this user-defined function is expected to be used in heavy computations, "
     "it may be more efficient to approximate it by a native density interpolator class: "
     "DensitySphericalHarmonic (for spheroidal profiles that are not too flattened) or "
@@ -1402,14 +1539,16 @@ typedef struct {
 /// \endcond
 
 /// Helper class for providing a BaseDensity interface
-/// to a Python function that returns density at one or several point
+/// to a Python function that returns density at one or several point,
+/// or to a compiled C function (in which case the GIL is not needed to call it)
 class DensityWrapper: public potential::BaseDensity{
     PyObject* fnc;
+    const RawFunction raw;
     const coord::SymmetryType sym;
     const std::string fncname;
 public:
-    DensityWrapper(PyObject* _fnc, coord::SymmetryType _sym):
-        fnc(_fnc), sym(_sym), fncname(toString(fnc))
+    DensityWrapper(PyObject* _fnc, coord::SymmetryType _sym, RawFunction _raw=NULL):
+        fnc(_fnc), raw(_raw), sym(_sym), fncname(toString(fnc))
     {
         Py_INCREF(fnc);
         FILTERMSG(utils::VL_DEBUG, "Agama",
@@ -1471,6 +1610,12 @@ public:
         for(size_t p=0; p<npoints; p++)
             unconvertPos(pos[p], xyz + p*3);
         double mult = conv->massUnit / pow_3(conv->lengthUnit);
+        if(raw) {  // compiled function is called directly, without involving the Python interpreter
+            raw(npoints, xyz, values);
+            for(size_t p=0; p<npoints; p++)
+                values[p] *= mult;
+            return;
+        }
         PyAcquireGIL lock;
         bool typeerror   = false;
         npy_intp dims[]  = { (npy_intp)npoints, 3};
@@ -1681,7 +1826,17 @@ potential::PtrDensity getDensity(PyObject* dens_obj, coord::SymmetryType sym)
     if(PyObject_TypeCheck(dens_obj, DensityTypePtr) && ((DensityObject*)dens_obj)->dens)
         return ((DensityObject*)dens_obj)->dens;
 
-    // otherwise this could be an arbitrary Python function
+    // otherwise this could be a compiled C function
+    try{
+        if(RawFunction raw = getRawFunction(dens_obj))
+            return potential::PtrDensity(new DensityWrapper(dens_obj, sym, raw));
+    }
+    catch(std::exception &ex) {  // a compiled function with a wrong signature
+        FILTERMSG(utils::VL_WARNING, "Agama", ex.what());
+        return potential::PtrDensity();
+    }
+
+    // or an arbitrary Python function
     if(checkCallable(dens_obj, /*dimension of input*/ 3)) {
         // then create a C++ wrapper for this Python function with the prescribed symmetry
         return potential::PtrDensity(new DensityWrapper(dens_obj, sym));
@@ -1750,6 +1905,17 @@ PyObject* Density_density(PyObject* self, PyObject* args, PyObject* namedArgs)
     return FncDensityDensity(args, namedArgs, *((DensityObject*)self)->dens).run(/*chunk*/1024);
 }
 
+/// compute the projected density by numerical integration along the line of sight,
+/// or exactly for models that provide an analytic expression (Multi-Gaussian Expansion)
+double projectedDensityAny(const potential::BaseDensity& dens, double X, double Y,
+    const coord::Orientation& orientation)
+{
+    const potential::MGE* mge = dynamic_cast<const potential::MGE*>(&dens);
+    if(mge)
+        return mge->projectedDensity(X, Y, orientation);
+    return potential::projectedDensity(dens, X, Y, orientation);
+}
+
 /// compute the projected (surface) density for an array of points
 class FncDensityProjectedDensity: public BatchFunction {
     const potential::BaseDensity& dens;
@@ -1767,7 +1933,7 @@ public:
     virtual void processPoint(npy_intp indexPoint)
     {
         outputBuffer[indexPoint] =
-            projectedDensity(dens,
+            projectedDensityAny(dens,
                 /*X*/ inputBuffer[indexPoint*2  ] * conv->lengthUnit,
                 /*Y*/ inputBuffer[indexPoint*2+1] * conv->lengthUnit,
                 orientation) /
@@ -1789,7 +1955,7 @@ PyObject* Density_projectedDensity(PyObject* self, PyObject* args, PyObject* nam
     {   // shortcut and alternative syntax for just a single point x,y
         try{
             return PyFloat_FromDouble(
-                projectedDensity(*((DensityObject*)self)->dens,
+                projectedDensityAny(*((DensityObject*)self)->dens,
                     X * conv->lengthUnit, Y * conv->lengthUnit,
                     coord::Orientation(alpha, beta, gamma)) /
                 (conv->massUnit / pow_2(conv->lengthUnit)) );
@@ -2067,7 +2233,7 @@ static PyMethodDef Density_methods[] = {
       "of the image plane in the intrinsic coordinate system of the model; "
       "in particular, beta is the inclination angle.\n"
       "Returns: float or array of floats - the density integrated along the line of sight Z "
-      "perpendicular to the image plane."},
+      "perpendicular to the image plane (computed analytically for MGE models)."},
     { "export", Density_export, METH_VARARGS,
       "Export density or potential expansion coefficients to a text file\n"
       "Arguments: filename (string)\n"
@@ -2157,7 +2323,7 @@ static const char* docstringPotential =
     "Note that all keywords and their values are not case-sensitive.\n\n"
     "List of possible keywords for a single component:\n"
     "  type='...'   the type of potential, can be one of the following 'basic' types:\n"
-    "    Harmonic, Logarithmic, Plummer, MiyamotoNagai, NFW, Ferrers, Dehnen, "
+    "    Harmonic, Logarithmic, Plummer, MiyamotoNagai, NFW, Ferrers, MGE, Dehnen, "
     "PerfectEllipsoid, Disk, Spheroid, Nuker, Sersic, King, KeplerBinary, UniformAcceleration;\n"
     "    or one of the expansion types:  BasisSet, Multipole, CylSpline - "
     "in these cases, one should provide either a density model, file name, "
@@ -2175,10 +2341,15 @@ static const char* docstringPotential =
     "  potential=...   instead of density, one may provide a potential source for the expansion. "
     "This argument shoud be either an instance of Potential class, or a user-defined function "
     "`my_potential(xyz)` returning the value of potential at N point, where xyz is a Nx3 array of "
-    "points in cartesian coordinates. \n"
+    "points in cartesian coordinates (its derivatives are computed by finite differences, "
+    "and the values at all points needed for the expansion are requested in a single call). \n"
     "  file='...'   the name of another INI file with potential parameters and/or "
     "coefficients of a Multipole/CylSpline potential expansion, or an N-body snapshot file "
     "that will be used to compute the coefficients of such expansion.\n"
+    "  sharedCoefs='...'   the name of a shared-memory segment with the coefficients of "
+    "a potential expansion, previously created by the exportSharedCoefs() method (possibly "
+    "in another process on the same machine); the potential is reconstructed from them "
+    "in the private memory of this process; this argument cannot be combined with any other ones.\n"
     "  particles=(coords, mass)   array of point masses to be used in construction of a "
     "potential expansion (an alternative to density=..., potential=... or file='...' options): "
     "should be a tuple with two arrays - coordinates and mass, where the first one is "
@@ -2253,36 +2424,25 @@ typedef struct {
 /// \endcond
 
 /// Helper class for providing a BasePotential interface
-/// to a Python function that returns the value of a potential at one or several point
-/// (with 1st and 2nd derivatives estimated by finite differences).
+/// to a Python function (or a compiled C function) that returns the value of a potential
+/// at one or several point (with 1st and 2nd derivatives estimated by finite differences).
+/// The vectorized evaluation routines collect the finite-difference stencils for all input points
+/// and pass them to the user function in a single call, amortizing the cost of the Python call.
 class PotentialWrapper: public potential::BasePotentialCar{
     PyObject* fnc;
+    const RawFunction raw;
     const coord::SymmetryType sym;
     const std::string fncname;
-public:
-    PotentialWrapper(PyObject* _fnc, coord::SymmetryType _sym):
-        fnc(_fnc), sym(_sym), fncname(toString(fnc))
-    {
-        Py_INCREF(fnc);
-        FILTERMSG(utils::VL_DEBUG, "Agama",
-            "Created a C++ potential wrapper for Python function " + fncname +
-            " (symmetry: " + potential::getSymmetryNameByType(sym) + ")");
-        if(isUnknown(sym))
-            PyErr_WarnEx(NULL, "symmetry is not provided, some methods will not be available", 1);
-    }
-    ~PotentialWrapper()
-    {
-        FILTERMSG(utils::VL_DEBUG, "Agama",
-            "Deleted a C++ potential wrapper for Python function " + fncname);
-        Py_DECREF(fnc);
-    }
-    virtual coord::SymmetryType symmetry() const { return sym; }
-    virtual std::string name() const { return fncname; };
-    virtual void evalCar(const coord::PosCar &pos,
-        double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double /*time*/) const
+
+    /// number of points in the 3d finite-difference stencil for computing the potential alone,
+    /// potential and gradient, or potential, gradient and hessian
+    static const int NPOINTS_POT = 1, NPOINTS_GRAD = 13, NPOINTS_HESS = 21;
+
+    /// fill the array of points of the finite-difference stencil around the given point
+    /// (in the units of the user function), and return the stepsize
+    static double makeStencil(const coord::PosCar &pos, int npoints, /*output*/ double xyz[])
     {
-        const int NPOINTS = 21;   // number of points in the 3d finite-difference stencil
-        const double OFFSETS[NPOINTS][3] = {  // offsets in units of stepsize h
+        static const double OFFSETS[NPOINTS_HESS][3] = {  // offsets in units of stepsize h
             { 0, 0, 0},   // function value at the point
             {-2, 0, 0},   // 4-point stencil in x  for df/dx, d2f/dx2
             {-1, 0, 0},
@@ -2304,18 +2464,49 @@ public:
             {-1, 1, 1},
             { 1,-1, 1},
             { 1, 1, 1} };
-        double xyz[3*NPOINTS], val[NPOINTS];
         unconvertPos(pos, xyz);
         // if 1st derivatives are needed, they will be estimated by finite differencing with this stepsize
         double eps = fmax(sqrt(pow_2(xyz[0])+pow_2(xyz[1])+pow_2(xyz[2])) * 5e-4 /* ~DBLEPS^(1/5) */,
             SQRT_DBL_EPSILON);
-        int npoints = deriv2 ? NPOINTS : deriv ? 13 : 1;
         for(int d=1; d<npoints; d++) {
             xyz[d*3+0] = xyz[0] + OFFSETS[d][0] * eps;
             xyz[d*3+1] = xyz[1] + OFFSETS[d][1] * eps;
             xyz[d*3+2] = xyz[2] + OFFSETS[d][2] * eps;
         }
-        npy_intp dims[]  = {npoints, 3};
+        return eps;
+    }
+
+    /// compute the potential and its derivatives from the values of the user function at the stencil
+    static void finishStencil(const double val[], double eps,
+        double* potential, coord::GradCar* deriv, coord::HessCar* deriv2)
+    {
+        if(potential)
+            *potential = val[0] * pow_2(conv->velocityUnit);
+        if(deriv) {  // 4-point rule for 1st derivs, accuracy O(h^4)
+            double mul = 1./12 / eps * pow_2(conv->velocityUnit) / conv->lengthUnit;
+            deriv->dx = (val[1] - val[4] - 8*val[2] + 8*val[3]) * mul;
+            deriv->dy = (val[5] - val[8] - 8*val[6] + 8*val[7]) * mul;
+            deriv->dz = (val[9] - val[12]- 8*val[10]+ 8*val[11])* mul;
+        }
+        if(deriv2) {  // 5-point rule for d2f/dx_i^2 (4th order), and 8-point for mixed derivs (2nd order)
+            double mul = 1./12 / pow_2(eps) * pow_2(conv->velocityUnit / conv->lengthUnit);
+            deriv2->dx2 = (-val[1] + 16*val[2] - 30*val[0] + 16*val[3] - val[4]) * mul;
+            deriv2->dy2 = (-val[5] + 16*val[6] - 30*val[0] + 16*val[7] - val[8]) * mul;
+            deriv2->dz2 = (-val[9] + 16*val[10]- 30*val[0] + 16*val[11]- val[12])* mul;
+            deriv2->dxdy= (val[13]-val[14]-val[15]+val[16]+val[17]-val[18]-val[19]+val[20]) * mul*1.5;
+            deriv2->dxdz= (val[13]-val[15]-val[17]+val[19]+val[14]-val[16]-val[18]+val[20]) * mul*1.5;
+            deriv2->dydz= (val[13]-val[17]-val[14]+val[18]+val[15]-val[19]-val[16]+val[20]) * mul*1.5;
+        }
+    }
+
+    /// call the user function for an array of points xyz[npoints*3], storing the results in val
+    void callFunction(size_t npoints, double xyz[], /*output*/ double val[]) const
+    {
+        if(raw) {  // compiled function is called directly, without involving the Python interpreter
+            raw(npoints, xyz, val);
+            return;
+        }
+        npy_intp dims[]  = {(npy_intp)npoints, 3};
         PyObject *result = NULL;
         bool typeerror   = false;
         // open a critical section for accessing Python C API
@@ -2329,7 +2520,7 @@ public:
             } else if(PyArray_Check(result) && PyArray_NDIM((PyArrayObject*)result)==1 &&
                 PyArray_DIM((PyArrayObject*)result, 0)==dims[0])
             {
-                for(int i=0; i<dims[0]; i++) {
+                for(npy_intp i=0; i<dims[0]; i++) {
                     switch(PyArray_TYPE((PyArrayObject*) result)) {
                         case NPY_DOUBLE: val[i] = pyArrayElem<double>(result, i); break;
                         case NPY_FLOAT:  val[i] = pyArrayElem<float >(result, i); break;
@@ -2347,27 +2538,64 @@ public:
             throw std::runtime_error("Call to user-defined potential function failed");
         else if(typeerror)
             throw std::runtime_error("Invalid data type returned by user-defined potential function");
-        /*else if(!isFinite(val[0]))
-            throw std::runtime_error("Invalid value (" + utils::toString(val[0]) +
-                ") returned by user-defined potential function at point (" +
-                utils::toString(xyz[0]) + ',' + utils::toString(xyz[1]) + ',' + utils::toString(xyz[2]) + ')');
-        */
-        if(potential)
-            *potential = val[0] * pow_2(conv->velocityUnit);
-        if(deriv) {  // 4-point rule for 1st derivs, accuracy O(h^4)
-            double mul = 1./12 / eps * pow_2(conv->velocityUnit) / conv->lengthUnit;
-            deriv->dx = (val[1] - val[4] - 8*val[2] + 8*val[3]) * mul;
-            deriv->dy = (val[5] - val[8] - 8*val[6] + 8*val[7]) * mul;
-            deriv->dz = (val[9] - val[12]- 8*val[10]+ 8*val[11])* mul;
-        }
-        if(deriv2) {  // 5-point rule for d2f/dx_i^2 (4th order), and 8-point for mixed derivs (2nd order)
-            double mul = 1./12 / pow_2(eps) * pow_2(conv->velocityUnit / conv->lengthUnit);
-            deriv2->dx2 = (-val[1] + 16*val[2] - 30*val[0] + 16*val[3] - val[4]) * mul;
-            deriv2->dy2 = (-val[5] + 16*val[6] - 30*val[0] + 16*val[7] - val[8]) * mul;
-            deriv2->dz2 = (-val[9] + 16*val[10]- 30*val[0] + 16*val[11]- val[12])* mul;
-            deriv2->dxdy= (val[13]-val[14]-val[15]+val[16]+val[17]-val[18]-val[19]+val[20]) * mul*1.5;
-            deriv2->dxdz= (val[13]-val[15]-val[17]+val[19]+val[14]-val[16]-val[18]+val[20]) * mul*1.5;
-            deriv2->dydz= (val[13]-val[17]-val[14]+val[18]+val[15]-val[19]-val[16]+val[20]) * mul*1.5;
+    }
+
+public:
+    PotentialWrapper(PyObject* _fnc, coord::SymmetryType _sym, RawFunction _raw=NULL):
+        fnc(_fnc), raw(_raw), sym(_sym), fncname(toString(fnc))
+    {
+        Py_INCREF(fnc);
+        FILTERMSG(utils::VL_DEBUG, "Agama",
+            "Created a C++ potential wrapper for " + std::string(raw ? "compiled" : "Python") +
+            " function " + fncname + " (symmetry: " + potential::getSymmetryNameByType(sym) + ")");
+        if(isUnknown(sym))
+            PyErr_WarnEx(NULL, "symmetry is not provided, some methods will not be available", 1);
+    }
+    ~PotentialWrapper()
+    {
+        FILTERMSG(utils::VL_DEBUG, "Agama",
+            "Deleted a C++ potential wrapper for Python function " + fncname);
+        Py_DECREF(fnc);
+    }
+    virtual coord::SymmetryType symmetry() const { return sym; }
+    virtual std::string name() const { return fncname; };
+    virtual void evalCar(const coord::PosCar &pos,
+        double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double /*time*/) const
+    {
+        double xyz[3*NPOINTS_HESS], val[NPOINTS_HESS];
+        int npoints = deriv2 ? NPOINTS_HESS : deriv ? NPOINTS_GRAD : NPOINTS_POT;
+        double eps = makeStencil(pos, npoints, xyz);
+        callFunction(npoints, xyz, val);
+        finishStencil(val, eps, potential, deriv, deriv2);
+    }
+    // vectorized evaluation: stencils for all points are sent to the user function in one call
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[], /*input*/ double /*time*/) const
+    {
+        if(npoints == 0)
+            return;
+        const int nstencil = deriv ? NPOINTS_GRAD : NPOINTS_POT;
+        std::vector<double> xyz(npoints * nstencil * 3), val(npoints * nstencil), eps(npoints);
+        for(size_t p=0; p<npoints; p++)
+            eps[p] = makeStencil(pos[p], nstencil, &xyz[p * nstencil * 3]);
+        callFunction(npoints * nstencil, &xyz[0], &val[0]);
+        for(size_t p=0; p<npoints; p++)
+            finishStencil(&val[p * nstencil], eps[p], &potential[p], deriv ? &deriv[p] : NULL, NULL);
+    }
+    virtual void evalmanyPotentialCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double potential[], coord::GradCyl deriv[], /*input*/ double time) const
+    {
+        if(npoints == 0)
+            return;
+        std::vector<coord::PosCar> poscar(npoints);
+        std::vector<coord::GradCar> gradcar(deriv ? npoints : 0);
+        for(size_t p=0; p<npoints; p++)
+            poscar[p] = toPosCar(pos[p]);
+        evalmanyPotentialCar(npoints, &poscar[0], potential, deriv ? &gradcar[0] : NULL, time);
+        for(size_t p=0; deriv && p<npoints; p++) {
+            coord::PosDerivT<coord::Cyl, coord::Car> der;
+            coord::toPosDeriv<coord::Cyl, coord::Car>(pos[p], &der);
+            deriv[p] = coord::toGrad<coord::Car, coord::Cyl>(gradcar[p], der);
         }
     }
 };
@@ -2405,6 +2633,13 @@ PyObject* createPotentialObject(const potential::PtrPotential& pot)
 /// attempt to construct an elementary potential from the parameters provided in dictionary
 potential::PtrPotential Potential_initFromDict(PyObject* namedArgs)
 {
+    // check if the potential should be reconstructed from coefficients in a shared-memory segment
+    PyObject* shared_obj = getItemFromPyDict(namedArgs, "sharedCoefs");
+    if(shared_obj) {
+        if(PyDict_Size(namedArgs) != 1)
+            throw std::invalid_argument("Argument 'sharedCoefs' cannot be combined with other arguments");
+        return potential::loadPotentialFromSharedMemory(toString(shared_obj));
+    }
     // check if the list of arguments contains an array of particles
     PyObject* particles_obj = getItemFromPyDict(namedArgs, "particles");
     if(particles_obj) {
@@ -2552,7 +2787,17 @@ potential::PtrPotential getPotential(PyObject* pot_obj, coord::SymmetryType sym)
     if(PyObject_TypeCheck(pot_obj, PotentialTypePtr) && ((PotentialObject*)pot_obj)->pot)
         return ((PotentialObject*)pot_obj)->pot;
 
-    // otherwise this could be an arbitrary Python function
+    // otherwise this could be a compiled C function
+    try{
+        if(RawFunction raw = getRawFunction(pot_obj))
+            return potential::PtrPotential(new PotentialWrapper(pot_obj, sym, raw));
+    }
+    catch(std::exception &ex) {  // a compiled function with a wrong signature
+        FILTERMSG(utils::VL_WARNING, "Agama", ex.what());
+        return potential::PtrPotential();
+    }
+
+    // or an arbitrary Python function
     if(checkCallable(pot_obj, /*dimension of input*/ 3)) {
         // then create a C++ wrapper for this Python function with the prescribed symmetry
         return potential::PtrPotential(new PotentialWrapper(pot_obj, sym));
@@ -2905,6 +3150,32 @@ PyObject* Potential_Rperiapo(PyObject* self, PyObject* args)
     return result;
 }
 
+/// store the coefficients of the potential in a shared-memory segment
+PyObject* Potential_exportSharedCoefs(PyObject* self, PyObject* args)
+{
+    const char* name=NULL;
+    if(!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    try{
+        potential::exportPotentialCoefsToSharedMemory(name, *((PotentialObject*)self)->pot);
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    catch(std::exception& ex) {
+        raisePythonException(ex, "Error exporting potential to shared memory: ");
+        return NULL;
+    }
+}
+
+/// remove a shared-memory segment
+PyObject* Potential_removeShared(PyObject* /*self*/, PyObject* args)
+{
+    const char* name=NULL;
+    if(!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    return PyBool_FromLong(utils::SharedMemorySegment::remove(name));
+}
+
 static PyMethodDef Potential_methods[] = {
     { "potential", (PyCFunction)Potential_potential, METH_VARARGS | METH_KEYWORDS,
       "Compute potential at a given point or array of points\n"
@@ -2966,6 +3237,24 @@ static PyMethodDef Potential_methods[] = {
       "spherically-symmetric potentials (the minimum/maximum spherical radius that an orbit can "
       "attain), but only approximate values for out-of-plane orbits in non-spherical potentials.\n"
       "Returns: a pair of values (Rperi,Rapo) or a Nx2 array of these values for each input point\n" },
+    { "exportSharedCoefs", Potential_exportSharedCoefs, METH_VARARGS,
+      "Store the coefficients of the potential in a named shared-memory segment, from which "
+      "the potential can be reconstructed by other processes on the same machine with "
+      "`Potential(sharedCoefs=name)`, avoiding the costly computation of the coefficients "
+      "of potential expansions in each process. Only potential expansions "
+      "(BasisSet, Multipole, CylSpline) and composite potentials made of them are supported.\n"
+      "This only transports the coefficients, it does not share the potential object itself: "
+      "each process that loads it constructs its own interpolating splines from them "
+      "(which is much cheaper than computing the coefficients, but not free) and keeps "
+      "a full copy in its private memory, so the memory footprint is not reduced. "
+      "Action finders cannot be transported in this way.\n"
+      "The segment persists until removed by `Potential.removeShared(name)`.\n"
+      "Arguments: name (string) - the name of the segment, which should not exist yet\n"
+      "Returns: none" },
+    { "removeShared", Potential_removeShared, METH_VARARGS | METH_STATIC,
+      "Remove a shared-memory segment previously created by exportSharedCoefs() (static method)\n"
+      "Arguments: name (string)\n"
+      "Returns: True if the segment was removed, False if it did not exist" },
     { NULL }
 };
 
@@ -3280,7 +3569,6 @@ static const char* docstringActionMapper =
 typedef struct {
     PyObject_HEAD
     actions::PtrActionMapper am;  // C++ object for action mapper
-    bool useTorus;  // whether the mapper uses Torus (not thread-safe) or another implementation
 } ActionMapperObject;
 /// \endcond
 
@@ -3318,8 +3606,6 @@ int ActionMapper_init(ActionMapperObject* self, PyObject* args, PyObject* namedA
         self->am = tol == tol ?
             actions::createActionMapper(pot, tol) :  // use the provided value of tol
             actions::createActionMapper(pot);        // use the default value
-        // if the potential is non-spherical, the underlying implementation uses Torus
-        self->useTorus = !isSpherical(*pot);
         FILTERMSG(utils::VL_DEBUG, "Agama", "Created " + self->am->name() + " action mapper at " +
             utils::toString(self->am.get()));
         return 0;
@@ -3393,9 +3679,7 @@ PyObject* ActionMapper_value(PyObject* self, PyObject* args, PyObject* namedArgs
     }
     bool needFreq = toBool(needFreq_flag, false);
     return FncActionMapper(points_obj, *((ActionMapperObject*)self)->am, needFreq) .
-        run(/*chunk*/ ((ActionMapperObject*)self)->useTorus ?
-            0  /* disable parallelization: Torus is not thread-safe */ :
-            64 /* otherwise parallelize normally */);
+        run(/*chunk*/64);
 }
 
 PyObject* ActionMapper_name(PyObject* self)
@@ -3439,7 +3723,10 @@ static const char* docstringDistributionFunction =
     "frequencies (potential=... argument). For the QuasiSpherical DF one needs to provide "
     "an instance of density profile (density=...) and the potential (if they are the same, then only "
     "potential=... is needed), and optionally the central value of anisotropy coefficient `beta0` "
-    "(by default 0) and the anisotropy radius `r_a` (by default infinity).\n"
+    "(by default 0) and the anisotropy radius `r_a` (by default infinity); setting "
+    "`tableAccuracy` to a positive value (e.g. 1e-4) enables an interpolation table for ln(f) "
+    "in scaled actions, which speeds up the computation of DF values; table cells where the error "
+    "of ln(f) at check points exceeds half of this tolerance are evaluated exactly.\n"
     "Other parameters are specific to each DF type.\n"
     "Alternatively, a composite DF may be created from an array of previously constructed DFs:\n"
     ">>> df = DistributionFunction(df1, df2, df3)\n\n"
@@ -3833,7 +4120,11 @@ PyObject* DistributionFunction_totalMass(PyObject* self)
         return NULL;
     }
     try{
-        double val = ((DistributionFunctionObject*)self)->df->totalMass();
+        double val;
+        {   // the integration over actions is OpenMP-parallelized, and the DF may be a Python function
+            PyReleaseGIL unlock;
+            val = ((DistributionFunctionObject*)self)->df->totalMass();
+        }
         return Py_BuildValue("d", val / conv->massUnit);
     }
     catch(std::exception& ex) {
@@ -3849,7 +4140,11 @@ PyObject* DistributionFunction_totalEntropy(PyObject* self)
         return NULL;
     }
     try{
-        double val = totalEntropy(*((DistributionFunctionObject*)self)->df);
+        double val;
+        {
+            PyReleaseGIL unlock;
+            val = totalEntropy(*((DistributionFunctionObject*)self)->df);
+        }
         return Py_BuildValue("d", val / conv->massUnit);
     }
     catch(std::exception& ex) {
@@ -5250,6 +5545,7 @@ typedef struct {
     actions::PtrActionFinder af;  ///< corresponding action finder (may be empty initially)
     bool useActionInterpolation;  ///< whether to use the interpolated action finder
     bool verbose;                 ///< whether to print out progress report messages
+    bool useJointUpdate;          ///< whether to update compatible DF-based components jointly
     double rminSph, rmaxSph;      ///< range of radii for the logarithmic grid
     unsigned int sizeRadialSph;   ///< number of grid points in radius
     unsigned int lmaxAngularSph;  ///< maximum order of angular-harmonic expansion (l_max)
@@ -5298,6 +5594,7 @@ int SelfConsistentModel_init(SelfConsistentModelObject* self, PyObject* args, Py
     }
     self->useActionInterpolation = toBool(getItemFromPyDict(namedArgs, "useActionInterpolation"), false);
     self->verbose     =   toBool(getItemFromPyDict(namedArgs, "verbose"), true);
+    self->useJointUpdate= toBool(getItemFromPyDict(namedArgs, "useJointUpdate"), false);
     // default values for the grid parameters are invalid, forcing the user to set them explicitly
     self->rminSph     = toDouble(getItemFromPyDict(namedArgs, "rminSph"), -1);
     self->rmaxSph     = toDouble(getItemFromPyDict(namedArgs, "rmaxSph"), -1);
@@ -5335,6 +5632,7 @@ PyObject* SelfConsistentModel_iterate(SelfConsistentModelObject* self)
     }
     model.useActionInterpolation = self->useActionInterpolation;
     model.verbose = self->verbose;
+    model.useJointUpdate = self->useJointUpdate;
     model.rminSph = self->rminSph * conv->lengthUnit;
     model.rmaxSph = self->rmaxSph * conv->lengthUnit;
     model.sizeRadialSph = self->sizeRadialSph;
@@ -5418,6 +5716,9 @@ static PyMemberDef SelfConsistentModel_members[] = {
       const_cast<char*>("Whether to use interpolated action finder (faster but less accurate)") },
     { const_cast<char*>("verbose"), T_BOOL, offsetof(SelfConsistentModelObject, verbose), 0,
       const_cast<char*>("Whether to print out progress report messages") },
+    { const_cast<char*>("useJointUpdate"), T_BOOL, offsetof(SelfConsistentModelObject, useJointUpdate), 0,
+      const_cast<char*>("Whether to update DF-based components with identical grid parameters jointly "
+      "(computing the actions only once for all of them); default False") },
     { const_cast<char*>("rminSph"), T_DOUBLE, offsetof(SelfConsistentModelObject, rminSph), 0,
       const_cast<char*>("Spherical radius of innermost grid node for Multipole potential") },
     { const_cast<char*>("rmaxSph"), T_DOUBLE, offsetof(SelfConsistentModelObject, rmaxSph), 0,
@@ -6157,61 +6458,34 @@ PyObject* ghMoments(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
         }
     } else {
         // construct best-fit parameters of GH expansion (find amplitude,center,width)
-        // for each aperture and component, and then compute GH moments using these parameters
+        // for each aperture and component, and then compute GH moments using these parameters;
+        // the input amplitudes are gathered into a matrix with one row per aperture and component,
+        // which is then processed by an OpenMP-parallelized routine sharing the common setup
         const npy_intp count = numApertures * numComponents;
-#ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1)
-#endif
-        for(npy_intp ar=0; ar < count; ar++) {
-            if(fail) continue;
-            try{
+        try{
+            math::Matrix<double> srcmat(count, numBasisFnc);
+            for(npy_intp ar=0; ar < count; ar++) {
                 int r = ar / numApertures, a = ar % numApertures;  // row and aperture indices
-                std::vector<double> srcrow(numBasisFnc);
                 for(int b=0; b<numBasisFnc; b++)
-                    srcrow[b] = ndim == 1 ?
+                    srcmat(ar, b) = ndim == 1 ?
                         pyArrayElem<galaxymodel::StorageNumT>(mat_arr,    a * numBasisFnc + b) :
                         pyArrayElem<galaxymodel::StorageNumT>(mat_arr, r, a * numBasisFnc + b);
-                shared_ptr<math::GaussHermiteExpansion> ghexp;
-                switch(degree) {
-                    case 0: ghexp.reset(new math::GaussHermiteExpansion(
-                        math::BsplineWrapper<0>(math::BsplineInterpolator1d<0>(gridv), srcrow),
-                        ghorder));
-                        break;
-                    case 1: ghexp.reset(new math::GaussHermiteExpansion(
-                        math::BsplineWrapper<1>(math::BsplineInterpolator1d<1>(gridv), srcrow),
-                        ghorder));
-                        break;
-                    case 2: ghexp.reset(new math::GaussHermiteExpansion(
-                        math::BsplineWrapper<2>(math::BsplineInterpolator1d<2>(gridv), srcrow),
-                        ghorder));
-                        break;
-                    case 3: ghexp.reset(new math::GaussHermiteExpansion(
-                        math::BsplineWrapper<3>(math::BsplineInterpolator1d<3>(gridv), srcrow),
-                        ghorder));
-                        break;
-                    default:  // shouldn't occur, we've checked degree beforehand
-                        assert(!"Invalid B-spline degree");
-                }
-                std::vector<double> dstrow(ghorder+4);
-                dstrow[0] = ghexp->ampl();    // overall amplitude
-                dstrow[1] = ghexp->center();  // center of the expansion
-                dstrow[2] = ghexp->width();   // width of the base gaussian
-                std::copy(ghexp->coefs().begin(), ghexp->coefs().end(), dstrow.begin()+3);
+            }
+            math::Matrix<double> dstmat(math::fitGaussHermiteMany(degree, gridv, ghorder, srcmat));
+            for(npy_intp ar=0; ar < count; ar++) {
+                int r = ar / numApertures, a = ar % numApertures;
+                // amplitude, center, width, and GH moments h_0..h_M
                 for(int m=0; m<=ghorder+3; m++)
                     (ndim==1 ?
                     pyArrayElem<galaxymodel::StorageNumT>(output_arr,    a * (ghorder+4) + m) :
                     pyArrayElem<galaxymodel::StorageNumT>(output_arr, r, a * (ghorder+4) + m) ) =
-                        static_cast<galaxymodel::StorageNumT>(dstrow[m]);
-            }
-            catch(std::exception& ex) {
-                errorMessage = ex.what();
-                fail = true;
-            }
-            if(cbrk.triggered()) {
-                errorMessage = cbrk.message();
-                fail = true;
+                        static_cast<galaxymodel::StorageNumT>(dstmat(ar, m));
             }
         }
+        catch(std::exception& ex) {
+            errorMessage = ex.what();
+            fail = true;
+        }
     }
     Py_XDECREF(gh_arr);
     Py_DECREF(mat_arr);
@@ -7091,6 +7365,10 @@ static const char* docstringOrbit =
     "a chaos indicator (positive value means that the orbit is chaotic, zero - regular).\n"
     "  accuracy (optional, default 1e-8):  relative accuracy of the ODE integrator.\n"
     "  maxNumSteps (optional, default 1e8):  upper limit on the number of steps in the ODE integrator.\n"
+    "  regularizationRadius (optional, default 0):  if positive, use a time transformation that "
+    "regularizes the motion near the central black hole (the KeplerBinary component of the potential, "
+    "or a single point mass at origin if there is none) within approximately this radius; "
+    "this greatly reduces the number of steps for orbits that pass close to the black hole.\n"
     "  dtype (optional, default 'float32'):  storage data type for trajectories (see below).\n"
     "Returns:\n"
     "  depending on the arguments, one or a tuple of several data containers (one for each target, "
@@ -7172,11 +7450,13 @@ PyObject* orbit(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
         *targets_obj = NULL, *trajsize_obj = NULL, *dtype_obj = NULL;
     static const char* keywords[] =
         {"ic", "time", "timestart", "potential", "targets", "trajsize",
-         "der", "lyapunov", "Omega", "accuracy", "maxNumSteps", "dtype", NULL};
-    if(!PyArg_ParseTupleAndKeywords(args, namedArgs, "|OOOOOOiiddiO", const_cast<char**>(keywords),
+         "der", "lyapunov", "Omega", "accuracy", "maxNumSteps", "regularizationRadius", "dtype", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, namedArgs, "|OOOOOOiiddidO", const_cast<char**>(keywords),
         &ic_obj, &time_obj, &timestart_obj, &pot_obj, &targets_obj, &trajsize_obj,
-        &haveDer, &haveLyap, &Omega, &params.accuracy, &params.maxNumSteps, &dtype_obj))
+        &haveDer, &haveLyap, &Omega, &params.accuracy, &params.maxNumSteps,
+        &params.regularizationRadius, &dtype_obj))
         return NULL;
+    params.regularizationRadius *= conv->lengthUnit;
 
     // check if deviation vectors are needed (if yes, the output contains yet another array)
     if(haveDer != 0 && haveDer != 1) {
@@ -8084,6 +8364,8 @@ static PyMethodDef module_methods[] = {
       METH_VARARGS | METH_KEYWORDS, docstringSetUnits },
     { "getUnits",                            getUnits,
       METH_NOARGS,                  docstringGetUnits },
+    { "setCacheDir",                         setCacheDir,
+      METH_VARARGS,                 docstringSetCacheDir },
     { "splineApprox",           (PyCFunction)splineApprox,
       METH_VARARGS | METH_KEYWORDS, docstringSplineApprox },
     { "splineLogDensity",       (PyCFunction)splineLogDensity,
@@ -220,4 +220,31 @@ public:
     }
 };
 
+/** Prototype of a vector-valued function with derivatives, whose output values are independent
+    of each other (e.g., residuals of a least-square fit at different data points), so that any
+    contiguous range of values can be computed separately.
+    The fitting and root-finding routines use this interface to split the evaluation of values
+    and the jacobian into blocks processed in parallel, hence `evalDerivRange()` must be
+    thread-safe (which is normally the case for a const method without side effects).
+*/
+class IFunctionNdimDerivSeparable: public IFunctionNdimDeriv {
+public:
+    /** evaluate a contiguous range of output values and their derivatives.
+        \param[in]  vars   is the N-dimensional point at which the function should be computed.
+        \param[in]  first  is the index of the first output value to compute.
+        \param[in]  count  is the number of output values to compute (first+count <= M).
+        \param[out] values is the array of length `count` that receives the output values
+                    with indices first..first+count-1; may be NULL if not needed.
+        \param[out] derivs if not NULL, is the count-by-N matrix of their partial derivatives,
+                    indexed as derivs[(m-first)*N+n] = df_m/dx_n.
+    */
+    virtual void evalDerivRange(const double vars[], unsigned int first, unsigned int count,
+        double values[], double *derivs=NULL) const = 0;
+
+    /** evaluate all output values at once (sequentially) */
+    virtual void evalDeriv(const double vars[], double values[], double *derivs=NULL) const {
+        evalDerivRange(vars, 0, numValues(), values, derivs);
+    }
+};
+
 }  // namespace math
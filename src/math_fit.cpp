@@ -5,6 +5,11 @@
 #include <gsl/gsl_multimin.h>
 #include <stdexcept>
 #include <string>
+#include <algorithm>
+#include <cfloat>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef HAVE_EIGEN
 // necessary to change the global setting for storage order, because the solver interface
@@ -45,6 +50,175 @@ private:
     gsl_matrix_const_view m;
 };
 
+// ----- parallel evaluation of separable functions ----- //
+
+/// number of output values of a separable function evaluated in one call of evalDerivRange()
+static const unsigned int BLOCK_SIZE = 1024;
+
+/// max number of groups of output values with independently accumulated partial sums
+/// in evalNormalEquations (does not depend on the number of threads, to make the result
+/// deterministic)
+static const unsigned int MAX_GROUPS = 64;
+
+/// evaluate all values and/or derivatives of the function; if it is separable and the number
+/// of values is large enough, the work is split into blocks that are processed in parallel
+void evalDerivBlocks(const IFunctionNdimDeriv& F, const double vars[], double values[], double derivs[])
+{
+    const IFunctionNdimDerivSeparable* FS = dynamic_cast<const IFunctionNdimDerivSeparable*>(&F);
+    const unsigned int M = F.numValues(), N = F.numVars(), numBlocks = (M + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if(!FS || numBlocks < 2) {
+        F.evalDeriv(vars, values, derivs);
+        return;
+    }
+    std::string errorMsg;
+    bool stop = false;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int b=0; b<(int)numBlocks; b++) {
+        if(stop) continue;
+        const unsigned int first = b * BLOCK_SIZE, count = std::min(BLOCK_SIZE, M - first);
+        try{
+            FS->evalDerivRange(vars, first, count,
+                values ? values + first : NULL, derivs ? derivs + first * N : NULL);
+        }
+        catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(evalDerivBlocks)
+#endif
+            errorMsg = e.what();
+            stop = true;
+        }
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error(errorMsg);
+}
+
+/** Compute the sum of squared values of the function  chi2 = |F(x)|^2,  and optionally
+    the gradient  g = J^T F  and the normal matrix  A = J^T J,  where J is the jacobian.
+    For a separable function, the full M-by-N jacobian is never stored: the values are split
+    into groups processed in parallel, each accumulating its own partial sums over blocks
+    of limited size, and the partial sums are then added up in a fixed order.
+    \throw std::runtime_error if the function throws an exception.
+*/
+double evalNormalEquations(const IFunctionNdimDeriv& F, const double vars[],
+    std::vector<double>* grad, Matrix<double>* hess)
+{
+    const IFunctionNdimDerivSeparable* FS = dynamic_cast<const IFunctionNdimDerivSeparable*>(&F);
+    const unsigned int M = F.numValues(), N = F.numVars(),
+        numGroups = std::min(MAX_GROUPS, (M + BLOCK_SIZE - 1) / BLOCK_SIZE),
+        stride = 1 + N + N * N;   // chi2, gradient and normal matrix for each group
+    const bool needDer = grad != NULL && hess != NULL;
+    // a non-separable function computes all values and derivatives at once
+    std::vector<double> allval, allder;
+    if(!FS) {
+        allval.resize(M);
+        allder.resize(needDer ? M * N : 0);
+        F.evalDeriv(vars, &allval[0], needDer ? &allder[0] : NULL);
+    }
+    std::vector<double> sums(numGroups * stride, 0.);
+    std::string errorMsg;
+    bool stop = false;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int g=0; g<(int)numGroups; g++) {
+        if(stop) continue;
+        try{
+            std::vector<double> val, der;
+            double* sum = &sums[g * stride];
+            const unsigned int end = static_cast<unsigned int>(M * (g+1.) / numGroups);
+            for(unsigned int first = static_cast<unsigned int>(M * (g+0.) / numGroups);
+                first < end; first += BLOCK_SIZE)
+            {
+                const unsigned int count = std::min(BLOCK_SIZE, end - first);
+                const double *v, *d;
+                if(FS) {
+                    val.resize(count);
+                    der.resize(needDer ? count * N : 0);
+                    FS->evalDerivRange(vars, first, count, &val[0], needDer ? &der[0] : NULL);
+                    v = &val[0];
+                    d = needDer ? &der[0] : NULL;
+                } else {
+                    v = &allval[first];
+                    d = needDer ? &allder[first * N] : NULL;
+                }
+                for(unsigned int k=0; k<count; k++) {
+                    sum[0] += pow_2(v[k]);
+                    for(unsigned int i=0; needDer && i<N; i++) {
+                        sum[1+i] += d[k*N+i] * v[k];
+                        for(unsigned int j=i; j<N; j++)
+                            sum[1+N+i*N+j] += d[k*N+i] * d[k*N+j];
+                    }
+                }
+            }
+        }
+        catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(evalNormalEquations)
+#endif
+            errorMsg = e.what();
+            stop = true;
+        }
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error(errorMsg);
+    for(unsigned int g=1; g<numGroups; g++)
+        for(unsigned int i=0; i<stride; i++)
+            sums[i] += sums[g * stride + i];
+    if(needDer) {
+        grad->assign(sums.begin() + 1, sums.begin() + 1 + N);
+        *hess = Matrix<double>(N, N);
+        for(unsigned int i=0; i<N; i++)
+            for(unsigned int j=i; j<N; j++)
+                (*hess)(i, j) = (*hess)(j, i) = sums[1+N+i*N+j];
+    }
+    return sums[0];
+}
+
+/** Solve the trust-region subproblem in the eigenbasis of the (scaled) normal matrix:
+    find the step  p_k = -c_k / (s_k + lambda)  with the smallest lambda >= 0  such that |p| <= radius,
+    where s_k >= 0 are the eigenvalues and c_k are the components of the gradient in this basis.
+    Since the eigendecomposition does not depend on lambda, each trial value costs only O(N),
+    and the equation  1/|p(lambda)| = 1/radius  is solved by Newton iterations (Hebden's method).
+    \return  the value of lambda (0 for the unconstrained Gauss-Newton step).
+*/
+double trustRegionStep(const std::vector<double>& eig, const std::vector<double>& c,
+    const double radius, std::vector<double>& p)
+{
+    const unsigned int N = eig.size();
+    const double minEig = eig[0] * N * DBL_EPSILON;  // eigenvalues are sorted in decreasing order
+    double cnorm = 0;
+    for(unsigned int k=0; k<N; k++)
+        cnorm += pow_2(c[k]);
+    cnorm = sqrt(cnorm);
+    // start from the Gauss-Newton step, or the smallest regularization if the matrix is singular
+    const double lambdaMin = eig[N-1] > minEig ? 0 : fmax(minEig, DBL_MIN),
+        lambdaMax = cnorm / radius;  // |p(lambda)| < radius for any lambda above this value
+    double lambda = lambdaMin;
+    for(int iter=0; iter<100; iter++) {
+        double norm2 = 0, der = 0;
+        for(unsigned int k=0; k<N; k++) {
+            double q = c[k] / (eig[k] + lambda);
+            norm2 += q * q;
+            der   += q * q / (eig[k] + lambda);
+        }
+        double norm = sqrt(norm2);
+        // the step is accepted if it lies within the trust region (with 10% tolerance),
+        // and is either unconstrained or close enough to the boundary
+        if(norm <= radius * 1.1 && (lambda == lambdaMin || norm >= radius * 0.9))
+            break;
+        // Newton step for the function 1/|p(lambda)| - 1/radius, which is concave and increasing,
+        // so that the iterations starting to the left of the root converge monotonically
+        double newLambda = lambda + (norm - radius) / radius * norm2 / der;
+        lambda = newLambda > lambda && newLambda < lambdaMax ? newLambda : 0.5 * (lambda + lambdaMax);
+    }
+    p.resize(N);
+    for(unsigned int k=0; k<N; k++)
+        p[k] = -c[k] / (eig[k] + lambda);
+    return lambda;
+}
+
 // ----- wrappers for multidimensional minimization routines ----- //
 template <class T>
 struct GslFncWrapper {
@@ -98,7 +272,7 @@ inline int functionWrapperNdimMvalFncDer(
     GslFncWrapper<IFunctionNdimDeriv>* p = static_cast<GslFncWrapper<IFunctionNdimDeriv>*>(param);
     try{
         p->numCalls++;
-        p->F.evalDeriv(x->data, f? f->data : NULL, df? df->data : NULL);
+        evalDerivBlocks(p->F, x->data, f? f->data : NULL, df? df->data : NULL);
         // check that values and/or derivatives are ok
         bool ok=true;
         for(unsigned int i=0; f && i<p->F.numValues(); i++)
@@ -144,7 +318,7 @@ struct EigenFncWrapper {
     int operator()(const InputType &x, ValueType &f) const {
         try{
             numCalls++;
-            F.eval(x.data(), f.data());
+            evalDerivBlocks(F, x.data(), f.data(), NULL);
             for(unsigned int i=0; i<F.numValues(); i++)
                 if(!isFinite(f[i])) {
                     for(unsigned int j=0; j<F.numValues(); j++)
@@ -165,7 +339,7 @@ struct EigenFncWrapper {
     int df(const InputType &x, JacobianType &df) const {
         try{
             numCalls++;
-            F.evalDeriv(x.data(), NULL, df.data());
+            evalDerivBlocks(F, x.data(), NULL, df.data());
             /*for(unsigned int i=0; i<F.numVars()*F.numValues(); i++)
                 if(!isFinite(df.data()[i])) {
                     error = "Derivative is not finite";
@@ -314,6 +488,115 @@ int nonlinearMultiFit(const IFunctionNdimDeriv& F, const double xinit[],
     return params.numCalls;
 }
 
+// ----- nonlinear least-square fit with a trust region and normal equations ----- //
+int nonlinearMultiFitTrustRegion(const IFunctionNdimDeriv& F, const double xinit[],
+    const double relToler, const int maxNumIter, double result[])
+{
+    const unsigned int Nparam = F.numVars();   // number of parameters to vary
+    const unsigned int Ndata  = F.numValues(); // number of data points to fit
+    if(Ndata < Nparam)
+        throw std::invalid_argument("nonlinearMultiFitTrustRegion: "
+            "number of data points is less than the number of parameters to fit");
+    std::vector<double> x(xinit, xinit+Nparam), xnew(Nparam), grad, gradnew,
+        scale(Nparam, 0.), c(Nparam), eig, p;
+    Matrix<double> hess, hessnew, V;
+    double chi2;
+    try{
+        chi2 = evalNormalEquations(F, &x[0], &grad, &hess);
+    }
+    catch(std::exception& e) {
+        throw std::runtime_error("Error in nonlinearMultiFitTrustRegion: "+std::string(e.what()));
+    }
+    if(!isFinite(chi2))
+        throw std::runtime_error("Error in nonlinearMultiFitTrustRegion: "
+            "function is not finite at the initial point");
+    int numCalls = 1;
+    double radius = -1;   // radius of the trust region in scaled variables (assigned below)
+    bool converged = chi2 == 0, newJacobian = true;
+    while(!converged && numCalls < maxNumIter) {
+        if(newJacobian) {
+            // the trust region is an ellipsoid with semiaxes inversely proportional to
+            // the square root of the diagonal elements of the normal matrix (Marquardt's scaling)
+            for(unsigned int i=0; i<Nparam; i++)
+                scale[i] = fmax(scale[i], sqrt(hess(i, i)));
+            for(unsigned int i=0; i<Nparam; i++)
+                if(scale[i] == 0)
+                    scale[i] = 1;
+            // eigendecomposition of the scaled normal matrix, reused in all trial steps
+            // until a step is accepted and the jacobian is recomputed at the new point;
+            // for a symmetric positive semi-definite matrix it is equivalent to SVD
+            Matrix<double> B(Nparam, Nparam);
+            for(unsigned int i=0; i<Nparam; i++)
+                for(unsigned int j=0; j<Nparam; j++)
+                    B(i, j) = hess(i, j) / (scale[i] * scale[j]);
+            SVDecomp svd(B);
+            V   = svd.V();
+            eig = svd.S();
+            for(unsigned int k=0; k<Nparam; k++) {
+                c[k] = 0;
+                for(unsigned int i=0; i<Nparam; i++)
+                    c[k] += V(i, k) * grad[i] / scale[i];
+            }
+            if(radius < 0) {   // initial radius is proportional to the scaled norm of parameters
+                radius = 0;
+                for(unsigned int i=0; i<Nparam; i++)
+                    radius += pow_2(scale[i] * x[i]);
+                radius = radius > 0 ? 100 * sqrt(radius) : 100;
+            }
+            newJacobian = false;
+        }
+        trustRegionStep(eig, c, radius, p);
+        // predicted decrease of chi2 in the linearized model |F + J dx|^2,
+        // and the norm of the step in scaled variables
+        double pred = 0, pnorm = 0;
+        for(unsigned int k=0; k<Nparam; k++) {
+            pred -= (2 * c[k] + eig[k] * p[k]) * p[k];
+            pnorm += pow_2(p[k]);
+        }
+        pnorm = sqrt(pnorm);
+        bool stepSmall = true;
+        for(unsigned int i=0; i<Nparam; i++) {
+            double dx = 0;
+            for(unsigned int k=0; k<Nparam; k++)
+                dx += V(i, k) * p[k];
+            dx /= scale[i];
+            xnew[i] = x[i] + dx;
+            stepSmall &= fabs(dx) <= relToler * fabs(xnew[i]);
+        }
+        if(pnorm == 0 || pred <= 0) {
+            converged = true;   // gradient is zero or the model cannot be improved any further
+            break;
+        }
+        // evaluate the function and the jacobian at the trial point in a single pass,
+        // since the step is usually accepted; if the function throws an exception
+        // (e.g., the parameters are out of range), the step is rejected
+        double chi2new = NAN;
+        numCalls++;
+        try{
+            chi2new = evalNormalEquations(F, &xnew[0], &gradnew, &hessnew);
+        }
+        catch(std::exception&) {}
+        double rho = isFinite(chi2new) ? (chi2 - chi2new) / pred : -1;
+        // update the trust region radius
+        if(rho < 0.25)
+            radius = 0.25 * fmin(radius, pnorm);
+        else if(rho > 0.75)
+            radius = fmax(radius, 2 * pnorm);
+        if(rho > 1e-4) {   // accept the step
+            x.swap(xnew);
+            grad.swap(gradnew);
+            swap(hess, hessnew);
+            chi2 = chi2new;
+            newJacobian = true;
+            converged = stepSmall || chi2 == 0;
+        } else   // reject the step and try again with a smaller radius, reusing the decomposition;
+            converged = stepSmall;   // stop if even the rejected step is below the tolerance
+    }
+    for(unsigned int i=0; i<Nparam; i++)
+        result[i] = x[i];
+    return converged ? numCalls : -numCalls;
+}
+
 // ----- multidimensional root-finding ----- //
 
 int findRootNdimDeriv(const IFunctionNdimDeriv& F, const double xinit[],
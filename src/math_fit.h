@@ -67,6 +67,8 @@ void linearMultiFit(const IMatrixDense<double>& coefs, const std::vector<double>
     the fitting algorithm only needs to know the difference at each point and the gradient
     w.r.t. each parameter at each point.
     It should throw an exception if the parameter values `x` are outside an acceptable range.
+    If F is derived from IFunctionNdimDerivSeparable and M is large (several thousands or more),
+    the values and the jacobian are computed in blocks in parallel.
     \param[in]  xinit  is the array of starting values of parameters `x` (length N).
     \param[in]  relToler  is the stopping criterion: the change in parameter values during
     the step must satisfy |dx| < relToler * |x| to end the iterative procedure.
@@ -77,6 +79,25 @@ void linearMultiFit(const IMatrixDense<double>& coefs, const std::vector<double>
 int nonlinearMultiFit(const IFunctionNdimDeriv& F, const double xinit[],
     const double relToler, const int maxNumIter, double result[]);
 
+/** perform a multi-parameter nonlinear least-square fit by a trust-region method,
+    intended for problems with a large number of data points (M ~ 10^5-10^6).
+    It solves the same problem as nonlinearMultiFit and has the same arguments,
+    but works with the normal equations: at each point it accumulates the N-by-N matrix
+    `J^T J` and the gradient `J^T F` (where J is the jacobian), without storing the M-by-N jacobian.
+    For a function derived from IFunctionNdimDerivSeparable, the accumulation is performed
+    in blocks in parallel, and the result does not depend on the number of threads.
+    The eigendecomposition of the (scaled) normal matrix is computed once per point and reused
+    to solve the trust-region subproblem for all trial steps, so that a rejected step costs
+    only one function evaluation.
+    Unlike nonlinearMultiFit, an exception thrown by F at a trial point does not terminate
+    the fit, but the step is rejected and the trust region is reduced.
+    \return  the number of function evaluations (each computing both values and jacobian),
+    with a negative sign if the fit has not converged within maxNumIter evaluations.
+    \throw   std::runtime_error if F throws an exception or is not finite at the initial point.
+*/
+int nonlinearMultiFitTrustRegion(const IFunctionNdimDeriv& F, const double xinit[],
+    const double relToler, const int maxNumIter, double result[]);
+
 ///@}
 /// \name ------ multidimensional root-finding -------
 ///@{
@@ -87,6 +108,7 @@ int nonlinearMultiFit(const IFunctionNdimDeriv& F, const double xinit[],
     N variables is represented by one element of the array of output values).
     It must provide the Jacobian matrix of derivatives of each function by all input vars.
     The equation system is \f$  F_i( \{x_k\} ) = 0, i=0..N-1, k=0..N-1  \f$.
+    If F is derived from IFunctionNdimDerivSeparable, large systems are evaluated in parallel.
     \param[in]  xinit  is the starting N-dimensional point for root finding;
     \param[in]  absToler  is the required tolerance on the value of each function at root;
     \param[in]  maxNumIter  is the upper limit on the number of iterations;
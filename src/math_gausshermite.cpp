@@ -2,6 +2,7 @@
 #include "math_core.h"
 #include "math_fit.h"
 #include "math_specfunc.h"
+#include "utils.h"
 #include <cmath>
 #include <stdexcept>
 #include <algorithm>
@@ -128,31 +129,60 @@ inline std::vector<double> computeGaussHermiteMoments(const IFunction& fnc,
 }
 
 
-/// compute the coefficients of GH expansion for a function f(x) that is a B-spline of degree N
-template<int N>
-inline std::vector<double> computeGaussHermiteMoments(const BsplineWrapper<N>& fnc,
-    unsigned int order, double ampl, double center, double width)
+/// construct an integration grid with NnodesGL Gauss-Legendre points per each segment of the input grid
+void makeIntegrationGrid(const std::vector<double>& grid, const int NnodesGL,
+    std::vector<double>& nodes, std::vector<double>& weights)
 {
-    const std::vector<double>& grid = fnc.bspl.xvalues();
-    const int NnodesGL = 4;  // number of nodes per segment of the B-spline grid
     const double *glnodes = GLPOINTS[NnodesGL], *glweights = GLWEIGHTS[NnodesGL];
-    std::vector<double> hpoly(order+1);    // temp.storage for Hermite polynomials
-    std::vector<double> result(order+1);
+    nodes.  resize((grid.size()-1) * NnodesGL);
+    weights.resize(nodes.size());
     for(size_t i=0; i<grid.size()-1; i++) {
         double x1= grid[i], x2=grid[i+1];  // endpoints of the current grid segment
         for(int k=0; k<NnodesGL; k++) {
-            double
-            x = glnodes[k] * x2 + (1-glnodes[k]) * x1,  // GL integration node within the segment
-            y = (x-center) / width,
-            mult = M_SQRT2 / ampl * exp(-0.5*y*y) * glweights[k] * (x2-x1) * fnc(x);
-            hermiteArray(order, y, &hpoly[0]);
-            for(unsigned int m=0; m<=order; m++)
-                result[m] += mult * hpoly[m];
+            nodes  [i*NnodesGL+k] = glnodes[k] * x2 + (1-glnodes[k]) * x1;
+            weights[i*NnodesGL+k] = glweights[k] * (x2 - x1);
         }
     }
+}
+
+/// number of GL nodes per segment of B-spline grid used in computing the GH moments
+static const int NNODES_GL_MOMENTS = 4;
+
+/// number of GL nodes per segment of B-spline grid used in fitting the parameters of GH expansion
+static const int NNODES_GL_FIT = 3;
+
+/// compute the coefficients of GH expansion for a function f(x) given by its values
+/// at the nodes of an integration grid with the corresponding weights
+std::vector<double> computeGaussHermiteMoments(unsigned int order, double ampl, double center,
+    double width, const std::vector<double>& nodes, const std::vector<double>& weights,
+    const double fvalues[])
+{
+    std::vector<double> hpoly(order+1);    // temp.storage for Hermite polynomials
+    std::vector<double> result(order+1);
+    for(size_t p=0; p<nodes.size(); p++) {
+        double
+        y = (nodes[p]-center) / width,
+        mult = M_SQRT2 / ampl * exp(-0.5*y*y) * weights[p] * fvalues[p];
+        hermiteArray(order, y, &hpoly[0]);
+        for(unsigned int m=0; m<=order; m++)
+            result[m] += mult * hpoly[m];
+    }
     return result;
 }
 
+/// compute the coefficients of GH expansion for a function f(x) that is a B-spline of degree N
+template<int N>
+inline std::vector<double> computeGaussHermiteMoments(const BsplineWrapper<N>& fnc,
+    unsigned int order, double ampl, double center, double width)
+{
+    std::vector<double> nodes, weights;
+    makeIntegrationGrid(fnc.bspl.xvalues(), NNODES_GL_MOMENTS, nodes, weights);
+    std::vector<double> fvalues(nodes.size());
+    for(size_t p=0; p<nodes.size(); p++)
+        fvalues[p] = fnc(nodes[p]);
+    return computeGaussHermiteMoments(order, ampl, center, width, nodes, weights, &fvalues[0]);
+}
+
 
 /** compute the coefs of GH expansion for an array of B-spline basis functions of degree N.
     A function f(x) represented as a B-spline expansion with an array of amplitudes A_k
@@ -249,37 +279,25 @@ public:
     for a general function, we use a fixed uniform grid in the scaled variable y (argument of the
     exponent in GH expansion), while for a B-spline we use a fixed grid in the unscaled variable x
     tailored to the B-spline grid, to improve the integration accuracy for a non-smooth f(x).
-    \tparam N is the degree of B-spline
+    The nodes of this grid, the square roots of integration weights and the function values
+    at these nodes are provided by the caller, so that they may be shared between many fits.
 */
-template<int N>
-class GaussHermiteFitter: public IFunctionNdimDeriv {
+class GaussHermiteFitter: public IFunctionNdimDerivSeparable {
     const unsigned int order;  ///< order of GH expansion
-    /// nodes and weights of integration grid for B-spline, and function values at these points
-    std::vector<double> nodes, weights, fvalues;
+    /// nodes and sqrt(weights) of integration grid for B-spline, and function values at these points
+    const std::vector<double> &nodes, &weights;
+    const double* fvalues;
 public:
-    GaussHermiteFitter(unsigned int _order, const BsplineWrapper<N>& fnc) :
-        order(_order)
-    {
-        const std::vector<double>& grid = fnc.bspl.xvalues();
-        const int NnodesGL = 3;  // integration points per one segment of B-spline grid
-        const double *glnodes = GLPOINTS[NnodesGL], *glweights = GLWEIGHTS[NnodesGL];
-        nodes.  resize((grid.size()-1) * NnodesGL);
-        weights.resize(nodes.size());
-        fvalues.resize(nodes.size());
-        for(size_t i=0; i<grid.size()-1; i++) {
-            double x1= grid[i], x2=grid[i+1];  // endpoints of the current grid segment
-            for(int k=0; k<NnodesGL; k++) {
-                nodes  [i*NnodesGL+k] = glnodes[k] * x2 + (1-glnodes[k]) * x1;
-                weights[i*NnodesGL+k] = sqrt(glweights[k] * (x2 - x1));
-                fvalues[i*NnodesGL+k] = fnc(nodes[i*NnodesGL+k]);
-            }
-        }
-    }
-    virtual void evalDeriv(const double vars[], double values[], double *derivs=NULL) const
+    GaussHermiteFitter(unsigned int _order,
+        const std::vector<double>& _nodes, const std::vector<double>& _weights, const double _fvalues[]) :
+        order(_order), nodes(_nodes), weights(_weights), fvalues(_fvalues) {}
+    virtual void evalDerivRange(const double vars[], unsigned int first, unsigned int count,
+        double values[], double *derivs=NULL) const
     {
         double ampl = vars[0], center = vars[1], width = vars[2];
         double* hpoly = static_cast<double*>(alloca((order+1) * sizeof(double)));
-        for(size_t p=0; p<nodes.size(); p++) {
+        for(size_t i=0; i<count; i++) {
+            size_t p = i + first;
             double y = (nodes[p] - center) / width;
             double sum = 1.;
             if(order>2) {
@@ -289,13 +307,13 @@ public:
             }
             double mult = 1./M_SQRT2/M_SQRTPI * exp(-0.5*y*y) * weights[p] * sum / width;
             if(values)
-                values[p] = weights[p] * fvalues[p] - mult * ampl;
+                values[i] = weights[p] * fvalues[p] - mult * ampl;
             if(derivs) {
-                derivs[p*(order+1)  ] = -mult;
-                derivs[p*(order+1)+1] = -mult * ampl / width * y;
-                derivs[p*(order+1)+2] =  mult * ampl / width * (1-y*y);
+                derivs[i*(order+1)  ] = -mult;
+                derivs[i*(order+1)+1] = -mult * ampl / width * y;
+                derivs[i*(order+1)+2] =  mult * ampl / width * (1-y*y);
                 for(unsigned int n=3; n<=order; n++)
-                    derivs[p*(order+1)+n] = -mult * ampl / sum * hpoly[n];
+                    derivs[i*(order+1)+n] = -mult * ampl / sum * hpoly[n];
             }
         }
     }
@@ -303,6 +321,147 @@ public:
     virtual unsigned int numValues() const { return nodes.size(); };
 };
 
+/// fit the amplitude, center and width of the base gaussian (params[0..2]),
+/// starting from the initial values provided in the same array
+inline void fitGaussHermiteParams(const std::vector<double>& nodes, const std::vector<double>& weights,
+    const double fvalues[], double params[])
+{
+    const unsigned int fitorder = 2;  // see the comment in the generic constructor below
+    nonlinearMultiFit(GaussHermiteFitter(fitorder, nodes, weights, fvalues),
+        /*init*/ params, /*accuracy*/ 1e-6, /*max.num.fnc.eval.*/ 100, /*output*/ params);
+}
+
+/** Precomputed quantities for constructing GH expansions of many B-spline functions
+    of degree N defined on the same grid: the integrals of each basis function times 1,x,x^2
+    (used to compute the initial guess for the parameters of the gaussian),
+    and the values of basis functions at the nodes of the two integration grids
+    (for fitting the parameters of the gaussian and for computing the GH moments).
+    The values of any function at these nodes are then obtained by a sparse matrix-vector product.
+*/
+template<int N>
+class GaussHermiteBatch {
+public:
+    const BsplineInterpolator1d<N> interp;
+    /// integrals of B_j(x) x^m dx, m=0..2 (3 rows, numBasisFnc columns)
+    Matrix<double> classicMoments;
+    /// nodes and sqrt(weights) of the integration grid used in the fit
+    std::vector<double> fitNodes, fitWeights;
+    /// nodes and weights of the integration grid used for computing GH moments
+    std::vector<double> momNodes, momWeights;
+    /// values of N+1 possibly nonzero basis functions at each node of the two grids,
+    /// and the indices of the leftmost of these functions
+    std::vector<double> fitBasis, momBasis;
+    std::vector<unsigned int> fitLeftInd, momLeftInd;
+
+    explicit GaussHermiteBatch(const std::vector<double>& grid) :
+        interp(grid), classicMoments(3, interp.numValues())
+    {
+        const unsigned int numBasisFnc = interp.numValues();
+        std::vector<double> unit(numBasisFnc);
+        for(unsigned int j=0; j<numBasisFnc; j++) {
+            unit[j] = 1.;
+            for(int m=0; m<=2; m++)
+                classicMoments(m, j) = interp.integrate(interp.xmin(), interp.xmax(), unit, m);
+            unit[j] = 0.;
+        }
+        makeIntegrationGrid(grid, NNODES_GL_FIT, fitNodes, fitWeights);
+        for(size_t p=0; p<fitWeights.size(); p++)
+            fitWeights[p] = sqrt(fitWeights[p]);
+        makeIntegrationGrid(grid, NNODES_GL_MOMENTS, momNodes, momWeights);
+        initBasis(fitNodes, fitLeftInd, fitBasis);
+        initBasis(momNodes, momLeftInd, momBasis);
+    }
+
+    /// compute the values of the B-spline function with the given amplitudes at the nodes of
+    /// either integration grid (fit or moments), specified by the arrays of indices and basis values
+    static void evalNodes(const std::vector<unsigned int>& leftInd, const std::vector<double>& basis,
+        const double ampl[], double fvalues[])
+    {
+        for(size_t p=0; p<leftInd.size(); p++) {
+            double val = 0;
+            for(int b=0; b<=N; b++)
+                val += basis[p*(N+1)+b] * ampl[leftInd[p]+b];
+            fvalues[p] = val;
+        }
+    }
+
+private:
+    void initBasis(const std::vector<double>& nodes,
+        std::vector<unsigned int>& leftInd, std::vector<double>& basis) const
+    {
+        leftInd.resize(nodes.size());
+        basis.resize(nodes.size() * (N+1));
+        for(size_t p=0; p<nodes.size(); p++)
+            leftInd[p] = interp.nonzeroComponents(nodes[p], /*derivOrder*/0, /*output*/ &basis[p*(N+1)]);
+    }
+};
+
+/// construct GH expansions for all rows of the matrix of amplitudes (templated version)
+template<int N>
+Matrix<double> fitGaussHermiteMany(const std::vector<double>& grid, unsigned int order,
+    const Matrix<double>& amplitudes)
+{
+    const GaussHermiteBatch<N> batch(grid);
+    const ptrdiff_t numFnc = amplitudes.rows();
+    const unsigned int numBasisFnc = batch.interp.numValues();
+    if(amplitudes.cols() != numBasisFnc)
+        throw std::invalid_argument(
+            "fitGaussHermiteMany: number of columns in the matrix of amplitudes does not match "
+            "the number of basis functions (" + utils::toString(numBasisFnc) + ")");
+    Matrix<double> result(numFnc, order+4);
+    std::string errorMsg;
+    utils::CtrlBreakHandler cbrk;  // catch Ctrl-Break keypress
+    bool stop = false;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        // thread-local temporary storage for the function values at the nodes of both grids
+        std::vector<double> fitValues(batch.fitNodes.size()), momValues(batch.momNodes.size());
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16)
+#endif
+        for(ptrdiff_t r=0; r<numFnc; r++) {
+            if(stop) continue;
+            if(cbrk.triggered()) stop = true;
+            try{
+                const double* ampl = &amplitudes(r, 0);
+                // initial guess for the parameters of the gaussian from the classical moments,
+                // computed in the same way as in computeClassicMoments<N>
+                double params[3];
+                for(int m=0; m<=2; m++) {
+                    params[m] = 0;
+                    for(unsigned int j=0; j<numBasisFnc; j++)
+                        params[m] += batch.classicMoments(m, j) * ampl[j];
+                }
+                if(params[0] != 0) {
+                    params[1] /= params[0];
+                    params[2] = sqrt(fmax(0, params[2] / params[0] - pow_2(params[1])));
+                }
+                batch.evalNodes(batch.fitLeftInd, batch.fitBasis, ampl, &fitValues[0]);
+                fitGaussHermiteParams(batch.fitNodes, batch.fitWeights, &fitValues[0], params);
+                batch.evalNodes(batch.momLeftInd, batch.momBasis, ampl, &momValues[0]);
+                std::vector<double> moments = computeGaussHermiteMoments(order,
+                    params[0], params[1], params[2], batch.momNodes, batch.momWeights, &momValues[0]);
+                double* dest = &result(r, 0);
+                dest[0] = params[0];
+                dest[1] = params[1];
+                dest[2] = params[2];
+                std::copy(moments.begin(), moments.end(), dest+3);
+            }
+            catch(std::exception& ex) {
+                errorMsg = ex.what();
+                stop = true;
+            }
+        }
+    }
+    if(cbrk.triggered())
+        throw std::runtime_error(cbrk.message());
+    if(!errorMsg.empty())
+        throw std::runtime_error("fitGaussHermiteMany: " + errorMsg);
+    return result;
+}
+
 }  // internal ns
 
 // constructor from a generic function
@@ -354,10 +513,14 @@ GaussHermiteExpansion::GaussHermiteExpansion(const BsplineWrapper<N>& fnc,
         throw std::invalid_argument("GaussHermiteExpansion: order must be >=2");
     if(!isFinite(ampl + center + width)) {
         std::vector<double> params = computeClassicMoments<N>(fnc);
-        const unsigned int fitorder = 2;
-        params.resize(fitorder+1);
-        nonlinearMultiFit(GaussHermiteFitter<N>(fitorder, fnc),
-            /*init*/ &params[0], /*accuracy*/ 1e-6, /*max.num.fnc.eval.*/ 100, /*output*/ &params[0]);
+        std::vector<double> nodes, weights;
+        makeIntegrationGrid(fnc.bspl.xvalues(), NNODES_GL_FIT, nodes, weights);
+        std::vector<double> fvalues(nodes.size());
+        for(size_t p=0; p<nodes.size(); p++) {
+            weights[p] = sqrt(weights[p]);
+            fvalues[p] = fnc(nodes[p]);
+        }
+        fitGaussHermiteParams(nodes, weights, &fvalues[0], &params[0]);
         Ampl   = params[0];
         Center = params[1];
         Width  = params[2];
@@ -423,4 +586,19 @@ Matrix<double> computeGaussHermiteMatrix(int N, const std::vector<double>& grid,
     }
 }
 
+Matrix<double> fitGaussHermiteMany(int N, const std::vector<double>& grid,
+    unsigned int order, const Matrix<double>& amplitudes)
+{
+    if(order<2)
+        throw std::invalid_argument("fitGaussHermiteMany: order must be >=2");
+    switch(N) {
+        case 0: return fitGaussHermiteMany<0>(grid, order, amplitudes);
+        case 1: return fitGaussHermiteMany<1>(grid, order, amplitudes);
+        case 2: return fitGaussHermiteMany<2>(grid, order, amplitudes);
+        case 3: return fitGaussHermiteMany<3>(grid, order, amplitudes);
+        default:
+            throw std::invalid_argument("fitGaussHermiteMany: wrong B-spline degree");
+    }
+}
+
 } // namespace
\ No newline at end of file
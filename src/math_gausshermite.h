@@ -65,5 +65,25 @@ public:
 Matrix<double> computeGaussHermiteMatrix(int N, const std::vector<double>& grid,
     unsigned int order, double ampl, double center, double width);
 
+/** Construct the best-fit Gauss-Hermite expansions for many functions represented by B-splines
+    defined on the same grid (e.g., the velocity distributions in all apertures and for all orbits).
+    The result is the same as constructing a GaussHermiteExpansion from a BsplineWrapper for each
+    function separately, but the setup common to all functions (integrals of basis functions used
+    in the initial guess for the parameters of the gaussian, and the values of basis functions
+    at the nodes of integration grids) is performed only once, and the loop over functions
+    is OpenMP-parallelized.
+    \param[in]  N      is the degree of B-spline (0 to 3);
+    \param[in]  grid   is the grid in velocity space defining the B-spline;
+    \param[in]  order  is the order M of GH expansion (should be >=2);
+    \param[in]  amplitudes  is the matrix of B-spline amplitudes, with one row per input function,
+    and the number of columns equal to the number of basis functions;
+    \return  a matrix with the same number of rows and order+4 columns, containing
+    the amplitude, center and width of the best-fit gaussian, followed by GH moments h_0..h_M.
+    \throw  std::invalid_argument if the size of input matrix is incorrect,
+    std::runtime_error if the fit failed for any input function.
+*/
+Matrix<double> fitGaussHermiteMany(int N, const std::vector<double>& grid,
+    unsigned int order, const Matrix<double>& amplitudes);
+
 
 }  // namespace
@@ -1,8 +1,10 @@
 #include "math_sphharm.h"
 #include "math_core.h"
 #include "math_specfunc.h"
+#include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <complex>
 #include <stdexcept>
 #ifndef _MSC_VER
 #include <alloca.h>
@@ -261,6 +263,126 @@ std::vector<int> getIndicesAzimuthal(int mmax, coord::SymmetryType sym)
     return result;
 }
 
+// ------ mixed-radix FFT used in the Fourier transform for large mmax ------ //
+
+namespace{
+
+typedef std::complex<double> cplx;
+
+/// minimum order of Fourier expansion for which the FFT may be used instead of direct summation
+const int FFT_MIN_MMAX = 8;
+
+/// the FFT is used only if the sum of prime factors of the transform length does not exceed
+/// this fraction of the length itself (otherwise the direct summation is cheaper)
+const double FFT_MAX_FACTOR_SUM = 0.4;
+
+/** Decompose the transform length n into prime factors, preferring 5 and 3 (there are
+    specialized butterflies for them); each stage is described by a pair (p, remaining length).
+    \return the sum of all prime factors, used to estimate the cost of the transform.
+*/
+int fftFactorize(int n, std::vector<int>& factors)
+{
+    factors.clear();
+    int sum = 0;
+    for(int p=5; n>1; ) {
+        while(n % p != 0) {
+            // sequence of trial divisors: 5, 3, 2, then odd numbers starting from 7
+            p = p==5 ? 3 : p==3 ? 2 : p==2 ? 7 : p+2;
+            if(p*p > n) p = n;  // n is prime
+        }
+        n /= p;
+        factors.push_back(p);
+        factors.push_back(n);
+        sum += p;
+    }
+    return sum;
+}
+
+/// radix-3 butterfly: combine three sub-transforms of length m into one of length 3m
+void fftButterfly3(cplx* out, size_t fstride, const cplx* tw, int m)
+{
+    const double sin3 = -0.86602540378443864676;  // Im(exp(-2 pi i/3))
+    for(int k=0; k<m; k++) {
+        cplx a = out[k], b = out[k+m] * tw[k*fstride], c = out[k+2*m] * tw[2*k*fstride];
+        cplx s = b + c, d = (b - c) * sin3, h = a - 0.5 * s;
+        out[k]     = a + s;
+        out[k+m]   = cplx(h.real() - d.imag(), h.imag() + d.real());
+        out[k+2*m] = cplx(h.real() + d.imag(), h.imag() - d.real());
+    }
+}
+
+/// radix-5 butterfly: combine five sub-transforms of length m into one of length 5m
+void fftButterfly5(cplx* out, size_t fstride, const cplx* tw, int m)
+{
+    const double
+    c1 = 0.30901699437494742410,  // cos(2 pi/5)
+    c2 =-0.80901699437494742410,  // cos(4 pi/5)
+    s1 = 0.95105651629515357212,  // sin(2 pi/5)
+    s2 = 0.58778525229247312917;  // sin(4 pi/5)
+    for(int k=0; k<m; k++) {
+        cplx x0 = out[k],
+        x1 = out[k+  m] * tw[  k*fstride],
+        x2 = out[k+2*m] * tw[2*k*fstride],
+        x3 = out[k+3*m] * tw[3*k*fstride],
+        x4 = out[k+4*m] * tw[4*k*fstride],
+        sa = x1 + x4, da = x1 - x4, sb = x2 + x3, db = x2 - x3,
+        ha = x0 + c1 * sa + c2 * sb,
+        hb = x0 + c2 * sa + c1 * sb,
+        ga = s1 * da + s2 * db,   // the corresponding output terms are multiplied by -i or +i
+        gb = s2 * da - s1 * db;
+        out[k]     = x0 + sa + sb;
+        out[k+  m] = cplx(ha.real() + ga.imag(), ha.imag() - ga.real());
+        out[k+4*m] = cplx(ha.real() - ga.imag(), ha.imag() + ga.real());
+        out[k+2*m] = cplx(hb.real() + gb.imag(), hb.imag() - gb.real());
+        out[k+3*m] = cplx(hb.real() - gb.imag(), hb.imag() + gb.real());
+    }
+}
+
+/// generic butterfly for an arbitrary radix p (cost O(p^2 m)); tmp is a temporary array of length p.
+/// The twiddle factor of the j-th sub-transform and the p-th root of unity are combined
+/// into a single factor exp(-2 pi i j (k+q*m) fstride / n) for the output element k+q*m
+void fftButterflyGeneric(cplx* out, size_t fstride, const cplx* tw, int m, int p, int n, cplx* tmp)
+{
+    for(int k=0; k<m; k++) {
+        for(int j=0; j<p; j++)
+            tmp[j] = out[k+j*m];
+        for(int q=0; q<p; q++) {
+            cplx sum = tmp[0];
+            const int step = (k + q*m) * fstride % n;
+            for(int j=1, ind=step; j<p; j++) {
+                sum += tmp[j] * tw[ind];
+                ind += step;
+                if(ind >= n) ind -= n;
+            }
+            out[k+q*m] = sum;
+        }
+    }
+}
+
+/** Recursive decimation-in-time step of the mixed-radix FFT of length n:
+    out[0..len-1] receives the transform of the subsequence in[0], in[fstride], ...,
+    where len is the product of the remaining factors.
+*/
+void fftWork(cplx* out, const cplx* in, size_t fstride,
+    const int* factors, const cplx* tw, int n, cplx* tmp)
+{
+    const int p = factors[0], m = factors[1];
+    if(m == 1) {
+        for(int j=0; j<p; j++)
+            out[j] = in[j*fstride];
+    } else {
+        for(int j=0; j<p; j++)
+            fftWork(out + j*m, in + j*fstride, fstride*p, factors+2, tw, n, tmp);
+    }
+    switch(p) {
+        case 3:  fftButterfly3(out, fstride, tw, m); break;
+        case 5:  fftButterfly5(out, fstride, tw, m); break;
+        default: fftButterflyGeneric(out, fstride, tw, m, p, n, tmp);
+    }
+}
+
+}  // internal namespace
+
 // ------ classes for performing many transformations with identical setup ------ //
 
 FourierTransformForward::FourierTransformForward(int _mmax, bool _useSine) :
@@ -268,6 +390,20 @@ FourierTransformForward::FourierTransformForward(int _mmax, bool _useSine) :
 {
     if(mmax<0)
         throw std::invalid_argument("FourierTransformForward: mmax must be non-negative");
+    // decide whether to use the FFT: the transform length 2*mmax+1 is odd,
+    // so the relevant factors are 3, 5 and (less efficiently) larger primes
+    const int nfft = 2*mmax+1;
+    if(mmax >= FFT_MIN_MMAX && fftFactorize(nfft, fftFactors) <= FFT_MAX_FACTOR_SUM * nfft) {
+        fftTwiddle.resize(2*nfft);
+        for(int k=0; k<nfft; k++) {
+            double s, c;
+            sincos(2*M_PI * k / nfft, s, c);
+            fftTwiddle[2*k]   = c;
+            fftTwiddle[2*k+1] =-s;
+        }
+        return;
+    }
+    fftFactors.clear();
     const int nphi = mmax+1;  // number of nodes in uniform grid in phi
     const int nfnc = useSine ? mmax*2+1 : mmax+1;  // number of trig functions for each phi-node
     trigFnc.resize(nphi * nfnc);
@@ -289,6 +425,29 @@ FourierTransformForward::FourierTransformForward(int _mmax, bool _useSine) :
 void FourierTransformForward::transform(const double values[], double coefs[], int stride) const
 {
     const int nfnc = useSine ? mmax*2+1 : mmax+1;  // number of trig functions for each phi-node
+    if(!fftFactors.empty()) {
+        // FFT of a real sequence of length n=2*mmax+1 (in the cosine-only case, the input
+        // values are extended symmetrically: f(2pi-phi) = f(phi)); temporary arrays on the stack
+        const int n = 2*mmax+1, maxp = *std::max_element(fftFactors.begin(), fftFactors.end());
+        cplx* in  = static_cast<cplx*>(alloca((2*n + maxp) * sizeof(cplx)));
+        cplx* out = in + n, *tmp = out + n;
+        for(int k=0; k<n; k++)
+            in[k] = values[(useSine || k<=mmax ? k : n-k) * stride];
+        fftWork(out, in, 1, &fftFactors[0], reinterpret_cast<const cplx*>(&fftTwiddle[0]), n, tmp);
+        // output: C_m = w Re(X_m), C_{-m} = -w Im(X_m), w = 2pi/n is the weight of each node
+        const double weight = 2*M_PI / n;
+        if(useSine) {
+            for(int m=0; m<=mmax; m++) {
+                coefs[mmax+m] = weight * out[m].real();
+                if(m>0)
+                    coefs[mmax-m] = -weight * out[m].imag();
+            }
+        } else {
+            for(int m=0; m<=mmax; m++)
+                coefs[m] = weight * out[m].real();
+        }
+        return;
+    }
     for(int mm=0; mm<nfnc; mm++) {  // index in the output array
         coefs[mm] = 0;
         int m = useSine ? mm-mmax : mm;  // if use sines, m runs from -mmax to mmax
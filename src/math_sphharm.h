@@ -190,6 +190,13 @@ std::vector<int> getIndicesAzimuthal(int mmax, coord::SymmetryType sym);
     output_coefs[mmax+m] = C_m,    0 <= m <= mmax  (cosine terms).
     If useSine is false, then the output contains only cosine terms:
     output_coefs[m] = C_m,  0 <= m <= mmax.
+    In both cases the transform is equivalent to a real discrete Fourier transform of length
+    2*mmax+1 (in the cosine-only case, the function is assumed to be symmetric in phi).
+    For small mmax it is carried out by direct summation with precomputed trigonometric
+    functions, at a cost O(mmax^2) per transform; for larger mmax, if the transform length
+    factorizes into sufficiently small primes, a self-contained mixed-radix FFT is used
+    instead (with specialized radix-3 and radix-5 butterflies), at a cost O(mmax log(mmax)).
+    The choice is made automatically in the constructor.
 */
 class FourierTransformForward {
 public:
@@ -217,6 +224,11 @@ private:
     const int mmax;               ///< order of expansion
     const bool useSine;           ///< whether to use sine terms (if no then only cosines)
     std::vector<double> trigFnc;  ///< values of sine/cosine at the nodes of angular grid
+    /// factorization of the transform length 2*mmax+1 for the FFT, stored as pairs (p, n/p)
+    /// for consecutive stages; empty if the direct summation is used instead
+    std::vector<int> fftFactors;
+    /// complex twiddle factors exp(-2 pi i k / (2*mmax+1)), stored as pairs (re, im)
+    std::vector<double> fftTwiddle;
 };
 
 /** Class for performing forward spherical-harmonic transformation.
@@ -237,8 +249,9 @@ private:
         \endcode
     Depending on the symmetry properties specified by the indexing scheme, not all elements
     of input_values need to be filled by the user; the transform routine takes this into account.
-    The implementation uses 'naive' summation approach without any FFT or fast Legendre transform
-    algorithms, has complexity O(lmax^2*mmax) and is only suitable for lmax <~ few dozen.
+    The Legendre transform in theta uses 'naive' summation, while the Fourier transform in phi
+    switches to FFT for large mmax (see `FourierTransformForward`); the overall complexity is
+    O(lmax^2*mmax), and the method is only suitable for lmax <~ few dozen.
     The transformation is 'lossless' (to machine precision) if the original function is
     band-limited, i.e. given by a sum of spherical harmonics with order up to lmax and mmax.
 */
@@ -1,5 +1,7 @@
 #include "orbit.h"
 #include "potential_base.h"
+#include "potential_composite.h"
+#include "potential_analytic.h"
 #include "utils.h"
 #include "math_core.h"
 #include <stdexcept>
@@ -10,6 +12,35 @@ namespace orbit{
 /// roundoff tolerance in the trajectory sampling routine
 static const double ROUNDOFF = 10*DBL_EPSILON;
 
+/// relative accuracy of converting the physical time to the fictitious time in the regularized mode
+static const double ACCURACY_FICTITIOUS_TIME = 1e-14;
+
+namespace{
+
+/// find a KeplerBinary potential among the components of a (possibly composite) potential
+const potential::KeplerBinary* findKeplerBinary(const potential::BasePotential& pot)
+{
+    const potential::KeplerBinary* bh = dynamic_cast<const potential::KeplerBinary*>(&pot);
+    if(bh)
+        return bh;
+    const potential::Composite* comp = dynamic_cast<const potential::Composite*>(&pot);
+    for(unsigned int i=0; comp && !bh && i<comp->size(); i++)
+        bh = findKeplerBinary(*comp->component(i));
+    return bh;
+}
+
+/// the difference between the physical time at the given value of fictitious time and the target time
+class FictitiousTimeFinder: public math::IFunctionNoDeriv {
+    const math::BaseOdeSolver& solver;
+    const double time;
+public:
+    FictitiousTimeFinder(const math::BaseOdeSolver& _solver, double _time) :
+        solver(_solver), time(_time) {}
+    virtual double value(const double s) const { return solver.getSol(s, 6) - time; }
+};
+
+}  // internal namespace
+
 //---- RuntimeTrajectory ----//
 
 bool RuntimeTrajectory::processTimestep(const double tbegin, const double tend)
@@ -48,14 +79,62 @@ bool RuntimeTrajectory::processTimestep(const double tbegin, const double tend)
 
 //---- OrbitIntegrator ----//
 
+BaseOrbitIntegrator::BaseOrbitIntegrator(const potential::BasePotential& _potential, double _Omega,
+    const OrbitIntParams& params)
+:
+    maxNumSteps(params.maxNumSteps),
+    regRadius(params.regularizationRadius > 0 ? params.regularizationRadius : 0),
+    regBinary(NULL),
+    sPrev(0),
+    solver(*this, params.accuracy),
+    potential(_potential), Omega(_Omega)
+{
+    if(regRadius>0) {
+        const potential::KeplerBinary* bh = findKeplerBinary(_potential);
+        if(bh && bh->getParams().sma > 0 && bh->getParams().q > 0)
+            regBinary = &bh->getParams();
+    }
+}
+
+double BaseOrbitIntegrator::timeTransform(const coord::PosCar& pos, double time) const
+{
+    double sum = 0;
+    if(regBinary) {
+        double bhX[2], bhY[2], bhVX[2], bhVY[2];
+        regBinary->keplerOrbit(time, bhX, bhY, bhVX, bhVY);
+        double mu1 = regBinary->q / (1 + regBinary->q);
+        sum = (1-mu1) / sqrt(pow_2(pos.x - bhX[0]) + pow_2(pos.y - bhY[0]) + pow_2(pos.z)) +
+                  mu1 / sqrt(pow_2(pos.x - bhX[1]) + pow_2(pos.y - bhY[1]) + pow_2(pos.z));
+    } else
+        sum = 1 / sqrt(pow_2(pos.x) + pow_2(pos.y) + pow_2(pos.z));
+    return 1 / (1 + regRadius * sum);  // tends to zero at the location of a black hole
+}
+
+double BaseOrbitIntegrator::fictitiousTime(double time) const
+{
+    double sCurr = solver.getTime();
+    double tCurr = solver.getSol(sCurr, 6), tPrev = solver.getSol(sPrev, 6);
+    if(time == tCurr)
+        return sCurr;
+    if(time == tPrev || sPrev == sCurr)
+        return sPrev;
+    // physical time is a monotonic function of s, which is given by the dense output of the solver
+    double s = math::findRoot(FictitiousTimeFinder(solver, time), sPrev, sCurr, ACCURACY_FICTITIOUS_TIME);
+    if(isFinite(s))
+        return s;
+    // the requested time is outside the last timestep - return the nearest endpoint
+    return fabs(time - tPrev) < fabs(time - tCurr) ? sPrev : sCurr;
+}
+
 coord::PosVelCar BaseOrbitIntegrator::run(const double totalTime)
 {
     if(totalTime==0 || !isFinite(totalTime))  // don't bother
-        return getSol(solver.getTime());
+        return getSol(getTime());
     size_t numSteps = 0;
     double sign = totalTime>0 ? +1 : -1;   // integrate forward (+1) or backward (-1) in time
-    double currentTime = solver.getTime(), endTime = totalTime + currentTime;
+    double currentTime = getTime(), endTime = totalTime + currentTime;
     while(true) {
+        sPrev = solver.getTime();
         if(!(solver.doStep(sign>0 ? +0.0 : -0.0) * sign > 0.)) {
             // signal of error
             FILTERMSG(utils::VL_WARNING,
@@ -63,7 +142,7 @@ coord::PosVelCar BaseOrbitIntegrator::run(const double totalTime)
             break;
         }
         double prevTime = currentTime;
-        currentTime = fmin(solver.getTime()*sign, endTime*sign) * sign;
+        currentTime = fmin(getTime()*sign, endTime*sign) * sign;
         bool contin = true;
         for(size_t i=0; contin && i<fncs.size(); i++)
             contin &= fncs[i]->processTimestep(prevTime, currentTime);
@@ -76,6 +155,9 @@ coord::PosVelCar BaseOrbitIntegrator::run(const double totalTime)
 template<typename CoordT>
 void OrbitIntegrator<CoordT>::init(const coord::PosVelCar& ic, double time)
 {
+    if(regRadius>0)
+        throw std::invalid_argument(
+            "OrbitIntegrator: regularization is only supported in cartesian coordinates");
     double posvel[6];
     coord::toPosVel<coord::Car, CoordT>(ic).unpack_to(posvel);
     solver.init(posvel, time);
@@ -86,9 +168,10 @@ void OrbitIntegrator<CoordT>::init(const coord::PosVelCar& ic, double time)
 template<>
 void OrbitIntegrator<coord::Car>::init(const coord::PosVelCar& ic, double time)
 {
-    double posvel[6];
+    double posvel[7];
+    double t = time==time ? time : getTime();
     if(Omega) {
-        double ca=1, sa=0, t = time==time ? time : solver.getTime();
+        double ca=1, sa=0;
         math::sincos(Omega * t, sa, ca);
         posvel[0] = ic.x *ca - ic.y *sa;
         posvel[1] = ic.y *ca + ic.x *sa;
@@ -99,15 +182,22 @@ void OrbitIntegrator<coord::Car>::init(const coord::PosVelCar& ic, double time)
     }
     else
         ic.unpack_to(posvel);
-    solver.init(posvel, time);
+    if(regRadius>0) {
+        // physical time is the last variable of the ODE system, and the integration variable
+        // (fictitious time) continues from its current value
+        posvel[6] = t;
+        solver.init(posvel);
+    } else
+        solver.init(posvel, time);
 }
 
 template<>
 coord::PosVelCar OrbitIntegrator<coord::Car>::getSolNative(double time) const
 {
     double data[6];
+    const double s = regRadius>0 ? fictitiousTime(time) : time;
     for(int i=0; i<6; i++)
-        data[i] = solver.getSol(time, i);
+        data[i] = solver.getSol(s, i);
     if(Omega) {
         // integration is performed in the inertial frame; transform output to the rotating frame
         double ca=1, sa=0;
@@ -166,8 +256,11 @@ coord::PosVelSph OrbitIntegrator<coord::Sph>::getSolNative(double time) const
 }
 
 template<>
-void OrbitIntegrator<coord::Car>::eval(const double time, const double x[], double dxdt[]) const
+void OrbitIntegrator<coord::Car>::eval(const double s, const double x[], double dxdt[]) const
 {
+    // in the regularized mode, the integration variable is the fictitious time,
+    // and the physical time is the last element of the ODE system
+    const double time = regRadius>0 ? x[6] : s;
     double ca=1, sa=0;
     if(Omega)
         math::sincos(Omega * time, sa, ca);
@@ -175,7 +268,8 @@ void OrbitIntegrator<coord::Car>::eval(const double time, const double x[], doub
     // and rotate the potential instead (same as adding the Rotating modifier to the potential,
     // but storing the resulting orbit in the rotating frame)
     coord::GradCar grad;
-    potential.eval(coord::PosCar(x[0]*ca + x[1]*sa, x[1]*ca - x[0]*sa, x[2]), NULL, &grad, NULL, time);
+    const coord::PosCar pos(x[0]*ca + x[1]*sa, x[1]*ca - x[0]*sa, x[2]);
+    potential.eval(pos, NULL, &grad, NULL, time);
     // time derivative of position
     dxdt[0] = x[3];
     dxdt[1] = x[4];
@@ -184,6 +278,13 @@ void OrbitIntegrator<coord::Car>::eval(const double time, const double x[], doub
     dxdt[3] = -grad.dx*ca + grad.dy*sa;
     dxdt[4] = -grad.dy*ca - grad.dx*sa;
     dxdt[5] = -grad.dz;
+    if(regRadius>0) {
+        // convert the derivatives w.r.t. physical time into derivatives w.r.t. fictitious time
+        double dtds = timeTransform(pos, time);
+        for(int i=0; i<6; i++)
+            dxdt[i] *= dtds;
+        dxdt[6] = dtds;
+    }
 }
 
 template<>
@@ -247,9 +348,9 @@ void OrbitIntegrator<coord::Sph>::eval(const double time, const double x[], doub
 }
 
 template<typename CoordT>
-double OrbitIntegrator<CoordT>::getAccuracyFactor(const double time, const double x[]) const
+double OrbitIntegrator<CoordT>::getAccuracyFactor(const double s, const double x[]) const
 {
-    double Epot = potential.value(coord::PosT<CoordT>(x[0], x[1], x[2]), time);
+    double Epot = potential.value(coord::PosT<CoordT>(x[0], x[1], x[2]), regRadius>0 ? x[6] : s);
     double Ekin = 0.5 * (x[3]*x[3] + x[4]*x[4] + x[5]*x[5]);
     return fmin(1, fabs(Epot + Ekin) / fmax(fabs(Epot), Ekin));
 }
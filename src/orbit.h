@@ -29,6 +29,19 @@
     about the z axis with some pattern speed Omega, while any number of attached runtime functions
     performing data collection tasks. Another convenience function `orbit::integrateTraj()`
     performs a simplified task of just recording the trajectory.
+
+    Orbits passing close to a central point mass (black hole) require very short timesteps
+    near pericenter, and the errors accumulate quickly. To alleviate this, the orbit integrator
+    in cartesian coordinates may use a time transformation (Sundman regularization), similar
+    to that used in the algorithmic regularization chain method of Mikkola&Tanikawa:
+    the ODE is solved in a fictitious time s, related to the physical time t by
+    dt/ds = 1 / (1 + r_reg * sum_b mu_b / r_b),  where r_b is the distance to b-th black hole,
+    mu_b is its fraction of the total black hole mass, and r_reg is the regularization radius.
+    Far from the black hole(s) the two variables coincide, and at distances smaller than r_reg
+    the timestep in physical time automatically shrinks in proportion to the distance,
+    while the timestep in s remains large. The physical time is evolved as an additional
+    variable in the ODE, and the dense output is converted back to physical time, so the
+    regularization is transparent to the runtime functions.
 */
 #pragma once
 #include "smart.h"
@@ -37,6 +50,11 @@
 #include <vector>
 #include <utility>
 
+namespace potential {
+// forward declaration (the full definition is in potential_analytic.h)
+struct KeplerBinaryParams;
+}
+
 /** Orbit integration routines and classes */
 namespace orbit {
 
@@ -115,10 +133,15 @@ struct OrbitIntParams {
     //math::OdeSolverType solver;///< choice of the ODE integrator (at the moment there is only one)
     double accuracy;             ///< accuracy parameter for the ODE integrator
     size_t maxNumSteps;          ///< upper limit on the number of steps of the ODE integrator
+    /// radius of the region around the central black hole(s) in which the time transformation
+    /// is switched on (0 means no regularization); the black hole is either a KeplerBinary
+    /// potential found among the components of the total potential, or otherwise a single
+    /// point mass at origin; only supported for the orbit integration in cartesian coordinates
+    double regularizationRadius;
 
     /// assign default values
-    OrbitIntParams(double _accuracy=1e-8, size_t _maxNumSteps=1e8) :
-        accuracy(_accuracy), maxNumSteps(_maxNumSteps) {}
+    OrbitIntParams(double _accuracy=1e-8, size_t _maxNumSteps=1e8, double _regularizationRadius=0) :
+        accuracy(_accuracy), maxNumSteps(_maxNumSteps), regularizationRadius(_regularizationRadius) {}
 };
 
 /** Interface for the orbit integrator in the given potential, optionally in a reference frame
@@ -159,7 +182,24 @@ class BaseOrbitIntegrator: public math::IOdeSystem {
     const size_t maxNumSteps;        ///< maximum allowed number of integration steps
     std::vector<PtrRuntimeFnc> fncs; ///< list of runtime functions attached to the given orbit
 protected:
+    /// radius of the regularization region (0 if the time transformation is not used);
+    /// must be initialized before the ODE solver, which queries the size of the ODE system
+    const double regRadius;
+    /// parameters of the binary black hole for the regularization
+    /// (NULL if there is a single black hole at origin)
+    const potential::KeplerBinaryParams* regBinary;
+    /// value of the integration variable at the beginning of the last completed timestep
+    /// (only used in the regularized mode, when it differs from the physical time)
+    double sPrev;
     math::OdeSolverDOP853 solver;    ///< the actual ODE integrator
+
+    /// compute the ratio dt/ds between physical and fictitious time at the given position
+    /// (in the non-rotating frame of the potential) and physical time
+    double timeTransform(const coord::PosCar& pos, double time) const;
+
+    /// find the value of the integration variable corresponding to the given physical time
+    /// within the last completed timestep (in the regularized mode)
+    double fictitiousTime(double time) const;
 public:
     /// gravitational potential in which the orbit is computed (accessible to runtime functions)
     const potential::BasePotential& potential;
@@ -169,12 +209,7 @@ public:
 
     /// initialize the object for the given potential, pattern speed, and other integration params
     BaseOrbitIntegrator(const potential::BasePotential& _potential, double _Omega,
-        const OrbitIntParams& params)
-    :
-        maxNumSteps(params.maxNumSteps),
-        solver(*this, params.accuracy),
-        potential(_potential), Omega(_Omega)
-    {}
+        const OrbitIntParams& params);
 
     virtual ~BaseOrbitIntegrator() {}
 
@@ -204,8 +239,12 @@ public:
     /// obtain the solution at the given time, which should lie within the just completed timestep
     virtual coord::PosVelCar getSol(double time) const = 0;
 
-    /// return the size of ODE system - three coordinates and three velocities
-    virtual unsigned int size() const { return 6; }
+    /// return the current (physical) time of the orbit
+    double getTime() const { return regRadius>0 ? solver.getSol(solver.getTime(), 6) : solver.getTime(); }
+
+    /// return the size of ODE system - three coordinates and three velocities,
+    /// plus the physical time in the regularized mode
+    virtual unsigned int size() const { return regRadius>0 ? 7 : 6; }
 };
 
 
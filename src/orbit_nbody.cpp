@@ -0,0 +1,286 @@
+#include "orbit_nbody.h"
+#include "math_specfunc.h"
+#include "utils.h"
+#include <cmath>
+#include <cfloat>
+#include <stdexcept>
+#include <algorithm>
+
+namespace orbit {
+
+namespace{
+
+/// relative accuracy in comparing the times of trajectory samples with the ends of timesteps
+static const double ROUNDOFF = 10*DBL_EPSILON;
+
+/// ODE system for the centers of massive bodies: 6 variables (position, velocity) per body
+class BodiesOdeSystem: public math::IOdeSystem {
+    const std::vector<MassiveBody>& bodies;
+public:
+    explicit BodiesOdeSystem(const std::vector<MassiveBody>& _bodies) : bodies(_bodies) {}
+
+    virtual void eval(const double t, const double x[], double dxdt[]) const
+    {
+        for(size_t j=0, nb=bodies.size(); j<nb; j++) {
+            dxdt[6*j+0] = x[6*j+3];
+            dxdt[6*j+1] = x[6*j+4];
+            dxdt[6*j+2] = x[6*j+5];
+            double acc[3] = {0, 0, 0};
+            for(size_t i=0; i<nb; i++) {
+                if(i==j)
+                    continue;
+                // position and velocity of j-th body relative to the center of i-th body
+                const coord::PosVelCar rel(
+                    x[6*j+0] - x[6*i+0], x[6*j+1] - x[6*i+1], x[6*j+2] - x[6*i+2],
+                    x[6*j+3] - x[6*i+3], x[6*j+4] - x[6*i+4], x[6*j+5] - x[6*i+5]);
+                coord::GradCar grad;
+                bodies[i].potential->eval(rel, NULL, &grad, NULL, t);
+                const coord::GradCar fric = dynamicalFriction(bodies[j], bodies[i], rel, t);
+                acc[0] += fric.dx - grad.dx;
+                acc[1] += fric.dy - grad.dy;
+                acc[2] += fric.dz - grad.dz;
+            }
+            dxdt[6*j+3] = acc[0];
+            dxdt[6*j+4] = acc[1];
+            dxdt[6*j+5] = acc[2];
+        }
+    }
+
+    virtual unsigned int size() const { return bodies.size() * 6; }
+};
+
+/// ODE system for a test particle moving in the potentials of massive bodies,
+/// whose positions are taken from the dense output of the ODE solver for the bodies
+/// (valid only within its last completed timestep)
+class ParticleOdeSystem: public math::IOdeSystem {
+    const std::vector<MassiveBody>& bodies;
+    const math::BaseOdeSolver& bodySolver;
+public:
+    ParticleOdeSystem(const std::vector<MassiveBody>& _bodies, const math::BaseOdeSolver& _bodySolver) :
+        bodies(_bodies), bodySolver(_bodySolver) {}
+
+    virtual void eval(const double t, const double x[], double dxdt[]) const
+    {
+        dxdt[0] = x[3];
+        dxdt[1] = x[4];
+        dxdt[2] = x[5];
+        dxdt[3] = dxdt[4] = dxdt[5] = 0;
+        for(size_t i=0, nb=bodies.size(); i<nb; i++) {
+            const coord::PosCar rel(
+                x[0] - bodySolver.getSol(t, 6*i+0),
+                x[1] - bodySolver.getSol(t, 6*i+1),
+                x[2] - bodySolver.getSol(t, 6*i+2));
+            coord::GradCar grad;
+            bodies[i].potential->eval(rel, NULL, &grad, NULL, t);
+            dxdt[3] -= grad.dx;
+            dxdt[4] -= grad.dy;
+            dxdt[5] -= grad.dz;
+        }
+    }
+
+    virtual unsigned int size() const { return 6; }
+};
+
+/// retrieve the interpolated position/velocity from the ODE solver, starting from the given index
+inline coord::PosVelCar getPosVel(const math::BaseOdeSolver& solver, double time, unsigned int offset)
+{
+    double data[6];
+    for(int d=0; d<6; d++)
+        data[d] = solver.getSol(time, offset + d);
+    return coord::PosVelCar(data);
+}
+
+/// store the trajectory samples at the nodes of a regular grid in time with the given step,
+/// starting from t0, which fall into the last completed timestep [tbegin:tend] of the ODE solver
+/// (same convention as in RuntimeTrajectory)
+void storeSamples(const math::BaseOdeSolver& solver, unsigned int offset,
+    double t0, double samplingInterval, double tbegin, double tend, Trajectory& trajectory)
+{
+    double sign = tend>=tbegin ? +1 : -1;
+    double dtroundoff = ROUNDOFF * fmax(fmax(fabs(tend), fabs(tbegin)), fabs(t0));
+    ptrdiff_t ibegin = static_cast<ptrdiff_t>((sign * (tbegin-t0) - dtroundoff) / samplingInterval);
+    ptrdiff_t iend   = static_cast<ptrdiff_t>((sign * (tend-t0)   + dtroundoff) / samplingInterval);
+    trajectory.resize(iend + 1);
+    for(ptrdiff_t iout=std::max<ptrdiff_t>(ibegin, 0); iout<=iend; iout++) {
+        double tout = sign * samplingInterval * iout + t0;
+        if(sign * tout >= sign * tbegin - dtroundoff && sign * tout <= sign * tend + dtroundoff)
+            trajectory[iout] = Trajectory::value_type(getPosVel(solver, tout, offset), tout);
+    }
+}
+
+/// store the current point at the end of the integration interval,
+/// either overwriting the only element of the trajectory or appending it
+inline void storeEndpoint(const math::BaseOdeSolver& solver, unsigned int offset,
+    double samplingInterval, double tend, Trajectory& trajectory)
+{
+    if(samplingInterval == INFINITY)
+        trajectory.resize(1);
+    else
+        trajectory.push_back(Trajectory::value_type());
+    trajectory.back() = Trajectory::value_type(getPosVel(solver, tend, offset), tend);
+}
+
+}  // internal namespace
+
+coord::GradCar dynamicalFriction(const MassiveBody& body, const MassiveBody& host,
+    const coord::PosVelCar& posvel, double time)
+{
+    coord::GradCar result;
+    result.dx = result.dy = result.dz = 0;
+    if(!(body.mass > 0) || !host.velDisp)
+        return result;
+    const double
+    r     = sqrt(pow_2(posvel.x) + pow_2(posvel.y) + pow_2(posvel.z)),
+    v     = sqrt(pow_2(posvel.vx) + pow_2(posvel.vy) + pow_2(posvel.vz)),
+    couLog= r > body.minImpactParameter ? log(r / body.minImpactParameter) : 0;
+    if(v == 0 || couLog == 0)
+        return result;
+    const double
+    rho   = host.potential->density(coord::PosCar(posvel), time),
+    sigma = host.velDisp->value(r),
+    X     = v / (M_SQRT2 * sigma),
+    // the fraction of host particles moving slower than the body (for a Maxwellian distribution)
+    frac  = sigma > 0 ? math::erf(X) - 2/M_SQRTPI * X * exp(-X*X) : 1,
+    mult  = -4*M_PI * rho * body.mass * couLog * frac / pow_3(v);
+    if(!isFinite(mult))
+        return result;
+    result.dx = mult * posvel.vx;
+    result.dy = mult * posvel.vy;
+    result.dz = mult * posvel.vz;
+    return result;
+}
+
+void integrateRestrictedNbody(
+    const std::vector<MassiveBody>& bodies,
+    const std::vector<coord::PosVelCar>& particles,
+    const double totalTime,
+    const double samplingInterval,
+    std::vector<Trajectory>& bodyTrajectories,
+    std::vector<Trajectory>& particleTrajectories,
+    const OrbitIntParams& params,
+    const double startTime)
+{
+    const size_t numBodies = bodies.size(), numParticles = particles.size();
+    if(numBodies == 0)
+        throw std::invalid_argument("integrateRestrictedNbody: no massive bodies provided");
+    for(size_t b=0; b<numBodies; b++) {
+        if(!bodies[b].potential)
+            throw std::invalid_argument("integrateRestrictedNbody: potential of body " +
+                utils::toString(b) + " is not provided");
+        if(bodies[b].mass > 0 && !(bodies[b].minImpactParameter > 0))
+            throw std::invalid_argument("integrateRestrictedNbody: minImpactParameter of body " +
+                utils::toString(b) + " must be positive");
+    }
+    if(!(samplingInterval >= 0) || !isFinite(totalTime))
+        throw std::invalid_argument("integrateRestrictedNbody: invalid time parameters");
+    bodyTrajectories.assign(numBodies, Trajectory());
+    particleTrajectories.assign(numParticles, Trajectory());
+
+    // the ODE solver for all bodies together
+    BodiesOdeSystem bodySystem(bodies);
+    math::OdeSolverDOP853 bodySolver(bodySystem, params.accuracy);
+    std::vector<double> state(numBodies * 6);
+    for(size_t b=0; b<numBodies; b++)
+        bodies[b].posvel.unpack_to(&state[b*6]);
+    bodySolver.init(&state[0], startTime);
+
+    // the ODE solvers for test particles share the same ODE system, which refers to the body solver
+    ParticleOdeSystem particleSystem(bodies, bodySolver);
+    std::vector<math::OdeSolverDOP853> particleSolvers(numParticles,
+        math::OdeSolverDOP853(particleSystem, params.accuracy));
+    std::vector<size_t> numSteps(numParticles, 0);  // 0 means that the particle is not yet initialized
+    std::vector<char> active(numParticles, true);   // whether the particle is still being integrated
+    if(samplingInterval == 0) {
+        // add the initial point, after which the trajectories are recorded at the end of each step
+        for(size_t b=0; b<numBodies; b++)
+            bodyTrajectories[b].push_back(Trajectory::value_type(bodies[b].posvel, startTime));
+        for(size_t p=0; p<numParticles; p++)
+            particleTrajectories[p].push_back(Trajectory::value_type(particles[p], startTime));
+    }
+
+    const double sign = totalTime>=0 ? +1 : -1;
+    const double endTime = startTime + totalTime;
+    double currentTime = startTime;
+    size_t numBodySteps = 0;
+    std::string errorMsg;
+    bool stop = false;
+    while(totalTime != 0 && sign * currentTime < sign * endTime) {
+        // advance the bodies by one timestep
+        if(!(bodySolver.doStep(sign>0 ? +0.0 : -0.0) * sign > 0) || ++numBodySteps > params.maxNumSteps) {
+            FILTERMSG(utils::VL_WARNING, "integrateRestrictedNbody",
+                "terminated at t=" + utils::toString(currentTime));
+            break;
+        }
+        const double prevTime = currentTime;
+        currentTime = fmin(bodySolver.getTime() * sign, endTime * sign) * sign;
+        for(size_t b=0; b<numBodies; b++) {
+            if(samplingInterval > 0 && samplingInterval < INFINITY)
+                storeSamples(bodySolver, b*6, startTime, samplingInterval,
+                    prevTime, currentTime, bodyTrajectories[b]);
+            else
+                storeEndpoint(bodySolver, b*6, samplingInterval, currentTime, bodyTrajectories[b]);
+        }
+
+        // advance all test particles to the end of this timestep in parallel,
+        // with the positions of bodies taken from the dense output of the body solver
+        const double dtroundoff = ROUNDOFF * fmax(fabs(currentTime), fabs(startTime));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for(ptrdiff_t p=0; p<(ptrdiff_t)numParticles; p++) {
+            if(stop || !active[p])
+                continue;
+            try{
+                math::OdeSolverDOP853& solver = particleSolvers[p];
+                if(numSteps[p] == 0) {
+                    double posvel[6];
+                    particles[p].unpack_to(posvel);
+                    solver.init(posvel, startTime);
+                }
+                while(sign * (currentTime - solver.getTime()) > dtroundoff) {
+                    const double tbegin = solver.getTime(), remaining = currentTime - tbegin;
+                    // the step is shortened to end exactly at the end of the body timestep,
+                    // where the dense output for the bodies is no longer valid
+                    const double dt = solver.getTimeStep() >= fabs(remaining) ? remaining :
+                        sign>0 ? +0.0 : -0.0;
+                    if(!(solver.doStep(dt) * sign > 0) || ++numSteps[p] > params.maxNumSteps) {
+                        active[p] = false;
+                        break;
+                    }
+                    const double tend = fmin(solver.getTime() * sign, currentTime * sign) * sign;
+                    if(samplingInterval > 0 && samplingInterval < INFINITY)
+                        storeSamples(solver, 0, startTime, samplingInterval,
+                            tbegin, tend, particleTrajectories[p]);
+                }
+                if(active[p] && (samplingInterval == 0 || samplingInterval == INFINITY))
+                    storeEndpoint(solver, 0, samplingInterval, currentTime, particleTrajectories[p]);
+            }
+            catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(integrateRestrictedNbody)
+#endif
+                errorMsg = e.what();
+                stop = true;
+            }
+        }
+        if(stop)
+            throw std::runtime_error("integrateRestrictedNbody: " + errorMsg);
+    }
+
+    // trajectories that have not been recorded at all (zero integration time or an error
+    // in the first timestep) contain only the initial point
+    for(size_t b=0; b<numBodies; b++)
+        if(bodyTrajectories[b].empty())
+            bodyTrajectories[b].push_back(Trajectory::value_type(bodies[b].posvel, startTime));
+    size_t numFailed = 0;
+    for(size_t p=0; p<numParticles; p++) {
+        numFailed += !active[p];
+        if(particleTrajectories[p].empty())
+            particleTrajectories[p].push_back(Trajectory::value_type(particles[p], startTime));
+    }
+    if(numFailed > 0)
+        FILTERMSG(utils::VL_WARNING, "integrateRestrictedNbody",
+            utils::toString(numFailed) + " test particles were terminated prematurely");
+}
+
+}  // namespace orbit
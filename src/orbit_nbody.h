@@ -0,0 +1,105 @@
+/** \file    orbit_nbody.h
+    \brief   Restricted N-body problem: massive extended bodies with dynamical friction
+             and test particles integrated in the same time loop
+    \author  Eugene Vasiliev
+    \date    2024
+
+    This module describes the joint evolution of a few massive extended bodies (e.g., the Milky Way
+    and its satellites) and an arbitrary number of massless test particles (stars, stream members).
+    Each body is represented by a rigid (non-deforming) potential, which moves together with its
+    center; the center is accelerated by the gradients of potentials of all other bodies evaluated
+    at its location, and optionally decelerated by dynamical friction against the other bodies,
+    computed from the Chandrasekhar formula.
+    Test particles move in the sum of the potentials of all bodies, each shifted to its current
+    position; they do not act on the bodies or on each other.
+
+    The integration is performed in the inertial frame. At each step of the ODE solver for
+    the bodies, all test particles are advanced (in parallel) with their own adaptive ODE solvers
+    to the end of this step, taking the positions of the bodies from the dense output of the body
+    solver; thus the motion of all objects is computed in a single pass, without storing and
+    interpolating the trajectories of the bodies (which is required when they are represented
+    by `Shifted` potentials and a `UniformAcceleration` frame in a separate orbit integration).
+    To obtain the orbits in the frame centered on one of the bodies, subtract its trajectory
+    (sampled at the same moments of time) from the trajectories of the particles.
+*/
+#pragma once
+#include "orbit.h"
+
+namespace orbit {
+
+/** Description of a massive extended body in the restricted N-body problem */
+struct MassiveBody {
+    /// potential of the body in its own reference frame (centered at origin);
+    /// may be time-dependent, in which case it is evaluated at the current time
+    potential::PtrPotential potential;
+
+    /// initial position and velocity of the center of the body in the inertial frame
+    coord::PosVelCar posvel;
+
+    /// mass of the body entering the dynamical friction formula; if zero,
+    /// the body does not experience dynamical friction from other bodies
+    double mass;
+
+    /// minimum impact parameter b_min in the Coulomb logarithm ln(r/b_min) of the friction force
+    /// acting on this body, where r is the distance to the center of the host body;
+    /// typically comparable to the size of the body (required if mass>0)
+    double minImpactParameter;
+
+    /// one-dimensional velocity dispersion of the material constituting this body, as a function
+    /// of distance from its center; if provided, the body exerts dynamical friction on other bodies
+    /// with nonzero mass, otherwise its friction on them is neglected
+    math::PtrFunction velDisp;
+
+    MassiveBody(const potential::PtrPotential& _potential, const coord::PosVelCar& _posvel,
+        double _mass=0, double _minImpactParameter=0,
+        const math::PtrFunction& _velDisp=math::PtrFunction()) :
+        potential(_potential), posvel(_posvel), mass(_mass),
+        minImpactParameter(_minImpactParameter), velDisp(_velDisp) {}
+};
+
+/** Compute the dynamical friction acceleration experienced by a body moving through
+    the material of another (host) body, using the Chandrasekhar formula with a Maxwellian
+    velocity distribution of the host:
+    \f$  a = -4\pi G^2 M \rho \ln\Lambda\, [\mathrm{erf}(X) - 2X/\sqrt{\pi} \exp(-X^2)]\,
+    \Delta v / |\Delta v|^3,  X = |\Delta v| / (\sqrt{2} \sigma)  \f$,
+    where the density rho and the velocity dispersion sigma of the host are evaluated at the
+    offset from its center, and lnLambda = max(0, ln(r / b_min)).
+    \param[in]  body  is the body experiencing friction (uses its mass and minImpactParameter).
+    \param[in]  host  is the body providing the background (uses its potential and velDisp).
+    \param[in]  posvel  is the position and velocity of the body relative to the host center.
+    \param[in]  time  is the time at which the density of the host is evaluated.
+    \return  the acceleration vector (zero if any of the two bodies does not participate
+    in dynamical friction, or the relative velocity is zero).
+*/
+coord::GradCar dynamicalFriction(const MassiveBody& body, const MassiveBody& host,
+    const coord::PosVelCar& posvel, double time=0);
+
+/** Integrate the orbits of massive bodies and test particles in the restricted N-body problem.
+    \param[in]  bodies  is the array of massive bodies with their initial conditions (at least one).
+    \param[in]  particles  is the array of initial conditions of test particles (may be empty).
+    \param[in]  totalTime  is the duration of integration (may be negative).
+    \param[in]  samplingInterval  determines how the trajectories are recorded:
+    INFINITY means only the final point, 0 means at the end of each timestep of the ODE solver
+    for the bodies (shared by all objects), any other positive value - at this regular interval.
+    \param[out] bodyTrajectories  will contain the trajectories of the centers of all bodies.
+    \param[out] particleTrajectories  will contain the trajectories of all test particles;
+    if a particle could not be integrated until the end (e.g. its number of steps exceeded
+    the limit), its trajectory is truncated at the last successfully completed timestep.
+    \param[in]  params  are the parameters of the orbit integrator (accuracy applies to all
+    ODE solvers, and the upper limit on the number of steps - to each body or particle separately;
+    regularization and time-parallel mode are not supported here and are ignored).
+    \param[in]  startTime  is the initial time.
+    \throw  std::invalid_argument if the input parameters are incorrect,
+    std::runtime_error if an error occurred during the integration of test particles.
+*/
+void integrateRestrictedNbody(
+    const std::vector<MassiveBody>& bodies,
+    const std::vector<coord::PosVelCar>& particles,
+    const double totalTime,
+    const double samplingInterval,
+    /*output*/ std::vector<Trajectory>& bodyTrajectories,
+    /*output*/ std::vector<Trajectory>& particleTrajectories,
+    const OrbitIntParams& params = OrbitIntParams(),
+    const double startTime = 0);
+
+}  // namespace orbit
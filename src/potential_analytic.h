@@ -177,6 +177,8 @@ public:
     virtual double totalMass() const { return params.mass; }
     virtual double enclosedMass(const double radius) const
     { return radius>=params.sma ? params.mass : 0; }
+    /// return the parameters of the binary
+    const KeplerBinaryParams& getParams() const { return params; }
 private:
     const KeplerBinaryParams params;   ///< parameters of the binary
     virtual void evalCar(const coord::PosCar &pos,
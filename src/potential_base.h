@@ -174,6 +174,30 @@ public:
     /** estimate the mass enclosed within a given radius from the radial component of force */
     virtual double enclosedMass(const double radius) const;
 
+    /** Vectorized evaluation of the potential and optionally its gradient for several points.
+        \param[in]  npoints - size of the input array;
+        \param[in]  pos - array of positions in the given coordinate system, with length npoints;
+        \param[out] potential - output array of length npoints filled with the potential values;
+        \param[out] deriv (optional) - if not NULL, an array of length npoints that will be
+                    filled with the gradients of potential;
+        \param[in]  time (optional, default 0) - time at which the potential is computed.
+        Derived classes with a high per-call overhead (e.g., user-defined functions in Python)
+        may override these methods to process all points in a single call.
+    */
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[]=NULL, /*input*/ double time=0) const
+    {
+        // default implementation just loops over input points one by one
+        for(size_t p=0; p<npoints; p++)
+            evalCar(pos[p], &potential[p], deriv ? &deriv[p] : NULL, NULL, time);
+    }
+    virtual void evalmanyPotentialCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double potential[], coord::GradCyl deriv[]=NULL, /*input*/ double time=0) const
+    {
+        for(size_t p=0; p<npoints; p++)
+            evalCyl(pos[p], &potential[p], deriv ? &deriv[p] : NULL, NULL, time);
+    }
+
 protected:
     /** evaluate potential and up to two its derivatives in cartesian coordinates;
         must be implemented in derived classes */
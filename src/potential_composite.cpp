@@ -1,6 +1,10 @@
 #include "potential_composite.h"
 #include "math_core.h"
 #include <stdexcept>
+#include <stdint.h>   // for uintptr_t
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #ifndef _MSC_VER
 #include <alloca.h>
 #else
@@ -384,6 +388,38 @@ void Composite::evalmanyDensitySph(const size_t npoints, const coord::PosSph pos
     }
 }
 
+void Composite::evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+    /*output*/ double potential[], coord::GradCar deriv[], /*input*/ double time) const
+{
+    components[0]->evalmanyPotentialCar(npoints, pos, potential, deriv, time);
+    ALLOC(npoints, double, tmppot)
+    std::vector<coord::GradCar> tmpgrad(deriv ? npoints : 0);
+    for(unsigned int i=1; i<components.size(); i++) {
+        components[i]->evalmanyPotentialCar(npoints, pos, tmppot, deriv ? &tmpgrad[0] : NULL, time);
+        for(size_t p=0; p<npoints; p++) {
+            potential[p] += tmppot[p];
+            if(deriv)
+                coord::combine(deriv[p], tmpgrad[p]);
+        }
+    }
+}
+
+void Composite::evalmanyPotentialCyl(const size_t npoints, const coord::PosCyl pos[],
+    /*output*/ double potential[], coord::GradCyl deriv[], /*input*/ double time) const
+{
+    components[0]->evalmanyPotentialCyl(npoints, pos, potential, deriv, time);
+    ALLOC(npoints, double, tmppot)
+    std::vector<coord::GradCyl> tmpgrad(deriv ? npoints : 0);
+    for(unsigned int i=1; i<components.size(); i++) {
+        components[i]->evalmanyPotentialCyl(npoints, pos, tmppot, deriv ? &tmpgrad[0] : NULL, time);
+        for(size_t p=0; p<npoints; p++) {
+            potential[p] += tmppot[p];
+            if(deriv)
+                coord::combine(deriv[p], tmpgrad[p]);
+        }
+    }
+}
+
 double Composite::totalMass() const
 {
     double sum = 0;
@@ -473,47 +509,92 @@ double Evolving::densityCar(const coord::PosCar &pos, double time) const
 
 //--------- Modifier classes --------//
 
+// common function for computing the offset of the center,
+// shared between Shifted<BaseDensity> and Shifted<BasePotential>
+inline void getOffset(const math::CubicSpline& centerx,
+    const math::CubicSpline& centery, const math::CubicSpline& centerz,
+    double time, double offset[3])
+{
+    offset[0] = centerx(time);
+    offset[1] = centery(time);
+    offset[2] = centerz(time);
+}
+
+coord::PosCar Shifted<BaseDensity>::shifted(const coord::PosCar &pos, double time) const
+{
+    double offset[3];
+    getOffset(centerx, centery, centerz, time, offset);
+    return coord::PosCar(pos.x - offset[0], pos.y - offset[1], pos.z - offset[2]);
+}
+
+coord::PosCar Shifted<BasePotential>::shifted(const coord::PosCar &pos, double time) const
+{
+    double offset[3];
+    getOffset(centerx, centery, centerz, time, offset);
+    return coord::PosCar(pos.x - offset[0], pos.y - offset[1], pos.z - offset[2]);
+}
+
 // common function for evaluating density in the given coordinate system,
 // shared between Shifted<BaseDensity> and Shifted<BasePotential>
 template<typename CoordT>
 inline void evalmanyShifted(const BaseDensity& dens,
-    const double centerx, const double centery, const double centerz,
+    const math::CubicSpline& centerx, const math::CubicSpline& centery, const math::CubicSpline& centerz,
     const size_t npoints, const coord::PosT<CoordT> pos[],
     /*output*/ double values[], /*input*/ double time)
 {
+    double offset[3];
+    getOffset(centerx, centery, centerz, time, offset);
     ALLOC(npoints, coord::PosCar, poscar)
     for(size_t i=0; i<npoints; i++) {
         poscar[i] = toPosCar(pos[i]);
-        poscar[i].x -= centerx;
-        poscar[i].y -= centery;
-        poscar[i].z -= centerz;
+        poscar[i].x -= offset[0];
+        poscar[i].y -= offset[1];
+        poscar[i].z -= offset[2];
     }
     dens.evalmanyDensityCar(npoints, poscar, values, time);
 }
 
 void Shifted<BaseDensity>::evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
     /*output*/ double values[], /*input*/ double time) const
-{ evalmanyShifted(*dens, centerx(time), centery(time), centerz(time), npoints, pos, values, time); }
+{ evalmanyShifted(*dens, centerx, centery, centerz, npoints, pos, values, time); }
 
 void Shifted<BaseDensity>::evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
     /*output*/ double values[], /*input*/ double time) const
-{ evalmanyShifted(*dens, centerx(time), centery(time), centerz(time), npoints, pos, values, time); }
+{ evalmanyShifted(*dens, centerx, centery, centerz, npoints, pos, values, time); }
 
 void Shifted<BaseDensity>::evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
     /*output*/ double values[], /*input*/ double time) const
-{ evalmanyShifted(*dens, centerx(time), centery(time), centerz(time), npoints, pos, values, time); }
+{ evalmanyShifted(*dens, centerx, centery, centerz, npoints, pos, values, time); }
 
 void Shifted<BasePotential>::evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
     /*output*/ double values[], /*input*/ double time) const
-{ evalmanyShifted(*pot, centerx(time), centery(time), centerz(time), npoints, pos, values, time); }
+{ evalmanyShifted(*pot, centerx, centery, centerz, npoints, pos, values, time); }
 
 void Shifted<BasePotential>::evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
     /*output*/ double values[], /*input*/ double time) const
-{ evalmanyShifted(*pot, centerx(time), centery(time), centerz(time), npoints, pos, values, time); }
+{ evalmanyShifted(*pot, centerx, centery, centerz, npoints, pos, values, time); }
 
 void Shifted<BasePotential>::evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
     /*output*/ double values[], /*input*/ double time) const
-{ evalmanyShifted(*pot, centerx(time), centery(time), centerz(time), npoints, pos, values, time); }
+{ evalmanyShifted(*pot, centerx, centery, centerz, npoints, pos, values, time); }
+
+void Shifted<BasePotential>::evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+    /*output*/ double potential[], coord::GradCar deriv[], /*input*/ double time) const
+{
+    // the offset is computed once for all points, and the gradient needs no transformation
+    double offset[3];
+    getOffset(centerx, centery, centerz, time, offset);
+    ALLOC(npoints, coord::PosCar, poscar)
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i=0; i<npoints; i++) {
+        poscar[i].x = pos[i].x - offset[0];
+        poscar[i].y = pos[i].y - offset[1];
+        poscar[i].z = pos[i].z - offset[2];
+    }
+    pot->evalmanyPotentialCar(npoints, poscar, potential, deriv, time);
+}
 
 
 // common function for evaluating density in the given coordinate system,
@@ -553,6 +634,18 @@ void Tilted<BasePotential>::evalmanyDensitySph(const size_t npoints, const coord
     /*output*/ double values[], /*input*/ double time) const
 { evalmanyTilted(*pot, orientation, npoints, pos, values, time); }
 
+void Tilted<BasePotential>::evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+    /*output*/ double potential[], coord::GradCar deriv[], /*input*/ double time) const
+{
+    ALLOC(npoints, coord::PosCar, poscar)
+    for(size_t i=0; i<npoints; i++)
+        poscar[i] = orientation.toRotated(pos[i]);
+    pot->evalmanyPotentialCar(npoints, poscar, potential, deriv, time);
+    if(deriv)
+        for(size_t i=0; i<npoints; i++)
+            deriv[i] = orientation.fromRotated(deriv[i]);
+}
+
 coord::SymmetryType Tilted<BaseDensity>::symmetry() const {
     coord::SymmetryType sym = dens->symmetry();
     return isUnknown(sym) || isSpherical(sym) ? sym :
@@ -566,10 +659,31 @@ coord::SymmetryType Tilted<BasePotential>::symmetry() const {
 }
 
 
+// common function for computing the rotation angle and its sine and cosine,
+// shared between Rotating<BaseDensity> and Rotating<BasePotential>
+inline double getRotationAngle(const math::CubicSpline& angle, double time, double* sa, double* ca)
+{
+    double phi = angle(time), s, c;
+    math::sincos(phi, s, c);
+    if(sa) *sa = s;
+    if(ca) *ca = c;
+    return phi;
+}
+
+double Rotating<BaseDensity>::rotationAngle(double time, double* sa, double* ca) const
+{
+    return getRotationAngle(angle, time, sa, ca);
+}
+
+double Rotating<BasePotential>::rotationAngle(double time, double* sa, double* ca) const
+{
+    return getRotationAngle(angle, time, sa, ca);
+}
+
 double Rotating<BaseDensity>::densityCar(const coord::PosCar &pos, double time) const
 {
     double sa, ca;
-    math::sincos(angle(time), sa, ca);
+    rotationAngle(time, &sa, &ca);
     return dens->density(coord::PosCar(pos.x * ca + pos.y * sa, pos.y * ca - pos.x * sa, pos.z), time);
 }
 
@@ -578,7 +692,7 @@ void Rotating<BaseDensity>::evalmanyDensityCar(const size_t npoints, const coord
 {
     ALLOC(npoints, coord::PosCar, poscar)
     double sa, ca;
-    math::sincos(angle(time), sa, ca);
+    rotationAngle(time, &sa, &ca);
     for(size_t i=0; i<npoints; i++)
         poscar[i] = coord::PosCar(pos[i].x * ca + pos[i].y * sa, pos[i].y * ca - pos[i].x * sa, pos[i].z);
     dens->evalmanyDensityCar(npoints, poscar, values, time);
@@ -588,7 +702,7 @@ void Rotating<BaseDensity>::evalmanyDensityCyl(const size_t npoints, const coord
     /*output*/ double values[], /*input*/ double time) const
 {
     ALLOC(npoints, coord::PosCyl, poscyl)
-    double ang = angle(time);
+    double ang = rotationAngle(time);
     for(size_t i=0; i<npoints; i++)
         poscyl[i] = coord::PosCyl(pos[i].R, pos[i].z, pos[i].phi - ang);
     dens->evalmanyDensityCyl(npoints, poscyl, values, time);
@@ -598,7 +712,7 @@ void Rotating<BaseDensity>::evalmanyDensitySph(const size_t npoints, const coord
     /*output*/ double values[], /*input*/ double time) const
 {
     ALLOC(npoints, coord::PosSph, possph)
-    double ang = angle(time);
+    double ang = rotationAngle(time);
     for(size_t i=0; i<npoints; i++)
         possph[i] = coord::PosSph(pos[i].r, pos[i].theta, pos[i].phi - ang);
     dens->evalmanyDensitySph(npoints, possph, values, time);
@@ -607,7 +721,7 @@ void Rotating<BaseDensity>::evalmanyDensitySph(const size_t npoints, const coord
 double Rotating<BasePotential>::densityCar(const coord::PosCar &pos, double time) const
 {
     double sa, ca;
-    math::sincos(angle(time), sa, ca);
+    rotationAngle(time, &sa, &ca);
     return pot->density(coord::PosCar(pos.x * ca + pos.y * sa, pos.y * ca - pos.x * sa, pos.z), time);
 }
 
@@ -616,7 +730,7 @@ void Rotating<BasePotential>::evalmanyDensityCar(const size_t npoints, const coo
 {
     ALLOC(npoints, coord::PosCar, poscar)
     double sa, ca;
-    math::sincos(angle(time), sa, ca);
+    rotationAngle(time, &sa, &ca);
     for(size_t i=0; i<npoints; i++)
         poscar[i] = coord::PosCar(pos[i].x * ca + pos[i].y * sa, pos[i].y * ca - pos[i].x * sa, pos[i].z);
     pot->evalmanyDensityCar(npoints, poscar, values, time);
@@ -626,7 +740,7 @@ void Rotating<BasePotential>::evalmanyDensityCyl(const size_t npoints, const coo
     /*output*/ double values[], /*input*/ double time) const
 {
     ALLOC(npoints, coord::PosCyl, poscyl)
-    double ang = angle(time);
+    double ang = rotationAngle(time);
     for(size_t i=0; i<npoints; i++)
         poscyl[i] = coord::PosCyl(pos[i].R, pos[i].z, pos[i].phi - ang);
     pot->evalmanyDensityCyl(npoints, poscyl, values, time);
@@ -636,7 +750,7 @@ void Rotating<BasePotential>::evalmanyDensitySph(const size_t npoints, const coo
     /*output*/ double values[], /*input*/ double time) const
 {
     ALLOC(npoints, coord::PosSph, possph)
-    double ang = angle(time);
+    double ang = rotationAngle(time);
     for(size_t i=0; i<npoints; i++)
         possph[i] = coord::PosSph(pos[i].r, pos[i].theta, pos[i].phi - ang);
     pot->evalmanyDensitySph(npoints, possph, values, time);
@@ -648,7 +762,7 @@ void Rotating<BasePotential>::evalCar(const coord::PosCar &pos,
     double sa, ca;
     coord::GradCar derivrot;
     coord::HessCar deriv2rot;
-    math::sincos(angle(time), sa, ca);
+    rotationAngle(time, &sa, &ca);
     pot->eval(coord::PosCar(pos.x * ca + pos.y * sa, pos.y * ca - pos.x * sa, pos.z),
         potential, deriv ? &derivrot : NULL, deriv2 ? &deriv2rot : NULL, time);
     if(deriv) {
@@ -669,13 +783,50 @@ void Rotating<BasePotential>::evalCar(const coord::PosCar &pos,
 void Rotating<BasePotential>::evalCyl(const coord::PosCyl &pos,
     double* potential, coord::GradCyl* deriv, coord::HessCyl* deriv2, double time) const
 {
-    pot->eval(coord::PosCyl(pos.R, pos.z, pos.phi - angle(time)), potential, deriv, deriv2, time);
+    pot->eval(coord::PosCyl(pos.R, pos.z, pos.phi - rotationAngle(time)), potential, deriv, deriv2, time);
 }
 
 void Rotating<BasePotential>::evalSph(const coord::PosSph &pos,
     double* potential, coord::GradSph* deriv, coord::HessSph* deriv2, double time) const
 {
-    pot->eval(coord::PosSph(pos.r, pos.theta, pos.phi - angle(time)), potential, deriv, deriv2, time);
+    pot->eval(coord::PosSph(pos.r, pos.theta, pos.phi - rotationAngle(time)), potential, deriv, deriv2, time);
+}
+
+void Rotating<BasePotential>::evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+    /*output*/ double potential[], coord::GradCar deriv[], /*input*/ double time) const
+{
+    ALLOC(npoints, coord::PosCar, poscar)
+    double sa, ca;
+    rotationAngle(time, &sa, &ca);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i=0; i<npoints; i++) {
+        poscar[i].x = pos[i].x * ca + pos[i].y * sa;
+        poscar[i].y = pos[i].y * ca - pos[i].x * sa;
+        poscar[i].z = pos[i].z;
+    }
+    pot->evalmanyPotentialCar(npoints, poscar, potential, deriv, time);
+    if(deriv) {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(size_t i=0; i<npoints; i++) {
+            double dx = deriv[i].dx, dy = deriv[i].dy;
+            deriv[i].dx = dx * ca - dy * sa;
+            deriv[i].dy = dy * ca + dx * sa;
+        }
+    }
+}
+
+void Rotating<BasePotential>::evalmanyPotentialCyl(const size_t npoints, const coord::PosCyl pos[],
+    /*output*/ double potential[], coord::GradCyl deriv[], /*input*/ double time) const
+{
+    ALLOC(npoints, coord::PosCyl, poscyl)
+    double ang = rotationAngle(time);
+    for(size_t i=0; i<npoints; i++)
+        poscyl[i] = coord::PosCyl(pos[i].R, pos[i].z, pos[i].phi - ang);
+    pot->evalmanyPotentialCyl(npoints, poscyl, potential, deriv, time);
 }
 
 coord::SymmetryType Rotating<BaseDensity>::symmetry() const {
@@ -826,4 +977,495 @@ void Scaled<BasePotential>::evalSph(const coord::PosSph &pos,
     }
 }
 
+
+AffineTransform::AffineTransform(const math::CubicSpline center[3],
+    const coord::Orientation* _orientation, const math::CubicSpline& _angle,
+    const math::CubicSpline& _ampl, const math::CubicSpline& _scale) :
+    centerx(center[0]), centery(center[1]), centerz(center[2]),
+    angle(_angle), ampl(_ampl), scale(_scale),
+    tilted(_orientation!=NULL),
+    orientation(_orientation ? *_orientation : coord::Orientation())
+{
+    if(centerx.empty() != centery.empty() || centerx.empty() != centerz.empty())
+        throw std::invalid_argument("AffineTransform: center must have all three components or none");
+    if(ampl.empty() != scale.empty())
+        throw std::invalid_argument("AffineTransform: amplitude and scale must be provided together");
+}
+
+void AffineTransform::getParams(double time, Params& params) const
+{
+    // rotation about the z axis by the angle phi (passive rotation)
+    double sa = 0, ca = 1;
+    if(!angle.empty())
+        math::sincos(angle(time), sa, ca);
+    // the combined matrix is (1/scale) * Rz * O, where O is the tilt matrix (or unity)
+    double s = scale.empty() ? 1 : 1 / scale(time), a = ampl.empty() ? 1 : ampl(time);
+    const double* O = orientation.mat;
+    for(int c=0; c<3; c++) {
+        params.mat[c]   = (ca * O[c] + sa * O[3+c]) * s;
+        params.mat[3+c] = (ca * O[3+c] - sa * O[c]) * s;
+        params.mat[6+c] = O[6+c] * s;
+    }
+    params.center[0] = centerx.empty() ? 0 : centerx(time);
+    params.center[1] = centery.empty() ? 0 : centery(time);
+    params.center[2] = centerz.empty() ? 0 : centerz(time);
+    params.potMult   = a * s;
+    params.densMult  = a * pow_3(s);
+}
+
+coord::SymmetryType AffineTransform::symmetry(coord::SymmetryType sym) const
+{
+    // apply the symmetry transformations of individual modifiers, from the innermost outwards
+    if(!angle.empty() && !(isUnknown(sym) || isZRotSymmetric(sym)))
+        sym = static_cast<coord::SymmetryType>(sym & coord::ST_BISYMMETRIC);
+    if(tilted && !(isUnknown(sym) || isSpherical(sym)))
+        sym = static_cast<coord::SymmetryType>(sym & coord::ST_REFLECTION);
+    if(hasShift())
+        sym = isUnknown(sym) ? coord::ST_UNKNOWN : coord::ST_NONE;
+    return sym;
+}
+
+std::string AffineTransform::name() const
+{
+    std::string result;
+    if(hasShift())
+        result += Shifted<BaseDensity>::myName() + " ";
+    if(tilted)
+        result += Tilted<BaseDensity>::myName() + " ";
+    if(!angle.empty())
+        result += Rotating<BaseDensity>::myName() + " ";
+    if(!scale.empty())
+        result += Scaled<BaseDensity>::myName() + " ";
+    return result;
+}
+
+namespace {
+/// convert the positions into the intrinsic coordinate system of the transformed object
+template<typename CoordT>
+inline void toIntrinsic(const AffineTransform::Params& tr,
+    const size_t npoints, const coord::PosT<CoordT> pos[], coord::PosCar poscar[])
+{
+    const double* M = tr.mat;
+    for(size_t i=0; i<npoints; i++) {
+        const coord::PosCar p = toPosCar(pos[i]);
+        const double x = p.x - tr.center[0], y = p.y - tr.center[1], z = p.z - tr.center[2];
+        poscar[i].x = M[0] * x + M[1] * y + M[2] * z;
+        poscar[i].y = M[3] * x + M[4] * y + M[5] * z;
+        poscar[i].z = M[6] * x + M[7] * y + M[8] * z;
+    }
+}
+
+/// specialization for cartesian input, which is written as a vectorizable loop
+template<>
+inline void toIntrinsic(const AffineTransform::Params& tr,
+    const size_t npoints, const coord::PosCar pos[], coord::PosCar poscar[])
+{
+    const double
+    M0 = tr.mat[0], M1 = tr.mat[1], M2 = tr.mat[2],
+    M3 = tr.mat[3], M4 = tr.mat[4], M5 = tr.mat[5],
+    M6 = tr.mat[6], M7 = tr.mat[7], M8 = tr.mat[8],
+    cx = tr.center[0], cy = tr.center[1], cz = tr.center[2];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i=0; i<npoints; i++) {
+        const double x = pos[i].x - cx, y = pos[i].y - cy, z = pos[i].z - cz;
+        poscar[i].x = M0 * x + M1 * y + M2 * z;
+        poscar[i].y = M3 * x + M4 * y + M5 * z;
+        poscar[i].z = M6 * x + M7 * y + M8 * z;
+    }
+}
+
+/// convert the gradient from the intrinsic coordinate system: g_ext = potMult * M^T g_int
+inline void fromIntrinsic(const AffineTransform::Params& tr, coord::GradCar& grad)
+{
+    const double* M = tr.mat;
+    const double gx = grad.dx, gy = grad.dy, gz = grad.dz, mult = tr.potMult;
+    grad.dx = (M[0] * gx + M[3] * gy + M[6] * gz) * mult;
+    grad.dy = (M[1] * gx + M[4] * gy + M[7] * gz) * mult;
+    grad.dz = (M[2] * gx + M[5] * gy + M[8] * gz) * mult;
+}
+
+/// convert the hessian from the intrinsic coordinate system: H_ext = potMult * M^T H_int M
+inline void fromIntrinsic(const AffineTransform::Params& tr, coord::HessCar& hess)
+{
+    const double* M = tr.mat;
+    const double H[9] = {
+        hess.dx2,  hess.dxdy, hess.dxdz,
+        hess.dxdy, hess.dy2,  hess.dydz,
+        hess.dxdz, hess.dydz, hess.dz2 };
+    double HM[9], R[9];  // HM = H_int M,  R = M^T HM
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            HM[i*3+j] = H[i*3] * M[j] + H[i*3+1] * M[3+j] + H[i*3+2] * M[6+j];
+    for(int i=0; i<3; i++)
+        for(int j=i; j<3; j++)
+            R[i*3+j] = (M[i] * HM[j] + M[3+i] * HM[3+j] + M[6+i] * HM[6+j]) * tr.potMult;
+    hess.dx2  = R[0];
+    hess.dxdy = R[1];
+    hess.dxdz = R[2];
+    hess.dy2  = R[4];
+    hess.dydz = R[5];
+    hess.dz2  = R[8];
+}
+
+template<typename CoordT>
+inline void evalmanyTransformed(const BaseDensity& dens, const AffineTransform& transform,
+    const size_t npoints, const coord::PosT<CoordT> pos[],
+    /*output*/ double values[], /*input*/ double time)
+{
+    AffineTransform::Params tr;
+    transform.getParams(time, tr);
+    ALLOC(npoints, coord::PosCar, poscar)
+    toIntrinsic(tr, npoints, pos, poscar);
+    dens.evalmanyDensityCar(npoints, poscar, values, time);
+    for(size_t i=0; i<npoints; i++)
+        values[i] *= tr.densMult;
+}
+}  // internal namespace
+
+double Transformed<BaseDensity>::enclosedMass(const double radius) const
+{
+    // without an offset, the remaining transformations preserve the spherical radius up to scaling
+    return transform.hasShift() ? BaseDensity::enclosedMass(radius) :
+        dens->enclosedMass(radius / transform.scale0()) * transform.amplitude0();
+}
+
+double Transformed<BaseDensity>::densityCar(const coord::PosCar &pos, double time) const
+{
+    AffineTransform::Params tr;
+    transform.getParams(time, tr);
+    coord::PosCar poscar;
+    toIntrinsic(tr, 1, &pos, &poscar);
+    return dens->density(poscar, time) * tr.densMult;
+}
+
+void Transformed<BaseDensity>::evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+    /*output*/ double values[], /*input*/ double time) const
+{
+    evalmanyTransformed(*dens, transform, npoints, pos, values, time);
+}
+
+void Transformed<BaseDensity>::evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
+    /*output*/ double values[], /*input*/ double time) const
+{
+    evalmanyTransformed(*dens, transform, npoints, pos, values, time);
+}
+
+void Transformed<BaseDensity>::evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
+    /*output*/ double values[], /*input*/ double time) const
+{
+    evalmanyTransformed(*dens, transform, npoints, pos, values, time);
+}
+
+double Transformed<BasePotential>::enclosedMass(const double radius) const
+{
+    return transform.hasShift() ? BasePotential::enclosedMass(radius) :
+        pot->enclosedMass(radius / transform.scale0()) * transform.amplitude0();
+}
+
+void Transformed<BasePotential>::evalCar(const coord::PosCar &pos,
+    double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const
+{
+    AffineTransform::Params tr;
+    transform.getParams(time, tr);
+    coord::PosCar poscar;
+    toIntrinsic(tr, 1, &pos, &poscar);
+    pot->eval(poscar, potential, deriv, deriv2, time);
+    if(potential)
+        *potential *= tr.potMult;
+    if(deriv)
+        fromIntrinsic(tr, *deriv);
+    if(deriv2)
+        fromIntrinsic(tr, *deriv2);
+}
+
+double Transformed<BasePotential>::densityCar(const coord::PosCar &pos, double time) const
+{
+    AffineTransform::Params tr;
+    transform.getParams(time, tr);
+    coord::PosCar poscar;
+    toIntrinsic(tr, 1, &pos, &poscar);
+    return pot->density(poscar, time) * tr.densMult;
+}
+
+void Transformed<BasePotential>::evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+    /*output*/ double values[], /*input*/ double time) const
+{
+    evalmanyTransformed(*pot, transform, npoints, pos, values, time);
+}
+
+void Transformed<BasePotential>::evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
+    /*output*/ double values[], /*input*/ double time) const
+{
+    evalmanyTransformed(*pot, transform, npoints, pos, values, time);
+}
+
+void Transformed<BasePotential>::evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
+    /*output*/ double values[], /*input*/ double time) const
+{
+    evalmanyTransformed(*pot, transform, npoints, pos, values, time);
+}
+
+void Transformed<BasePotential>::evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+    /*output*/ double potential[], coord::GradCar deriv[], /*input*/ double time) const
+{
+    AffineTransform::Params tr;
+    transform.getParams(time, tr);
+    ALLOC(npoints, coord::PosCar, poscar)
+    toIntrinsic(tr, npoints, pos, poscar);
+    pot->evalmanyPotentialCar(npoints, poscar, potential, deriv, time);
+    const double mult = tr.potMult;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i=0; i<npoints; i++)
+        potential[i] *= mult;
+    if(deriv)
+        for(size_t i=0; i<npoints; i++)
+            fromIntrinsic(tr, deriv[i]);
+}
+
+
+//--------- Memoized potential --------//
+
+namespace {
+/// one remembered result of potential evaluation in the given coordinate system
+template<typename CoordT> struct MemoEntry {
+    coord::PosT<CoordT> pos;
+    double time;
+    double value;
+    coord::GradT<CoordT> grad;
+    coord::HessT<CoordT> hess;
+    bool hasValue, hasGrad, hasHess;
+    size_t lastUsed;  ///< time stamp of the last access (0 means empty)
+};
+
+inline bool samePos(const coord::PosCar& a, const coord::PosCar& b)
+{ return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+inline bool samePos(const coord::PosCyl& a, const coord::PosCyl& b)
+{ return a.R == b.R && a.z == b.z && a.phi == b.phi; }
+
+inline bool samePos(const coord::PosSph& a, const coord::PosSph& b)
+{ return a.r == b.r && a.theta == b.theta && a.phi == b.phi; }
+}  // internal namespace
+
+/// size of the cache line: per-thread data that is frequently modified is placed into
+/// separate cache lines, to avoid the performance penalty of false sharing between threads
+static const size_t CACHE_LINE = 64;
+
+/// round up the pointer to the nearest cache line boundary
+template<typename T>
+inline T* alignToCacheLine(T* ptr)
+{
+    return reinterpret_cast<T*>(
+        (reinterpret_cast<uintptr_t>(ptr) + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+}
+
+/// locks guarding the per-thread tables of Memoized against simultaneous use
+/// by several threads with the same OpenMP thread index
+class CacheLocks {
+public:
+    explicit CacheLocks(size_t size)
+#ifdef _OPENMP
+        : storage(size+1), locks(alignToCacheLine(&storage[0])), numLocks(size)
+    {
+        for(size_t i=0; i<numLocks; i++)
+            omp_init_nest_lock(&locks[i].lock);
+    }
+    ~CacheLocks()
+    {
+        for(size_t i=0; i<numLocks; i++)
+            omp_destroy_nest_lock(&locks[i].lock);
+    }
+#else
+    { (void)size; }
+#endif
+
+    /// find the table of the current thread and lock it, or return -1 if it cannot be used:
+    /// in a parallel region nested inside an active one (whether the inner region is active
+    /// or not), if the table is used by another thread with the same index, or if this thread
+    /// already holds it (recursive call); a team of one thread is inactive, but its index is
+    /// still unique, so the cache is used unless it has a multi-threaded ancestor
+    int acquire()
+    {
+#ifdef _OPENMP
+        if(omp_get_level() > 1 && omp_get_active_level() > 0)
+            return -1;
+        int index = omp_get_thread_num();
+        if(index >= (int)numLocks)
+            return -1;
+        int count = omp_test_nest_lock(&locks[index].lock);
+        if(count == 1)
+            return index;
+        if(count > 1)
+            omp_unset_nest_lock(&locks[index].lock);
+        return -1;
+#else
+        return 0;
+#endif
+    }
+
+    /// release the table obtained by acquire()
+    void release(int index)
+    {
+#ifdef _OPENMP
+        omp_unset_nest_lock(&locks[index].lock);
+#else
+        (void)index;
+#endif
+    }
+
+private:
+#ifdef _OPENMP
+    /// each lock occupies a separate cache line, since it is modified at every acquire/release
+    union PaddedLock { omp_nest_lock_t lock; char padding[CACHE_LINE]; };
+    std::vector<PaddedLock> storage;  ///< storage with one spare element for the alignment
+    PaddedLock* locks;                ///< first lock in the storage aligned to the cache line
+    size_t numLocks;                  ///< number of usable locks
+#endif
+    CacheLocks(const CacheLocks&);
+    CacheLocks& operator=(const CacheLocks&);
+};
+
+namespace {
+/// locks the table of the current thread for the lifetime of this object
+class CacheSlotGuard {
+    CacheLocks& locks;
+public:
+    const int index;  ///< index of the table, or -1 if the cache cannot be used
+    explicit CacheSlotGuard(CacheLocks& _locks) : locks(_locks), index(locks.acquire()) {}
+    ~CacheSlotGuard() { if(index >= 0) locks.release(index); }
+};
+}  // internal namespace
+
+/// per-thread table of recent results in all three coordinate systems, and hit-rate counters
+class MemoTable {
+public:
+    std::vector< MemoEntry<coord::Car> > entriesCar;
+    std::vector< MemoEntry<coord::Cyl> > entriesCyl;
+    std::vector< MemoEntry<coord::Sph> > entriesSph;
+    size_t clock, numCalls, numHits;
+    /// the counters above are modified at every call, so the tables of different threads
+    /// (allocated one after another) are separated by this padding to avoid false sharing
+    char padding[CACHE_LINE];
+
+    explicit MemoTable(unsigned int capacity) :
+        entriesCar(capacity), entriesCyl(capacity), entriesSph(capacity),
+        clock(0), numCalls(0), numHits(0)
+    {
+        for(unsigned int i=0; i<capacity; i++)
+            entriesCar[i].lastUsed = entriesCyl[i].lastUsed = entriesSph[i].lastUsed = 0;
+    }
+};
+
+namespace {
+/// common implementation of Memoized::eval in any coordinate system
+template<typename CoordT>
+inline void evalMemoized(const BasePotential& pot, MemoTable* table,
+    std::vector< MemoEntry<CoordT> > MemoTable::* entriesMember, const coord::PosT<CoordT>& pos,
+    double* value, coord::GradT<CoordT>* deriv, coord::HessT<CoordT>* deriv2, double time)
+{
+    if(!table) {  // cache not available in this context
+        pot.eval(pos, value, deriv, deriv2, time);
+        return;
+    }
+    std::vector< MemoEntry<CoordT> >& entries = table->*entriesMember;
+    table->numCalls++;
+    table->clock++;
+    // linear search for the same point, keeping track of the least recently used entry
+    size_t index = 0;
+    bool found = false;
+    for(size_t i=0; i<entries.size(); i++) {
+        if(entries[i].lastUsed != 0 && entries[i].time == time && samePos(entries[i].pos, pos)) {
+            index = i;
+            found = true;
+            break;
+        }
+        if(entries[i].lastUsed < entries[index].lastUsed)
+            index = i;
+    }
+    MemoEntry<CoordT>& entry = entries[index];
+    if(found && (!value || entry.hasValue) && (!deriv || entry.hasGrad) && (!deriv2 || entry.hasHess)) {
+        table->numHits++;
+    } else {
+        // compute the requested quantities, and if the point was already present,
+        // merge them with the previously stored ones
+        if(!found) {
+            entry.lastUsed = 0;  // keep the entry invalid until the evaluation succeeds
+            entry.pos  = pos;
+            entry.time = time;
+            entry.hasValue = entry.hasGrad = entry.hasHess = false;
+        }
+        pot.eval(pos, value ? &entry.value : NULL, deriv ? &entry.grad : NULL,
+            deriv2 ? &entry.hess : NULL, time);
+        entry.hasValue |= value  != NULL;
+        entry.hasGrad  |= deriv  != NULL;
+        entry.hasHess  |= deriv2 != NULL;
+    }
+    entry.lastUsed = table->clock;
+    if(value)
+        *value = entry.value;
+    if(deriv)
+        *deriv = entry.grad;
+    if(deriv2)
+        *deriv2 = entry.hess;
+}
+}  // internal namespace
+
+Memoized::Memoized(const PtrPotential& _pot, unsigned int capacity) :
+    pot(_pot)
+{
+    if(capacity == 0)
+        throw std::invalid_argument("Memoized: capacity must be positive");
+#ifdef _OPENMP
+    tables.resize(std::max(omp_get_max_threads(), 1));
+#else
+    tables.resize(1);
+#endif
+    for(size_t i=0; i<tables.size(); i++)
+        tables[i].reset(new MemoTable(capacity));
+    locks.reset(new CacheLocks(tables.size()));
+}
+
+void Memoized::evalCar(const coord::PosCar &pos,
+    double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const
+{
+    CacheSlotGuard guard(*locks);
+    MemoTable* table = guard.index >= 0 ? tables[guard.index].get() : NULL;
+    evalMemoized(*pot, table, &MemoTable::entriesCar, pos, potential, deriv, deriv2, time);
+}
+
+void Memoized::evalCyl(const coord::PosCyl &pos,
+    double* potential, coord::GradCyl* deriv, coord::HessCyl* deriv2, double time) const
+{
+    CacheSlotGuard guard(*locks);
+    MemoTable* table = guard.index >= 0 ? tables[guard.index].get() : NULL;
+    evalMemoized(*pot, table, &MemoTable::entriesCyl, pos, potential, deriv, deriv2, time);
+}
+
+void Memoized::evalSph(const coord::PosSph &pos,
+    double* potential, coord::GradSph* deriv, coord::HessSph* deriv2, double time) const
+{
+    CacheSlotGuard guard(*locks);
+    MemoTable* table = guard.index >= 0 ? tables[guard.index].get() : NULL;
+    evalMemoized(*pot, table, &MemoTable::entriesSph, pos, potential, deriv, deriv2, time);
+}
+
+void Memoized::statistics(size_t& numCalls, size_t& numHits) const
+{
+    numCalls = numHits = 0;
+    for(size_t i=0; i<tables.size(); i++) {
+        numCalls += tables[i]->numCalls;
+        numHits  += tables[i]->numHits;
+    }
+}
+
+void Memoized::resetStatistics() const
+{
+    for(size_t i=0; i<tables.size(); i++)
+        tables[i]->numCalls = tables[i]->numHits = 0;
+}
+
 } // namespace potential
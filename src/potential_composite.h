@@ -1,7 +1,7 @@
 /** \file    potential_composite.h
     \brief   Composite density and potential classes and various modifiers
     \author  Eugene Vasiliev
-    \date    2014-2022
+    \date    2014-2024
 */
 #pragma once
 #include "potential_base.h"
@@ -89,6 +89,10 @@ private:
         /*output*/ double values[], /*input*/ double time=0) const;
     virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
         /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[]=NULL, /*input*/ double time=0) const;
+    virtual void evalmanyPotentialCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double potential[], coord::GradCyl deriv[]=NULL, /*input*/ double time=0) const;
 };
 
 
@@ -154,12 +158,66 @@ private:
 };
 
 
-// four kinds of modifiers, which can be applied to density or potential classes
+// four kinds of modifiers, which can be applied to density or potential classes,
+// and their combination into a single transformation
 // (unfortunately, some code duplication is inevitable here)
 template<class BaseDensityOrPotential> class Shifted;
 template<class BaseDensityOrPotential> class Tilted;
 template<class BaseDensityOrPotential> class Rotating;
 template<class BaseDensityOrPotential> class Scaled;
+template<class BaseDensityOrPotential> class Transformed;
+
+
+/** A single time-dependent affine transformation equivalent to a stack of modifiers
+    Shifted(Tilted(Rotating(Scaled(...)))), some of which may be absent (this is the order in which
+    they are applied by the factory routines).
+    The intrinsic coordinates are  x_int = M(t) (x - c(t)),  where c is the offset of the center,
+    and the matrix M is the product of the inverse scale factor, the rotation about the z axis
+    and the tilt of the principal axes; the potential and the density of the original object
+    are multiplied by amplitude/scale and amplitude/scale^3, respectively.
+    This class is shared between Transformed<BaseDensity> and Transformed<BasePotential>.
+*/
+class AffineTransform {
+public:
+    /// parameters of the transformation at a particular moment of time
+    struct Params {
+        double mat[9];    ///< matrix M (row-major)
+        double center[3]; ///< offset of the center c
+        double potMult;   ///< multiplicative factor for the potential: amplitude / scale
+        double densMult;  ///< multiplicative factor for the density: amplitude / scale^3
+    };
+
+    /** construct the transformation from its individual components.
+        \param[in]  center  is the array of three splines for the time-dependent offset
+        (empty splines if there is no offset);
+        \param[in]  orientation  is the pointer to the tilt of the principal axes (NULL if none);
+        \param[in]  angle  is the time-dependent rotation angle about the z axis (empty if none);
+        \param[in]  ampl, scale  are the time-dependent amplitude and length scale (empty if none).
+    */
+    AffineTransform(const math::CubicSpline center[3], const coord::Orientation* orientation,
+        const math::CubicSpline& angle, const math::CubicSpline& ampl, const math::CubicSpline& scale);
+
+    /// compute the parameters at the given time
+    void getParams(double time, Params& params) const;
+
+    /// symmetry of the transformed object, given the symmetry of the original one
+    coord::SymmetryType symmetry(coord::SymmetryType sym) const;
+
+    /// names of the combined modifiers, from the outermost to the innermost
+    std::string name() const;
+
+    /// whether the transformation includes an offset of the center
+    bool hasShift() const { return !centerx.empty(); }
+
+    /// amplitude and length scale factors at t=0 (used for the total and enclosed mass)
+    double amplitude0() const { return ampl.empty() ? 1 : ampl(0); }
+    double scale0() const { return scale.empty() ? 1 : scale(0); }
+
+private:
+    const math::CubicSpline centerx, centery, centerz, angle, ampl, scale;
+    const bool tilted;                    ///< whether the orientation is used
+    const coord::Orientation orientation; ///< tilt of the principal axes
+};
 
 
 /** Modifier of any density profile adding an arbitrary, possibly time-dependent offset */
@@ -188,10 +246,11 @@ private:
     /// time-dependent offsets of the potential center from origin
     const math::CubicSpline centerx, centery, centerz;
 
-    virtual double densityCar(const coord::PosCar &pos, double time) const {
-        return dens->density(
-            coord::PosCar(pos.x-centerx(time), pos.y-centery(time), pos.z-centerz(time)), time);
-    }
+    /// return the position relative to the center at the given time
+    coord::PosCar shifted(const coord::PosCar &pos, double time) const;
+
+    virtual double densityCar(const coord::PosCar &pos, double time) const
+    { return dens->density(shifted(pos, time), time); }
 
     virtual double densityCyl(const coord::PosCyl &pos, double time) const
     { return densityCar(toPosCar(pos), time); }
@@ -232,17 +291,15 @@ private:
     /// time-dependent offsets of the potential center from origin
     const math::CubicSpline centerx, centery, centerz;
 
+    /// return the position relative to the center at the given time
+    coord::PosCar shifted(const coord::PosCar &pos, double time) const;
+
     virtual void evalCar(const coord::PosCar &pos,
         double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const
-    {
-        pot->eval(coord::PosCar(pos.x-centerx(time), pos.y-centery(time), pos.z-centerz(time)),
-            potential, deriv, deriv2, time);
-    }
+    { pot->eval(shifted(pos, time), potential, deriv, deriv2, time); }
 
-    virtual double densityCar(const coord::PosCar &pos, double time) const {
-        return pot->density(
-            coord::PosCar(pos.x-centerx(time), pos.y-centery(time), pos.z-centerz(time)), time);
-    }
+    virtual double densityCar(const coord::PosCar &pos, double time) const
+    { return pot->density(shifted(pos, time), time); }
 
     virtual double densityCyl(const coord::PosCyl &pos, double time) const
     { return densityCar(toPosCar(pos), time); }
@@ -256,6 +313,8 @@ private:
         /*output*/ double values[], /*input*/ double time=0) const;
     virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
         /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[]=NULL, /*input*/ double time=0) const;
 };
 
 
@@ -342,6 +401,8 @@ private:
         /*output*/ double values[], /*input*/ double time=0) const;
     virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
         /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[]=NULL, /*input*/ double time=0) const;
 };
 
 
@@ -368,11 +429,14 @@ private:
     /// time-dependent rotation angle
     const math::CubicSpline angle;
 
+    /// return the rotation angle at the given time, and optionally its sine and cosine
+    double rotationAngle(double time, double* sa=NULL, double* ca=NULL) const;
+
     virtual double densityCar(const coord::PosCar &pos, double time) const;
     virtual double densityCyl(const coord::PosCyl &pos, double time) const
-    { return dens->density(coord::PosCyl(pos.R, pos.z, pos.phi - angle(time)), time); }
+    { return dens->density(coord::PosCyl(pos.R, pos.z, pos.phi - rotationAngle(time)), time); }
     virtual double densitySph(const coord::PosSph &pos, double time) const
-    { return dens->density(coord::PosSph(pos.r, pos.theta, pos.phi - angle(time)), time); }
+    { return dens->density(coord::PosSph(pos.r, pos.theta, pos.phi - rotationAngle(time)), time); }
 
     virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
         /*output*/ double values[], /*input*/ double time=0) const;
@@ -404,6 +468,9 @@ private:
     /// time-dependent rotation angle
     const math::CubicSpline angle;
 
+    /// return the rotation angle at the given time, and optionally its sine and cosine
+    double rotationAngle(double time, double* sa=NULL, double* ca=NULL) const;
+
     virtual void evalCar(const coord::PosCar &pos,
         double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const;
     virtual void evalCyl(const coord::PosCyl &pos,
@@ -413,9 +480,9 @@ private:
 
     virtual double densityCar(const coord::PosCar &pos, double time) const;
     virtual double densityCyl(const coord::PosCyl &pos, double time) const
-    { return pot->density(coord::PosCyl(pos.R, pos.z, pos.phi - angle(time)), time); }
+    { return pot->density(coord::PosCyl(pos.R, pos.z, pos.phi - rotationAngle(time)), time); }
     virtual double densitySph(const coord::PosSph &pos, double time) const
-    { return pot->density(coord::PosSph(pos.r, pos.theta, pos.phi - angle(time)), time); }
+    { return pot->density(coord::PosSph(pos.r, pos.theta, pos.phi - rotationAngle(time)), time); }
 
     virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
         /*output*/ double values[], /*input*/ double time=0) const;
@@ -423,6 +490,10 @@ private:
         /*output*/ double values[], /*input*/ double time=0) const;
     virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
         /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[]=NULL, /*input*/ double time=0) const;
+    virtual void evalmanyPotentialCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double potential[], coord::GradCyl deriv[]=NULL, /*input*/ double time=0) const;
 };
 
 
@@ -540,4 +611,173 @@ private:
         /*output*/ double values[], /*input*/ double time=0) const;
 };
 
+
+/** Modifier of any density profile that applies a combination of several modifiers
+    (Shifted, Tilted, Rotating, Scaled) as a single affine transformation */
+template<> class Transformed<BaseDensity>: public BaseDensity, public BaseComposite<BaseDensity> {
+public:
+    /// initialize from the given density and the combined transformation
+    Transformed(const PtrDensity& _dens, const AffineTransform& _transform) :
+        dens(_dens), transform(_transform) {}
+
+    virtual double totalMass() const { return dens->totalMass() * transform.amplitude0(); }
+    virtual double enclosedMass(const double radius) const;
+    virtual coord::SymmetryType symmetry() const { return transform.symmetry(dens->symmetry()); }
+    virtual std::string name() const { return transform.name() + dens->name(); }
+    virtual unsigned int size() const { return 1; }
+    virtual PtrDensity component(unsigned int) const { return dens; }
+
+private:
+    /// the instance of the actual density
+    const PtrDensity dens;
+
+    /// the combined transformation of coordinates and amplitude
+    const AffineTransform transform;
+
+    virtual double densityCar(const coord::PosCar &pos, double time) const;
+    virtual double densityCyl(const coord::PosCyl &pos, double time) const
+    { return densityCar(toPosCar(pos), time); }
+    virtual double densitySph(const coord::PosSph &pos, double time) const
+    { return densityCar(toPosCar(pos), time); }
+
+    virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
+        /*output*/ double values[], /*input*/ double time=0) const;
+};
+
+/** Modifier of any potential profile that applies a combination of several modifiers
+    (Shifted, Tilted, Rotating, Scaled) as a single affine transformation */
+template<> class Transformed<BasePotential>: public BasePotentialCar, public BaseComposite<BasePotential> {
+public:
+    /// initialize from the given potential and the combined transformation
+    Transformed(const PtrPotential& _pot, const AffineTransform& _transform) :
+        pot(_pot), transform(_transform) {}
+
+    virtual double totalMass() const { return pot->totalMass() * transform.amplitude0(); }
+    virtual double enclosedMass(const double radius) const;
+    virtual coord::SymmetryType symmetry() const { return transform.symmetry(pot->symmetry()); }
+    virtual std::string name() const { return transform.name() + pot->name(); }
+    virtual unsigned int size() const { return 1; }
+    virtual PtrPotential component(unsigned int) const { return pot; }
+
+private:
+    /// the instance of the actual potential
+    const PtrPotential pot;
+
+    /// the combined transformation of coordinates and amplitude
+    const AffineTransform transform;
+
+    virtual void evalCar(const coord::PosCar &pos,
+        double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const;
+
+    virtual double densityCar(const coord::PosCar &pos, double time) const;
+    virtual double densityCyl(const coord::PosCyl &pos, double time) const
+    { return densityCar(toPosCar(pos), time); }
+    virtual double densitySph(const coord::PosSph &pos, double time) const
+    { return densityCar(toPosCar(pos), time); }
+
+    virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
+        /*output*/ double values[], /*input*/ double time=0) const;
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[]=NULL, /*input*/ double time=0) const;
+};
+
+
+/// per-thread storage of recently computed values in the Memoized potential (opaque structure)
+class MemoTable;
+
+/// locks guarding the per-thread tables of Memoized against simultaneous use (defined in .cpp)
+class CacheLocks;
+
+/** Wrapper around any potential that remembers the results of a few most recent evaluations
+    and returns them without calling the underlying potential when it is asked again for
+    exactly the same position (in the same coordinate system) and time.
+    This is useful when an expensive potential (e.g. a Composite of many components, or a
+    user-defined function in Python) is repeatedly evaluated at the same points by root-finders
+    or by ODE integrators after step rejection.
+    Each OpenMP thread uses the table with its thread index, which holds recent results with
+    least-recently-used replacement policy; in parallel regions nested inside an active one
+    (whether the inner region is active or not), where thread indices are not unique,
+    the cache is bypassed. Threads created outside OpenMP (e.g., by the Python interpreter) may
+    have the same index, so each table is guarded by a lock, and a thread that finds the table
+    locked bypasses the cache instead of waiting.
+    The density and batch evaluation methods are forwarded to the underlying potential directly.
+    Hit-rate statistics (accumulated over all threads) can be used to decide whether the wrapper
+    is beneficial in a particular context.
+*/
+class Memoized: public BasePotential, public BaseComposite<BasePotential> {
+public:
+    /** create the wrapper around the given potential.
+        \param[in]  pot  is the original potential.
+        \param[in]  capacity  is the number of recent results remembered by each thread
+        separately for each coordinate system (Car/Cyl/Sph); since the search is linear,
+        this should be a small number (a few to a few dozen).
+        \throw std::invalid_argument if capacity is zero.
+    */
+    Memoized(const PtrPotential& pot, unsigned int capacity=8);
+
+    virtual double totalMass() const { return pot->totalMass(); }
+    virtual double enclosedMass(const double radius) const { return pot->enclosedMass(radius); }
+    virtual coord::SymmetryType symmetry() const { return pot->symmetry(); }
+    virtual std::string name() const { return myName() + " " + pot->name(); }
+    static std::string myName() { return "Memoized"; }
+    virtual unsigned int size() const { return 1; }
+    virtual PtrPotential component(unsigned int) const { return pot; }
+
+    /** retrieve the total number of potential evaluations and the number of those which were
+        served from the cache, summed over all threads (should be called outside parallel regions,
+        and does not include evaluations that bypassed the cache, e.g., in nested regions) */
+    void statistics(size_t& numCalls, size_t& numHits) const;
+
+    /// reset the hit-rate counters (but keep the cached values)
+    void resetStatistics() const;
+
+private:
+    /// the instance of the actual potential
+    const PtrPotential pot;
+
+    /// one table for each OpenMP thread
+    std::vector<shared_ptr<MemoTable> > tables;
+
+    /// one lock per table (shared between copies of this object)
+    shared_ptr<CacheLocks> locks;
+
+    virtual void evalCar(const coord::PosCar &pos,
+        double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const;
+    virtual void evalCyl(const coord::PosCyl &pos,
+        double* potential, coord::GradCyl* deriv, coord::HessCyl* deriv2, double time) const;
+    virtual void evalSph(const coord::PosSph &pos,
+        double* potential, coord::GradSph* deriv, coord::HessSph* deriv2, double time) const;
+
+    virtual double densityCar(const coord::PosCar &pos, double time) const
+    { return pot->density(pos, time); }
+    virtual double densityCyl(const coord::PosCyl &pos, double time) const
+    { return pot->density(pos, time); }
+    virtual double densitySph(const coord::PosSph &pos, double time) const
+    { return pot->density(pos, time); }
+
+    virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double values[], /*input*/ double time=0) const
+    { pot->evalmanyDensityCar(npoints, pos, values, time); }
+    virtual void evalmanyDensityCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double values[], /*input*/ double time=0) const
+    { pot->evalmanyDensityCyl(npoints, pos, values, time); }
+    virtual void evalmanyDensitySph(const size_t npoints, const coord::PosSph pos[],
+        /*output*/ double values[], /*input*/ double time=0) const
+    { pot->evalmanyDensitySph(npoints, pos, values, time); }
+    virtual void evalmanyPotentialCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double potential[], coord::GradCar deriv[]=NULL, /*input*/ double time=0) const
+    { pot->evalmanyPotentialCar(npoints, pos, potential, deriv, time); }
+    virtual void evalmanyPotentialCyl(const size_t npoints, const coord::PosCyl pos[],
+        /*output*/ double potential[], coord::GradCyl deriv[]=NULL, /*input*/ double time=0) const
+    { pot->evalmanyPotentialCyl(npoints, pos, potential, deriv, time); }
+};
+
 }  // namespace potential
@@ -103,11 +103,14 @@ template<>
 inline void collectValues(const BasePotential& src, const std::vector<coord::PosCyl>& points,
     /*output array of length 3*points.size()*/ double values[])
 {
-    coord::GradCyl grad;
-    for(size_t i=0, count=points.size(); i<count; i++) {
-        src.eval(points[i], &values[i*3], &grad);
-        values[i*3+1] = grad.dR;
-        values[i*3+2] = grad.dz;
+    const size_t npoints = points.size();
+    std::vector<double> pot(npoints);
+    std::vector<coord::GradCyl> grad(npoints);
+    src.evalmanyPotentialCyl(npoints, &points[0], &pot[0], &grad[0]);  // vectorized evaluation
+    for(size_t i=0; i<npoints; i++) {
+        values[i*3]   = pot[i];
+        values[i*3+1] = grad[i].dR;
+        values[i*3+2] = grad[i].dz;
     }
 }
 
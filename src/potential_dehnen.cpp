@@ -3,6 +3,7 @@
 #include <cmath>
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
 
 namespace potential {
 
@@ -24,14 +25,58 @@ static const double EPSREL_POTENTIAL_INT = 1e-6;
 //    This may be done by down-casting an instance of Dehnen class to BaseDensity,
 //    or by using a SpheroidDensity object instead.
 
-Dehnen::Dehnen(double _mass, double _scalerad, double _gamma, double _axisRatioY, double _axisRatioZ): 
+/// parameters of the fixed integration rule in the non-spherical case:
+/// the interval 0<s<1 is split into segments, each with numNodesGL points, whose lengths
+/// decrease geometrically with the given ratio towards s=0 (the integrands have a transition
+/// at s ~ scaleRadius/r and a power-law behaviour below), down to MIN_SEGMENT,
+/// and towards s=1 (where the integrands have a nearby complex singularity if an axis ratio is small)
+static const double RATIO_SEGMENTS = 3.;
+static const double MIN_SEGMENT = 1e-10;
+/// the number of nodes per segment is chosen to be the number of required significant digits
+/// (the error decreases roughly by a factor of 10 per node), within the given limits
+static const int MIN_NODES_GL = 3, MAX_NODES_GL = 20;
+
+Dehnen::Dehnen(double _mass, double _scalerad, double _gamma, double _axisRatioY, double _axisRatioZ,
+    bool _exact, double accuracy) :
     BasePotentialCar(), mass(_mass), scalerad(_scalerad),
-    gamma(_gamma), axisRatioY(_axisRatioY), axisRatioZ(_axisRatioZ)
+    gamma(_gamma), axisRatioY(_axisRatioY), axisRatioZ(_axisRatioZ), exact(_exact),
+    numNodesGL(0), epsCut(0)
 {
     if(scalerad<=0)
         throw std::invalid_argument("Dehnen potential: scale radius must be positive");
     if(gamma<0 || gamma>2)
         throw std::invalid_argument("Dehnen potential: gamma must lie in the range [0:2]");
+    if(!(accuracy > 0 && accuracy < 1))
+        throw std::invalid_argument("Dehnen potential: accuracy must be between 0 and 1");
+    if(exact || (axisRatioY==1 && axisRatioZ==1))
+        return;
+    // the error of the midpoint estimate on the innermost interval is proportional to its length
+    numNodesGL = std::min(MAX_NODES_GL, std::max(MIN_NODES_GL, (int)ceil(-log10(accuracy))));
+    epsCut = 0.01 * accuracy;
+    // boundaries of segments in decreasing order, starting from s=1
+    double minAxis = fmin(axisRatioY, axisRatioZ);
+    double dist = minAxis<1 ? 1/sqrt(1-pow_2(minAxis)) - 1 : INFINITY;  // distance to singularity
+    std::vector<double> dupper;
+    for(double d = 0.5 / RATIO_SEGMENTS; d > dist; d /= RATIO_SEGMENTS)
+        dupper.push_back(d);
+    quadSegments.assign(1, 1.);
+    for(int k=dupper.size()-1; k>=0; k--)
+        quadSegments.push_back(1 - dupper[k]);
+    for(double s = 0.5; s > MIN_SEGMENT; s /= RATIO_SEGMENTS)
+        quadSegments.push_back(s);
+    quadSegments.push_back(0.);
+    const size_t numNodes = (quadSegments.size()-1) * numNodesGL;
+    quadNodes.  resize(numNodes);
+    quadWeights.resize(numNodes);
+    quadFacY.   resize(numNodes);
+    quadFacZ.   resize(numNodes);
+    for(size_t k=0; k<quadSegments.size()-1; k++)
+        math::prepareIntegrationTableGL(quadSegments[k+1], quadSegments[k], numNodesGL,
+            &quadNodes[k * numNodesGL], &quadWeights[k * numNodesGL]);
+    for(size_t i=0; i<numNodes; i++) {
+        quadFacY[i] = 1 / (1 - (1-pow_2(axisRatioY)) * pow_2(quadNodes[i]));
+        quadFacZ[i] = 1 / (1 - (1-pow_2(axisRatioZ)) * pow_2(quadNodes[i]));
+    }
 }
 
 double Dehnen::densityCar(const coord::PosCar& pos, double /*time*/) const
@@ -122,6 +167,10 @@ void Dehnen::evalCar(const coord::PosCar &pos,
         }
         return;
     }
+    if(!exact) {
+        evalFixedQuad(pos, potential, deriv, deriv2);
+        return;
+    }
     if(potential) {
         DehnenIntegrandPhi fnc(pos, gamma, axisRatioY, axisRatioZ, scalerad);
         *potential = math::integrate(fnc, 0, 1, EPSREL_POTENTIAL_INT) * mass/scalerad;
@@ -195,4 +244,110 @@ void Dehnen::evalCar(const coord::PosCar &pos,
     }
 }
 
+void Dehnen::evalFixedQuad(const coord::PosCar &pos,
+    double* potential, coord::GradCar* deriv, coord::HessCar* deriv2) const
+{
+    // The integrals are the same as in the exact method, but all expressed in terms of a single
+    // integration variable s, with m(s) = s * sqrt(X^2 + Y^2 F_y(s) + Z^2 F_z(s)),
+    // X,Y,Z being the coordinates scaled by scalerad, and F_y = 1/(1-(1-q^2) s^2), etc.
+    // Potential:  -\int_0^1 ds  psi(m) sqrt(F_y F_z),  psi(m) = \int_m^\infty (3-gamma) w(m') m' dm',
+    // w(m) = m^-gamma (1+m)^(gamma-4);
+    // Force: dPhi/dX_i = (3-gamma) X_i \int ds s^2 w(m) F_i sqrt(F_y F_z)  (F_x=1),
+    // Hessian: (3-gamma) [ delta_{ij} (force integral)_i -
+    // X_i X_j \int ds s^4 w(m) (gamma+4m) / (m^2 (1+m)) F_i F_j sqrt(F_y F_z) ].
+    const double X2 = pow_2(pos.x/scalerad), Y2 = pow_2(pos.y/scalerad), Z2 = pow_2(pos.z/scalerad);
+    if(!isFinite(X2 + Y2 + Z2)) {  // point at infinity
+        if(potential)
+            *potential = 0;
+        if(deriv)
+            deriv->dx = deriv->dy = deriv->dz = 0;
+        if(deriv2)
+            deriv2->dx2 = deriv2->dy2 = deriv2->dz2 = deriv2->dxdy = deriv2->dxdz = deriv2->dydz = 0;
+        return;
+    }
+    const bool origin = X2==0 && Y2==0 && Z2==0;
+    const bool needDer = (deriv!=NULL || deriv2!=NULL) && !origin, needDer2 = deriv2!=NULL && !origin;
+    const double scut = epsCut /
+        fmax(1, sqrt(X2 + Y2 / pow_2(axisRatioY) + Z2 / pow_2(axisRatioZ)));
+    double Phi = 0, F[3] = {0,0,0}, H[6] = {0,0,0,0,0,0};
+    const size_t numNodes = quadNodes.size();
+    for(size_t i=0; i<=numNodes; i++) {
+        double s, weight, fy, fz;
+        const size_t seg = i / numNodesGL;  // index of the current segment
+        if(i < numNodes && quadSegments[seg] >= scut) {
+            s  = quadNodes[i];
+            weight = quadWeights[i];
+            fy = quadFacY[i];
+            fz = quadFacZ[i];
+        } else {
+            // the remaining interval [0, quadSegments[seg]] is replaced by its midpoint,
+            // then the loop terminates
+            weight = quadSegments[seg];
+            s  = 0.5 * weight;
+            fy = 1 / (1 - (1-pow_2(axisRatioY)) * s*s);
+            fz = 1 / (1 - (1-pow_2(axisRatioZ)) * s*s);
+            i  = numNodes;
+            if(weight == 0)
+                break;
+        }
+        const double s2 = s*s,
+        fs = weight * sqrt(fy * fz),
+        m  = s * sqrt(X2 + Y2 * fy + Z2 * fz),
+        t  = m / (1+m),
+        // the only expensive operation per node (m=0 may only occur at origin, where
+        // the derivatives are not computed, and the potential needs t^(2-gamma) = 0)
+        tg = m>0 ? math::pow(t, -gamma) : 0;
+        if(potential) {
+            double psi;
+            if(m < 100)
+                psi = gamma==2 ? log(1/t) - 1/(1+m) : (1 - tg * t * t * (3-gamma+m) / (1+m)) / (2-gamma);
+            else {  // asymptotic regime: avoid the cancellation of nearly equal terms
+                double L = log1p(1/m);
+                psi = gamma==2 ? L - 1/(1+m) :
+                    (-expm1(-(2-gamma) * L) - tg * t * t * (2-gamma) / (1+m)) / (2-gamma);
+            }
+            Phi -= psi * fs;
+        }
+        if(!needDer)
+            continue;
+        const double w = s2 * tg / pow_2(pow_2(1+m)) * fs;
+        F[0] += w;
+        F[1] += w * fy;
+        F[2] += w * fz;
+        if(needDer2) {
+            const double h = w * s2 * (gamma + 4*m) / (m * m * (1+m));
+            H[0] += h;             // xx
+            H[1] += h * fy * fy;   // yy
+            H[2] += h * fz * fz;   // zz
+            H[3] += h * fy;        // xy
+            H[4] += h * fy * fz;   // yz
+            H[5] += h * fz;        // xz
+        }
+    }
+    if(potential)
+        *potential = Phi * mass / scalerad;
+    if(origin) {
+        if(deriv)
+            deriv->dx = deriv->dy = deriv->dz = 0;
+        if(deriv2)
+            deriv2->dx2 = deriv2->dy2 = deriv2->dz2 = deriv2->dxdy = deriv2->dxdz = deriv2->dydz = NAN;
+        return;
+    }
+    const double mult = (3-gamma) * mass / pow_3(scalerad);
+    if(deriv) {
+        deriv->dx = mult * pos.x * F[0];
+        deriv->dy = mult * pos.y * F[1];
+        deriv->dz = mult * pos.z * F[2];
+    }
+    if(deriv2) {
+        const double X = pos.x/scalerad, Y = pos.y/scalerad, Z = pos.z/scalerad;
+        deriv2->dx2  = mult * (F[0] - X*X * H[0]);
+        deriv2->dy2  = mult * (F[1] - Y*Y * H[1]);
+        deriv2->dz2  = mult * (F[2] - Z*Z * H[2]);
+        deriv2->dxdy =-mult * X*Y * H[3];
+        deriv2->dydz =-mult * Y*Z * H[4];
+        deriv2->dxdz =-mult * X*Z * H[5];
+    }
+}
+
 }  // namespace potential
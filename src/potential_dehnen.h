@@ -5,13 +5,27 @@
 **/
 #pragma once
 #include "potential_base.h"
+#include <vector>
 
 namespace potential {
 
-/** Dehnen(1993) double power-law model **/
+/** Dehnen(1993) double power-law model.
+    In the spherical case the potential is computed analytically, otherwise it is given by
+    one-dimensional integrals over an auxiliary variable s. By default, these integrals are
+    computed with a fixed composite Gauss-Legendre rule, whose nodes and the s-dependent
+    factors of the integrands are tabulated at construction; the potential and all its
+    derivatives are then obtained in a single pass over these nodes. The number of nodes is
+    determined by the required relative accuracy of the potential and force, which is given
+    as the last argument of the constructor (or the parameter `accuracy` in the potential factory).
+    The original method using adaptive integration separately for each quantity
+    is retained for validation and may be selected by the argument `exact` of the constructor
+    (or by the parameter exact=true in the potential factory); its relative accuracy is
+    fixed at ~1e-6 (and is worse at large radii).
+**/
 class Dehnen: public BasePotentialCar {
 public:
-    Dehnen(double _mass, double _scalerad, double _gamma, double _axisRatioY=1., double _axisRatioZ=1.);
+    Dehnen(double _mass, double _scalerad, double _gamma, double _axisRatioY=1., double _axisRatioZ=1.,
+        bool _exact=false, double accuracy=1e-8);
     virtual std::string name() const { return myName(); }
     static std::string myName() { return "Dehnen"; }
     virtual coord::SymmetryType symmetry() const { 
@@ -24,6 +38,20 @@ private:
     const double gamma;      ///< cusp exponent for Dehnen potential
     const double axisRatioY; ///< axis ratio y/x of equidensity surfaces
     const double axisRatioZ; ///< axis ratio z/x of equidensity surfaces
+    const bool exact;        ///< whether to use adaptive integration in the non-spherical case
+    /// boundaries of segments (in decreasing order), nodes and weights of the fixed integration
+    /// rule in s, and the s-dependent factors 1/(1-(1-q^2) s^2) and 1/(1-(1-p^2) s^2)
+    /// at these nodes (used if exact==false)
+    std::vector<double> quadSegments, quadNodes, quadWeights, quadFacY, quadFacZ;
+    /// number of nodes of the integration rule in each segment (used if exact==false)
+    int numNodesGL;
+    /// segments lying entirely below s = epsCut * min(1, scaleRadius / ellipsoidal radius)
+    /// contribute negligibly to all integrals, and are replaced by a single midpoint estimate
+    double epsCut;
+
+    /// evaluate the non-spherical potential and its derivatives using the fixed integration rule
+    void evalFixedQuad(const coord::PosCar &pos,
+        double* potential, coord::GradCar* deriv, coord::HessCar* deriv2) const;
 
     virtual void evalCar(const coord::PosCar &pos,
         double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const;
@@ -1,5 +1,5 @@
 /*
-This is a new implementation of GalPot written by Eugene Vasiliev, 2015-2017.
+This is a new implementation of GalPot written by Eugene Vasiliev, 2015-2024.
 
 The original GalPot code:
 Copyright Walter Dehnen, 1996-2004
@@ -25,6 +25,11 @@ Version 0.8    24. June      2005
 #include <cmath>
 #include <stdexcept>
 #include <cassert>
+#ifndef _MSC_VER
+#include <alloca.h>
+#else
+#include <malloc.h>
+#endif
 
 namespace potential{
 
@@ -247,4 +252,133 @@ void DiskAnsatz::evalCyl(const coord::PosCyl &pos,
     }
 }
 
+GalPot::GalPot(const std::vector<DiskParam>& diskParams, const PtrPotential& _residual) :
+    residual(_residual)
+{
+    if(!residual)
+        throw std::invalid_argument("GalPot: residual potential must be provided");
+    std::vector<DiskParam> radialParams, verticalParams;  // distinct profiles
+    for(size_t d=0; d<diskParams.size(); d++) {
+        const DiskParam& param = diskParams[d];
+        diskComponents.push_back(PtrPotential(new DiskAnsatz(param)));
+        surfaceDensities.push_back(param.surfaceDensity);
+        // find an existing radial profile with the same shape, or add a new one
+        size_t ir = 0;
+        while(ir < radialParams.size() && !(
+            radialParams[ir].scaleRadius         == param.scaleRadius &&
+            radialParams[ir].innerCutoffRadius   == param.innerCutoffRadius &&
+            radialParams[ir].modulationAmplitude == param.modulationAmplitude &&
+            radialParams[ir].sersicIndex         == param.sersicIndex))
+            ir++;
+        if(ir == radialParams.size()) {
+            radialParams.push_back(param);
+            radialParams.back().surfaceDensity = 1.;
+            radialFncs.push_back(createRadialDiskFnc(radialParams.back()));
+        }
+        radialIndex.push_back(ir);
+        // same for the vertical profile
+        size_t iv = 0;
+        while(iv < verticalParams.size() && verticalParams[iv].scaleHeight != param.scaleHeight)
+            iv++;
+        if(iv == verticalParams.size()) {
+            verticalParams.push_back(param);
+            verticalFncs.push_back(createVerticalDiskFnc(param));
+        }
+        verticalIndex.push_back(iv);
+    }
+}
+
+coord::SymmetryType GalPot::symmetry() const
+{
+    coord::SymmetryType sym = residual->symmetry();
+    return isUnknown(sym) || diskComponents.empty() ? sym :
+        static_cast<coord::SymmetryType>(sym & coord::ST_AXISYMMETRIC);
+}
+
+std::string GalPot::name() const
+{
+    std::string name = myName() + "{ ";
+    for(size_t i=0; i<diskComponents.size(); i++)
+        name += diskComponents[i]->name() + ", ";
+    return name + residual->name() + " }";
+}
+
+PtrPotential GalPot::component(unsigned int index) const
+{
+    if(index < diskComponents.size())
+        return diskComponents[index];
+    if(index == diskComponents.size())
+        return residual;
+    throw std::out_of_range("GalPot: component index out of range");
+}
+
+void GalPot::evalCyl(const coord::PosCyl &pos,
+    double* potential, coord::GradCyl* deriv, coord::HessCyl* deriv2, double time) const
+{
+    residual->eval(pos, potential, deriv, deriv2, time);
+    const size_t numRadial = radialFncs.size(), numVertical = verticalFncs.size();
+    if(surfaceDensities.empty())
+        return;
+    // values and two derivatives of each distinct radial and vertical profile
+    double* fval = static_cast<double*>(alloca(3 * (numRadial + numVertical) * sizeof(double)));
+    double* Hval = fval + 3 * numRadial;
+    bool needDeriv = deriv!=NULL || deriv2!=NULL;  // compute derivatives of f and H only if necessary
+    double r = sqrt(pow_2(pos.R) + pow_2(pos.z));
+    for(size_t ir=0; ir<numRadial; ir++)
+        radialFncs[ir]->evalDeriv(r, &fval[ir*3],
+            needDeriv ? &fval[ir*3+1] : NULL, deriv2 ? &fval[ir*3+2] : NULL);
+    for(size_t iv=0; iv<numVertical; iv++)
+        verticalFncs[iv]->evalDeriv(pos.z, &Hval[iv*3],
+            needDeriv ? &Hval[iv*3+1] : NULL, deriv2 ? &Hval[iv*3+2] : NULL);
+    // accumulate the products of radial and vertical factors over all disks:
+    // the potential of each disk is 4 pi Sigma_0 f(r) H(z), and its derivatives are linear
+    // combinations of these products with the same coordinate-dependent coefficients
+    double fH = 0, fpH = 0, fppH = 0, fHp = 0, fpHp = 0, fh = 0;
+    for(size_t d=0; d<surfaceDensities.size(); d++) {
+        const double* f = &fval[radialIndex[d] * 3], *H = &Hval[verticalIndex[d] * 3];
+        const double mult = 4*M_PI * surfaceDensities[d];
+        if(f[0] == 0)  // avoid 0*infinity when the disk profile vanishes
+            continue;
+        fH += mult * f[0] * H[0];
+        if(needDeriv) {
+            fpH += mult * f[1] * H[0];
+            fHp += mult * f[0] * H[1];
+        }
+        if(deriv2) {
+            fppH += mult * f[2] * H[0];
+            fpHp += mult * f[1] * H[1];
+            fh   += mult * f[0] * H[2];
+        }
+    }
+    double rinv = r>0 ? 1./r : 1.;  // if r==0, avoid indeterminacy in 0/0
+    double Rr   = pos.R * rinv;
+    double zr   = pos.z * rinv;
+    if(potential)
+        *potential += fH;
+    if(deriv) {
+        deriv->dR += fpH * Rr;
+        deriv->dz += fpH * zr + fHp;
+    }
+    if(deriv2) {
+        deriv2->dR2 += fppH * pow_2(Rr) + fpH * rinv * pow_2(zr);
+        deriv2->dz2 += fppH * pow_2(zr) + fpH * rinv * pow_2(Rr) + fpHp * zr * 2 + fh;
+        deriv2->dRdz+= (fppH - fpH * rinv) * Rr * zr + fpHp * Rr;
+    }
+}
+
+double GalPot::densityCyl(const coord::PosCyl &pos, double time) const
+{
+    double result = residual->density(pos, time);
+    double r = sqrt(pow_2(pos.R) + pow_2(pos.z));
+    for(size_t d=0; d<surfaceDensities.size(); d++) {
+        // the same expression as in DiskAnsatz::densityCyl, but without sharing the profiles,
+        // since the density is needed much less frequently than the potential
+        double h, H, Hp, f, fp, fpp;
+        verticalFncs[verticalIndex[d]]->evalDeriv(pos.z, &H, &Hp, &h);
+        radialFncs  [radialIndex  [d]]->evalDeriv(r, &f, &fp, &fpp);
+        result += surfaceDensities[d] * (f*h + (pos.z!=0 ? 2*fp*(H+pos.z*Hp)/r : 0) + fpp*H);
+    }
+    return result;
+}
+
 } // namespace
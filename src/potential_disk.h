@@ -1,7 +1,7 @@
 /** \file    potential_disk.h
     \brief   a reimplementation of Walter Dehnen's GalaxyPotential code for axisymmetric disks
     \author  Eugene Vasiliev, based on the earlier work of Walter Dehnen, Paul McMillan
-    \date    2015-2017
+    \date    2015-2024
 
 The original GalPot code is written by W.Dehnen:
 
@@ -60,12 +60,20 @@ a 2d grid in (r,theta) plane, so that the potential evaluation uses 2d spline-in
 values; however, if the radius lies outside the grid definition region, the potential is computed
 by summing up appropriately extrapolated multipole components (unlike the original GalPot).
 
+When the potential is constructed by the factory routines, all DiskAnsatz components and
+the Multipole potential of the residual density sharing the same modifiers are combined into
+a single GalPot object, which evaluates them in one pass: the spherical radius is computed once,
+the radial and vertical profiles shared by several disks (up to a normalization factor)
+are evaluated only once, and the potential, its derivatives and the density of all disk terms
+are accumulated together before adding the residual potential.
+
 For compatibility with the original implementation, an utility function `readGalaxyPotential`
 is provided in potential_factory.h, taking the name of parameter file and the Units object as parameters.
 */
 
 #pragma once
 #include "potential_base.h"
+#include "potential_composite.h"
 #include "smart.h"
 #include <vector>
 
@@ -172,6 +180,49 @@ private:
     virtual double densityCyl(const coord::PosCyl &pos, double /*time*/) const;
 };
 
+/** Combination of several DiskAnsatz components and the potential of the residual density
+    (typically a Multipole), evaluated together in a single pass.
+    It is equivalent to a Composite potential made of the same components, which are also
+    accessible individually through the BaseComposite interface, but is more efficient:
+    disks whose radial profiles differ only by the surface density normalization share
+    the evaluation of this profile (same for the vertical profiles with equal scale heights),
+    the coordinate-dependent factors are computed once for all disks, and the conversion
+    between coordinate systems is performed once for the entire potential.
+*/
+class GalPot: public BasePotentialCyl, public BaseComposite<BasePotential> {
+public:
+    /** construct the potential from the parameters of disk components and the residual potential.
+        \param[in]  diskParams  is the array of parameters of disks (may be empty).
+        \param[in]  residual  is the potential of the residual density (must be provided).
+        \throw std::invalid_argument if the residual potential is not provided,
+        or the disk parameters are invalid.
+    */
+    GalPot(const std::vector<DiskParam>& diskParams, const PtrPotential& residual);
+
+    virtual coord::SymmetryType symmetry() const;
+    virtual std::string name() const;
+    static std::string myName() { return "GalPot"; }
+    virtual double totalMass() const { return residual->totalMass(); }  // DiskAnsatz has zero mass
+    virtual unsigned int size() const { return diskComponents.size() + 1; }
+    virtual PtrPotential component(unsigned int index) const;
+
+private:
+    /// DiskAnsatz instances with the same parameters as the disk terms (used only as components)
+    std::vector<PtrPotential> diskComponents;
+    /// potential of the residual density
+    PtrPotential residual;
+    /// distinct radial and vertical profiles of disks, with unit surface density
+    std::vector<math::PtrFunction> radialFncs, verticalFncs;
+    /// for each disk, the indices of its radial and vertical profiles in the above arrays
+    std::vector<int> radialIndex, verticalIndex;
+    /// surface density normalization of each disk
+    std::vector<double> surfaceDensities;
+
+    virtual void evalCyl(const coord::PosCyl &pos,
+        double* potential, coord::GradCyl* deriv, coord::HessCyl* deriv2, double time) const;
+    virtual double densityCyl(const coord::PosCyl &pos, double time) const;
+};
+
 ///@}
 
 } // namespace potential
@@ -5,6 +5,7 @@
 #include "potential_dehnen.h"
 #include "potential_disk.h"
 #include "potential_ferrers.h"
+#include "potential_mge.h"
 #include "potential_king.h"
 #include "potential_multipole.h"
 #include "potential_perfect_ellipsoid.h"
@@ -18,10 +19,15 @@
 #include <stdexcept>
 #include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <map>
+#include <cstdio>
+#include <cstdlib>
 /// OS- and filesystem-specific definitions
 #ifdef _MSC_VER
 #include <direct.h>
+#include <process.h>
+#define getpid _getpid
 #pragma warning(disable:4996)  // prevent deprecation error on chdir and getcwd
 #define DIRECTORY_SEPARATOR '\\'
 #else
@@ -33,6 +39,9 @@ namespace potential {
 
 namespace {  // internal definitions and routines
 
+/// version of the binary format of serialized potentials (also a part of the cache key)
+static const int BINARY_FORMAT_VERSION = 1;
+
 /// order of the Multipole expansion for the GalPot potential
 static const int GALPOT_LMAX = 32;
 
@@ -84,6 +93,7 @@ enum PotentialType {
     PT_MIYAMOTONAGAI,///< axisymmetric Miyamoto-Nagai(1975) model:  `MiyamotoNagai`
     PT_DEHNEN,       ///< spherical, axisymmetric or triaxial Dehnen(1993) density model:  `Dehnen`
     PT_FERRERS,      ///< triaxial Ferrers model with finite extent:  `Ferrers`
+    PT_MGE,          ///< Multi-Gaussian Expansion:  `MGE`
     PT_PLUMMER,      ///< spherical Plummer model:  `Plummer`
     PT_ISOCHRONE,    ///< spherical isochrone model:  `Isochrone`
     PT_PERFECTELLIPSOID,  ///< axisymmetric model of Kuzmin/de Zeeuw :  `PerfectEllipsoid`
@@ -149,7 +159,10 @@ struct AllParam: public ModifierParams
     double eta;              ///< shape parameters of basis functions for BasisSet (0.5-CB, 1.0-HO, etc.)
     double r0;               ///< scale radius of the basis functions for BasisSet
     bool fixOrder;           ///< whether to limit the internal SH density expansion to the output order
+    bool exact;              ///< whether to use the original (slow) evaluation method for Dehnen and Ferrers
+    double accuracy;         ///< relative accuracy of the fast evaluation method for Dehnen and Ferrers
     std::string file;        ///< name of a file with coordinates of points, or coefficients of expansion
+    std::string table;       ///< parameters of MGE components (inline array or file name)
     double lengthUnit;       ///< dimensional length unit for Logarithmic (taken from ExternalUnits)
     /// default constructor initializes the fields to some reasonable values
     AllParam(const units::ExternalUnits& converter) :
@@ -163,7 +176,7 @@ struct AllParam: public ModifierParams
         modulationAmplitude(0.), cutoffStrength(2.), sersicIndex(NAN), W0(NAN), trunc(1.),
         binary_q(0), binary_sma(0), binary_ecc(0), binary_phase(0),
         gridSizeR(25), gridSizez(25), rmin(0), rmax(0), zmin(0), zmax(0),
-        lmax(6), mmax(6), smoothing(1.), nmax(12), eta(1.0), r0(0), fixOrder(false), lengthUnit(1)
+        lmax(6), mmax(6), smoothing(1.), nmax(12), eta(1.0), r0(0), fixOrder(false), exact(false), accuracy(1e-8), lengthUnit(1)
     {}
 };
 
@@ -184,6 +197,7 @@ PotentialType getPotentialTypeByName(const std::string& name)
     if(utils::stringsEqual(name, Plummer      ::myName())) return PT_PLUMMER;
     if(utils::stringsEqual(name, Dehnen       ::myName())) return PT_DEHNEN;
     if(utils::stringsEqual(name, Ferrers      ::myName())) return PT_FERRERS;
+    if(utils::stringsEqual(name, MGE          ::myName())) return PT_MGE;
     if(utils::stringsEqual(name, Isochrone    ::myName())) return PT_ISOCHRONE;
     if(utils::stringsEqual(name, SpheroidParam::myName())) return PT_SPHEROID;
     if(utils::stringsEqual(name, NukerParam   ::myName())) return PT_NUKER;
@@ -318,6 +332,9 @@ AllParam parseParam(const utils::KeyValueMap& kvmap, const units::ExternalUnits&
     param.r0                  = kvmap.getDouble("r0",   param.r0)
                               * conv.lengthUnit;
     param.fixOrder            = kvmap.getBool  ("fixOrder", param.fixOrder);
+    param.exact               = kvmap.getBool  ("exact", param.exact);
+    param.accuracy            = kvmap.getDouble("accuracy", param.accuracy);
+    param.table               = kvmap.getString("table");
     param.lengthUnit          = conv.lengthUnit;
 
     // tweak: if 'type' is Plummer or NFW, but axis ratio is not unity or a cutoff radius is provided,
@@ -845,6 +862,23 @@ void writeDensityAzimuthalHarmonic(std::ostream& strm, const DensityAzimuthalHar
     writeAzimuthalHarmonics(strm, gridR, gridz, coefs);
 }
 
+/// write the parameters of all Gaussian components of an MGE potential as an inline table
+void writePotentialMGE(std::ostream& strm, const MGE& pot,
+    const units::ExternalUnits& converter)
+{
+    strm << "table=[";
+    for(unsigned int k=0; k<pot.size(); k++) {
+        double mass, sigmaX, sigmaY, sigmaZ;
+        pot.getComponent(k, mass, sigmaX, sigmaY, sigmaZ);
+        strm << (k>0 ? ",[" : "[") <<
+            utils::toString(mass   / converter.massUnit,   16) << ',' <<
+            utils::toString(sigmaX / converter.lengthUnit, 16) << ',' <<
+            utils::toString(sigmaY / converter.lengthUnit, 16) << ',' <<
+            utils::toString(sigmaZ / converter.lengthUnit, 16) << ']';
+    }
+    strm << "]\n";
+}
+
 /// write data (expansion coefs or components) for a single or composite density or potential to a stream.
 /// this implementation is fairly incomplete - it flattens out any hierarchy of composite objects,
 /// and is not able to save parameters of most elementary objects (this may be implemented in the future);
@@ -910,6 +944,11 @@ void writeAnyDensityOrPotential(std::ostream& strm, const BaseDensity* dens,
         writeDensityAzimuthalHarmonic(strm, *ah, converter);
         return;
     }
+    const MGE* mg = dynamic_cast<const MGE*>(dens);
+    if(mg) {
+        writePotentialMGE(strm, *mg, converter);
+        return;
+    }
 
     // otherwise don't know how to store this potential
     strm << "#other parameters are not stored\n";
@@ -1051,6 +1090,48 @@ static void readTimeDependentArray(
             utils::toString(2*K+1) + " columns");
 }
 
+/** Create a Multi-Gaussian Expansion from the parameter 'table', which is either
+    a serialized 2d array [[mass, sigmaX, sigmaY, sigmaZ], ...] with one row per component,
+    or the name of a text file with these four columns (lines starting with '#' are ignored)
+*/
+PtrPotential createMGE(const AllParam& param)
+{
+    std::vector<double> values;
+    if(param.table.empty())
+        throw std::invalid_argument("MGE: parameter 'table' is required");
+    if(isPairOfBrackets(param.table.front(), param.table.back())) {
+        std::vector<std::string> fields = utils::splitString(param.table, ",; \t[]()");
+        for(size_t i=0; i<fields.size(); i++)
+            values.push_back(utils::toDouble(fields[i]));
+    } else {
+        std::ifstream strm(param.table.c_str(), std::ios::in);
+        if(!strm)
+            throw std::runtime_error("MGE: cannot read file \"" + param.table + "\"");
+        std::string buffer;
+        while(std::getline(strm, buffer)) {
+            if(!buffer.empty() && utils::isComment(buffer[0]))  // commented line
+                continue;
+            std::vector<std::string> fields = utils::splitString(buffer, ";, \t");
+            if(fields.size() < 4)
+                continue;
+            for(int c=0; c<4; c++)
+                values.push_back(utils::toDouble(fields[c]));
+        }
+    }
+    if(values.empty() || values.size() % 4 != 0)
+        throw std::invalid_argument("MGE: 'table' should contain four columns: "
+            "mass, sigmaX, sigmaY, sigmaZ");
+    size_t size = values.size() / 4;
+    std::vector<double> mass(size), sigmaX(size), sigmaY(size), sigmaZ(size);
+    for(size_t k=0; k<size; k++) {
+        mass  [k] = values[k*4  ] * param.converter.massUnit;
+        sigmaX[k] = values[k*4+1] * param.converter.lengthUnit;
+        sigmaY[k] = values[k*4+2] * param.converter.lengthUnit;
+        sigmaZ[k] = values[k*4+3] * param.converter.lengthUnit;
+    }
+    return PtrPotential(new MGE(mass, sigmaX, sigmaY, sigmaZ));
+}
+
 /** helper function for finding the slope of asymptotic power-law behaviour of a certain function:
     if  f(x) ~ f0 + a * x^b  as  x --> 0  or  x --> infinity,  then the slope b is given by
     solving the equation  [x1^b - x2^b] / [x2^b - x3^b] = [f(x1) - f(x2)] / [f(x2) - f(x3)],
@@ -1082,19 +1163,15 @@ template<typename BaseDensityOrPotential>
 void applyModifiers(
     shared_ptr<const BaseDensityOrPotential>& obj, const ModifierParams& param)
 {
-    // when applying more than one modifier, order is important
-    if(!param.scale.empty()) {
-        math::CubicSpline scale[2];
+    // parse all modifiers first
+    math::CubicSpline scale[2], rotation, center[3];
+    if(!param.scale.empty())
         readTimeDependentArray<2>(param.scale,
             /*units*/ param.converter.timeUnit, 1 /*dimensionless*/, /*output*/ scale);
-        obj.reset(new Scaled<BaseDensityOrPotential>(obj, scale[0], scale[1]));
-    }
-    if(!param.rotation.empty()) {
-        math::CubicSpline rotation;
+    if(!param.rotation.empty())
         readTimeDependentArray<1>(param.rotation,
             /*units*/ param.converter.timeUnit, 1 /*dimensionless*/, /*output*/ &rotation);
-        obj.reset(new Rotating<BaseDensityOrPotential>(obj, rotation));
-    }
+    double euler[3] = {0, 0, 0};
     if(!param.orientation.empty()) {
         // string should contain three Euler angles
         // (space and/or comma-separated, possibly surrounded by square or round brackets)
@@ -1104,17 +1181,33 @@ void applyModifiers(
             param.orientation, ",; \t");
         if(fields.size() != 3)
             throw std::invalid_argument("'orientation' must specify three Euler angles");
-        obj.reset(new Tilted<BaseDensityOrPotential>(obj,
-            utils::toDouble(fields[0]), utils::toDouble(fields[1]), utils::toDouble(fields[2])));
+        for(int d=0; d<3; d++)
+            euler[d] = utils::toDouble(fields[d]);
     }
-    if(!param.center.empty()) {
+    if(!param.center.empty())
         // string could contain either three components of the fixed offset vector,
         // or the name of a file with time-dependent trajectory
-        math::CubicSpline center[3];
         readTimeDependentArray<3>(param.center,
             /*units*/ param.converter.timeUnit, param.converter.lengthUnit, /*output*/ center);
-        obj.reset(new Shifted<BaseDensityOrPotential>(obj, center[0], center[1], center[2]));
+
+    // when more than one modifier is present, combine them into a single affine transformation,
+    // equivalent to applying them one by one in the order scale, rotation, orientation, center
+    int numModifiers = !param.scale.empty() + !param.rotation.empty() +
+        !param.orientation.empty() + !param.center.empty();
+    if(numModifiers >= 2) {
+        const coord::Orientation orientation(euler[0], euler[1], euler[2]);
+        obj.reset(new Transformed<BaseDensityOrPotential>(obj, AffineTransform(center,
+            param.orientation.empty() ? NULL : &orientation, rotation, scale[0], scale[1])));
+        return;
     }
+    if(!param.scale.empty())
+        obj.reset(new Scaled<BaseDensityOrPotential>(obj, scale[0], scale[1]));
+    if(!param.rotation.empty())
+        obj.reset(new Rotating<BaseDensityOrPotential>(obj, rotation));
+    if(!param.orientation.empty())
+        obj.reset(new Tilted<BaseDensityOrPotential>(obj, euler[0], euler[1], euler[2]));
+    if(!param.center.empty())
+        obj.reset(new Shifted<BaseDensityOrPotential>(obj, center[0], center[1], center[2]));
 }
 
 /// create potential expansion of a given type from a set of point masses
@@ -1157,10 +1250,14 @@ PtrPotential createAnalyticPotential(const AllParam& param)
         return PtrPotential(new MiyamotoNagai(param.mass, param.scaleRadius, param.scaleHeight));
     case PT_DEHNEN:
         return PtrPotential(new Dehnen(
-            param.mass, param.scaleRadius, param.gamma, param.axisRatioY, param.axisRatioZ));
+            param.mass, param.scaleRadius, param.gamma, param.axisRatioY, param.axisRatioZ,
+            param.exact, param.accuracy));
     case PT_FERRERS:
         return PtrPotential(new Ferrers(
-            param.mass, param.scaleRadius, param.axisRatioY, param.axisRatioZ)); 
+            param.mass, param.scaleRadius, param.axisRatioY, param.axisRatioZ,
+            param.exact, param.accuracy));
+    case PT_MGE:
+        return createMGE(param);
     case PT_PLUMMER:
         if(param.axisRatioY==1 && param.axisRatioZ==1)
             return PtrPotential(new Plummer(param.mass, param.scaleRadius));
@@ -1236,6 +1333,93 @@ PtrPotential createPotentialExpansionFromSource(
     }
 }
 
+/// directory for caching potential expansions (empty if disabled)
+std::string cacheDirectory = std::getenv("AGAMA_CACHE_DIR") ? std::getenv("AGAMA_CACHE_DIR") : "";
+
+/** Construct the name of the cache file for a potential expansion defined by the given lines
+    of the INI section: the file name contains a 64-bit FNV-1a hash of these lines, the unit
+    conversion factors, the version of the binary format and the version string of the library
+    (AGAMA_VERSION, which includes the compilation date), so that the cache is invalidated
+    when the library is upgraded or rebuilt.
+    Return an empty string if the cache is disabled.
+*/
+std::string cacheFileName(const std::vector<std::string>& lines, const units::ExternalUnits& conv)
+{
+    if(cacheDirectory.empty())
+        return "";
+    std::string key = "AgamaPot" + utils::toString(BINARY_FORMAT_VERSION) +
+        " " + AGAMA_VERSION + "\n";
+    const double units[4] = { conv.lengthUnit, conv.velocityUnit, conv.massUnit, conv.timeUnit };
+    key.append(reinterpret_cast<const char*>(units), sizeof(units));
+    for(size_t i=0; i<lines.size(); i++)
+        key += "\n" + lines[i];
+    unsigned long long hash = 14695981039346656037ULL;
+    for(size_t i=0; i<key.size(); i++) {
+        hash ^= static_cast<unsigned char>(key[i]);
+        hash *= 1099511628211ULL;
+    }
+    char hex[17];
+    for(int i=0; i<16; i++)
+        hex[i] = "0123456789abcdef"[(hash >> (60 - 4*i)) & 15];
+    hex[16] = 0;
+    std::string dir = cacheDirectory;
+    if(dir[dir.size()-1] != DIRECTORY_SEPARATOR)
+        dir += DIRECTORY_SEPARATOR;
+    return dir + "agama_" + hex + ".bin";
+}
+
+/// load a potential from the cache file, or return an empty pointer if it is not available
+PtrPotential readCachedPotential(const std::string& fileName)
+{
+    if(fileName.empty())
+        return PtrPotential();
+    std::ifstream strm(fileName.c_str(), std::ios::in | std::ios::binary);
+    if(!strm)
+        return PtrPotential();
+    std::string data((std::istreambuf_iterator<char>(strm)), std::istreambuf_iterator<char>());
+    try{
+        PtrPotential pot = deserializePotential(data.data(), data.size());
+        FILTERMSG(utils::VL_DEBUG, "createPotential", "Loaded potential from cache " + fileName);
+        return pot;
+    }
+    catch(std::exception& ex) {  // corrupted or outdated file will be overwritten
+        utils::msg(utils::VL_WARNING, "createPotential",
+            "Ignoring invalid cache file " + fileName + ": " + ex.what());
+        return PtrPotential();
+    }
+}
+
+/** store a potential in the cache file; the data is first written into a temporary file, which
+    is then renamed, so that concurrent processes never read a partially written file */
+void writeCachedPotential(const std::string& fileName, const BasePotential& pot)
+{
+    if(fileName.empty())
+        return;
+    // the temporary file name must be unique among all processes and threads that may write
+    // the same cache file simultaneously: it contains the process id and the address of
+    // a local variable, which is different for all threads running concurrently in one process
+    const char localVar = 0;
+    const std::string tmpName = fileName + "." + utils::toString(static_cast<int>(getpid())) +
+        "." + utils::toString(static_cast<unsigned long>(reinterpret_cast<size_t>(&localVar)));
+    try{
+        const std::string data = serializePotential(pot);
+        std::ofstream strm(tmpName.c_str(), std::ios::out | std::ios::binary);
+        strm.write(data.data(), data.size());
+        strm.close();
+        if(!strm)
+            throw std::runtime_error("cannot write file " + tmpName);
+#ifdef _WIN32
+        std::remove(fileName.c_str());  // on Windows, rename fails if the file exists
+#endif
+        if(std::rename(tmpName.c_str(), fileName.c_str()) != 0)
+            throw std::runtime_error("cannot rename file " + tmpName);
+    }
+    catch(std::exception& ex) {  // not a critical error, but worth mentioning
+        std::remove(tmpName.c_str());
+        utils::msg(utils::VL_WARNING, "createPotential", std::string("Cannot cache potential: ") + ex.what());
+    }
+}
+
 /** General routine for creating a potential expansion from the provided INI parameters */
 PtrPotential createPotentialExpansion(const AllParam& param, const utils::KeyValueMap& kvmap)
 {
@@ -1291,6 +1475,11 @@ PtrPotential createPotentialExpansion(const AllParam& param, const utils::KeyVal
 
     // option 3: analytic density or potential model
     if(haveSource && !haveFile && !haveCoefs) {
+        // the result is fully determined by the INI parameters, so may be taken from the cache
+        const std::string cacheFile = cacheFileName(lines, param.converter);
+        PtrPotential pot = readCachedPotential(cacheFile);
+        if(pot)
+            return pot;
         // create a temporary density or potential model to serve as the source for potential expansion
         AllParam srcpar(param);
         srcpar.potentialType = param.densityType;
@@ -1298,12 +1487,14 @@ PtrPotential createPotentialExpansion(const AllParam& param, const utils::KeyVal
             param.densityType == PT_FERRERS ||
             param.densityType == PT_MIYAMOTONAGAI )
         {   // use an analytic potential as the source
-            return createPotentialExpansionFromSource(param, createAnalyticPotential(srcpar));
+            pot = createPotentialExpansionFromSource(param, createAnalyticPotential(srcpar));
         }
         else
         {   // otherwise use analytic density as the source
-            return createPotentialExpansionFromSource(param, createAnalyticDensity(srcpar));
+            pot = createPotentialExpansionFromSource(param, createAnalyticDensity(srcpar));
         }
+        writeCachedPotential(cacheFile, *pot);
+        return pot;
     }
 
     throw std::invalid_argument( (
@@ -1370,8 +1561,10 @@ PtrPotential readUniformAcceleration(const std::string& filename, const units::E
 
 // a collection of would-be potential components with a common set of modifiers
 struct Bunch {
-    // all potential components (DiskAnsatz or any other potential class)
+    // all potential components (except DiskAnsatz)
     std::vector<PtrPotential> componentsPot;
+    // parameters of disk components, whose DiskAnsatz parts are combined with the Multipole
+    std::vector<DiskParam> componentsDisk;
     // all density components that will contribute to a single additional Multipole potential
     std::vector<PtrDensity> componentsDens;
     // parameters of modifiers
@@ -1555,7 +1748,8 @@ PtrPotential createPotential(
     // each Disk group is represented by one potential component (DiskAnsatz) and two density
     // components ("residuals") that are added to the list of components of a CompositeDensity;
     // all Spheroid, Nuker and Sersic density profiles are also added to this CompositeDensity;
-    // and in the end a single Multipole potential is constructed from this density collection.
+    // and in the end a single Multipole potential is constructed from this density collection,
+    // and combined with all DiskAnsatz components into a single GalPot potential.
     // 2) Any parameter group may have one or more modifiers (center, rotation, orientation, scale).
     // As a consequence of the two circumstances, the elements of GalPot scheme sharing a common
     // list of modifiers are grouped into a single bunch of DiskAnsatz+Multipole combinations,
@@ -1594,8 +1788,8 @@ PtrPotential createPotential(
         // possibly potential components
         case PT_DISK: {
             DiskParam dparam = parseDiskParam(param);
-            // the two parts of disk profile: DiskAnsatz goes to the list of potentials...
-            bunch.componentsPot.push_back(PtrPotential(new DiskAnsatz(dparam)));
+            // the two parts of disk profile: DiskAnsatz goes to the list of disks...
+            bunch.componentsDisk.push_back(dparam);
             // ...and gets subtracted from the entire DiskDensity for the list of density components
             bunch.componentsDens.push_back(PtrDensity(new DiskDensity(dparam)));
             dparam.surfaceDensity *= -1;  // subtract the density of DiskAnsatz
@@ -1648,10 +1842,13 @@ PtrPotential createPotential(
                 totalDens = bunch->componentsDens[0];
             else
                 totalDens.reset(new CompositeDensity(bunch->componentsDens));
-            bunch->componentsPot.push_back(Multipole::create(*totalDens,
+            PtrPotential multipole = Multipole::create(*totalDens,
                 bunch->galpot_lmax>=0 ? bunch->galpot_lmax : (isSpherical   (*totalDens) ? 0 : GALPOT_LMAX),
                 bunch->galpot_mmax>=0 ? bunch->galpot_mmax : (isAxisymmetric(*totalDens) ? 0 : GALPOT_MMAX),
-                GALPOT_NRAD));
+                GALPOT_NRAD);
+            // if there are any disks, their DiskAnsatz parts are evaluated together with the Multipole
+            bunch->componentsPot.push_back(bunch->componentsDisk.empty() ? multipole :
+                PtrPotential(new GalPot(bunch->componentsDisk, multipole)));
         }
         if(bunch->modifiers.empty()) {
             // add all components with no modifiers individually to the overall list
@@ -1832,6 +2029,344 @@ PtrPotential readGalaxyPotential(const std::string& filename, const units::Exter
 
 ///@}
 
+/// \name Binary serialization of potential expansions
+//        ---------------------------------------------
+///@{
+
+namespace {
+
+/// signature at the beginning of binary data, followed by the format version
+static const char BINARY_SIGNATURE[8] = {'A','g','a','m','a','P','o','t'};
+
+/// helper class for appending binary data to a string
+class BinaryWriter {
+    std::string& buf;
+public:
+    explicit BinaryWriter(std::string& _buf) : buf(_buf) {}
+    void raw(const void* data, size_t size) {
+        buf.append(static_cast<const char*>(data), size);
+    }
+    void integer(long val) { raw(&val, sizeof(val)); }
+    void number(double val) { raw(&val, sizeof(val)); }
+    void string(const std::string& str) {
+        integer(str.size());
+        raw(str.data(), str.size());
+    }
+    void array(const std::vector<double>& arr) {
+        integer(arr.size());
+        if(!arr.empty())
+            raw(&arr[0], arr.size() * sizeof(double));
+    }
+    void arrays(const std::vector< std::vector<double> >& arr) {
+        integer(arr.size());
+        for(size_t i=0; i<arr.size(); i++)
+            array(arr[i]);
+    }
+    void matrices(const std::vector< math::Matrix<double> >& arr) {
+        integer(arr.size());
+        for(size_t i=0; i<arr.size(); i++) {
+            integer(arr[i].rows());
+            integer(arr[i].cols());
+            if(arr[i].rows() * arr[i].cols() > 0)
+                raw(arr[i].data(), arr[i].rows() * arr[i].cols() * sizeof(double));
+        }
+    }
+};
+
+/// helper class for reading binary data with bound checks
+class BinaryReader {
+    const char* ptr;
+    const char* end;
+public:
+    BinaryReader(const char* data, size_t size) : ptr(data), end(data+size) {}
+    void raw(void* data, size_t size) {
+        if(size > static_cast<size_t>(end-ptr))
+            throw std::runtime_error("deserializePotential: unexpected end of data");
+        std::copy(ptr, ptr+size, static_cast<char*>(data));
+        ptr += size;
+    }
+    long integer() {
+        long val;
+        raw(&val, sizeof(val));
+        if(val < 0)
+            throw std::runtime_error("deserializePotential: corrupted data");
+        return val;
+    }
+    /// read the number of elements that follow, each occupying at least elemSize bytes,
+    /// and check that they fit into the remaining data before anything is allocated
+    size_t count(size_t elemSize) {
+        size_t num = integer();
+        if(num > static_cast<size_t>(end-ptr) / elemSize)
+            throw std::runtime_error("deserializePotential: unexpected end of data");
+        return num;
+    }
+    double number() {
+        double val;
+        raw(&val, sizeof(val));
+        return val;
+    }
+    std::string string() {
+        std::string str(count(1), '\0');
+        if(!str.empty())
+            raw(&str[0], str.size());
+        return str;
+    }
+    std::vector<double> array() {
+        std::vector<double> arr(count(sizeof(double)));
+        if(!arr.empty())
+            raw(&arr[0], arr.size() * sizeof(double));
+        return arr;
+    }
+    std::vector< std::vector<double> > arrays() {
+        // each array is preceded by its length
+        std::vector< std::vector<double> > arr(count(sizeof(long)));
+        for(size_t i=0; i<arr.size(); i++)
+            arr[i] = array();
+        return arr;
+    }
+    std::vector< math::Matrix<double> > matrices() {
+        // each matrix is preceded by the number of rows and columns
+        std::vector< math::Matrix<double> > arr(count(2 * sizeof(long)));
+        for(size_t i=0; i<arr.size(); i++) {
+            size_t rows = integer(), cols = integer();
+            if(rows > 0 && cols > static_cast<size_t>(end-ptr) / sizeof(double) / rows)
+                throw std::runtime_error("deserializePotential: unexpected end of data");
+            arr[i] = math::Matrix<double>(rows, cols);
+            if(rows*cols>0)
+                raw(arr[i].data(), rows * cols * sizeof(double));
+        }
+        return arr;
+    }
+    bool finished() const { return ptr == end; }
+};
+
+void serializeAnyPotential(BinaryWriter& out, const BasePotential& pot)
+{
+    const Composite* co = dynamic_cast<const Composite*>(&pot);
+    if(co) {
+        out.string("Composite");
+        out.integer(co->size());
+        for(unsigned int i=0; i<co->size(); i++)
+            serializeAnyPotential(out, *co->component(i));
+        return;
+    }
+    const BasisSet* bs = dynamic_cast<const BasisSet*>(&pot);
+    if(bs) {
+        double eta, r0;
+        std::vector< std::vector<double> > coefs;
+        bs->getCoefs(eta, r0, coefs);
+        out.string(BasisSet::myName());
+        out.number(eta);
+        out.number(r0);
+        out.arrays(coefs);
+        return;
+    }
+    const Multipole* mu = dynamic_cast<const Multipole*>(&pot);
+    if(mu) {
+        std::vector<double> gridr;
+        std::vector< std::vector<double> > Phi, dPhi;
+        mu->getCoefs(gridr, Phi, dPhi);
+        out.string(Multipole::myName());
+        out.array(gridr);
+        out.arrays(Phi);
+        out.arrays(dPhi);
+        return;
+    }
+    const CylSpline* cy = dynamic_cast<const CylSpline*>(&pot);
+    if(cy) {
+        std::vector<double> gridR, gridz;
+        std::vector< math::Matrix<double> > Phi, dPhidR, dPhidz;
+        cy->getCoefs(gridR, gridz, Phi, dPhidR, dPhidz);
+        out.string(CylSpline::myName());
+        out.array(gridR);
+        out.array(gridz);
+        out.matrices(Phi);
+        out.matrices(dPhidR);
+        out.matrices(dPhidz);
+        return;
+    }
+    throw std::runtime_error("serializePotential: potential of type " + pot.name() +
+        " cannot be serialized");
+}
+
+PtrPotential deserializeAnyPotential(BinaryReader& in, const std::string& type)
+{
+    if(type == "Composite") {
+        // each component starts with the length of its type name
+        std::vector<PtrPotential> components(in.count(sizeof(long)));
+        for(size_t i=0; i<components.size(); i++)
+            components[i] = deserializeAnyPotential(in, in.string());
+        return PtrPotential(new Composite(components));
+    }
+    if(type == BasisSet::myName()) {
+        double eta = in.number(), r0 = in.number();
+        return PtrPotential(new BasisSet(eta, r0, in.arrays()));
+    }
+    if(type == Multipole::myName()) {
+        std::vector<double> gridr = in.array();
+        std::vector< std::vector<double> > Phi = in.arrays(), dPhi = in.arrays();
+        return PtrPotential(new Multipole(gridr, Phi, dPhi));
+    }
+    if(type == CylSpline::myName()) {
+        std::vector<double> gridR = in.array(), gridz = in.array();
+        std::vector< math::Matrix<double> > Phi = in.matrices(),
+            dPhidR = in.matrices(), dPhidz = in.matrices();
+        return PtrPotential(new CylSpline(gridR, gridz, Phi, dPhidR, dPhidz));
+    }
+    throw std::runtime_error("deserializePotential: unknown potential type " + type);
+}
+
+void serializeAnyDensity(BinaryWriter& out, const BaseDensity& dens)
+{
+    const BasePotential* pot = dynamic_cast<const BasePotential*>(&dens);
+    if(pot) {
+        serializeAnyPotential(out, *pot);
+        return;
+    }
+    const CompositeDensity* co = dynamic_cast<const CompositeDensity*>(&dens);
+    if(co) {
+        out.string("CompositeDensity");
+        out.integer(co->size());
+        for(unsigned int i=0; i<co->size(); i++)
+            serializeAnyDensity(out, *co->component(i));
+        return;
+    }
+    const DensitySphericalHarmonic* sh = dynamic_cast<const DensitySphericalHarmonic*>(&dens);
+    if(sh) {
+        std::vector<double> gridr;
+        std::vector< std::vector<double> > coefs;
+        sh->getCoefs(gridr, coefs);
+        out.string(DensitySphericalHarmonic::myName());
+        out.array(gridr);
+        out.arrays(coefs);
+        return;
+    }
+    const DensityAzimuthalHarmonic* ah = dynamic_cast<const DensityAzimuthalHarmonic*>(&dens);
+    if(ah) {
+        std::vector<double> gridR, gridz;
+        std::vector< math::Matrix<double> > coefs;
+        ah->getCoefs(gridR, gridz, coefs);
+        out.string(DensityAzimuthalHarmonic::myName());
+        out.array(gridR);
+        out.array(gridz);
+        out.matrices(coefs);
+        return;
+    }
+    throw std::runtime_error("serializeDensity: density of type " + dens.name() +
+        " cannot be serialized");
+}
+
+PtrDensity deserializeAnyDensity(BinaryReader& in)
+{
+    std::string type = in.string();
+    if(type == "CompositeDensity") {
+        std::vector<PtrDensity> components(in.count(sizeof(long)));
+        for(size_t i=0; i<components.size(); i++)
+            components[i] = deserializeAnyDensity(in);
+        return PtrDensity(new CompositeDensity(components));
+    }
+    if(type == DensitySphericalHarmonic::myName()) {
+        std::vector<double> gridr = in.array();
+        return PtrDensity(new DensitySphericalHarmonic(gridr, in.arrays()));
+    }
+    if(type == DensityAzimuthalHarmonic::myName()) {
+        std::vector<double> gridR = in.array(), gridz = in.array();
+        return PtrDensity(new DensityAzimuthalHarmonic(gridR, gridz, in.matrices()));
+    }
+    return deserializeAnyPotential(in, type);
+}
+
+/// check the signature and the version at the beginning of binary data
+BinaryReader openBinaryData(const char* data, size_t size)
+{
+    if(size < sizeof(BINARY_SIGNATURE) ||
+        !std::equal(BINARY_SIGNATURE, BINARY_SIGNATURE + sizeof(BINARY_SIGNATURE), data))
+        throw std::runtime_error("deserializePotential: data does not contain a potential");
+    BinaryReader in(data + sizeof(BINARY_SIGNATURE), size - sizeof(BINARY_SIGNATURE));
+    if(in.integer() != BINARY_FORMAT_VERSION)
+        throw std::runtime_error("deserializePotential: incompatible version");
+    return in;
+}
+
+}  // internal ns
+
+std::string serializePotential(const BasePotential& potential)
+{
+    std::string result(BINARY_SIGNATURE, sizeof(BINARY_SIGNATURE));
+    BinaryWriter out(result);
+    out.integer(BINARY_FORMAT_VERSION);
+    serializeAnyPotential(out, potential);
+    return result;
+}
+
+PtrPotential deserializePotential(const char* data, size_t size)
+{
+    BinaryReader in = openBinaryData(data, size);
+    PtrPotential result = deserializeAnyPotential(in, in.string());
+    if(!in.finished())
+        throw std::runtime_error("deserializePotential: trailing data");
+    return result;
+}
+
+std::string serializeDensity(const BaseDensity& density)
+{
+    std::string result(BINARY_SIGNATURE, sizeof(BINARY_SIGNATURE));
+    BinaryWriter out(result);
+    out.integer(BINARY_FORMAT_VERSION);
+    serializeAnyDensity(out, density);
+    return result;
+}
+
+PtrDensity deserializeDensity(const char* data, size_t size)
+{
+    BinaryReader in = openBinaryData(data, size);
+    PtrDensity result = deserializeAnyDensity(in);
+    if(!in.finished())
+        throw std::runtime_error("deserializePotential: trailing data");
+    return result;
+}
+
+void exportPotentialCoefsToSharedMemory(const std::string& name, const BasePotential& potential)
+{
+    const std::string data = serializePotential(potential);
+    // the segment stores the length of the data followed by the data itself,
+    // since the size of the segment itself may be rounded up by the system
+    const long length = data.size();
+    utils::SharedMemorySegment segment(name, sizeof(length) + data.size());
+    char* ptr = static_cast<char*>(segment.data());
+    std::copy(reinterpret_cast<const char*>(&length), reinterpret_cast<const char*>(&length + 1), ptr);
+    std::copy(data.begin(), data.end(), ptr + sizeof(length));
+}
+
+PtrPotential loadPotentialFromSharedMemory(const std::string& name)
+{
+    const utils::SharedMemorySegment segment(name);
+    const char* ptr = static_cast<const char*>(segment.data());
+    long length = 0;
+    if(segment.size() >= sizeof(length))
+        std::copy(ptr, ptr + sizeof(length), reinterpret_cast<char*>(&length));
+    if(length <= 0 || static_cast<size_t>(length) > segment.size() - sizeof(length))
+        throw std::runtime_error("loadPotentialFromSharedMemory: invalid data in " + name);
+    return deserializePotential(ptr + sizeof(length), length);
+}
+
+void setCacheDirectory(const std::string& directory)
+{
+    cacheDirectory = directory;
+}
+
+std::string getCacheDirectory()
+{
+    return cacheDirectory;
+}
+
+std::string getCacheFileName(const utils::KeyValueMap& params, const units::ExternalUnits& converter)
+{
+    return cacheFileName(params.dumpLines(), converter);
+}
+
+///@}
+
 bool writeDensity(const std::string& fileName, const BaseDensity& dens,
     const units::ExternalUnits& converter)
 {
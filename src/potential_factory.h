@@ -277,6 +277,100 @@ inline bool writePotential(
     return writeDensity(fileName, potential, converter); }
 
 
+/** Serialize a potential into a compact binary representation.
+    Unlike `writePotential`, the data is stored in internal units with full precision and in
+    the native byte order, so it is intended for exchanging potentials between processes running
+    on the same machine (e.g., via shared memory), not for long-term storage.
+    Supported are the potential expansions (`BasisSet`, `Multipole`, `CylSpline`)
+    and composite potentials consisting of these classes (the hierarchy is preserved).
+    \param[in]  potential  is the potential to be serialized;
+    \return  a string containing the binary data;
+    \throw   std::runtime_error if the potential (or one of its components) is of unsupported type.
+*/
+std::string serializePotential(const BasePotential& potential);
+
+/** Reconstruct a potential from its binary representation produced by `serializePotential`.
+    \param[in]  data  is the pointer to the binary data;
+    \param[in]  size  is its length in bytes;
+    \return  a new instance of potential;
+    \throw   std::runtime_error if the data is corrupted or was produced by an incompatible version.
+*/
+PtrPotential deserializePotential(const char* data, size_t size);
+
+/** Serialize a density model into the same binary format as `serializePotential`.
+    Supported are all potentials accepted by `serializePotential`, the density expansions
+    (`DensitySphericalHarmonic`, `DensityAzimuthalHarmonic`) and composite densities
+    consisting of these classes.
+    \param[in]  density  is the density model to be serialized;
+    \return  a string containing the binary data;
+    \throw   std::runtime_error if the density (or one of its components) is of unsupported type.
+*/
+std::string serializeDensity(const BaseDensity& density);
+
+/** Reconstruct a density model from its binary representation produced by `serializeDensity`
+    or `serializePotential` (in the latter case the returned object is a potential).
+    \param[in]  data  is the pointer to the binary data;
+    \param[in]  size  is its length in bytes;
+    \return  a new instance of density;
+    \throw   std::runtime_error if the data is corrupted or was produced by an incompatible version.
+*/
+PtrDensity deserializeDensity(const char* data, size_t size);
+
+/** Store the coefficients of a potential expansion in a named shared-memory segment, so that
+    other processes on the same machine may reconstruct it by `loadPotentialFromSharedMemory`
+    without repeating the costly computation of the coefficients.
+    This is a transport mechanism for the coefficients only, not a way of sharing the potential
+    object itself: each process that loads it owns a full private copy (see below).
+    The segment remains in the system until removed by `utils::SharedMemorySegment::remove`.
+    \param[in]  name  is the name of the segment, which must not exist yet;
+    \param[in]  potential  is the potential (same restrictions as in `serializePotential`);
+    \throw   std::runtime_error if the segment cannot be created or the potential is not supported.
+*/
+void exportPotentialCoefsToSharedMemory(const std::string& name, const BasePotential& potential);
+
+/** Reconstruct a potential from the coefficients stored in a shared-memory segment
+    by `exportPotentialCoefsToSharedMemory`.
+    The segment is mapped read-only only for the duration of this call: the coefficients are
+    copied out of it and the interpolating splines are constructed anew in the private memory
+    of the calling process, so the memory footprint is the same as for a potential constructed
+    from scratch. Action finders and other interpolation tables cannot be transported this way.
+    \param[in]  name  is the name of the segment;
+    \return  a new instance of potential;
+    \throw   std::runtime_error if the segment does not exist or contains invalid data.
+*/
+PtrPotential loadPotentialFromSharedMemory(const std::string& name);
+
+/** Set the directory for the persistent cache of potential expansions.
+    When it is not empty, every potential expansion constructed from an analytic density or
+    potential model given by INI parameters (`density=...` or `potential=...` in the section of
+    Multipole, CylSpline or BasisSet type) is stored in this directory in the binary format of
+    `serializePotential`, under a file name derived from the hash of all parameters in this
+    section, the unit conversion factors, the version of the binary format and the version
+    string of the library (AGAMA_VERSION in utils.h, which includes the compilation date of
+    the potential factory, so the cache is invalidated by upgrading or rebuilding the library).
+    A subsequent request with identical parameters loads the expansion from this file instead
+    of constructing it again. A file that cannot be read is recomputed and overwritten,
+    and a warning is issued.
+    The cache is disabled by default, unless the environment variable AGAMA_CACHE_DIR is set;
+    the directory must exist and is not cleaned automatically.
+    \param[in]  directory  is the path to the cache directory, or an empty string to disable it.
+*/
+void setCacheDirectory(const std::string& directory);
+
+/// return the current cache directory (empty if caching is disabled)
+std::string getCacheDirectory();
+
+/** return the name of the file in the cache directory corresponding to the potential expansion
+    defined by the given INI parameters (regardless of whether this file exists),
+    or an empty string if the cache is disabled; this may be used to remove outdated entries.
+    \param[in]  params  are the parameters of the potential expansion;
+    \param[in]  converter  is the unit converter (the same as used in `createPotential`).
+*/
+std::string getCacheFileName(
+    const utils::KeyValueMap& params,
+    const units::ExternalUnits& converter = units::ExternalUnits());
+
+
 /** return the symmetry type encoded in the string.
     Spherical, Axisymmetric, Triaxial and None are recognized by the first letter,
     whereas other types must be given by their numerical code.
@@ -3,6 +3,7 @@
 #include "math_specfunc.h"
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
 
 namespace potential {
 
@@ -12,16 +13,61 @@ const double ACCURACY_ROOT = 1e-6;
 /// max. radius (in units of scale radii) beyond which to use an asymptotic quadrupole expansion
 const double MAX_RADIUS = 10.0;
 
+/// the number of nodes in the grid in log(1+lambda/c^2) for interpolating the coefficients W_i:
+/// the error of quintic spline interpolation scales as the 6th power of the grid spacing,
+/// so the number of nodes is NODES_LAMBDA_FACTOR * accuracy^(-1/6), within the given limits
+const double NODES_LAMBDA_FACTOR = 3.;
+const int MIN_NODES_LAMBDA = 16, MAX_NODES_LAMBDA = 1000;
+
+/// relative accuracy of Newton iterations for lambda and max.number of iterations
+const double ACCURACY_NEWTON = 1e-12;
+const int MAX_ITER_NEWTON = 100;
+
+/// powers of (a^2+lambda), (b^2+lambda) and (c^2+lambda) in the integrands of coefficients W_i
+static const int W_POWERS[20][3] = {
+    {0,0,0}, {1,0,0}, {0,1,0}, {0,0,1}, {1,1,0}, {0,1,1}, {1,0,1}, {2,0,0}, {0,2,0}, {0,0,2},
+    {1,1,1}, {1,2,0}, {0,1,2}, {2,0,1}, {2,1,0}, {0,2,1}, {1,0,2}, {3,0,0}, {0,3,0}, {0,0,3} };
+
 // Ferrers n=2 potential
 
-Ferrers::Ferrers(double _mass, double _R, double _p, double _q):
-    BasePotentialCar(), a(_R), b(_R*_p), c(_R*_q), mass(_mass), rho0( mass*105./(32*M_PI*a*b*c) )
+Ferrers::Ferrers(double _mass, double _R, double _p, double _q, bool _exact, double accuracy):
+    BasePotentialCar(), a(_R), b(_R*_p), c(_R*_q), mass(_mass), rho0( mass*105./(32*M_PI*a*b*c) ),
+    exact(_exact)
 {
     if(!(_R > 0))
         throw std::invalid_argument("Ferrers potential: scale radius should be positive");
     if(!(1 > _p && _p > _q && _q > 0))
         throw std::invalid_argument("Ferrers potential: axis ratios must satisfy 0 < q < p < 1");
+    if(!(accuracy > 0 && accuracy < 1))
+        throw std::invalid_argument("Ferrers potential: accuracy must be between 0 and 1");
     computeW(0, W0);
+    if(exact)
+        return;
+    const int numNodes = std::min(MAX_NODES_LAMBDA, std::max(MIN_NODES_LAMBDA,
+        (int)ceil(NODES_LAMBDA_FACTOR * pow(accuracy, -1./6))));
+    // tabulate the coefficients W_i as functions of lambda outside the model, up to the radius
+    // where the asymptotic expansion takes over; each W_i is an integral over u from lambda to
+    // infinity of 1 / sqrt((a^2+u) (b^2+u) (c^2+u)) / (a^2+u)^i / (b^2+u)^j / (c^2+u)^k,
+    // so its derivative by lambda is known analytically, and we construct quintic splines
+    // for log(W_i) as functions of t = log(1+lambda/c^2)
+    std::vector<double> tgrid = math::createUniformGrid(numNodes, 0,
+        log(1 + pow_2(MAX_RADIUS * a / c)));
+    std::vector< std::vector<double> >
+        logW(20, std::vector<double>(numNodes)),
+        derW(20, std::vector<double>(numNodes));
+    for(int n=0; n<numNodes; n++) {
+        double lambda = (exp(tgrid[n]) - 1) * c*c, W[20];
+        computeW(lambda, W);
+        double A = a*a+lambda, B = b*b+lambda, C = c*c+lambda, denom = sqrt(A*B*C);
+        for(int i=0; i<20; i++) {
+            logW[i][n] = log(W[i]);
+            derW[i][n] = -C / denom / (math::pow(A, W_POWERS[i][0]) *
+                math::pow(B, W_POWERS[i][1]) * math::pow(C, W_POWERS[i][2]) * W[i]);
+        }
+    }
+    Wspl.resize(20);
+    for(int i=0; i<20; i++)
+        Wspl[i] = math::QuinticSpline(tgrid, logW[i], derW[i]);
 }
 
 double Ferrers::densityCar(const coord::PosCar& pos, double /*time*/) const
@@ -85,11 +131,25 @@ void Ferrers::evalCar(const coord::PosCar &pos,
     }
     double Wcurr[20];  // temp.coefs for lambda>0 if needed
     const double *W;   // coefs used in computation (either pre-computed or temp.)
-    if(m2>1) {
+    if(m2>1 && exact) {
         FerrersLambdaRootFinder fnc(pos.x, pos.y, pos.z, a, b, c);
         double lambda = math::findRoot(fnc, math::ScalingSemiInf(), ACCURACY_ROOT);
         computeW(lambda, Wcurr);
         W = Wcurr;
+    } else if(m2>1) {
+        // find lambda by Newton iterations starting from a lower bound, where the function
+        // x^2/(a^2+lambda) + y^2/(b^2+lambda) + z^2/(c^2+lambda) - 1  is positive;
+        // since it is convex and decreasing, the iterations approach the root monotonically
+        double a2 = a*a, b2 = b*b, c2 = c*c, lambda = fmax(0, r2 - a2);
+        for(int iter=0; iter<MAX_ITER_NEWTON; iter++) {
+            double fa = X2 / (lambda+a2), fb = Y2 / (lambda+b2), fc = Z2 / (lambda+c2);
+            double delta = (fa + fb + fc - 1) / (fa / (lambda+a2) + fb / (lambda+b2) + fc / (lambda+c2));
+            lambda += delta;
+            if(delta <= ACCURACY_NEWTON * (lambda+c2))
+                break;
+        }
+        interpolateW(fmax(lambda, 0), Wcurr);
+        W = Wcurr;
     } else 
         W=W0;  // use pre-computed coefs inside the model
     if(potential) {
@@ -163,4 +223,11 @@ void Ferrers::computeW(double lambda, double W[20]) const
     W[19]= (2/denom/pow_2(c*c+lambda) - W[16] - W[12])/5;  // W_003
 }
 
+void Ferrers::interpolateW(double lambda, double W[20]) const
+{
+    double t = log(1 + lambda / (c*c));
+    for(int i=0; i<20; i++)
+        W[i] = exp(Wspl[i](t));
+}
+
 }  // namespace potential
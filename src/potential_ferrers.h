@@ -5,6 +5,7 @@
 */
 #pragma once
 #include "potential_base.h"
+#include "math_spline.h"
 
 namespace potential {
 
@@ -14,11 +15,26 @@ namespace potential {
     the density is zero if r>Rscale.
     The potential is calculated using expressions from Pfenniger(1984) with elliptic integrals, 
     under assumption that q<p<1 strictly (will not work if any of two axes are equal).
+    Outside the model, these expressions involve 20 coefficients that depend on the root lambda
+    of the equation  x^2/(a^2+lambda) + y^2/(b^2+lambda) + z^2/(c^2+lambda) = 1 ;
+    by default, these coefficients are interpolated from a table precomputed at construction,
+    and lambda is found by a few Newton iterations, so that no elliptic integrals need
+    to be evaluated at each point (the resolution of the table is determined by the required
+    relative accuracy, given as the last argument of the constructor or the parameter `accuracy`
+    in the potential factory). However, the coefficients themselves are computed by recurrence
+    relations that lose precision at large lambda, so the relative error of the potential and
+    force cannot be reduced below ~1e-7 and ~1e-6, respectively. The original (exact) method,
+    in which the coefficients are computed directly, is retained for validation and may be
+    selected in the constructor (or by the parameter exact=true in the potential factory);
+    its accuracy is limited to ~1e-6 by the tolerance of the root-finder for lambda.
 */
 class Ferrers: public BasePotentialCar {
 public:
-    /// Construct the potential for the following parameters: mass, radius, axis ratios p=y/x, q=z/x
-    Ferrers(double _mass, double _R, double _axisRatioY, double _axisRatioZ);
+    /// Construct the potential for the following parameters: mass, radius, axis ratios p=y/x, q=z/x;
+    /// the optional argument `exact` selects the exact evaluation of coefficients instead of
+    /// interpolation, and `accuracy` determines the resolution of the interpolation table
+    Ferrers(double _mass, double _R, double _axisRatioY, double _axisRatioZ, bool _exact=false,
+        double accuracy=1e-8);
     ~Ferrers() {};
     virtual std::string name() const { return myName(); }
     static std::string myName() { return "Ferrers"; }
@@ -27,6 +43,9 @@ private:
     const double a, b, c;       ///< principal axis of ellipsoidal density 
     const double mass, rho0;    ///< total mass and central density of the model
     double W0[20];              ///< pre-computed coefficients for lambda=0
+    const bool exact;           ///< whether to compute the coefficients exactly for each point
+    /// interpolators for log(W_i) as functions of log(1+lambda/c^2), used if exact==false
+    std::vector<math::QuinticSpline> Wspl;
 
     virtual void evalCar(const coord::PosCar &pos,
         double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const;
@@ -37,6 +56,9 @@ private:
         \param[in] lambda is zero inside the model and >0 outside;
         \param[out] W is the array of 20 coefs  */
     void computeW(double lambda, double W[20]) const;
+
+    /** compute the same coefficients by interpolation from the precomputed table */
+    void interpolateW(double lambda, double W[20]) const;
 };
 
 }  // namespace
@@ -0,0 +1,181 @@
+#include "potential_mge.h"
+#include "math_core.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace potential {
+
+/// the integrand of the potential is negligibly small (<exp(-MAX_EXPONENT)) for u > u_max,
+/// with  u_max^2 r^2 / (2 s^2) = MAX_EXPONENT,  so the integration interval is cut at this point
+static const double MAX_EXPONENT = 40.5;
+
+MGE::MGE(const std::vector<double>& masses, const std::vector<double>& sigmaX,
+    const std::vector<double>& sigmaY, const std::vector<double>& sigmaZ) :
+    BasePotentialCar(), mass(masses), mtotal(0)
+{
+    const size_t size = masses.size();
+    if(size == 0 || sigmaX.size() != size || sigmaY.size() != size || sigmaZ.size() != size)
+        throw std::invalid_argument("MGE: input arrays must be non-empty and have equal lengths");
+    bool axisym = true, spher = true;
+    rho0.resize(size);
+    ax.resize(size);
+    ay.resize(size);
+    az.resize(size);
+    smax.resize(size);
+    ex.resize(size);
+    ey.resize(size);
+    ez.resize(size);
+    for(size_t k=0; k<size; k++) {
+        double sx = sigmaX[k], sy = sigmaY[k], sz = sigmaZ[k];
+        if(!(sx > 0 && sy > 0 && sz > 0 && isFinite(sx + sy + sz + masses[k])))
+            throw std::invalid_argument("MGE: widths of all components must be positive");
+        rho0[k] = masses[k] / (pow(2*M_PI, 1.5) * sx * sy * sz);
+        ax[k]   = 0.5 / pow_2(sx);
+        ay[k]   = 0.5 / pow_2(sy);
+        az[k]   = 0.5 / pow_2(sz);
+        smax[k] = fmax(fmax(sx, sy), sz);
+        ex[k]   = 1 - pow_2(sx / smax[k]);
+        ey[k]   = 1 - pow_2(sy / smax[k]);
+        ez[k]   = 1 - pow_2(sz / smax[k]);
+        mtotal += masses[k];
+        axisym &= sx == sy;
+        spher  &= sx == sy && sx == sz;
+    }
+    sym = spher ? coord::ST_SPHERICAL : axisym ? coord::ST_AXISYMMETRIC : coord::ST_TRIAXIAL;
+
+    // Gauss-Legendre rule for the integration variable t in [0:1], substituting u = t (2-t):
+    // this stretches the region near u=1, where the integrand of a strongly flattened component
+    // varies rapidly (it has a singularity at u = 1/sqrt(e) ~ 1 + q^2/2, q being the axis ratio)
+    double glnodes[NUM_NODES], glweights[NUM_NODES];
+    math::prepareIntegrationTableGL(0, 1, NUM_NODES, glnodes, glweights);
+    for(int j=0; j<NUM_NODES; j++) {
+        nodes  [j] = glnodes[j] * (2 - glnodes[j]);
+        weights[j] = glweights[j] * 2 * (1 - glnodes[j]);
+    }
+}
+
+void MGE::getComponent(unsigned int k,
+    double& compMass, double& sigmaX, double& sigmaY, double& sigmaZ) const
+{
+    if(k >= mass.size())
+        throw std::out_of_range("MGE: component index out of range");
+    compMass = mass[k];
+    sigmaX = sqrt(0.5 / ax[k]);
+    sigmaY = sqrt(0.5 / ay[k]);
+    sigmaZ = sqrt(0.5 / az[k]);
+}
+
+double MGE::densityCar(const coord::PosCar &pos, double /*time*/) const
+{
+    const double x2 = pow_2(pos.x), y2 = pow_2(pos.y), z2 = pow_2(pos.z);
+    const size_t size = rho0.size();
+    const double *r0 = &rho0[0], *a = &ax[0], *b = &ay[0], *c = &az[0];
+    double result = 0;
+    // a single fused loop over all components, which may be vectorized by the compiler
+#ifdef _OPENMP
+#pragma omp simd reduction(+:result)
+#endif
+    for(size_t k=0; k<size; k++)
+        result += r0[k] * exp(-a[k] * x2 - b[k] * y2 - c[k] * z2);
+    return result;
+}
+
+void MGE::evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+    double values[], double /*time*/) const
+{
+    for(size_t p=0; p<npoints; p++)
+        values[p] = 0;
+    for(size_t k=0; k<rho0.size(); k++) {
+        const double r0 = rho0[k], a = ax[k], b = ay[k], c = az[k];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(size_t p=0; p<npoints; p++)
+            values[p] += r0 * exp(-a * pow_2(pos[p].x) - b * pow_2(pos[p].y) - c * pow_2(pos[p].z));
+    }
+}
+
+void MGE::evalCar(const coord::PosCar &pos,
+    double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double /*time*/) const
+{
+    const double x2 = pow_2(pos.x), y2 = pow_2(pos.y), z2 = pow_2(pos.z), r2 = x2 + y2 + z2;
+    double Phi = 0, grad[3] = {0}, hess[6] = {0};
+    for(size_t k=0; isFinite(r2) && k<mass.size(); k++) {  // all values are zero at infinity
+        const double is2 = 1 / pow_2(smax[k]), rs2 = r2 * is2,
+        // upper limit of integration in u (reduced at large radii), which scales all nodes
+        U = rs2 > 2*MAX_EXPONENT ? sqrt(2*MAX_EXPONENT / rs2) : 1;
+        // accumulators for the integrals of the potential (P), the first (S) and second (T)
+        // derivatives of the exponent w.r.t. x_i^2, weighted by the integrand
+        double P = 0, S[3] = {0}, T[6] = {0};
+        for(int j=0; j<NUM_NODES; j++) {
+            const double u2 = pow_2(U * nodes[j]),
+            d0 = 1 / (1 - ex[k] * u2),
+            d1 = 1 / (1 - ey[k] * u2),
+            d2 = 1 / (1 - ez[k] * u2),
+            // a_i = u^2 / (1 - e_i u^2), so that the exponent is  -sum_i x_i^2 a_i / (2 s^2)
+            a0 = u2 * d0, a1 = u2 * d1, a2 = u2 * d2,
+            f  = U * weights[j] * sqrt(d0 * d1 * d2) *
+                exp(-0.5 * is2 * (x2 * a0 + y2 * a1 + z2 * a2));
+            P += f;
+            if(deriv || deriv2) {
+                S[0] += f * a0;
+                S[1] += f * a1;
+                S[2] += f * a2;
+            }
+            if(deriv2) {
+                T[0] += f * a0 * a0;
+                T[1] += f * a1 * a1;
+                T[2] += f * a2 * a2;
+                T[3] += f * a0 * a1;
+                T[4] += f * a1 * a2;
+                T[5] += f * a0 * a2;
+            }
+        }
+        double coef = sqrt(2/M_PI) * mass[k] / smax[k];
+        Phi -= coef * P;
+        coef *= is2;
+        grad[0] += coef * pos.x * S[0];
+        grad[1] += coef * pos.y * S[1];
+        grad[2] += coef * pos.z * S[2];
+        hess[0] += coef * (S[0] - is2 * x2 * T[0]);
+        hess[1] += coef * (S[1] - is2 * y2 * T[1]);
+        hess[2] += coef * (S[2] - is2 * z2 * T[2]);
+        hess[3] -= coef * is2 * pos.x * pos.y * T[3];
+        hess[4] -= coef * is2 * pos.y * pos.z * T[4];
+        hess[5] -= coef * is2 * pos.x * pos.z * T[5];
+    }
+    if(potential)
+        *potential = Phi;
+    if(deriv) {
+        deriv->dx = grad[0];
+        deriv->dy = grad[1];
+        deriv->dz = grad[2];
+    }
+    if(deriv2) {
+        deriv2->dx2  = hess[0];
+        deriv2->dy2  = hess[1];
+        deriv2->dz2  = hess[2];
+        deriv2->dxdy = hess[3];
+        deriv2->dydz = hess[4];
+        deriv2->dxdz = hess[5];
+    }
+}
+
+double MGE::projectedDensity(double X, double Y, const coord::Orientation& orientation) const
+{
+    const double* R = orientation.mat;
+    double result = 0;
+    for(size_t k=0; k<mass.size(); k++) {
+        // covariance matrix of the projected 2d Gaussian: upper-left block of  R diag(sigma^2) R^T
+        const double sx2 = 0.5 / ax[k], sy2 = 0.5 / ay[k], sz2 = 0.5 / az[k],
+        cXX = R[0] * R[0] * sx2 + R[1] * R[1] * sy2 + R[2] * R[2] * sz2,
+        cYY = R[3] * R[3] * sx2 + R[4] * R[4] * sy2 + R[5] * R[5] * sz2,
+        cXY = R[0] * R[3] * sx2 + R[1] * R[4] * sy2 + R[2] * R[5] * sz2,
+        det = cXX * cYY - cXY * cXY;
+        result += mass[k] / (2*M_PI * sqrt(det)) *
+            exp(-0.5 * (cYY * X * X - 2 * cXY * X * Y + cXX * Y * Y) / det);
+    }
+    return result;
+}
+
+}  // namespace potential
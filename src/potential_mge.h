@@ -0,0 +1,88 @@
+/** \file    potential_mge.h
+    \brief   Multi-Gaussian Expansion density and potential
+    \author  Eugene Vasiliev
+    \date    2026
+
+    A Multi-Gaussian Expansion (MGE) represents the density profile as a sum of coaxial
+    triaxial Gaussians, which is a common way of parametrizing the surface brightness
+    of galaxies (e.g., Emsellem+1994, Cappellari 2002) and deprojecting it into a 3d model.
+    Each component has a total mass M_k and three widths sigma_{x,y,z}; its density is
+    \f$  \rho_k = \frac{M_k}{(2\pi)^{3/2} \sigma_x \sigma_y \sigma_z}
+    \exp\big[ -\frac{x^2}{2\sigma_x^2} -\frac{y^2}{2\sigma_y^2} -\frac{z^2}{2\sigma_z^2} \big]  \f$.
+    The potential of each component is given by a 1d integral (Chandrasekhar 1969), which,
+    after a change of variable, reads
+    \f$  \Phi_k = -\sqrt{2/\pi}\, \frac{G M_k}{s} \int_0^1 du\,
+    \exp\big[ -\frac{u^2}{2 s^2} \sum_i \frac{x_i^2}{1 - e_i u^2} \big]
+    \Big/ \sqrt{\prod_i (1 - e_i u^2)}  \f$,
+    where s is the largest of the three widths and  \f$  e_i = 1 - \sigma_i^2 / s^2  \f$.
+    It is computed with a fixed Gauss-Legendre rule (the same nodes for all components),
+    after a further substitution that regularizes the integrand for strongly flattened Gaussians;
+    the upper limit is reduced at large radii, where the integrand is concentrated near u=0.
+    This gives a relative accuracy ~1e-15 for axis ratios >=0.2 and ~1e-8 for axis ratios ~0.05.
+*/
+#pragma once
+#include "potential_base.h"
+#include <vector>
+
+namespace potential {
+
+/** Multi-Gaussian Expansion: a sum of coaxial triaxial Gaussian density components
+    with an exact potential, computed by a 1d quadrature with fixed nodes.
+    This is a direct replacement for a Composite of Spheroid density profiles with gamma=beta=0,
+    which would otherwise need a potential expansion to compute the potential.
+*/
+class MGE: public BasePotentialCar {
+public:
+    /** Construct the model from the parameters of its components.
+        \param[in]  masses  is the array of total masses of all Gaussians;
+        \param[in]  sigmaX, sigmaY, sigmaZ  are the arrays of their widths along each axis,
+        with the same length as masses;
+        \throws std::invalid_argument if the arrays are empty, have different lengths,
+        or any of the widths is not positive.
+    */
+    MGE(const std::vector<double>& masses, const std::vector<double>& sigmaX,
+        const std::vector<double>& sigmaY, const std::vector<double>& sigmaZ);
+
+    virtual std::string name() const { return myName(); }
+    static std::string myName() { return "MGE"; }
+    virtual coord::SymmetryType symmetry() const { return sym; }
+    virtual double totalMass() const { return mtotal; }
+
+    /// number of Gaussian components
+    unsigned int size() const { return mass.size(); }
+
+    /// parameters of k-th component:  mass and widths along three axes
+    void getComponent(unsigned int k,
+        double& compMass, double& sigmaX, double& sigmaY, double& sigmaZ) const;
+
+    /** Compute the exact projected (surface) density at the point X,Y in the observer's
+        coordinate system, which is oriented with respect to the intrinsic system of the model
+        as specified by the Euler angles (same convention as in the generic function
+        `projectedDensity`, which would compute the same quantity by numerical integration).
+        Each Gaussian projects into a two-dimensional Gaussian, so no integration is needed.
+    */
+    double projectedDensity(double X, double Y, const coord::Orientation& orientation) const;
+
+    /// vectorized evaluation of density: the loop over points is the innermost one
+    virtual void evalmanyDensityCar(const size_t npoints, const coord::PosCar pos[],
+        /*output*/ double values[], /*input*/ double time=0) const;
+
+private:
+    std::vector<double> mass;     ///< masses of all components
+    // parameters stored as separate arrays, to allow vectorization of the density computation
+    std::vector<double> rho0;     ///< central densities of each component
+    std::vector<double> ax, ay, az;  ///< 1/(2 sigma^2) for each axis
+    // parameters of the 1d integral for the potential
+    std::vector<double> smax;     ///< the largest of three widths of each component
+    std::vector<double> ex, ey, ez;  ///< 1 - (sigma_i / smax)^2 for each axis
+    static const int NUM_NODES = 32; ///< order of the Gauss-Legendre rule for the potential
+    double nodes[NUM_NODES], weights[NUM_NODES];  ///< its nodes and weights after substitution
+    double mtotal;                ///< total mass of the model
+    coord::SymmetryType sym;      ///< symmetry type (triaxial, axisymmetric or spherical)
+
+    virtual void evalCar(const coord::PosCar &pos,
+        double* potential, coord::GradCar* deriv, coord::HessCar* deriv2, double time) const;
+    virtual double densityCar(const coord::PosCar &pos, double time) const;
+};
+
+}  // namespace potential
@@ -45,6 +45,11 @@ static const int LMAX_1D_SPLINE = 2;
 /// minimum number of grid nodes
 static const unsigned int MULTIPOLE_MIN_GRID_SIZE = 2;
 
+/// number of particles whose contributions to the basis-set coefficients are summed directly
+/// before adding the block sum to the compensated (Kahan) running total of each thread;
+/// this keeps the roundoff error independent of the number of particles
+static const ptrdiff_t BSE_BLOCK_SIZE = 1024;
+
 /// order of Gauss-Legendre quadrature for computing the radial integrals in Multipole
 static const unsigned int GLORDER_RAD = 10;
 
@@ -173,11 +178,16 @@ template<>
 inline void collectValues(const BasePotential& src, const std::vector<coord::PosCyl>& points,
     /*output*/ double values[])
 {
-    coord::GradCyl grad;
-    for(size_t i=0; i<points.size(); i++) {
-        src.eval(points[i], &values[i*2], &grad);
+    // vectorized evaluation at all points, which may be much cheaper than individual calls
+    // (e.g., for a user-defined potential in Python)
+    const size_t npoints = points.size();
+    std::vector<double> pot(npoints);
+    std::vector<coord::GradCyl> grad(npoints);
+    src.evalmanyPotentialCyl(npoints, &points[0], &pot[0], &grad[0]);
+    for(size_t i=0; i<npoints; i++) {
+        values[i*2] = pot[i];
         double rinv = 1. / sqrt(pow_2(points[i].R) + pow_2(points[i].z));
-        values[i*2+1] = grad.dR * points[i].R * rinv + grad.dz * points[i].z * rinv;
+        values[i*2+1] = grad[i].dR * points[i].R * rinv + grad[i].dz * points[i].z * rinv;
     }
 }
 
@@ -239,6 +249,29 @@ void computeSphHarmCoefs(const BaseDensityOrPotential& src,
     }
 }
 
+// compute the spherical-harmonic functions Y_lm(theta, phi) for a single point,
+// storing them in the output array harm (indexed by SphHarmIndices::index(l,m));
+// leg and trig are temporary arrays of size lmax+1 and 2*mmax+1, and trig[0] must be 1.
+// Only the elements allowed by the indexing scheme are assigned.
+inline double sphHarmAtPoint(const coord::PosCyl& pos, const math::SphHarmIndices &ind,
+    double* leg, double* trig, /*output*/ double* harm)
+{
+    double r   = sqrt(pow_2(pos.R) + pow_2(pos.z));
+    double tau = pos.z == 0 ? 0 : pos.z / (r + pos.R);
+    bool needSine = ind.mmin()<0;
+    math::trigMultiAngle(pos.phi, ind.mmax, needSine, trig+1 /* start from m=1 */);
+    for(int m=0; m<=ind.mmax; m++) {
+        double mult = 2*M_SQRTPI * (m==0 ? 1 : M_SQRT2);
+        math::sphHarmArray(ind.lmax, m, tau, leg);
+        for(int l=ind.lmin(m); l<=ind.lmax; l+=ind.step)
+            harm[ind.index(l, m)] = mult * leg[l-m] * trig[m];
+        if(needSine && m>0)
+            for(int l=ind.lmin(-m); l<=ind.lmax; l+=ind.step)
+                harm[ind.index(l, -m)] = mult * leg[l-m] * trig[ind.mmax+m];
+    }
+    return r;
+}
+
 // transform an N-body snapshot to an array of spherical-harmonic coefficients:
 // for each k-th particle, the array of sph.-harm. functions Y_lm(theta_k, phi_k)
 // is stored in the output array with the following indexing scheme:
@@ -259,7 +292,6 @@ void computeSphericalHarmonicsFromParticles(
     for(int m=ind.mmin(); m<=ind.mmax; m++)
         for(int l=ind.lmin(m); l<=ind.lmax; l+=ind.step)
             coefs[ind.index(l, m)].resize(nbody);
-    bool needSine = ind.mmin()<0;
     std::string errorMsg;
     utils::CtrlBreakHandler cbrk;  // catch Ctrl-Break keypress
     bool stop = false;
@@ -267,9 +299,9 @@ void computeSphericalHarmonicsFromParticles(
 #pragma omp parallel
 #endif
     {
-        // thread-local temporary arrays for Legendre and trigonometric functions
-        std::vector<double> tmp(ind.lmax+2+2*ind.mmax);
-        double *leg = &tmp[0], *trig = leg + ind.lmax+1;
+        // thread-local temporary arrays for Legendre and trigonometric functions and Y_lm
+        std::vector<double> tmp(ind.lmax+2+2*ind.mmax + ind.size());
+        double *leg = &tmp[0], *trig = leg + ind.lmax+1, *harm = trig + 2*ind.mmax+1;
         trig[0] = 1.;  // stores cos(0*phi), which is not computed by trigMultiAngle
 #ifdef _OPENMP
 #pragma omp for schedule(static)
@@ -279,20 +311,10 @@ void computeSphericalHarmonicsFromParticles(
             if(cbrk.triggered()) stop = true;
             // compute Y_lm for each particle
             try{
-                const coord::PosCyl& pos = particles.point(i);
-                double r   = sqrt(pow_2(pos.R) + pow_2(pos.z));
-                double tau = pos.z == 0 ? 0 : pos.z / (r + pos.R);
-                particleRadii[i] = r;
-                math::trigMultiAngle(pos.phi, ind.mmax, needSine, trig+1 /* start from m=1 */);
-                for(int m=0; m<=ind.mmax; m++) {
-                    double mult = 2*M_SQRTPI * (m==0 ? 1 : M_SQRT2);
-                    math::sphHarmArray(ind.lmax, m, tau, leg);
+                particleRadii[i] = sphHarmAtPoint(particles.point(i), ind, leg, trig, harm);
+                for(int m=ind.mmin(); m<=ind.mmax; m++)
                     for(int l=ind.lmin(m); l<=ind.lmax; l+=ind.step)
-                        coefs[ind.index(l, m)][i] = mult * leg[l-m] * trig[m];
-                    if(needSine && m>0)
-                        for(int l=ind.lmin(-m); l<=ind.lmax; l+=ind.step)
-                            coefs[ind.index(l, -m)][i] = mult * leg[l-m] * trig[ind.mmax+m];
-                }
+                        coefs[ind.index(l, m)][i] = harm[ind.index(l, m)];
             }
             catch(std::exception& e) {
                 errorMsg = e.what();
@@ -1951,6 +1973,38 @@ void computePotentialCoefsBSE(
     }
 }
 
+/** Compute the normalization factors I_{nl} of radial basis functions for each n,l.
+    \param[in]  lmax is the order of angular expansion.
+    \param[in]  nmax is the order or radial expansion.
+    \param[in]  eta  is the shape parameter of basis functions.
+    \return  the array with the indexing scheme  Inl[l * (nmax+1) + n].
+*/
+std::vector<double> computeNormalizationBSE(int lmax, unsigned int nmax, double eta)
+{
+    std::vector<double> Inl((nmax+1) * (lmax+1));
+    for(int l=0; l<=lmax; l++) {
+        double w = 0.5 + eta * (2*l+1);
+        double prefac = - M_PI/2 / eta * pow(1./16, w) * exp(math::lngamma(2 * w) - 2*math::lngamma(w));
+        int n0 = l * (nmax+1);
+        Inl[n0] = prefac / w * (4 * w * w - 1);
+        for(unsigned int n=1; n<=nmax; n++) {
+            prefac *= (2 * w + n - 1) / n;
+            Inl[n0 + n] = prefac / (n + w) * (4 * pow_2(n + w) - 1);
+        }
+    }
+    return Inl;
+}
+
+/// add the array of values x to the running sum with Kahan compensation
+inline void addCompensated(size_t size, const double* x, double* sum, double* comp)
+{
+    for(size_t k=0; k<size; k++) {
+        double y = x[k] - comp[k], t = sum[k] + y;
+        comp[k] = (t - sum[k]) - y;
+        sum[k]  = t;
+    }
+}
+
 /** Compute the coefficients of the basis-set potential expansion from an N-body snapshot.
     \param[in]  particles  is the array of particles.
     \param[in]  ind  is the coefficient indexing scheme (defines the order of angular expansion
@@ -1958,39 +2012,36 @@ void computePotentialCoefsBSE(
     \param[in]  nmax is the order or radial expansion (number of basis functions is nmax+1).
     \param[in]  eta  is the shape parameter of basis functions.
     \param[in]  r0   is the scale radius of basis functions.
+    \param[in]  Inl  is the array of normalization factors produced by computeNormalizationBSE.
     \param[out] coefs  will contain the array of coefficients, will be resized as needed.
-    \note OpenMP-parallelized loop over particles.
+    \note OpenMP-parallelized loop over particles. The angular and radial basis functions are
+    computed on the fly for each particle, so the memory cost does not depend on the number
+    of particles. Contributions of particles are summed in blocks of BSE_BLOCK_SIZE,
+    and the block sums are accumulated with Kahan compensation, first in each thread
+    and then in the final reduction, so that the result stays accurate to machine precision
+    even for ~10^8-10^9 particles.
 */
 void computePotentialCoefsBSE(
     const particles::ParticleArray<coord::PosCyl> &particles,
     const math::SphHarmIndices &ind,
     unsigned int nmax, double eta, double r0,
+    const std::vector<double> &Inl,
     /*output*/ std::vector< std::vector<double> > &coefs)
 {
-    // 1st step: prepare auxiliary array of normalization factors Inl for each n,l
-    std::vector<double> Inl((nmax+1) * (ind.lmax+1));   // indexing scheme: Inl[ l * (nmax+1) + n]
-    for(int l=0; l<=ind.lmax; l++) {
-        double w = 0.5 + eta * (2*l+1);
-        double prefac = - M_PI/2 / eta * pow(1./16, w) * exp(math::lngamma(2 * w) - 2*math::lngamma(w));
-        int n0 = l * (nmax+1);
-        Inl[n0] = prefac / w * (4 * w * w - 1);
-        for(unsigned int n=1; n<=nmax; n++) {
-            prefac *= (2 * w + n - 1) / n;
-            Inl[n0 + n] = prefac / (n + w) * (4 * pow_2(n + w) - 1);
-        }
-    }
-
-    // 2nd step: compute the spherical-harmonic coefficients at each particle's radius
-    std::vector<std::vector<double> > harmonics(ind.size());
-    std::vector<double> particleRadii;
-    computeSphericalHarmonicsFromParticles(particles, ind, particleRadii, harmonics);
-    ptrdiff_t nbody = particleRadii.size();
-
-    // 3rd step: compute the radial basis-set expansion coefs for each angular harmonic
-    int mstep = (ind.symmetry() & coord::ST_TRIAXIAL) == coord::ST_TRIAXIAL ? 2 : 1;
+    const ptrdiff_t nbody = particles.size(), numBlocks = (nbody + BSE_BLOCK_SIZE - 1) / BSE_BLOCK_SIZE;
+    const size_t nrad = nmax+1, ncoefs = ind.size() * nrad;
     bool oddl = (ind.symmetry() & coord::ST_REFLECTION) != coord::ST_REFLECTION;  // use odd l?
+    // list of non-trivial harmonics (l,m) allowed by the symmetry, with their indices and l values
+    std::vector<int> harmIndex, harmL;
+    for(int m=ind.mmin(); m<=ind.mmax; m++)
+        for(int l=ind.lmin(m); l<=ind.lmax; l+=ind.step) {
+            harmIndex.push_back(ind.index(l, m));
+            harmL.push_back(l);
+        }
+    const size_t numHarm = harmIndex.size();
 
-    coefs.assign(ind.size(), std::vector<double>(nmax+1, 0.));
+    // global accumulator of coefficients (flattened as [c * nrad + n]) and its compensation term
+    std::vector<double> total(ncoefs, 0.), totalComp(ncoefs, 0.);
     std::string errorMsg;
     utils::CtrlBreakHandler cbrk;  // catch Ctrl-Break keypress
     bool stop = false;
@@ -1998,62 +2049,97 @@ void computePotentialCoefsBSE(
 #pragma omp parallel
 #endif
     {
-        // thread-local temporary arrays for expansion coefs
-        std::vector<std::vector<double> > thread_coefs(ind.size(), std::vector<double>(nmax+1, 0.));
+        // thread-local temporary arrays: Legendre and trigonometric functions, Y_lm,
+        // radial basis functions for all l,n, block sums, and compensated running sums
+        std::vector<double> tmp(ind.lmax+2+2*ind.mmax + ind.size() + (ind.lmax+1) * nrad + 3*ncoefs, 0.);
+        double *leg = &tmp[0], *trig = leg + ind.lmax+1, *harm = trig + 2*ind.mmax+1,
+            *radial = harm + ind.size(), *block = radial + (ind.lmax+1) * nrad,
+            *sum = block + ncoefs, *comp = sum + ncoefs;
+        trig[0] = 1.;  // stores cos(0*phi), which is not computed by trigMultiAngle
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
-        for(ptrdiff_t i=0; i<nbody; i++) {
+        for(ptrdiff_t b=0; b<numBlocks; b++) {
             if(stop) continue;
             if(cbrk.triggered()) stop = true;
             try{
-                double r = sqrt(pow_2(particles.point(i).R) + pow_2(particles.point(i).z)),
-                s = r / r0,
-                s1eta = math::pow(s, 1/eta),
-                xi = (s1eta-1) / (s1eta+1),
-                zi = math::pow(s1eta+1, -eta),
-                Phi = -zi * particles.mass(i),
-                mul = s * zi * zi;
-                for(int l=0; l<=ind.lmax; l++) {
-                    if(l>0) Phi *= mul;
-                    if(l%2==1 && !oddl)
-                        continue;   // no odd-l terms present
-                    int mmax = std::min<int>(l, ind.mmax),
-                    cmin = ind.index(l, ind.mmin()==0 ? 0 : -mmax),
-                    cmax = ind.index(l, mmax);
-                    // loop over radial basis functions
-                    double P=0, Q=1, N;  // prev, current and next Gegenbauer polynomials
-                    for(unsigned int n=0; n<=nmax; n++) {
-                        double Pnl = Phi / Inl[l * (nmax+1) + n] * Q;
-                        // update the recurrence relation for Gegenbauer polynomials
-                        N = (eta * (4*l+2) + n) * (xi * Q - P) / (n+1) + xi * Q;
-                        P = Q;
-                        Q = N;
-                        for(int c=cmin; c<=cmax; c+=mstep)
-                            if(!harmonics[c].empty())
-                                thread_coefs[c][n] += Pnl * harmonics[c][i];
+                std::fill(block, block + ncoefs, 0.);
+                for(ptrdiff_t i = b * BSE_BLOCK_SIZE, iend = std::min(nbody, i + BSE_BLOCK_SIZE);
+                    i<iend; i++)
+                {
+                    double mass = particles.mass(i);
+                    if(mass == 0) continue;
+                    double r = sphHarmAtPoint(particles.point(i), ind, leg, trig, harm),
+                    s = r / r0,
+                    s1eta = math::pow(s, 1/eta),
+                    xi = s1eta < 1 ? (s1eta-1) / (s1eta+1) : (1-1/s1eta) / (1+1/s1eta),
+                    zi = math::pow(s1eta+1, -eta),
+                    Phi = -zi * mass,
+                    mul = s * zi * zi;
+                    if(!isFinite(Phi + mul))
+                        continue;  // particles at infinity do not contribute
+                    // radial basis functions for each l,n: the Gegenbauer polynomials C_n^{(2w-1/2)}(xi)
+                    // are obtained by the forward three-term recurrence, which is stable for |xi|<=1
+                    for(int l=0; l<=ind.lmax; l++) {
+                        if(l>0) Phi *= mul;
+                        if(l%2==1 && !oddl)
+                            continue;   // no odd-l terms present
+                        double P=0, Q=1, N;  // prev, current and next Gegenbauer polynomials
+                        for(unsigned int n=0; n<=nmax; n++) {
+                            radial[l * nrad + n] = Phi / Inl[l * nrad + n] * Q;
+                            N = (eta * (4*l+2) + n) * (xi * Q - P) / (n+1) + xi * Q;
+                            P = Q;
+                            Q = N;
+                        }
+                    }
+                    for(size_t h=0; h<numHarm; h++) {
+                        const double Ylm = harm[harmIndex[h]], *rad = radial + harmL[h] * nrad;
+                        double* dest = block + harmIndex[h] * nrad;
+                        for(size_t n=0; n<nrad; n++)
+                            dest[n] += rad[n] * Ylm;
                     }
                 }
+                addCompensated(ncoefs, block, sum, comp);
             }
             catch(std::exception& e) {
                 errorMsg = e.what();
                 stop = true;
             }
         }
-        // reduction step: add the coefficients collected in this thread to the global array
+        // reduction step: add the coefficients collected in this thread to the global array,
+        // including the compensation terms (which carry the low-order bits of the partial sums)
+        for(size_t k=0; k<ncoefs; k++)
+            sum[k] -= comp[k];
 #ifdef _OPENMP
 #pragma omp critical
 #endif
-        {
-            for(int m=ind.mmin(); m<=ind.mmax; m++)
-                for(int l=ind.lmin(m); l<=ind.lmax; l+=ind.step)
-                    math::blas_daxpy(1, thread_coefs[ind.index(l, m)], coefs[ind.index(l, m)]);
-        }
+        addCompensated(ncoefs, sum, &total[0], &totalComp[0]);
     }
     if(cbrk.triggered())
         throw std::runtime_error(cbrk.message());
     if(!errorMsg.empty())
-        throw std::runtime_error("computeDensityCoefsBSE: " + errorMsg);
+        throw std::runtime_error("computePotentialCoefsBSE: " + errorMsg);
+    coefs.assign(ind.size(), std::vector<double>(nrad, 0.));
+    for(size_t h=0; h<numHarm; h++)
+        for(size_t n=0; n<nrad; n++)
+            coefs[harmIndex[h]][n] = total[harmIndex[h] * nrad + n] - totalComp[harmIndex[h] * nrad + n];
+}
+
+/// take the radius enclosing half of all particles with non-zero mass
+/// as a proxy for the half-mass radius, used as the default scale radius of basis functions
+double getScaleRadiusBSE(const particles::ParticleArray<coord::PosCyl> &particles)
+{
+    std::vector<double> radii;
+    radii.reserve(particles.size());
+    for(size_t i=0, size=particles.size(); i<size; i++) {
+        if(particles.mass(i) != 0)   // only consider particles with non-zero mass
+            radii.push_back(sqrt(pow_2(particles.point(i).R) + pow_2(particles.point(i).z)));
+    }
+    size_t nbody = radii.size();
+    if(nbody==0)
+        throw std::runtime_error("BasisSet: no particles provided as input");
+    std::nth_element(radii.begin(), radii.begin() + nbody/2, radii.end());
+    return radii[nbody/2];
 }
 
 } // end internal namespace
@@ -2103,30 +2189,50 @@ PtrPotential BasisSet::create(
     if(isUnknown(sym))
         throw std::invalid_argument("BasisSet: symmetry is not specified");
     // if r0 is not provided, assign a plausible value automatically
-    if(!(r0>0)) {
-        std::vector<double> radii;
-        radii.reserve(particles.size());
-        for(size_t i=0, size=particles.size(); i<size; i++) {
-            if(particles.mass(i) != 0)   // only consider particles with non-zero mass
-                radii.push_back(sqrt(pow_2(particles.point(i).R) + pow_2(particles.point(i).z)));
-        }
-        size_t nbody = radii.size();
-        if(nbody==0)
-            throw std::runtime_error("BasisSet: no particles provided as input");
-        // take the radius enclosing half of all particles as a proxy for the half-mass radius
-        std::nth_element(radii.begin(), radii.begin() + nbody/2, radii.end());
-        r0 = radii[nbody/2];
-    }
+    if(!(r0>0))
+        r0 = getScaleRadiusBSE(particles);
     if(isSpherical(sym))
         lmax = 0;
     if(isZRotSymmetric(sym))
         mmax = 0;
     std::vector<std::vector<double> > coefs;
-    computePotentialCoefsBSE(particles,
-        math::SphHarmIndices(lmax, mmax, sym), nmax, eta, r0, /*output*/coefs);
+    computePotentialCoefsBSE(particles, math::SphHarmIndices(lmax, mmax, sym), nmax, eta, r0,
+        computeNormalizationBSE(lmax, nmax, eta), /*output*/coefs);
     return PtrPotential(new BasisSet(eta, r0, coefs));
 }
 
+std::vector<PtrPotential> BasisSet::createSeries(
+    const std::vector<particles::ParticleArray<coord::PosCyl> > &snapshots,
+    coord::SymmetryType sym, int lmax, int mmax,
+    unsigned int nmax, double eta, double r0)
+{
+    if(lmax<0 || mmax<0 || mmax>lmax || nmax>256)
+        throw std::invalid_argument("BasisSet: invalid choice of expansion order");
+    if(!(eta>=0.5))
+        throw std::invalid_argument("BasisSet: shape parameter eta should be >=0.5");
+    if(isUnknown(sym))
+        throw std::invalid_argument("BasisSet: symmetry is not specified");
+    if(snapshots.empty())
+        throw std::invalid_argument("BasisSet: no snapshots provided as input");
+    // the same basis functions are used for all snapshots, so that the coefficients are
+    // directly comparable and may be interpolated in time
+    if(!(r0>0))
+        r0 = getScaleRadiusBSE(snapshots[0]);
+    if(isSpherical(sym))
+        lmax = 0;
+    if(isZRotSymmetric(sym))
+        mmax = 0;
+    const math::SphHarmIndices ind(lmax, mmax, sym);
+    const std::vector<double> Inl = computeNormalizationBSE(lmax, nmax, eta);
+    std::vector<PtrPotential> result(snapshots.size());
+    std::vector<std::vector<double> > coefs;
+    for(size_t s=0; s<snapshots.size(); s++) {
+        computePotentialCoefsBSE(snapshots[s], ind, nmax, eta, r0, Inl, /*output*/coefs);
+        result[s].reset(new BasisSet(eta, r0, coefs));
+    }
+    return result;
+}
+
 BasisSet::BasisSet(double _eta, double _r0, const std::vector<std::vector<double> > &_coefs) :
     ind(getIndicesFromCoefs(_coefs)), eta(_eta), r0(_r0), coefs(_coefs)
 {
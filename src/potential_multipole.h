@@ -314,6 +314,22 @@ public:
         coord::SymmetryType sym, int lmax, int mmax,
         unsigned int nmax, double eta=1.0, double r0=0.0);
 
+    /** create a sequence of potentials from a time series of N-body snapshots.
+        All potentials share the same basis functions (eta, r0), so that their coefficients
+        are directly comparable, and the resulting array together with the array of snapshot
+        times can be passed to the constructor of the `Evolving` potential.
+        \param[in]  snapshots  is the array of N-body snapshots.
+        \param[in]  sym, lmax, mmax, nmax, eta  have the same meaning as in the previous function;
+        \param[in]  r0    is the scale radius of basis functions (0 means auto-detect from
+        the first snapshot).
+        \return  the array of potentials, one per snapshot.
+        \note OpenMP-parallelized loop over particles in each snapshot.
+    */
+    static std::vector<PtrPotential> createSeries(
+        const std::vector<particles::ParticleArray<coord::PosCyl> > &snapshots,
+        coord::SymmetryType sym, int lmax, int mmax,
+        unsigned int nmax, double eta=1.0, double r0=0.0);
+
     /** construct the potential from the set of basis-set expansion coefficients.
         \param[in]  eta  is the shape parameter of basis functions
         (0.5 for Clutton-Brock, 1 for Hernquist-Ostriker, values between 1 and 2 provide best results),
@@ -68,17 +68,30 @@ double computeLztorque(const potential::BasePotential& potential,
 
 bool RuntimeBinary::processTimestep(double tbegin, double tend)
 {
-    // position/velocity at the beginning and the end of encounter,
-    // initially assigned to the beginning/end of timestep
-    coord::PosVelCar ptbegin = orbint.getSol(tbegin), ptend = orbint.getSol(tend);
+    // position/velocity at the end of encounter, initially assigned to the end of timestep
+    coord::PosVelCar ptend = orbint.getSol(tend);
 
-    // first determine whether the particle experiences an encounter during this timestep
-    double r2begin = pow_2(ptbegin.x) + pow_2(ptbegin.y) + pow_2(ptbegin.z);
-    double r2end   = pow_2(ptend  .x) + pow_2(ptend  .y) + pow_2(ptend  .z);
+    // first determine whether the particle experiences an encounter during this timestep;
+    // the distance at the beginning of timestep is taken from the previous one if possible,
+    // so that in the majority of timesteps spent far from the binary, the trajectory
+    // is evaluated only once
+    double r2begin;
+    if(tbegin == tprev)
+        r2begin = r2prev;
+    else {
+        coord::PosCar pt = orbint.getSol(tbegin);
+        r2begin = pow_2(pt.x) + pow_2(pt.y) + pow_2(pt.z);
+    }
+    double r2end   = pow_2(ptend.x) + pow_2(ptend.y) + pow_2(ptend.z);
     double r2crit  = pow_2(bh.sma * BINARY_ENCOUNTER_RADIUS);
+    tprev  = tend;
+    r2prev = r2end;
     if(r2begin >= r2crit && r2end >= r2crit)  // the entire timestep is outside the critical radius:
         return true;                          // no further action required
 
+    // position/velocity at the beginning of encounter, initially assigned to the beginning of timestep
+    coord::PosVelCar ptbegin = orbint.getSol(tbegin);
+
     // if during the timestep the particle spends some time inside the critical radius,
     // we need to determine exactly the time when it enters and exits the sphere with this radius
     // (it may well be the beginning or the end of the timestep)
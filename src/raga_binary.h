@@ -53,6 +53,10 @@ class RuntimeBinary: public orbit::BaseRuntimeFnc {
     const potential::BasePotential& potstars;///< stellar potential
     const potential::KeplerBinaryParams& bh; ///< parameters of the binary BH
     BinaryEncounterList& encountersList;     ///< place for storing the information about encounters
+    /// end time of the previous timestep and the squared distance from origin at that time:
+    /// the position does not change between timesteps (only the velocity may be perturbed),
+    /// so it is reused at the beginning of the next timestep
+    double tprev, r2prev;
 public:
     RuntimeBinary(
         orbit::BaseOrbitIntegrator& orbint,
@@ -63,7 +67,8 @@ public:
         BaseRuntimeFnc(orbint),
         potstars(_potstars),
         bh(_bh),
-        encountersList(_encountersList)
+        encountersList(_encountersList),
+        tprev(NAN), r2prev(NAN)
     {}
 
     virtual bool processTimestep(double tbegin, double tend);
@@ -123,6 +123,8 @@ void RagaCore::doEpisode(double episodeLength)
     orbit::OrbitIntParams orbitIntParams;
     orbitIntParams.accuracy = paramsRaga.accuracy;
     orbitIntParams.maxNumSteps = paramsRaga.maxNumSteps;
+    if(bh.mass!=0)  // regularization is only meaningful when there is a central black hole
+        orbitIntParams.regularizationRadius = paramsRaga.regularizationRadius;
 
     // if needed, construct a composite potential (stars + BH)
     std::vector<potential::PtrPotential> potComponents(bh.mass!=0 ? 2 : 1);
@@ -193,6 +195,7 @@ void RagaCore::init(const utils::KeyValueMap& config)
     // global parameters of the simulation
     paramsRaga.accuracy       = config.getDouble("accuracy",    orbit::OrbitIntParams().accuracy);
     paramsRaga.maxNumSteps    = config.getDouble("maxNumSteps", orbit::OrbitIntParams().maxNumSteps);
+    paramsRaga.regularizationRadius = config.getDouble("regularizationRadius", paramsRaga.regularizationRadius);
     paramsRaga.fileInput      = config.getString("fileInput");
     paramsRaga.fileLog        = config.getString("fileLog",
         paramsRaga.fileInput.empty() ? "" : paramsRaga.fileInput+".log");
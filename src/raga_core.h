@@ -54,6 +54,7 @@ namespace raga{
 struct ParamsRaga {
     double accuracy;            ///< accuracy parameter for the orbit integrator
     size_t maxNumSteps;         ///< max number of ODE steps for any orbit per one episode
+    double regularizationRadius;///< radius of regularized orbit integration around the black hole(s)
     bool   updatePotential;     ///< flag specifying whether to update the stellar potential
     double timeCurr;            ///< current sumulation time
     double timeEnd;             ///< total (maximum) simulation time
@@ -62,7 +63,7 @@ struct ParamsRaga {
     std::string fileLog;        ///< file name for logging the global parameters of the simulation
     bool initPotentialExternal; ///< whether the initial potential is set externally or from particles
     ParamsRaga() :              /// set default parameters
-        accuracy(1e-8), maxNumSteps(1e8), updatePotential(false),
+        accuracy(1e-8), maxNumSteps(1e8), regularizationRadius(0), updatePotential(false),
         timeCurr(0), timeEnd(0), episodeLength(0), initPotentialExternal(false)
     {}
 };
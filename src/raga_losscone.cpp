@@ -37,6 +37,22 @@ public:
     }
 };
 
+/** compute the time derivative of the squared distance to each of the black holes
+    at the given time, using a single evaluation of the trajectory and the binary orbit
+*/
+inline void computeDrdt(const potential::KeplerBinaryParams& bh,
+    const orbit::BaseOrbitIntegrator& orbint, const double time, const int numBH, double drdt[])
+{
+    double bhX[2], bhY[2], bhVX[2], bhVY[2];
+    bh.keplerOrbit(time, bhX, bhY, bhVX, bhVY);
+    coord::PosVelCar pv = orbint.getSol(time);
+    for(int b=0; b<numBH; b++)
+        drdt[b] =
+            (pv.x - bhX[b]) * (pv.vx - bhVX[b]) +
+            (pv.y - bhY[b]) * (pv.vy - bhVY[b]) +
+             pv.z * pv.vz;
+}
+
 } // anonymous namespace
 
 bool RuntimeLosscone::processTimestep(double tbegin, double tend)
@@ -47,24 +63,27 @@ bool RuntimeLosscone::processTimestep(double tbegin, double tend)
         return false;
 
     int numBH = bh.sma>0 ? 2 : 1;
-    for(int b=0; b<numBH; b++) {
-        const PericenterFinder pf(bh, orbint, b);
 
-        // if this is the first timestep, need to compute d(r^2)/dt at the beginning
-        // of the timestep, otherwise copy the stored value from the previous timestep
-        // w.r.t the central black hole(s) at the beginning of the timestep
-        double prevdrdt = tbegin == 0 ? pf(tbegin) : drdt[b];
+    // if this is the first timestep, need to compute d(r^2)/dt w.r.t the central black hole(s)
+    // at the beginning of the timestep, otherwise copy the stored value from the previous timestep
+    double prevdrdt[2] = {drdt[0], drdt[1]};
+    if(tbegin == 0)
+        computeDrdt(bh, orbint, tbegin, numBH, prevdrdt);
 
-        // now compute the same quantity at the end of the current timestep
-        drdt[b] = pf(tend);
+    // now compute the same quantity at the end of the current timestep;
+    // the position of the particle and the black hole(s) are evaluated only once for all of them,
+    // and this is the only work done in the majority of timesteps that contain no pericenter passage
+    computeDrdt(bh, orbint, tend, numBH, drdt);
 
+    for(int b=0; b<numBH; b++) {
         // check if we just passed a pericenter w.r.t. one of the black hole(s),
         // i.e. r^2 was decreasing at the beginning of this timestep,
         // and is now increasing at the end of the timestep
-        if(! (prevdrdt <= 0 && drdt[b] > 0))
+        if(! (prevdrdt[b] <= 0 && drdt[b] > 0))
             continue;
 
         // if we did, then find the exact time of pericenter passage
+        const PericenterFinder pf(bh, orbint, b);
         double tperi = math::findRoot(pf, tbegin, tend, 1e-4);
         if(!isFinite(tperi))  // the root-finder failed:
             // this may happen if the velocity has changed unfavourably between
@@ -122,8 +141,8 @@ RagaTaskLosscone::RagaTaskLosscone(
 
 void RagaTaskLosscone::createRuntimeFnc(orbit::BaseOrbitIntegrator& orbint, unsigned int particleIndex)
 {
-    double Mbh0 = bh.sma==0 ? bh.mass / (1 + bh.q) : bh.mass;
-    double Mbh1 = bh.sma==0 ? bh.mass / (1 + bh.q) * bh.q : 0;
+    double Mbh0 = bh.sma==0 ? bh.mass : bh.mass / (1 + bh.q);
+    double Mbh1 = bh.sma==0 ? 0 : bh.mass / (1 + bh.q) * bh.q;
     double captureRadius[2] = {
         fmax(8 * Mbh0 / pow_2(params.speedOfLight),
             particles.point(particleIndex).stellarRadius *
@@ -20,6 +20,10 @@
 #include "Orb.h"
 #include <cmath>
 #include "WD_Numerics.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace torus{
 
@@ -30,6 +34,7 @@ typedef Matrix<double,2,2> DB22;
 typedef Vector<double,2>   DB2;
 
 const   double  dch_tol = 1.e3;	// upper limit for dchirms/dparameter
+const   int     max_chunks = 32;	// max. # of chunks of angle points summed in parallel
 
 ////////////////////////////////////////////////////////////////////////////////
 // routine SbyLevMar() ****************************************************** //
@@ -132,158 +137,132 @@ dH/dS_(n1,n2) = dH_eff/d(Q,P) * d(Q,P)/d(q,p) * d(q,p)/dj * dj/dS_(n1,n2)
 
 ==============================================================================*/
 {
-    int    i1, i2, j, k, l, m;
-    PSPD   jt, QP;
-    double          dqpdj[4][2], dQPdqp[4][4], dHdQP[4], dHdqp[4]={0};
-    Pdble           dHda, dHavda, dqpdalfa[4], dQPdbeta[4];
-    double H, Hsqav, temp,chims;
-
-    dHda   = new double[mfit];
-    dHavda = new double[mfit];
-    Hav    = 0.;
-    Hsqav  = 0.;
-    //cerr << TM.parameters() << '\n' << PT.parameters() << '\n';
-    for(k=0; k<4; k++) {
-        dqpdalfa[k] = new double[TM.NumberofParameters()];
-        dQPdbeta[k] = new double[PT.NumberofParameters()];
-    }
-    for(k=0; k<mfit; k++) {
-        dHavda[k] = 0.;
-	bk[k]     = 0.;
-	for(l=k; l<mfit; l++)
-	    akl[k][l] = 0.;
-    }
-//
-// We make a difference between the cases with and without fitting of the Sn
-// this is to avoid the construction of the GenPar dj1dS, dj2dS in the latter
-//
-// 1. case: fit of the Sn
-//          bomb around the torus and sum up the derivatives
-//
-  
-    if(fit[0]) {
-        double  dHdj[2];
-        GenPar  dj1dS(GF.parameters()), dj2dS(GF.parameters()); 
-        for(i1=0; i1<GF.N_th1(); i1++)
-        for(i2=0; i2<GF.N_th2(); i2++) {
-	    jt = GF.MapWithDerivs(J(0),J(1),i1,i2,dj1dS,dj2dS);
-            if (jt[0] < 0. || jt[1] < 0.) {  // negative actions
-                for(k=0;k<4;k++) { delete[] dqpdalfa[k]; delete[] dQPdbeta[k]; }
-                delete[] dHda; delete[] dHavda;
-	        return -2;
-	    }
-            QP = jt >> TM;
-	    //cerr <<"\n"<< QP << "\n"; 
-	    QP = QP >> PT;
-	    //cerr << QP << "\n"; 
- 	    if(fit[1]) TM.Derivatives(dqpdj, dqpdalfa);
-		else   TM.Derivatives(dqpdj);
-            //if(fit[2]) PT.Derivatives(dQPdqp, dQPdbeta); // NB fix needed
-	    PT.Derivatives(dQPdqp);
-	    H = Heff(QP, dHdQP, Phi);
-	    if(fit[0] || fit[1])
-	      for(j=0; j<4; j++)
-		for(k=0, dHdqp[j]=0.; k<4; k++)
-		  dHdqp[j] += dHdQP[k] * dQPdqp[k][j];
-	    m = 0;
-	    if(fit[2])
-		for(j=0; j<PT.NumberofParameters(); j++,m++)
-		    for(k=0, dHda[m]=0.; k<4; k++)
-  			dHda[m] += dHdQP[k] * dQPdbeta[k][j];
-	    if(fit[1])
-		for(j=0; j<TM.NumberofParameters(); j++,m++)
-		    for(k=0, dHda[m]=0.; k<4; k++)
-			dHda[m] += dHdqp[k] * dqpdalfa[k][j];
-	    dHdj[0] = dHdj[1] = 0.;
-            for(k=0; k<4; k++) {
-	        dHdj[0] += dHdqp[k] * dqpdj[k][0];
-	        dHdj[1] += dHdqp[k] * dqpdj[k][1];
-	    }
-	    for(j=0; j<dj1dS.NumberofTerms(); j++,m++)
-		dHda[m] = dHdj[0] * dj1dS(j) + dHdj[1] * dj2dS(j);
-            if(m!=mfit) cerr<<"wrong MFIT in LevMarCof()\n";
-	    Hav   += H;
-	    Hsqav += H*H;
-	    for(k=0; k<mfit; k++) {
-		dHavda[k] += dHda[k];
-		bk[k]     += H * dHda[k];
-		for(l=k; l<mfit; l++)
-		    akl[k][l] += dHda[k] * dHda[l];
-	    }
-	} // done bombing around the torus
-    } else { 
-//
-// 2. case: no fit of the Sn
-//          bomb around the torus and sum up the derivatives
-//
-        for(i1=0; i1<GF.N_th1(); i1++)
-        for(i2=0; i2<GF.N_th2(); i2++) {
-	    jt = GF.Map(J(0),J(1),i1,i2);
-            if (jt[0] < 0. || jt[1] < 0.) {  // negative actions
-                for(k=0;k<4;k++) { delete[] dqpdalfa[k]; delete[] dQPdbeta[k]; }
-                delete[] dHda; delete[] dHavda;
-	        return -2;
-	    }	    
-            QP = jt >> TM;
-	    //cerr << QP << " "; 
-	    QP = QP >> PT;
-	    //cerr << QP << "\n";
-	    if(fit[1]) {         
-	      TM.Derivatives(dqpdj, dqpdalfa);
-	      PT.Derivatives(dQPdqp); 
-	    }
-	    
-	    H = Heff(QP, dHdQP, Phi);
-	    if(fit[1])
-                for(j=0; j<4; j++)
-                    for(k=0, dHdqp[j]=0.; k<4; k++)
-	                dHdqp[j] += dHdQP[k] * dQPdqp[k][j];
-	    m = 0;
-	    if(fit[2])
-		for(j=0; j<PT.NumberofParameters(); j++,m++)
-		    for(k=0, dHda[m]=0.; k<4; k++)
-  			dHda[m] += dHdQP[k] * dQPdbeta[k][j];
-	    if(fit[1])
-		for(j=0; j<TM.NumberofParameters(); j++,m++)
-		    for(k=0, dHda[m]=0.; k<4; k++)
-			dHda[m] += dHdqp[k] * dqpdalfa[k][j];
-            if(m!=mfit) cerr<<"wrong MFIT in LevMarCof()\n";
-	    Hav   += H;
-	    Hsqav += H*H;
-	    for(k=0; k<mfit; k++) {
-		dHavda[k] += dHda[k];
-		bk[k]     += H * dHda[k];
-		for(l=k; l<mfit; l++)
-		    akl[k][l] += dHda[k] * dHda[l];
-	    }
-	}
+    const int nth2 = GF.N_th2(), npoints = GF.N_th1() * nth2,
+        nTM = TM.NumberofParameters(), nPT = PT.NumberofParameters();
+    // The loop over points in angle space is parallelized. The points are split into a fixed
+    // number of contiguous chunks, each one accumulating the sums in its own section of
+    // the storage array; these partial sums are then added in the order of chunks, so that
+    // the result depends neither on the number of threads nor on their timing.
+    // Each thread uses its own copies of the toy map and the point transform (which keep
+    // the intermediate results of the forward transformation needed for computing the derivatives).
+    // The sums are, in this order: H, H^2, dH/da_k, H * dH/da_k, dH/da_k * dH/da_l (l>=k).
+    const int nsums = 2 + 2*mfit + mfit*mfit;
+    const int nchunks = std::max(1, std::min(max_chunks, npoints / 16));
+    std::vector<double> sums(nchunks * nsums, 0.);
+    bool negact = false, wrongmfit = false, stop = false;
+    std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        ToyMap* tm = TM.clone();
+        PoiTra* pt = PT.clone();
+        PSPD    jt, QP;
+        double  dqpdj[4][2], dQPdqp[4][4], dHdQP[4], dHdqp[4]={0}, dHdj[2], H;
+        std::vector<double> dHda(mfit), dqpdalfa_store(4*nTM+1, 0.), dQPdbeta_store(4*nPT+1, 0.);
+        Pdble   dqpdalfa[4], dQPdbeta[4];
+        for(int k=0; k<4; k++) {
+            dqpdalfa[k] = &dqpdalfa_store[k*nTM];
+            dQPdbeta[k] = &dQPdbeta_store[k*nPT];
+        }
+        // derivatives of toy actions w.r.t. Sn are computed only when the Sn are fitted
+        GenPar  dj1dS(GF.parameters()), dj2dS(GF.parameters());
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(int chunk=0; chunk<nchunks; chunk++) {
+            double* sum = &sums[chunk * nsums];
+            for(int ip=chunk*npoints/nchunks; ip<(chunk+1)*npoints/nchunks && !stop; ip++) {
+                try{
+                    int i1 = ip / nth2, i2 = ip % nth2, j, k, l, m;
+                    jt = fit[0] ? GF.MapWithDerivs(J(0),J(1),i1,i2,dj1dS,dj2dS) : GF.Map(J(0),J(1),i1,i2);
+                    if (jt[0] < 0. || jt[1] < 0.) {  // negative actions
+                        negact = stop = true;
+                        break;
+                    }
+                    QP = jt >> *tm;
+                    QP = QP >> *pt;
+                    if(fit[1]) tm->Derivatives(dqpdj, dqpdalfa);
+                    else if(fit[0]) tm->Derivatives(dqpdj);
+                    //if(fit[2]) pt->Derivatives(dQPdqp, dQPdbeta); // NB fix needed
+                    if(fit[0] || fit[1]) pt->Derivatives(dQPdqp);
+                    H = Heff(QP, dHdQP, Phi);
+                    if(fit[0] || fit[1])
+                        for(j=0; j<4; j++)
+                            for(k=0, dHdqp[j]=0.; k<4; k++)
+                                dHdqp[j] += dHdQP[k] * dQPdqp[k][j];
+                    m = 0;
+                    if(fit[2])
+                        for(j=0; j<nPT; j++,m++)
+                            for(k=0, dHda[m]=0.; k<4; k++)
+                                dHda[m] += dHdQP[k] * dQPdbeta[k][j];
+                    if(fit[1])
+                        for(j=0; j<nTM; j++,m++)
+                            for(k=0, dHda[m]=0.; k<4; k++)
+                                dHda[m] += dHdqp[k] * dqpdalfa[k][j];
+                    if(fit[0]) {
+                        dHdj[0] = dHdj[1] = 0.;
+                        for(k=0; k<4; k++) {
+                            dHdj[0] += dHdqp[k] * dqpdj[k][0];
+                            dHdj[1] += dHdqp[k] * dqpdj[k][1];
+                        }
+                        for(j=0; j<dj1dS.NumberofTerms(); j++,m++)
+                            dHda[m] = dHdj[0] * dj1dS(j) + dHdj[1] * dj2dS(j);
+                    }
+                    if(m!=mfit) {
+                        wrongmfit = true;
+                        continue;
+                    }
+                    sum[0] += H;
+                    sum[1] += H*H;
+                    double *sumdH = sum+2, *sumHdH = sum+2+mfit, *sumdHdH = sum+2+2*mfit;
+                    for(k=0; k<mfit; k++) {
+                        sumdH [k] += dHda[k];
+                        sumHdH[k] += H * dHda[k];
+                        for(l=k; l<mfit; l++)
+                            sumdHdH[k*mfit+l] += dHda[k] * dHda[l];
+                    }
+                }
+                catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(LevMarCof)
+#endif
+                    errorMsg = e.what();
+                    stop = true;
+                }
+            }
+        } // done bombing around the torus
+        delete tm;
+        delete pt;
     }
+    if(!errorMsg.empty())
+        throw std::runtime_error(errorMsg);
+    if(wrongmfit) cerr<<"wrong MFIT in LevMarCof()\n";
+    if(negact)
+        return -2;
 //
 // Done bombing around the torus.
-// Now normalize and finally compute bk, akl, delta H, and dchisq
+// Now add up the partial sums and normalize, and finally compute bk, akl, delta H, and dchisq
 //
-    temp    = 1./double(GF.N_th1()*GF.N_th2());
-    Hav    *= temp;
-    Hsqav  *= temp;
+    for(int c=1; c<nchunks; c++)
+        for(int i=0; i<nsums; i++)
+            sums[i] += sums[c*nsums+i];
+    double temp = 1./double(npoints), chims, Hsqav;
+    const double *dHavda = &sums[2], *sumHdH = &sums[2+mfit], *sumdHdH = &sums[2+2*mfit];
+    Hav    = sums[0] * temp;
+    Hsqav  = sums[1] * temp;
     chims  = Hsqav - Hav*Hav;
     chirms = (chims>0.)? sqrt(chims) : 0 ;
     dchisq  = 0.;
-    for(k=0; k<mfit; k++) {
-	dHavda[k] *= temp;
-	bk[k]      = Hav * dHavda[k] - bk[k] * temp;
+    for(int k=0; k<mfit; k++) {
+	sums[2+k] *= temp;  // now dHavda
+	bk[k]      = Hav * dHavda[k] - sumHdH[k] * temp;
 	dchisq    += bk[k] * bk[k];
     }
-    for(k=0; k<mfit; k++)
-	for(l=k; l<mfit; l++) 
-	    akl[l][k] = akl[k][l] = temp * akl[k][l] - dHavda[k] * dHavda[l]; 
+    for(int k=0; k<mfit; k++)
+	for(int l=k; l<mfit; l++)
+	    akl[l][k] = akl[k][l] = temp * sumdHdH[k*mfit+l] - dHavda[k] * dHavda[l];
     dchisq = 2. * sqrt(dchisq);
-    for(k=0; k<4; k++) {
-	delete[] dqpdalfa[k];
-	delete[] dQPdbeta[k];
-    }
-    
-    delete[] dHda;
-    delete[] dHavda;
     if(dchisq > dch_tol) { return -4;}
     return 0;
 }
@@ -303,26 +282,60 @@ on the meaning of the return value:
    -2  -> negative action(s) occured at least at one point in angle space
 ==============================================================================*/
 {
-    int     i1, i2;
-    PSPD    jt, QP;
-    double  H, Hsqav, temp;
-    Hav    = 0.;
-    Hsqav  = 0.;
+    const int nth2 = GF.N_th2(), npoints = GF.N_th1() * nth2;
+    // parallelized in the same way as LevMarCof(), with partial sums of H and H^2 in each chunk
+    const int nchunks = std::max(1, std::min(max_chunks, npoints / 16));
+    std::vector<double> sums(nchunks * 2, 0.);
+    bool negact = false, stop = false;
+    std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        ToyMap* tm = TM.clone();
+        PoiTra* pt = PT.clone();
 // bomb around the torus and sum up the H and H^2
-    for(i1=0; i1<GF.N_th1(); i1++)
-        for(i2=0; i2<GF.N_th2(); i2++) {
-	    jt    = GF.Map(J(0),J(1),i1,i2);
-            if(jt[0] < 0. || jt[1] < 0.) return -2;
-            QP    = jt >> TM >> PT;
-	    H     = 0.5 * (QP(2)*QP(2)+QP(3)*QP(3))
-	            + Phi->eff(double(QP(0)),double(QP(1)));
-            Hav  += H;
-	    Hsqav+= H*H;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(int chunk=0; chunk<nchunks; chunk++) {
+            double* sum = &sums[chunk * 2];
+            for(int ip=chunk*npoints/nchunks; ip<(chunk+1)*npoints/nchunks && !stop; ip++) {
+                try{
+                    PSPD jt = GF.Map(J(0),J(1),ip / nth2,ip % nth2);
+                    if(jt[0] < 0. || jt[1] < 0.) {
+                        negact = stop = true;
+                        break;
+                    }
+                    PSPD QP  = jt >> *tm >> *pt;
+                    double H = 0.5 * (QP(2)*QP(2)+QP(3)*QP(3))
+                        + Phi->eff(double(QP(0)),double(QP(1)));
+                    sum[0] += H;
+                    sum[1] += H*H;
+                }
+                catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(ChirmsOnly)
+#endif
+                    errorMsg = e.what();
+                    stop = true;
+                }
+            }
+        }
+        delete tm;
+        delete pt;
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error(errorMsg);
+    if(negact)
+        return -2;
+    for(int c=1; c<nchunks; c++) {
+        sums[0] += sums[c*2];
+        sums[1] += sums[c*2+1];
     }
-    temp    = 1./double(GF.N_th1()*GF.N_th2());
-    Hav    *= temp;
-    Hsqav  *= temp;
-    chirms  = sqrt(Hsqav - Hav*Hav);
+    double temp = 1./double(npoints);
+    Hav     = sums[0] * temp;
+    chirms  = sqrt(sums[1] * temp - Hav*Hav);
     return 0;
 }
 
@@ -30,6 +30,8 @@
 #include <gsl/gsl_multifit.h>
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_blas.h>
+#include <stdexcept>
+#include <string>
 
 /////////////////////////////////////////////////////////////////////////////////////////
 // typedefs and constants
@@ -148,33 +150,70 @@ int dSbySampling (            // return:     error flag (see below)
     work = gsl_vector_alloc(Rdim); // workspace vector for SVD
     S = gsl_vector_alloc(Rdim); // Vector needed for SVD of X
 
-    // Create grid of points in toy angle space
-    for (int i2 = 0; i2 < Nr; i2++){
-        for (int i1 = 0; i1 < Nr; i1++) {
-            // Make sure there's point everywhere on the grid, 0 < theta < pi
-            GenPar dj1dS(GF.parameters()), dj2dS(GF.parameters());
-            PSPD jt;
-
-            // 1. Compute toy actions and angles from real actions and toy angles
-            // by applying generating function
-            jt = GF.MapWithDerivs(J(0),J(1),i1,i2,dj1dS,dj2dS);
-            if(jt(0)<0.) jt[0]=0;  // ensure that toy actions are non-negative
-            if(jt(1)<0.) jt[1]=0;
-
-            // 2. Compute dHdj and dHdSk for each point in toy angle space
-            double dHdj[3];
-            dHdj_toy(TM, jt, PT, Phi, J(2), dHdj);
-            int row = i2*Nr + i1;
-
-            // 3. Fill a big matrix with rows of 1 and - dH/dSk
-            //    each row correspond to a point on toy angle space
-            fill_row_dHdSn(dHdj, dj1dS, dj2dS, X, row);
-
-            // Filling RHS of equation
-            gsl_vector_set (y1, row, dHdj[0]);
-            gsl_vector_set (y2, row, dHdj[1]);
-            gsl_vector_set (y3, row, dHdj[2]);
+    // Create grid of points in toy angle space;
+    // the points are processed in parallel, each thread using its own copy of the maps
+    std::string errorMsg;
+    bool stop = false;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        ToyMap* tm = TM.clone();
+        PoiTra* pt = PT.clone();
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (int row = 0; row < ydim; row++) {
+            if(stop) continue;
+            int i2 = row / Nr, i1 = row % Nr;
+            try{
+                // Make sure there's point everywhere on the grid, 0 < theta < pi
+                GenPar dj1dS(GF.parameters()), dj2dS(GF.parameters());
+                PSPD jt;
+
+                // 1. Compute toy actions and angles from real actions and toy angles
+                // by applying generating function
+                jt = GF.MapWithDerivs(J(0),J(1),i1,i2,dj1dS,dj2dS);
+                if(jt(0)<0.) jt[0]=0;  // ensure that toy actions are non-negative
+                if(jt(1)<0.) jt[1]=0;
+
+                // 2. Compute dHdj and dHdSk for each point in toy angle space
+                double dHdj[3];
+                dHdj_toy(*tm, jt, *pt, Phi, J(2), dHdj);
+
+                // 3. Fill a big matrix with rows of 1 and - dH/dSk
+                //    each row correspond to a point on toy angle space
+                fill_row_dHdSn(dHdj, dj1dS, dj2dS, X, row);
+
+                // Filling RHS of equation
+                gsl_vector_set (y1, row, dHdj[0]);
+                gsl_vector_set (y2, row, dHdj[1]);
+                gsl_vector_set (y3, row, dHdj[2]);
+            }
+            catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(dSbySampling)
+#endif
+                errorMsg = e.what();
+                stop = true;
+            }
         }
+        delete tm;
+        delete pt;
+    }
+    if(!errorMsg.empty()) {
+        gsl_vector_free(T1);
+        gsl_vector_free(T2);
+        gsl_vector_free(T3);
+        gsl_vector_free(y1);
+        gsl_vector_free(y2);
+        gsl_vector_free(y3);
+        gsl_vector_free(S);
+        gsl_vector_free(work);
+        gsl_matrix_free(X);
+        gsl_matrix_free(V);
+        gsl_matrix_free(Xprime);
+        throw std::runtime_error(errorMsg);
     }
 
     // Xprime is a copy of X. Copying is necessary because X will be overwritten
@@ -112,6 +112,10 @@ public:
     virtual PSPD    ForwardWithDerivs(const PSPD&, double[2][2]) const=0;
     virtual PSPD    ForwardWithDerivs(const PSPD&, double[2][2], 
 				      double[2][2])              const=0;
+    /// create a copy of this map (the intermediate results of a forward
+    /// map, used by Derivatives(), are stored in the object, so concurrent
+    /// evaluation requires a separate copy in each thread)
+    virtual ToyMap* clone            ()                          const=0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -122,6 +126,8 @@ class PoiTra : public PhaseSpaceMapWithBackward {
 public:
   virtual void    parameters       (double *)                  const=0;
   virtual void    Derivatives      (double[4][4])	       const=0; 
+  /// create a copy of this map (see ToyMap::clone)
+  virtual PoiTra* clone            ()                          const=0;
 };
 
 inline void AlignAngles(PSPD& JT)
@@ -8,12 +8,12 @@
 namespace torus {
 using std::cerr;
 
-// A lot like Press et al's version.
+// A lot like Press et al's version, except that the running estimate s is kept
+// by the caller rather than in a static variable, so that the routine is re-entrant.
 ////////////////////////////////////////////////////////////////////////////////
-double trapzd(double(*func)(double), const double a, const double b,const int n)
+double trapzd(double(*func)(double), const double a, const double b,const int n,
+	      double& s)
 {
-  static double s;
-
   if(n==1)
     return (s=0.5*(b-a)*func(a)+func(b));
   else {
@@ -65,11 +65,11 @@ double qromb(double(*func)(double), const double a,
 	     const double b, const double EPS) {
 
   const int JMAX=20, JMAXP = JMAX+1, K=5;
-  double ss=0,dss, s[JMAX], h[JMAXP], s_t[K], h_t[K];
+  double ss=0,dss, s[JMAX], h[JMAXP], s_t[K], h_t[K], strap=0;
   
   h[0]=1.;
   for(int j=1; j<=JMAX;j++) {
-    s[j-1] = trapzd(func,a,b,j);
+    s[j-1] = trapzd(func,a,b,j,strap);
     if(j>=K) {
       for(int i=0;i<K;i++) {
 	h_t[i] = h[j-K+i];
@@ -67,6 +67,12 @@ class PoiClosedOrbit : public PoiTra {
   Cheby xa,ya,za;         // Chebyshev polynomials which define transform
                           // N.B. za stores z' = z/th because that's ~constant
   
+  // intermediate quantities of the last Forward() or Backward() transform,
+  // needed by Derivatives()
+  mutable double R,z,r,th,th2,ir,costh,sinth,pr,pth,xpp,ypp,zpp,dx,dy,dz,
+    d2x,d2y,d2z,rt,tht,prt,ptht, drtdr, drtdth, dthtdr, dthtdth,
+    dthdtht, dthdrt, drdtht, drdrt;
+
   double thmaxforactint;  // used to find the action
   Cheby vr2, drdth2, pth2;//         ''
   double actint(double) const;
@@ -105,6 +111,8 @@ class PoiClosedOrbit : public PoiTra {
   PSPT    Forward3D         (const PSPT&)                const;
   PSPT    Backward3D        (const PSPT&)                const;
   void    Derivatives       (double[4][4])               const;
+  PoiTra* clone             ()                           const
+                                    { return new PoiClosedOrbit(*this); }
 };
 
 
@@ -43,6 +43,8 @@ public:
     PSPT    Forward3D         (const PSPT&)                const;
     PSPT    Backward3D        (const PSPT&)                const;
     void    Derivatives       (double[4][4])               const;
+    PoiTra* clone             ()                           const
+                                    { return new PoiNone(*this); }
 };
 
 inline void PoiNone::parameters (double *) const
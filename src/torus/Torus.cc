@@ -28,9 +28,6 @@ typedef Matrix<double,4,4> DB44;
 // class Torus ************************************************************** //
 ////////////////////////////////////////////////////////////////////////////////
 
-static double RforSOS;
-static PSPD   Jtroot;
-
 void Torus::SetMaps(const double* pp,
 	            const vec4 &tp,
 	            const GenPar &sn,
@@ -75,6 +75,25 @@ private:
   GenFnc	GF;                           // Generating function (J,thT->JT)
   AngMap	AM;                           // Angle Mapping (th->thT)
   bool useNewAngMap;  // choice of the method for angle mapping (old/new)
+  mutable PSPD  Jtroot;                       // scratch space for the root-finders
+  mutable double RforSOS;                     //   used in SOS() and SOS_z()
+
+  // The toy map and point transform keep the intermediate results of the last
+  // transformation (needed for computing derivatives) in their own data members,
+  // so the const mapping functions (Map, Map3D, Forward, etc.) work on private
+  // copies of these maps and may be called for the same torus from several threads.
+  // Other const functions (containsPoint, DistancetoPSP, SOS, ...) use the maps
+  // of the torus itself, and are safe only when applied to different tori.
+  class MapCopy {
+  public:
+    ToyMap *TM;
+    PoiTra *PT;
+    explicit MapCopy(const Torus& T) : TM(T.TM->clone()), PT(T.PT->clone()) {}
+    ~MapCopy() { delete PT; delete TM; }
+  private:
+    MapCopy(const MapCopy&);
+    MapCopy& operator= (const MapCopy&);
+  };
 
   Angles      mirror_Angles(Angles,double) const; 
   // For given angles & coord phi, find angles giving same x, -vR, -vz, vphi  
@@ -499,30 +518,36 @@ inline PSPD Torus::Forward(const PSPD &JT) const
 { 
     if((JT(0) != J(0)) || JT(1) != J(1))
 	cerr<<" WARNING: Torus::Forward() called with different action(s)\n";
-    return JT >> AM >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    return JT >> AM >> GF >> (*M.TM) >> (*M.PT);
 }
 inline PSPT Torus::Forward3D(const PSPT &JT) const
 { 
     if((JT(0) != J(0)) || JT(1) != J(1) || JT(2) != J(2))
 	cerr<<" WARNING: Torus::Forward() called with different action(s)\n";
-    return JT >> AM >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    return JT >> AM >> GF >> (*M.TM) >> (*M.PT);
 }
 
 inline PSPD Torus::Map(const Angles& A) const { 
-    return PSPD(J(0),J(1),A(0),A(1)) >> AM >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    return PSPD(J(0),J(1),A(0),A(1)) >> AM >> GF >> (*M.TM) >> (*M.PT);
 }
 inline PSPT Torus::Map3D(const Angles& A) const { 
-  return PSPT(J(0),J(1),J(2),A(0),A(1),A(2)) >> AM >> GF >> (*TM) >> (*PT);
+  MapCopy M(*this);
+  return PSPT(J(0),J(1),J(2),A(0),A(1),A(2)) >> AM >> GF >> (*M.TM) >> (*M.PT);
 }
 
 inline PSPD Torus::MapfromToy(		// return:	(R,z,vR,vz)
 	    const Angles& A) const	// input:       (tr,tt,phi)
 { 
-    return    PSPD(J(0),J(1),A(0),A(1)) >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    return    PSPD(J(0),J(1),A(0),A(1)) >> GF >> (*M.TM) >> (*M.PT);
 }
 inline PSPT Torus::MapfromToy3D(const Angles& A) const
 { 
-  return PSPT(J(0),J(1),J(2),A(0),A(1),A(2))>> GF >> (*TM) >> (*PT);
+  MapCopy M(*this);
+  return PSPT(J(0),J(1),J(2),A(0),A(1),A(2))>> GF >> (*M.TM) >> (*M.PT);
 }
 
 inline PSPD Torus::MapfromToy(		// return:	(R,z,vR,vz)
@@ -534,7 +559,8 @@ inline PSPD Torus::MapfromToy(		// return:	(R,z,vR,vz)
     PSPD Jt = PSPD(J(0),J(1),A(0),A(1));
     JT      = AM.BackwardWithDerivs(Jt,dTdt);
     Det     = dTdt[0][0]*dTdt[1][1] - dTdt[0][1]*dTdt[1][0];
-    return    Jt >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    return    Jt >> GF >> (*M.TM) >> (*M.PT);
 }
 
 inline double Torus::DToverDt(		// return: 	|d(Tr,Tt)/d(tr,tt)|
@@ -557,7 +583,8 @@ inline double Torus::DToverDt(		// return: 	|d(Tr,Tt)/d(tr,tt)|
 inline GCY Torus::FullMap(const Angles& A) const
 {
     GCY  gcy;
-    PSPD qp = PSPD(J(0),J(1),A(0),A(1)) >> AM >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    PSPD qp = PSPD(J(0),J(1),A(0),A(1)) >> AM >> GF >> (*M.TM) >> (*M.PT);
     gcy[0] = qp(0);		// R
     gcy[1] = qp(1);		// z
     gcy[2] = A(2);		// phi
@@ -570,7 +597,8 @@ inline GCY Torus::FullMap(const Angles& A) const
 inline Position Torus::PosMap(const Angles& A) const
 {
     Position X;
-    PSPT qp = PSPT(J(0),J(1),J(2),A(0),A(1),A(2)) >> AM >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    PSPT qp = PSPT(J(0),J(1),J(2),A(0),A(1),A(2)) >> AM >> GF >> (*M.TM) >> (*M.PT);
     X[0] = qp(0);
     X[1] = qp(1);
     X[2] = qp(2);
@@ -891,7 +919,8 @@ inline int Torus::containsPoint (const Position& X,GCY& w11, GCY& w21,
 
 inline PSPD Torus::StartPoint(const double th1, const double th2) const
 {
-    return PSPD(J(0),J(1),th1,th2) >> GF >> (*TM) >> (*PT);
+    MapCopy M(*this);
+    return PSPD(J(0),J(1),th1,th2) >> GF >> (*M.TM) >> (*M.PT);
 }
 
 /* inline int Torus::ManualFit(Potential *Phi, const double tol, const int Max, */
@@ -97,6 +97,8 @@ public:
     PSPD    Backward          (const PSPD&)                const;
     PSPT    Forward3D         (const PSPT&)                const;
     PSPT    Backward3D        (const PSPT&)                const;
+    ToyMap* clone             ()                           const
+                                    { return new ToyIsochrone(*this); }
 };
 
 inline void ToyIsochrone::set_parameters(const IsoPar& p)
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
 #include <stdexcept>
 #include <cassert>
 #include <signal.h>
@@ -16,6 +17,12 @@
 #endif
 #ifdef _MSC_VER
 #pragma warning(disable:4996)  // prevent deprecation error on getenv
+#else
+#define HAVE_SHARED_MEMORY
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 namespace utils {
@@ -199,6 +206,96 @@ CtrlBreakHandler::~CtrlBreakHandler()
 
 bool CtrlBreakHandler::triggered() { return ctrlBreakTriggered; }
 
+/* ----------- shared memory ----------------- */
+
+namespace {
+/// POSIX shared memory object names must start with a single slash
+inline std::string sharedMemoryName(const std::string& name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+}  // internal ns
+
+#ifdef HAVE_SHARED_MEMORY
+
+SharedMemorySegment::SharedMemorySegment(const std::string& name, size_t size) :
+    ptr(NULL), len(size)
+{
+    if(size == 0)
+        throw std::invalid_argument("SharedMemorySegment: size must be positive");
+    const std::string shmname = sharedMemoryName(name);
+    int fd = shm_open(shmname.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0)
+        throw std::runtime_error("SharedMemorySegment: cannot create " + shmname +
+            " (" + std::string(strerror(errno)) + ")");
+    if(ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(shmname.c_str());
+        throw std::runtime_error("SharedMemorySegment: cannot allocate " + toString((long)size) +
+            " bytes for " + shmname);
+    }
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);  // the mapping remains valid after closing the descriptor
+    if(ptr == MAP_FAILED) {
+        ptr = NULL;
+        shm_unlink(shmname.c_str());
+        throw std::runtime_error("SharedMemorySegment: cannot map " + shmname);
+    }
+}
+
+SharedMemorySegment::SharedMemorySegment(const std::string& name) :
+    ptr(NULL), len(0)
+{
+    const std::string shmname = sharedMemoryName(name);
+    int fd = shm_open(shmname.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        throw std::runtime_error("SharedMemorySegment: cannot open " + shmname +
+            " (" + std::string(strerror(errno)) + ")");
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        throw std::runtime_error("SharedMemorySegment: " + shmname + " is empty");
+    }
+    len = st.st_size;
+    ptr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED) {
+        ptr = NULL;
+        throw std::runtime_error("SharedMemorySegment: cannot map " + shmname);
+    }
+}
+
+SharedMemorySegment::~SharedMemorySegment()
+{
+    if(ptr)
+        munmap(ptr, len);
+}
+
+bool SharedMemorySegment::remove(const std::string& name)
+{
+    return shm_unlink(sharedMemoryName(name).c_str()) == 0;
+}
+
+#else
+
+SharedMemorySegment::SharedMemorySegment(const std::string& name, size_t) : ptr(NULL), len(0)
+{
+    throw std::runtime_error("SharedMemorySegment: not supported on this platform (" +
+        sharedMemoryName(name) + ")");
+}
+
+SharedMemorySegment::SharedMemorySegment(const std::string& name) : ptr(NULL), len(0)
+{
+    throw std::runtime_error("SharedMemorySegment: not supported on this platform (" +
+        sharedMemoryName(name) + ")");
+}
+
+SharedMemorySegment::~SharedMemorySegment() {}
+
+bool SharedMemorySegment::remove(const std::string&) { return false; }
+
+#endif
+
 /* ----------- string/number conversion and parsing routines ----------------- */
 
 int toInt(const char* val) {
@@ -7,6 +7,10 @@
 #include <string>
 #include <vector>
 
+/// version of the library, embedded into the Python module as the __version__ attribute
+/// and into the key of the persistent cache of potential expansions
+#define AGAMA_VERSION "1.0 compiled on " __DATE__
+
 /** Helper routines for string handling, logging and miscellaneous other tasks.  */
 namespace utils {
 
@@ -96,6 +100,48 @@ public:
 };
 
 
+/** A named block of memory shared between processes on the same machine.
+    One process creates the segment and fills it with data, and other processes may attach to it
+    by name and read the data without copying it through files or pipes.
+    The segment persists after all processes detach from it, until it is removed explicitly
+    by the static method `remove`.
+    This is implemented on top of POSIX shared memory (shm_open/mmap),
+    and is not available on Windows (the constructors throw an exception).
+*/
+class SharedMemorySegment {
+public:
+    /** create a new segment of the given size, mapped for reading and writing.
+        \param[in]  name  is the name of the segment (a leading '/' is added if missing);
+        \param[in]  size  is its size in bytes (must be positive);
+        \throws std::runtime_error if a segment with this name already exists or cannot be created.
+    */
+    SharedMemorySegment(const std::string& name, size_t size);
+
+    /** attach to an existing segment for reading only.
+        \throws std::runtime_error if the segment does not exist.
+    */
+    explicit SharedMemorySegment(const std::string& name);
+
+    /// unmap the segment from the address space of this process (but do not remove it)
+    ~SharedMemorySegment();
+
+    /// pointer to the beginning of the segment (writable only if created by this instance)
+    void* data() const { return ptr; }
+
+    /// size of the segment in bytes
+    size_t size() const { return len; }
+
+    /// remove the segment with the given name; return true on success
+    static bool remove(const std::string& name);
+
+private:
+    void* ptr;   ///< address of the mapped segment
+    size_t len;  ///< its size
+    SharedMemorySegment(const SharedMemorySegment&);             // non-copyable
+    SharedMemorySegment& operator=(const SharedMemorySegment&);
+};
+
+
 /*------------- string functions ------------*/
 
 /** split a string into several items.
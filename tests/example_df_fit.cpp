@@ -9,7 +9,9 @@
     Hernquist profile, and we fit it with a double-power-law distribution function
     of Posti et al.2015. We use the exact potential (i.e., do not compute it
     from the N-body model itself, nor try to vary its parameters, although
-    both options are possible), and compute actions for all particles only once.
+    both options are possible), and compute actions for all particles only once;
+    they are kept in the likelihood object (df::DFLikelihood), which evaluates the DF
+    for all particles in parallel and takes care of its normalization.
     Then we scan the parameter space of DF, finding the maximum of the likelihood
     function with a multidimensional minimization algorithm.
     This takes a few hundred iterations to converge.
@@ -20,7 +22,7 @@
 */
 #include "potential_dehnen.h"
 #include "actions_spherical.h"
-#include "df_halo.h"
+#include "df_likelihood.h"
 #include "particles_base.h"
 #include "math_fit.h"
 #include "math_core.h"
@@ -32,58 +34,50 @@
 #include <iostream>
 
 const unsigned int NPARAMS = 5;
-typedef std::vector<actions::Actions> ActionArray;
 
-/// convert from parameter space to DF params
-df::DoublePowerLawParam dfparams(const double vars[])
-{
-    df::DoublePowerLawParam params;
-    params.slopeIn   = vars[0];
-    params.slopeOut  = vars[1];
-    params.steepness = vars[2];
-    params.coefJrIn  = vars[3];
-    params.coefJzIn  = (3-vars[3])/2; // fix g_z=g_phi taking into account that g_r+g_z+g_phi=3
-    params.J0        = exp(vars[4]);
-    params.norm      = 1.;
-    return params;
-}
+/// names of the parameters of DoublePowerLaw DF that are varied in the fit
+const char* FREE_PARAMS[] = { "slopeIn", "slopeOut", "steepness", "coefJrIn", "coefJzIn", "J0" };
+const unsigned int NFREE = sizeof(FREE_PARAMS) / sizeof(FREE_PARAMS[0]);
 
-/// compute log-likelihood of DF with given params against an array of points
-double modelLikelihood(const df::DoublePowerLawParam& params, const ActionArray& points)
+/// convert from the parameter space of the search to the free parameters of the DF family
+void dfparams(const double vars[], double params[])
 {
-    std::cout <<
-        "J0="          << utils::pp(params.J0,       7) <<
-        ", slopeIn="   << utils::pp(params.slopeIn,  7) <<
-        ", slopeOut="  << utils::pp(params.slopeOut, 7) <<
-        ", steepness=" << utils::pp(params.steepness,7) <<
-        ", coefJrIn="  << utils::pp(params.coefJrIn, 7) << ": ";
-    double sumlog = 0;
-    try{
-        df::DoublePowerLaw dpl(params);
-        double norm = dpl.totalMass();
-        for(unsigned int i=0; i<points.size(); i++)
-            sumlog += log(dpl.value(points[i])/norm);
-        std::cout << "LogL=" << utils::pp(sumlog,10) << std::endl;
-        return sumlog;
-    }
-    catch(std::invalid_argument& e) {
-        std::cout << "Exception "<<e.what()<<"\n";
-        return -1000.*points.size();
-    }
+    params[0] = vars[0];        // slopeIn
+    params[1] = vars[1];        // slopeOut
+    params[2] = vars[2];        // steepness
+    params[3] = vars[3];        // coefJrIn
+    params[4] = (3-vars[3])/2;  // coefJzIn: fix g_z=g_phi taking into account that g_r+g_z+g_phi=3
+    params[5] = exp(vars[4]);   // J0
 }
 
-/// function to be minimized
+/// function to be minimized: the log-likelihood of the DF with given params against
+/// the array of particle actions, which are kept inside the likelihood object
 class ModelSearchFnc: public math::IFunctionNdim{
 public:
-    ModelSearchFnc(const ActionArray& _points) : points(_points) {};
+    ModelSearchFnc(const df::DFLikelihood& _likelihood) : likelihood(_likelihood) {};
     virtual void eval(const double vars[], double values[]) const
     {
-        values[0] = -modelLikelihood(dfparams(vars), points);
+        double params[NFREE], logL;
+        dfparams(vars, params);
+        likelihood.eval(1, params, &logL);
+        std::cout <<
+            "J0="          << utils::pp(params[5], 7) <<
+            ", slopeIn="   << utils::pp(params[0], 7) <<
+            ", slopeOut="  << utils::pp(params[1], 7) <<
+            ", steepness=" << utils::pp(params[2], 7) <<
+            ", coefJrIn="  << utils::pp(params[3], 7) << ": ";
+        if(logL == -INFINITY) {
+            std::cout << "invalid parameters\n";
+            values[0] = 1000.*likelihood.size();
+        } else {
+            std::cout << "LogL=" << utils::pp(logL,10) << std::endl;
+            values[0] = -logL;
+        }
     }
     virtual unsigned int numVars() const { return NPARAMS; }
     virtual unsigned int numValues() const { return 1; }
 private:
-    const ActionArray& points;
+    const df::DFLikelihood& likelihood;
 };
 
 /// analytic expression for the ergodic distribution function f(E)
@@ -130,7 +124,7 @@ int main(){
     potential::Dehnen pot(1., 1., 1., 1., 1.);
     const actions::ActionFinderSpherical actf(pot);
     particles::ParticleArrayCyl particles(createHernquistModel(100000));
-    ActionArray particleActions(particles.size());
+    std::vector<actions::Actions> particleActions(particles.size());
     for(unsigned int i=0; i<particles.size(); i++)
         particleActions[i] = actf.actions(particles.point(i));
 
@@ -140,7 +134,11 @@ int main(){
     const int maxNumIter = 1000;
     const double toler   = 1e-4;
     double bestparams[NPARAMS];
-    ModelSearchFnc fnc(particleActions);
+    df::DoublePowerLawParam baseParams;
+    baseParams.norm = 1.;
+    df::DFLikelihood likelihood(df::PtrDFFamily(new df::DoublePowerLawFamily(baseParams,
+        std::vector<std::string>(FREE_PARAMS, FREE_PARAMS + NFREE))), particleActions);
+    ModelSearchFnc fnc(likelihood);
     int numIter = math::findMinNdim(fnc, initparams, stepsizes, toler, maxNumIter, bestparams);
     std::cout << numIter << " iterations\n";
 }
@@ -26,7 +26,11 @@
 #include <iostream>
 #include <fstream>
 #include <ctime>
+#include <cstring>
 #include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 const units::InternalUnits unit(units::galactic_Myr);//(1.*units::Kpc, 977.8*units::Myr);
 const unsigned int NUM_ANGLE_SAMPLES = 64;
@@ -73,6 +77,44 @@ bool test_actions(const potential::BasePotential& poten,
     return tolerable;
 }
 
+/// check that tori are constructed and mapped identically when done concurrently from several
+/// threads, with several threads mapping the same torus at the same time
+bool test_concurrency(const potential::PtrPotential& pot, const actions::Actions& acts)
+{
+    const int NUM_TORI = 4, NUM_POINTS = NUM_TORI * 16;
+    std::vector<actions::ActionAngles> aa(NUM_POINTS);
+    for(int i=0; i<NUM_POINTS; i++) {
+        actions::Actions act = acts;
+        act.Jr *= 1 + 0.25 * (i % NUM_TORI);
+        act.Jz *= 1 - 0.15 * (i % NUM_TORI);
+        aa[i] = actions::ActionAngles(act, actions::Angles(
+            math::wrapAngle(0.1*i), math::wrapAngle(0.3*i+1), math::wrapAngle(0.7*i+2)));
+    }
+    std::vector<coord::PosVelCyl> xvseq(NUM_POINTS), xvpar(NUM_POINTS);
+    // reference values computed sequentially, with the fitting routines themselves running
+    // in parallel, while in the concurrent case below they run in one thread (nested parallelism
+    // is off); the summation order in the fit does not depend on the number of threads,
+    // so the results must be identical
+    actions::ActionMapperTorus mapseq(pot), mappar(pot);
+    for(int i=0; i<NUM_POINTS; i++)
+        xvseq[i] = mapseq.map(aa[i]);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(4)
+#endif
+    for(int i=0; i<NUM_POINTS; i++)
+        xvpar[i] = mappar.map(aa[i]);
+    bool ok = true;
+    for(int i=0; i<NUM_POINTS; i++) {
+        // failed tori produce NAN in both cases, and NAN != NAN, hence compare the bit patterns
+        ok &= memcmp(&xvseq[i], &xvpar[i], sizeof(coord::PosVelCyl)) == 0;
+        if(output)
+            std::cout << "Sequential: " << xvseq[i] << "\nParallel:   " << xvpar[i] << "\n";
+    }
+    std::cout << "Concurrent construction and mapping of " << NUM_TORI << " tori: " <<
+        (ok ? "identical results\n" : "\033[1;31mresults differ\033[0m\n");
+    return ok;
+}
+
 potential::PtrPotential make_galpot(const char* params)
 {
     const char* params_file="test_galpot_params.pot";
@@ -118,6 +160,7 @@ int main(int argc, const char* argv[]) {
     actions::ActionMapperTorus mapper(pot);
     actions::ActionFinderAxisymFudge finder(pot, false);
     allok &= test_actions(*pot, finder, mapper, acts);
+    allok &= test_concurrency(pot, acts);
     if(allok)
         std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
     else
@@ -78,6 +78,31 @@ bool test(const galaxymodel::BaseTargetDensity& grid)
     return ok;
 }
 
+// check that adding a sequence of points in a single batch gives the same result as adding them one by one
+bool testBatch(const galaxymodel::BaseTargetDensity& grid)
+{
+    const int N=grid.numValues(), NP=200;
+    std::vector<double> points(NP*6), mults(NP), v1(N), v2(N);
+    for(int p=0; p<NP; p++) {
+        // a smooth rosette-like trajectory, which occasionally crosses the outer grid boundary
+        double t = p * 0.05, r = 0.5 + 0.45 * sin(0.7*t);
+        points[p*6  ] = r * cos(t) * cos(0.3*t);
+        points[p*6+1] = r * sin(t);
+        points[p*6+2] = r * cos(t) * sin(0.3*t) - 0.05;
+        points[p*6+3] = points[p*6+4] = points[p*6+5] = 0;
+        mults [p]     = 1 + 0.01 * p;
+    }
+    for(int p=0; p<NP; p++)
+        grid.addPoint(&points[p*6], mults[p], &v1[0]);
+    grid.addPoints(NP, &points[0], &mults[0], &v2[0]);
+    bool ok = true;
+    for(int i=0; i<N; i++)
+        ok &= fabs(v1[i]-v2[i]) <= 1e-12 * (1 + fabs(v1[i]));
+    if(!ok)
+        std::cout << grid.name() << ": batched addPoints differs from addPoint\n";
+    return ok;
+}
+
 int main()
 {
     potential::Ferrers dens(mass, radius, axisYtoX, axisZtoX);
@@ -95,6 +120,11 @@ int main()
     ok &= check(grid1, 0.10, 0.10, 0.11, 58, 59, 39, 60);
     ok &= test (grid0);
     ok &= test (grid1);
+    ok &= testBatch(grid0);
+    ok &= testBatch(grid1);
+    ok &= testBatch(galaxymodel::TargetDensitySphHarm(6, 4, rad));
+    ok &= testBatch(galaxymodel::TargetDensityCylindrical<0>(4, rad, rad));
+    ok &= testBatch(galaxymodel::TargetDensityCylindrical<1>(4, rad, rad));
     std::vector<double> masses = grid0.computeDensityProjection(dens);
     double sum = std::accumulate(masses.begin(), masses.end(), 0.);
     ok &= fabs(sum - mass) < 1e-10;
@@ -206,6 +206,22 @@ int main(){
     } else
         std::cout << "\n";
 
+    // the cached mass of a rescaled model (all actions multiplied by a constant, and a different
+    // norm) should agree with the direct integration, which is not exactly scale-invariant
+    paramDPL.J0    *= 4.;
+    paramDPL.Jphi0 *= 4.;
+    paramDPL.Jcore *= 4.;
+    paramDPL.norm  *= 2.;
+    double massCached = df::DoublePowerLaw(paramDPL).totalMass();
+    double massDirect = df::DoublePowerLaw(paramDPL).BaseDistributionFunction::totalMass();
+    std::cout << "Mass of a rescaled model: cached " << utils::pp(massCached,8) <<
+        ", direct " << utils::pp(massDirect,8);
+    if(math::fcmp(massCached, 2*massCore, 1e-12)!=0 || math::fcmp(massCached, massDirect, 1e-5)!=0) {
+        std::cout << errmsg << "\n";
+        ok = false;
+    } else
+        std::cout << "\n";
+
     if(ok)
         std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
     else
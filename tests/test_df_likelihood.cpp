@@ -0,0 +1,185 @@
+/** \file    test_df_likelihood.cpp
+    \author  Eugene Vasiliev
+    \date    2026
+
+    This test checks the analytic derivatives of DoublePowerLaw and QuasiIsothermal DFs
+    w.r.t. their parameters against finite differences, and the batched computation of
+    log-likelihood and its gradient by the DFLikelihood class against a direct computation.
+*/
+#include <iostream>
+#include <cmath>
+#include "df_likelihood.h"
+#include "potential_analytic.h"
+#include "potential_dehnen.h"
+#include "potential_composite.h"
+#include "math_core.h"
+#include "math_random.h"
+#include "utils.h"
+
+const char* errmsg = "\033[1;31m **\033[0m";
+
+/// compare the analytic derivatives of DF w.r.t. parameters with finite differences
+bool testParamDerivs(const df::BaseDFFamily& family, const double params[],
+    const std::vector<std::string>& names, const std::vector<actions::Actions>& points)
+{
+    const unsigned int K = family.numParams(), N = points.size();
+    std::vector<double> values(N), derivs(N * K), valuesLeft(N), valuesRight(N);
+    family.evalParamDeriv(*family.createDF(params), N, &points[0], &values[0], &derivs[0]);
+    bool ok = true;
+    for(unsigned int k=0; k<K; k++) {
+        const double EPS = 1e-4, delta = EPS * fmax(fabs(params[k]), 0.1);
+        std::vector<double> par(params, params+K);
+        par[k] = params[k] - delta;
+        family.createDF(&par[0])->evalmany(N, &points[0], false, &valuesLeft[0]);
+        par[k] = params[k] + delta;
+        family.createDF(&par[0])->evalmany(N, &points[0], false, &valuesRight[0]);
+        double maxerr = 0;
+        for(unsigned int p=0; p<N; p++) {
+            // compare the derivatives of log(f) w.r.t. parameter, scaled to be dimensionless
+            double dlogfAn = derivs[p * K + k] / values[p] * delta / EPS;
+            double dlogfFD = (valuesRight[p] - valuesLeft[p]) / (2 * EPS * values[p]);
+            maxerr = fmax(maxerr, fabs(dlogfAn - dlogfFD) / (1 + fabs(dlogfFD)));
+        }
+        bool good = maxerr < 1e-3;
+        std::cout << "d f / d " << names[k] << ": max error=" << maxerr << (good ? "" : errmsg) << "\n";
+        ok &= good;
+    }
+    return ok;
+}
+
+/// compare the likelihood computed by DFLikelihood with a direct computation,
+/// and its gradient with finite differences
+bool testLikelihood(const df::DFLikelihood& likelihood, const df::BaseDFFamily& family,
+    const std::vector<double>& params, const std::vector<actions::Actions>& points)
+{
+    const unsigned int K = family.numParams(), numSets = params.size() / K;
+    std::vector<double> logL(numSets), grad(numSets * K), logLnograd(numSets);
+    likelihood.eval(numSets, &params[0], &logLnograd[0]);
+    likelihood.eval(numSets, &params[0], &logL[0], &grad[0]);
+    bool ok = true;
+    for(unsigned int s=0; s<numSets; s++) {
+        // direct computation
+        double logLdirect = -INFINITY;
+        try{
+            df::PtrDistributionFunction df = family.createDF(&params[s * K]);
+            double logNorm = log(df->totalMass());
+            logLdirect = 0;
+            for(unsigned int p=0; p<points.size(); p++)
+                logLdirect += log(df->value(points[p])) - logNorm;
+        }
+        catch(std::invalid_argument&) {}
+        bool good = (logLdirect == -INFINITY && logL[s] == -INFINITY) ||
+            (fabs(logL[s] - logLdirect) < 1e-8 * points.size() && logL[s] == logLnograd[s]);
+        std::cout << "Parameter set " << s << ": logL=" << utils::pp(logL[s], 12) <<
+            ", direct computation: " << utils::pp(logLdirect, 12) << (good ? "" : errmsg) << "\n";
+        ok &= good;
+        if(logLdirect == -INFINITY)
+            continue;
+        // finite-difference estimate of the gradient
+        for(unsigned int k=0; k<K; k++) {
+            const double delta = 1e-3 * fmax(fabs(params[s * K + k]), 0.1);
+            std::vector<double> par(&params[s * K], &params[s * K] + K);
+            double logLleft, logLright;
+            par[k] -= delta;
+            likelihood.eval(1, &par[0], &logLleft);
+            par[k] += 2*delta;
+            likelihood.eval(1, &par[0], &logLright);
+            double gradFD = (logLright - logLleft) / (2*delta);
+            bool goodgrad = fabs(grad[s * K + k] - gradFD) < 1e-3 * points.size() / fmax(fabs(params[s * K + k]), 0.1);
+            std::cout << "  dlogL/dparam" << k << "=" << utils::pp(grad[s * K + k], 10) <<
+                ", finite-difference estimate: " << utils::pp(gradFD, 10) << (goodgrad ? "" : errmsg) << "\n";
+            ok &= goodgrad;
+        }
+    }
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    std::vector<actions::Actions> points;
+    for(int i=0; i<200; i++)
+        points.push_back(actions::Actions(
+            math::random() * 3, math::random() * 2, (math::random()-0.3) * 4));
+
+    // 1. derivatives of a double-power-law DF with core, cutoff and rotation
+    {
+        df::DoublePowerLawParam par;
+        par.norm = 1.; par.J0 = 1.; par.slopeIn = 1.5; par.slopeOut = 4.5; par.steepness = 1.2;
+        par.Jcutoff = 5.; par.cutoffStrength = 1.5; par.coefJrIn = 1.2; par.coefJzIn = 0.8;
+        par.coefJrOut = 0.9; par.coefJzOut = 1.1; par.rotFrac = 0.4; par.Jphi0 = 0.5; par.Jcore = 0.2;
+        const char* names[] = { "norm", "J0", "slopeIn", "slopeOut", "steepness", "Jcutoff",
+            "cutoffStrength", "coefJrIn", "coefJzIn", "coefJrOut", "coefJzOut", "rotFrac", "Jphi0", "Jcore" };
+        const double values[] = { par.norm, par.J0, par.slopeIn, par.slopeOut, par.steepness,
+            par.Jcutoff, par.cutoffStrength, par.coefJrIn, par.coefJzIn, par.coefJrOut,
+            par.coefJzOut, par.rotFrac, par.Jphi0, par.Jcore };
+        std::vector<std::string> freeParams(names, names + sizeof(names)/sizeof(names[0]));
+        std::cout << "\033[1mDoublePowerLaw\033[0m\n";
+        ok &= testParamDerivs(df::DoublePowerLawFamily(par, freeParams), values, freeParams, points);
+    }
+
+    // 2. derivatives of a quasi-isothermal DF with two variants of vertical velocity dispersion
+    {
+        std::vector<potential::PtrPotential> comps;
+        comps.push_back(potential::PtrPotential(new potential::MiyamotoNagai(1., 1., 0.2)));
+        comps.push_back(potential::PtrPotential(new potential::Dehnen(2., 3., 1., 1., 1.)));
+        const potential::Composite pot(comps);
+        const potential::Interpolator freq(pot);
+        df::QuasiIsothermalParam par;
+        par.Sigma0 = 1.; par.Rdisk = 1.5; par.sigmar0 = 0.6; par.Rsigmar = 3.; par.sigmamin = 0.05;
+        par.coefJr = 1.1; par.coefJz = 0.3; par.qJr = 0.2; par.qJz = 0.1; par.qJphi = 0.3; par.Jmin = 0.1;
+        par.Hdisk = 0.2;
+        const char* names1[] = { "Sigma0", "Rdisk", "Hdisk", "sigmar0", "sigmamin", "Rsigmar",
+            "coefJr", "coefJz", "qJr", "qJz", "qJphi", "Jmin" };
+        const double values1[] = { par.Sigma0, par.Rdisk, par.Hdisk, par.sigmar0, par.sigmamin,
+            par.Rsigmar, par.coefJr, par.coefJz, par.qJr, par.qJz, par.qJphi, par.Jmin };
+        std::vector<std::string> freeParams1(names1, names1 + sizeof(names1)/sizeof(names1[0]));
+        std::cout << "\033[1mQuasiIsothermal with Hdisk\033[0m\n";
+        ok &= testParamDerivs(df::QuasiIsothermalFamily(par, freq, freeParams1),
+            values1, freeParams1, points);
+        par.Hdisk = 0; par.sigmaz0 = 0.3; par.Rsigmaz = 4.; par.qJz = 1e-3;
+        const char* names2[] = { "sigmaz0", "Rsigmaz", "sigmamin", "qJz" };
+        const double values2[] = { par.sigmaz0, par.Rsigmaz, par.sigmamin, par.qJz };
+        std::vector<std::string> freeParams2(names2, names2 + sizeof(names2)/sizeof(names2[0]));
+        std::cout << "\033[1mQuasiIsothermal with sigmaz0\033[0m\n";
+        ok &= testParamDerivs(df::QuasiIsothermalFamily(par, freq, freeParams2),
+            values2, freeParams2, points);
+    }
+
+    // 3. likelihood of a sample drawn from a double-power-law DF, for several parameter sets,
+    // including an invalid one
+    {
+        df::DoublePowerLawParam par;
+        par.norm = 1.; par.J0 = 1.; par.slopeIn = 1.; par.slopeOut = 5.; par.coefJrIn = 1.3;
+        std::vector<actions::Actions> sample = df::sampleActions(df::DoublePowerLaw(par), 2000);
+        const char* names[] = { "J0", "slopeIn", "slopeOut", "coefJrIn" };
+        std::vector<std::string> freeParams(names, names + sizeof(names)/sizeof(names[0]));
+        df::PtrDFFamily family(new df::DoublePowerLawFamily(par, freeParams));
+        df::DFLikelihood likelihood(family, sample);
+        const double sets[] = {
+            1.0, 1.0, 5.0, 1.3,
+            1.5, 0.8, 4.5, 1.0,
+            0.7, 1.2, 2.5, 1.5 };  // invalid: slopeOut<3
+        std::cout << "\033[1mLikelihood\033[0m\n";
+        ok &= testLikelihood(likelihood, *family,
+            std::vector<double>(sets, sets + sizeof(sets)/sizeof(sets[0])), sample);
+
+        // per-particle values should add up to the total likelihood
+        std::vector<double> logf(sample.size());
+        std::vector<df::DerivByActions> derivs(sample.size());
+        likelihood.evalParticles(sets+4, &logf[0], &derivs[0]);
+        double logL, sumlogf = 0;
+        likelihood.eval(1, sets+4, &logL);
+        for(size_t i=0; i<sample.size(); i++)
+            sumlogf += logf[i];
+        bool good = fabs(sumlogf - logL) < 1e-10 * sample.size();
+        std::cout << "Sum of per-particle log(f): " << utils::pp(sumlogf, 12) << (good ? "" : errmsg) << "\n";
+        ok &= good;
+    }
+
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}
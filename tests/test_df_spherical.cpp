@@ -299,6 +299,27 @@ bool test(const potential::BasePotential& pot, double beta=0, double r_a=INFINIT
         (potential::Sphericalized<potential::BasePotential>(pot)), beta, r_a);
     double mass = comDF.totalMass();
 
+    // compare the tabulated and the exact action-based DF (value and derivatives) at random points
+    const df::QuasiSphericalCOM tabDF(
+        (potential::Sphericalized<potential::BaseDensity>(pot)),
+        (potential::Sphericalized<potential::BasePotential>(pot)), beta, r_a, /*accuracy*/ 1e-4);
+    double errtabf=0, errtabd=0;
+    for(int i=0; i<10000; i++) {
+        actions::Actions J(pow(10., 6*math::random()-3), pow(10., 6*math::random()-3),
+            (2*math::random()-1) * pow(10., 6*math::random()-3));
+        double fex, ftab;
+        df::DerivByActions dex, dtab;
+        comDF.evalDeriv(J, &fex, &dex);
+        tabDF.evalDeriv(J, &ftab, &dtab);
+        if(fex>0 && ftab>0) {
+            errtabf = fmax(errtabf, fabs(log(ftab/fex)));
+            // error in logarithmic derivatives d ln f / d ln J
+            errtabd = fmax(errtabd, (fabs(dtab.dbyJr-dex.dbyJr) * J.Jr +
+                fabs(dtab.dbyJz-dex.dbyJz) * J.Jz + fabs(dtab.dbyJphi-dex.dbyJphi) * fabs(J.Jphi)) / fex);
+        } else if(!(fex==ftab || (fex!=fex && ftab!=ftab)))
+            errtabf = INFINITY;  // both should be invalid or zero simultaneously
+    }
+
     const potential::Interpolator interp(pot);
     const potential::PhaseVolume phasevol((potential::Sphericalized<potential::BasePotential>(pot)));
     const math::LogLogSpline intRho= createInterpolatedDensity(pot);
@@ -573,7 +594,9 @@ bool test(const potential::BasePotential& pot, double beta=0, double r_a=INFINIT
     }
     std::cout <<
        " comf="     + checkLess(errcomf,2e-05, ok) +
-       ", DF mass=" + checkLess(mass-1,  0.01, ok) + "\n";
+       ", DF mass=" + checkLess(mass-1,  0.01, ok) +
+       ", tabulated DF=" + checkLess(errtabf, 1e-04, ok) +
+       ", its derivs=" + checkLess(errtabd, 0.05, ok) + "\n";
     return ok;
 }
 
@@ -16,6 +16,7 @@
 */
 #include "galaxymodel_losvd.h"
 #include "math_core.h"
+#include "math_gausshermite.h"
 #include "math_random.h"
 #include "math_specfunc.h"
 #include "utils.h"
@@ -109,14 +110,28 @@ int main()
 
     // add points to the datacube
     math::Matrix<double> datacube = lgrid.newDatacube();
-    double pp[6] = {0.};
+    std::vector<double> allpoints(numPoints * 6), mults(numPoints, 1.);
     for(size_t p=0; p<numPoints; p++) {
+        double* pp = &allpoints[p*6];
         pp[0] = points[p].x;
         pp[1] = points[p].y;
         pp[5] = (math::random()-0.5) * gridSizeV * velbin;
         lgrid.addPoint(pp, 1., datacube.data());
     }
 
+    // the same datacube constructed by adding all points at once should be identical
+    math::Matrix<double> datacube2 = lgrid.newDatacube();
+    lgrid.addPoints(numPoints, &allpoints[0], &mults[0], datacube2.data());
+    double maxdif = 0;
+    for(size_t i=0; i<datacube.size(); i++)
+        maxdif = fmax(maxdif, fabs(datacube.data()[i] - datacube2.data()[i]));
+    std::cout << "Difference between batched and sequential datacubes: " << maxdif;
+    if(maxdif > 1e-14) {
+        ok = false;
+        std::cout << " \033[1;31m**\033[0m";
+    }
+    std::cout << "\n";
+
     // obtain amplitudes of b-spline decomposition
     math::Matrix<galaxymodel::StorageNumT> aper(numApertures, velfem.interp.numValues());
     lgrid.finalizeDatacube(datacube, aper.data());
@@ -135,6 +150,35 @@ int main()
         std::cout << "\n";
     }
 
+    // construct Gauss-Hermite expansions of LOSVDs in all non-empty apertures at once,
+    // and compare with the results of constructing them for each aperture separately
+    const unsigned int ghorder = 6;
+    std::vector<size_t> nonempty;
+    for(size_t a=0; a<numApertures; a++)
+        if(expected[a] > 1e-3)
+            nonempty.push_back(a);
+    math::Matrix<double> amplmat(nonempty.size(), aper.cols());
+    for(size_t i=0; i<nonempty.size(); i++)
+        for(size_t v=0; v<aper.cols(); v++)
+            amplmat(i, v) = aper(nonempty[i], v);
+    math::Matrix<double> ghmat = math::fitGaussHermiteMany(DEGREE, params.gridv, ghorder, amplmat);
+    maxdif = 0;
+    for(size_t i=0; i<nonempty.size(); i++) {
+        math::GaussHermiteExpansion ghexp(math::BsplineWrapper<DEGREE>(velfem.interp,
+            std::vector<double>(&amplmat(i, 0), &amplmat(i, 0) + amplmat.cols())), ghorder);
+        maxdif = fmax(maxdif, fabs(ghmat(i, 0) - ghexp.ampl()) / ghexp.ampl());
+        maxdif = fmax(maxdif, fabs(ghmat(i, 1) - ghexp.center()) / ghexp.width());
+        maxdif = fmax(maxdif, fabs(ghmat(i, 2) - ghexp.width()) / ghexp.width());
+        for(unsigned int m=0; m<=ghorder; m++)
+            maxdif = fmax(maxdif, fabs(ghmat(i, m+3) - ghexp.coefs()[m]));
+    }
+    std::cout << "Difference between batched and individual Gauss-Hermite fits: " << maxdif;
+    if(!(maxdif < 1e-8)) {
+        ok = false;
+        std::cout << " \033[1;31m**\033[0m";
+    }
+    std::cout << "\n";
+
     if(output) {
         std::ofstream strm("test_losvd.dat");
         strm << "#Points(x,y):\n";
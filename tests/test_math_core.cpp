@@ -240,6 +240,34 @@ private:
     double dataX[numDataPoints], dataY[numDataPoints];
 };
 
+// same fitting problem with a large number of data points computed on the fly,
+// represented as a separable function which can be evaluated in parallel blocks
+class test9LMsep: public math::IFunctionNdimDerivSeparable {
+public:
+    virtual void evalDerivRange(const double vars[], unsigned int first, unsigned int count,
+        double values[], double *derivs=0) const
+    {
+        double a = vars[0], b = vars[1], c = vars[2];
+        for(unsigned int k=0; k<count; k++) {
+            double x = (k+first) * 1.0 / numDataPoints;
+            double y = cos(1.5*x*M_PI) + 0.2*sin(x*5*M_PI) + 0.1*cos(x*21.4231) + 0.07*sin(x*67.56473);
+            double sinx = sin(b * x + c);
+            if(values)
+                values[k] = a * sinx - y;
+            if(derivs) {
+                double cosx = cos(b * x + c);
+                derivs[k*3  ] = sinx;
+                derivs[k*3+1] = a * cosx * x;
+                derivs[k*3+2] = a * cosx;
+            }
+        }
+    }
+    virtual unsigned int numVars() const { return 3; }
+    virtual unsigned int numValues() const { return numDataPoints; }
+private:
+    static const int numDataPoints = 200000;
+};
+
 // represent the least-square fitting problem as a general minimization problem
 class test9min: public math::IFunctionNdimDeriv {
 public:
@@ -595,6 +623,31 @@ int main()
     //fncLM.dump(yresult, "fit.log");
     ok &= fabs(result) < 1.5 || err();  // well it's not a particularly good fit by design
 
+    // same problem using the trust-region method with normal equations
+    numIter = nonlinearMultiFitTrustRegion(fncLM, yinit, 1e-4, 100, yresult);
+    fncMin.eval(yresult, &result);
+    std::cout << "Trust-region least-square fit: parameters x=("<<
+        yresult[0]<<","<<yresult[1]<<","<<yresult[2]<<")"
+        ", sum square dif="<<result<<" (nIter="<<numIter<<")\n";
+    ok &= (numIter > 0 && fabs(result) < 1.5) || err();
+
+    // a large separable fitting problem solved by both methods, which evaluate it in parallel
+    {
+        test9LMsep fncSep;
+        double yresultLM[3], yresultTR[3];
+        // the Levenberg-Marquardt solver stops by its own criterion when the relative change
+        // of parameters is ~1e-6, so it would not be considered converged with a tighter tolerance
+        int numIterLM = nonlinearMultiFit(fncSep, yinit, 1e-5, 100, yresultLM);
+        int numIterTR = nonlinearMultiFitTrustRegion(fncSep, yinit, 1e-6, 100, yresultTR);
+        std::cout << "Large separable fit: LM x=("<<
+            yresultLM[0]<<","<<yresultLM[1]<<","<<yresultLM[2]<<") nIter="<<numIterLM<<
+            ", trust-region x=("<<
+            yresultTR[0]<<","<<yresultTR[1]<<","<<yresultTR[2]<<") nIter="<<numIterTR<<"\n";
+        ok &= (numIterLM > 0 && numIterTR > 0 &&
+            fabs(yresultLM[0]-yresultTR[0]) + fabs(yresultLM[1]-yresultTR[1]) +
+            fabs(yresultLM[2]-yresultTR[2]) < 1e-5) || err();
+    }
+
     // same problem using a generic minimizer with derivatives
     numEval = 0;
     numIter = findMinNdimDeriv(fncMin, yinit, ystep[0], 1e-4, 100, yresult);
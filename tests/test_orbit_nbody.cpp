@@ -0,0 +1,155 @@
+/** \file    test_orbit_nbody.cpp
+    \author  Eugene Vasiliev
+    \date    2024
+
+    Test the restricted N-body integrator with massive extended bodies and test particles:
+    - a test particle orbiting a uniformly moving body should follow the same orbit
+    (shifted by the motion of the body) as in the static potential of that body;
+    - two bodies with Plummer potentials of equal scale radii attract each other with equal and
+    opposite forces, hence the total momentum should be conserved;
+    - dynamical friction should make the orbit of a satellite decay.
+*/
+#include "orbit_nbody.h"
+#include "potential_factory.h"
+#include "utils.h"
+#include <cmath>
+#include <iostream>
+
+const char* err = " \033[1;31m**\033[0m";
+
+/// velocity dispersion of an isotropic Plummer sphere as a function of radius
+class PlummerVelDisp: public math::IFunctionNoDeriv {
+    const double mass, scaleRadius;
+public:
+    PlummerVelDisp(double _mass, double _scaleRadius) : mass(_mass), scaleRadius(_scaleRadius) {}
+    virtual double value(const double r) const {
+        return sqrt(mass / (6 * sqrt(r*r + scaleRadius*scaleRadius)));
+    }
+};
+
+double difposvel(const coord::PosVelCar& a, const coord::PosVelCar& b)
+{
+    return sqrt(pow_2(a.x-b.x) + pow_2(a.y-b.y) + pow_2(a.z-b.z) +
+        pow_2(a.vx-b.vx) + pow_2(a.vy-b.vy) + pow_2(a.vz-b.vz));
+}
+
+bool testMovingBody()
+{
+    potential::PtrPotential pot = potential::createPotential(
+        utils::KeyValueMap("type=Plummer mass=1 scaleRadius=1"));
+    const coord::PosVelCar center(1., 2., 0., 0.3, 0., 0.1);
+    std::vector<orbit::MassiveBody> bodies(1, orbit::MassiveBody(pot, center));
+    std::vector<coord::PosVelCar> particles, relative;
+    relative.push_back(coord::PosVelCar(1.0, 0.0, 0.0, 0.0, 0.8, 0.1));
+    relative.push_back(coord::PosVelCar(0.0, 2.0, 1.0,-0.4, 0.0, 0.3));
+    relative.push_back(coord::PosVelCar(0.5,-0.3, 0.2, 0.2, 0.5,-0.6));
+    for(size_t p=0; p<relative.size(); p++)
+        particles.push_back(coord::PosVelCar(
+            relative[p].x  + center.x,  relative[p].y  + center.y,  relative[p].z  + center.z,
+            relative[p].vx + center.vx, relative[p].vy + center.vy, relative[p].vz + center.vz));
+    const double totalTime = 50., samplingInterval = 0.5, startTime = 3.;
+    std::vector<orbit::Trajectory> trajBodies, trajParticles;
+    orbit::integrateRestrictedNbody(bodies, particles, totalTime, samplingInterval,
+        trajBodies, trajParticles, orbit::OrbitIntParams(), startTime);
+    const size_t size = static_cast<size_t>(totalTime / samplingInterval) + 1;
+    bool ok = trajBodies.size() == 1 && trajParticles.size() == particles.size() &&
+        trajBodies[0].size() == size;
+    double maxdif = 0;
+    for(size_t p=0; ok && p<particles.size(); p++) {
+        orbit::Trajectory traj = orbit::integrateTraj(relative[p], totalTime, samplingInterval,
+            *pot, 0, orbit::OrbitIntParams(), startTime);
+        ok &= traj.size() == size && trajParticles[p].size() == size;
+        for(size_t i=0; ok && i<size; i++) {
+            const coord::PosVelCar& body = trajBodies[0][i].first, &part = trajParticles[p][i].first;
+            double t = trajBodies[0][i].second, dt = t - startTime;
+            ok &= fabs(t - traj[i].second) < 1e-12 && trajParticles[p][i].second == t;
+            // the body moves uniformly, and the particle relative to it follows the static orbit
+            maxdif = fmax(maxdif, difposvel(body, coord::PosVelCar(center.x + center.vx * dt,
+                center.y + center.vy * dt, center.z + center.vz * dt, center.vx, center.vy, center.vz)));
+            maxdif = fmax(maxdif, difposvel(traj[i].first, coord::PosVelCar(
+                part.x  - body.x,  part.y  - body.y,  part.z  - body.z,
+                part.vx - body.vx, part.vy - body.vy, part.vz - body.vz)));
+        }
+    }
+    ok &= maxdif < 1e-5;
+    std::cout << "Test particles around a moving body: max deviation from the static orbit = " <<
+        maxdif << (ok ? "\n" : std::string(err) + "\n");
+    return ok;
+}
+
+bool testMomentum()
+{
+    const double mass1 = 1., mass2 = 0.3;
+    std::vector<orbit::MassiveBody> bodies;
+    bodies.push_back(orbit::MassiveBody(potential::createPotential(utils::KeyValueMap(
+        "type=Plummer mass=" + utils::toString(mass1) + " scaleRadius=0.5")),
+        coord::PosVelCar(-0.6, 0.0, 0.1, 0.0,-0.15, 0.0)));
+    bodies.push_back(orbit::MassiveBody(potential::createPotential(utils::KeyValueMap(
+        "type=Plummer mass=" + utils::toString(mass2) + " scaleRadius=0.5")),
+        coord::PosVelCar( 2.0, 0.0,-0.1, 0.0, 0.5, 0.05)));
+    std::vector<orbit::Trajectory> trajBodies, trajParticles;
+    orbit::integrateRestrictedNbody(bodies, std::vector<coord::PosVelCar>(), 100., /*every step*/ 0,
+        trajBodies, trajParticles);
+    bool ok = trajBodies.size() == 2 && trajParticles.empty() &&
+        trajBodies[0].size() == trajBodies[1].size() && trajBodies[0].size() > 2 &&
+        trajBodies[0].back().second == 100.;
+    double maxdif = 0, maxdist = 0, mindist = INFINITY;
+    for(size_t i=0; ok && i<trajBodies[0].size(); i++) {
+        const coord::PosVelCar& a = trajBodies[0][i].first, &b = trajBodies[1][i].first;
+        maxdif = fmax(maxdif, sqrt(
+            pow_2(mass1 * a.vx + mass2 * b.vx) +
+            pow_2(mass1 * a.vy + mass2 * b.vy - (-0.15 * mass1 + 0.5 * mass2)) +
+            pow_2(mass1 * a.vz + mass2 * b.vz - 0.05 * mass2)));
+        double dist = sqrt(pow_2(a.x-b.x) + pow_2(a.y-b.y) + pow_2(a.z-b.z));
+        maxdist = fmax(maxdist, dist);
+        mindist = fmin(mindist, dist);
+    }
+    ok &= maxdif < 1e-8 && mindist < 0.9 * maxdist;
+    std::cout << "Two bodies: distance varies between " << mindist << " and " << maxdist <<
+        ", max violation of momentum conservation = " << maxdif <<
+        (ok ? "\n" : std::string(err) + "\n");
+    return ok;
+}
+
+bool testFriction()
+{
+    const double massHost = 1., radiusHost = 1., massSat = 0.02, radiusSat = 0.1, r0 = 4.;
+    potential::PtrPotential potHost = potential::createPotential(utils::KeyValueMap(
+        "type=Plummer mass=" + utils::toString(massHost) + " scaleRadius=" + utils::toString(radiusHost)));
+    potential::PtrPotential potSat = potential::createPotential(utils::KeyValueMap(
+        "type=Plummer mass=" + utils::toString(massSat) + " scaleRadius=" + utils::toString(radiusSat)));
+    math::PtrFunction velDisp(new PlummerVelDisp(massHost, radiusHost));
+    const double vcirc = sqrt(massHost * pow_2(r0) * pow(pow_2(r0) + pow_2(radiusHost), -1.5));
+    const coord::PosVelCar icSat(r0, 0, 0, 0, vcirc, 0);
+    // a test particle on a nearly circular orbit around the satellite
+    std::vector<coord::PosVelCar> particles(1, coord::PosVelCar(r0 + 0.05, 0, 0, 0,
+        vcirc + sqrt(massSat * pow_2(0.05) * pow(pow_2(0.05) + pow_2(radiusSat), -1.5)), 0));
+    double finalDist[2];
+    for(int fric=0; fric<2; fric++) {
+        std::vector<orbit::MassiveBody> bodies;
+        bodies.push_back(orbit::MassiveBody(potHost, coord::PosVelCar(0, 0, 0, 0, 0, 0),
+            0, 0, velDisp));
+        bodies.push_back(orbit::MassiveBody(potSat, icSat, fric ? massSat : 0, 2 * radiusSat));
+        std::vector<orbit::Trajectory> trajBodies, trajParticles;
+        orbit::integrateRestrictedNbody(bodies, particles, 100., INFINITY, trajBodies, trajParticles);
+        const coord::PosVelCar& host = trajBodies[0][0].first, &sat = trajBodies[1][0].first;
+        finalDist[fric] = sqrt(pow_2(sat.x-host.x) + pow_2(sat.y-host.y) + pow_2(sat.z-host.z));
+    }
+    bool ok = fabs(finalDist[0] / r0 - 1) < 0.05 && finalDist[1] < 0.8 * finalDist[0];
+    std::cout << "Satellite orbit: final distance without friction " << finalDist[0] <<
+        ", with friction " << finalDist[1] << (ok ? "\n" : std::string(err) + "\n");
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= testMovingBody();
+    ok &= testMomentum();
+    ok &= testFriction();
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}
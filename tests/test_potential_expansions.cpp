@@ -10,6 +10,7 @@
 #include "math_spline.h"
 #include "particles_io.h"
 #include "potential_analytic.h"
+#include "potential_composite.h"
 #include "potential_cylspline.h"
 #include "potential_dehnen.h"
 #include "potential_disk.h"
@@ -256,6 +257,28 @@ bool checkSH(const math::SphHarmIndices& ind)
     return true;
 }
 
+// test the Fourier transformation in phi by comparing it with a direct summation
+bool checkFourier(int mmax, bool useSine)
+{
+    math::FourierTransformForward tr(mmax, useSine);
+    std::vector<double> d(tr.size()), c(tr.size());
+    for(unsigned int i=0; i<d.size(); i++)
+        d[i] = exp(cos(tr.phi(i))) + (useSine ? sin(3*tr.phi(i)) : 0);
+    tr.transform(&d.front(), &c.front());
+    int nphi = 2*mmax+1;
+    for(unsigned int i=0; i<c.size(); i++) {
+        int m = useSine ? i-mmax : i;
+        double sum = 0;
+        for(int k=0; k<nphi; k++) {
+            double val = d[useSine || k<=mmax ? k : nphi-k], phi = 2*M_PI * k / nphi;
+            sum += val * (m>=0 ? cos(m*phi) : sin(-m*phi)) * 2*M_PI / nphi;
+        }
+        if(fabs(sum - c[i]) > 1e-13)
+            return false;
+    }
+    return true;
+}
+
 // a wrapper class for manually tweaking the symmetry level
 class SPotential: public potential::BasePotentialCar {
     const potential::BasePotential& pot;
@@ -398,6 +421,13 @@ int main() {
     ok &= checkSH<2, 1>(math::SphHarmIndices(3, 1,
         static_cast<coord::SymmetryType>(coord::ST_REFLECTION | coord::ST_YREFLECTION)));
     ok &= checkSH<2, 2>(math::SphHarmIndices(5, 3, coord::ST_TRIAXIAL));
+    // check the Fourier transform against direct summation for orders where it uses the FFT
+    // (2*mmax+1 = 45, 75, 325, 405) and where it does not (2*mmax+1 = 37, a prime number)
+    const int mmaxFourier[] = {22, 37, 162, 202, 18};
+    for(int i=0; i<5; i++) {
+        ok &= checkFourier(mmaxFourier[i], true);
+        ok &= checkFourier(mmaxFourier[i], false);
+    }
     if(!ok)
         std::cout << "Spherical-harmonic transform failed \033[1;31m**\033[0m\n";
 
@@ -515,6 +545,66 @@ int main() {
     ok &= testAverageError(*test2dn,test2_Dehnen0Trin,0.04);  // no log-scaling => somewhat worse error
     ok &= testAverageError(*test2c, test2_Dehnen0Tri, 0.02);
     ok &= testAverageError(*test2c, *test2c_clone, 1e-3);
+    {
+        // a potential reconstructed from the binary serialized form is close (though not bitwise
+        // identical) to the original one, and the copies created from the same buffer and
+        // from a shared-memory segment are exactly equal
+        std::vector<PtrPotential> comps;
+        comps.push_back(test2b);
+        comps.push_back(test2m);
+        comps.push_back(test2c);
+        potential::Composite test2all(comps);
+        std::string buffer = potential::serializePotential(test2all);
+        PtrPotential test2all_clone = potential::deserializePotential(buffer.data(), buffer.size());
+        ok &= testAverageError(test2all, *test2all_clone, 2e-6);
+        // truncated data, or data with a corrupted number of components (located after
+        // the signature, the version and the type name "Composite"), are rejected without
+        // attempting to allocate the claimed amount of memory
+        std::string corrupted = buffer;
+        long hugeCount = 1L<<50;
+        corrupted.replace(3*sizeof(long) + 9, sizeof(long), (const char*)&hugeCount, sizeof(long));
+        for(int t=0; t<2; t++) {
+            try{
+                if(t==0)
+                    potential::deserializePotential(buffer.data(), buffer.size()/2);
+                else
+                    potential::deserializePotential(corrupted.data(), corrupted.size());
+                std::cout << "Corrupted data not detected\033[1;31m **\033[0m\n";
+                ok = false;
+            }
+            catch(std::runtime_error&) {}
+        }
+        const char* shmName = "agama_test_potential_expansions";
+        utils::SharedMemorySegment::remove(shmName);  // in case it was left from a previous run
+        try{
+            potential::exportPotentialCoefsToSharedMemory(shmName, test2all);
+            PtrPotential test2all_shared = potential::loadPotentialFromSharedMemory(shmName);
+            ok &= testAverageError(*test2all_clone, *test2all_shared, 1e-12);
+        }
+        catch(std::exception& ex) {
+            // shared memory may be unavailable on some systems, which is not considered an error
+            std::cout << "Shared memory test skipped: " << ex.what() << "\n";
+        }
+        utils::SharedMemorySegment::remove(shmName);
+    }
+    {
+        // the persistent cache: the second request for the same expansion loads it from the file
+        // written by the first request, resulting in the same object as a binary serialized copy
+        const std::string prevCacheDir = potential::getCacheDirectory();
+        potential::setCacheDirectory(".");
+        utils::KeyValueMap params("type=Multipole density=Dehnen gamma=1 axisRatioY=0.8 axisRatioZ=0.6 lmax=8");
+        const std::string cacheFile = potential::getCacheFileName(params);
+        std::remove(cacheFile.c_str());
+        PtrPotential test2cache = potential::createPotential(params);
+        bool cached = utils::fileExists(cacheFile);
+        std::string buffer = potential::serializePotential(*test2cache);
+        PtrPotential test2cache_clone = potential::deserializePotential(buffer.data(), buffer.size());
+        PtrPotential test2cache_loaded = potential::createPotential(params);
+        std::cout << "Potential " << (cached ? "was" : "was not\033[1;31m **\033[0m") << " cached\n";
+        ok &= cached && testAverageError(*test2cache_clone, *test2cache_loaded, 1e-12);
+        std::remove(cacheFile.c_str());
+        potential::setCacheDirectory(prevCacheDir);
+    }
 
     // mildly triaxial, cuspy
     std::cout << "--- Triaxial Dehnen gamma=1.5 ---\n";
@@ -544,6 +634,38 @@ int main() {
     ok &= testAverageError(*test6m, test6_Dehnen05Tri, 0.5);
     ok &= testAverageError(*test6c, test6_Dehnen05Tri, 1.0);
 
+    // a series of snapshots processed in one call: the second one contains each particle
+    // split into ten copies with 1/10 of the original mass, which should produce the same
+    // coefficients up to roundoff errors
+    {
+        double eta, r0;
+        std::vector<std::vector<double> > coefs, coefsSeries;
+        dynamic_cast<const potential::BasisSet&>(*test6b).getCoefs(eta, r0, coefs);
+        std::vector<particles::ParticleArray<coord::PosCyl> > snapshots(2);
+        snapshots[0] = test6_points;
+        for(size_t i=0; i<test6_points.size(); i++)
+            for(int k=0; k<10; k++)
+                snapshots[1].add(coord::toPosCyl(test6_points.point(i)), 0.1 * test6_points.mass(i));
+        std::vector<PtrPotential> series = potential::BasisSet::createSeries(
+            snapshots, coord::ST_TRIAXIAL, 6, 6, 20, eta, r0);
+        double maxdev = 0, maxcoef = 0;
+        for(size_t s=0; s<series.size(); s++) {
+            dynamic_cast<const potential::BasisSet&>(*series[s]).getCoefs(eta, r0, coefsSeries);
+            for(size_t c=0; c<coefs.size(); c++)
+                for(size_t n=0; n<coefs[c].size(); n++) {
+                    maxdev  = fmax(maxdev, fabs(coefsSeries[c][n] - coefs[c][n]));
+                    maxcoef = fmax(maxcoef, fabs(coefs[c][n]));
+                }
+        }
+        std::cout << "BasisSet series of snapshots: max deviation of coefs = " << maxdev / maxcoef;
+        if(maxdev < 1e-13 * maxcoef)
+            std::cout << "\n";
+        else {
+            std::cout << " \033[1;31m**\033[0m\n";
+            ok = false;
+        }
+    }
+
     std::cout << "--- Testing the accuracy of representation of an off-centered constant-density sphere ---"
         "\n--- Ideally all mass should be contained within the sphere radius, <r>=3/4, <r^2>=3/5 ---\n";
     ok &= testBlob(*potential::BasisSet ::create(test7d, 8, 8, 20, 0.5,  1.0), test7d);
@@ -5,6 +5,7 @@
     Test potential modifiers by integrating and comparing orbits in variously modified potentials
 */
 #include "orbit.h"
+#include "potential_composite.h"
 #include "potential_factory.h"
 #include "utils.h"
 #include <iostream>
@@ -231,6 +232,234 @@ bool testTiltedRotating()
     return true;
 }
 
+// evaluate the potential at points and times varying from one call to the next, sequentially and
+// from several threads, each of them inside a nested (hence inactive) parallel region, where
+// the OpenMP thread index is 0 in all threads; the results should be identical
+bool testConcurrentEval(const potential::BasePotential& pot)
+{
+    const int npoints = 1000;
+    std::vector<double> valSeq(npoints);
+    for(int i=0; i<npoints; i++)
+        valSeq[i] = pot.value(coord::PosCar(sin(i+1.) * 2, cos(i*2.), 0.5), /*time*/ (i % 11) * 0.9);
+    int numErrors = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(4)
+#endif
+    for(int i=0; i<npoints; i++) {
+#ifdef _OPENMP
+#pragma omp parallel num_threads(2)
+#endif
+        {
+            if(pot.value(coord::PosCar(sin(i+1.) * 2, cos(i*2.), 0.5), (i % 11) * 0.9) != valSeq[i]) {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                numErrors++;
+            }
+        }
+    }
+    if(numErrors > 0)
+        std::cout << pot.name() << ": concurrent evaluation gives different results in " <<
+            numErrors << " cases\033[1;31m **\033[0m\n";
+    return numErrors == 0;
+}
+
+// test the equivalence of a combination of all four modifiers applied one after another
+// and a single Transformed modifier representing the same combined affine transformation
+bool testFusedModifiers()
+{
+    utils::KeyValueMap potParams("type=Ferrers, scaleRadius=2, axisRatioY=0.8, axisRatioZ=0.6");
+    potential::PtrPotential potOrig = potential::createPotential(potParams);
+    potential::PtrDensity   denOrig = potential::createDensity  (potParams);
+    // time-dependent parameters of the modifiers, linearly varying on the interval [0..10]
+    std::vector<double> times(2);
+    times[1] = 10;
+    math::CubicSpline center[3], angle, ampl, scale;
+    const double initval[6] = {1.0, 0.5, -1.0, 0.2, 1.5, 2.0}, finalval[6] = {1.5, 0.0, -0.5, 1.2, 2.5, 1.6};
+    std::vector<double> values(2);
+    for(int k=0; k<6; k++) {
+        values[0] = initval[k];
+        values[1] = finalval[k];
+        (k<3 ? center[k] : k==3 ? angle : k==4 ? ampl : scale) = math::CubicSpline(times, values);
+    }
+    const double alpha=0.4, beta=0.5, gamma=0.6;
+    const coord::Orientation orientation(alpha, beta, gamma);
+    potential::PtrPotential potNested(new potential::Shifted<potential::BasePotential>(
+        potential::PtrPotential(new potential::Tilted<potential::BasePotential>(
+        potential::PtrPotential(new potential::Rotating<potential::BasePotential>(
+        potential::PtrPotential(new potential::Scaled<potential::BasePotential>(
+        potOrig, ampl, scale)), angle)), alpha, beta, gamma)), center[0], center[1], center[2]));
+    potential::PtrDensity denNested(new potential::Shifted<potential::BaseDensity>(
+        potential::PtrDensity(new potential::Tilted<potential::BaseDensity>(
+        potential::PtrDensity(new potential::Rotating<potential::BaseDensity>(
+        potential::PtrDensity(new potential::Scaled<potential::BaseDensity>(
+        denOrig, ampl, scale)), angle)), alpha, beta, gamma)), center[0], center[1], center[2]));
+    const potential::AffineTransform transform(center, &orientation, angle, ampl, scale);
+    potential::PtrPotential potFused(new potential::Transformed<potential::BasePotential>(potOrig, transform));
+    potential::PtrDensity   denFused(new potential::Transformed<potential::BaseDensity>(denOrig, transform));
+    bool ok = potFused->name() == potNested->name() && denFused->name() == denNested->name() &&
+        potFused->symmetry() == potNested->symmetry();
+
+    // compare the values, gradients, hessians and densities, one point at a time and in a batch
+    const int npoints = 20;
+    coord::PosCar points[npoints];
+    double valNested[npoints], valFused[npoints];
+    coord::GradCar gradNested[npoints], gradFused[npoints];
+    double difVal = 0, difGrad = 0, difHess = 0, difDens = 0, difBatch = 0;
+    for(int t=0; t<5; t++) {
+        double time = 2.5 * t;
+        for(int i=0; i<npoints; i++) {
+            points[i] = coord::PosCar(sin(i+1.) * 2 + 1, cos(i*2.) * 1.5 + 0.5, sin(i*3.) - 1);
+            double phiNested, phiFused;
+            coord::GradCar gN, gF;
+            coord::HessCar hN, hF;
+            potNested->eval(points[i], &phiNested, &gN, &hN, time);
+            potFused ->eval(points[i], &phiFused,  &gF, &hF, time);
+            difVal  = fmax(difVal,  fabs(phiNested - phiFused));
+            difGrad = fmax(difGrad, fabs(gN.dx - gF.dx) + fabs(gN.dy - gF.dy) + fabs(gN.dz - gF.dz));
+            difHess = fmax(difHess, fabs(hN.dx2 - hF.dx2) + fabs(hN.dy2 - hF.dy2) +
+                fabs(hN.dz2 - hF.dz2) + fabs(hN.dxdy - hF.dxdy) +
+                fabs(hN.dydz - hF.dydz) + fabs(hN.dxdz - hF.dxdz));
+            difDens = fmax(difDens, fabs(potNested->density(points[i], time) - potFused->density(points[i], time))
+                + fabs(denNested->density(points[i], time) - denFused->density(points[i], time))
+                + fabs(denFused->density(points[i], time) - potFused->density(points[i], time)));
+        }
+        potNested->evalmanyPotentialCar(npoints, points, valNested, gradNested, time);
+        potFused ->evalmanyPotentialCar(npoints, points, valFused,  gradFused,  time);
+        for(int i=0; i<npoints; i++)
+            difBatch = fmax(difBatch, fabs(valNested[i] - valFused[i]) +
+                fabs(gradNested[i].dx - gradFused[i].dx) + fabs(gradNested[i].dy - gradFused[i].dy) +
+                fabs(gradNested[i].dz - gradFused[i].dz));
+        denNested->evalmanyDensityCar(npoints, points, valNested, time);
+        denFused ->evalmanyDensityCar(npoints, points, valFused,  time);
+        for(int i=0; i<npoints; i++)
+            difBatch = fmax(difBatch, fabs(valNested[i] - valFused[i]));
+    }
+    ok &= difVal < 1e-14 && difGrad < 1e-14 && difHess < 1e-13 && difDens < 1e-14 && difBatch < 1e-14;
+    if(!ok) {
+        std::cout << "fused and nested modifiers inconsistent: "
+            "dPhi=" << difVal << ", dGrad=" << difGrad << ", dHess=" << difHess <<
+            ", dDens=" << difDens << ", dBatch=" << difBatch << "\033[1;31m **\033[0m\n";
+    }
+
+    ok &= testConcurrentEval(*potNested) && testConcurrentEval(*potFused);
+
+    // the factory routine should produce the same combination from the input parameters
+    potParams.set("scale", "1.5,2");
+    potParams.set("rotation", "0.2");
+    potParams.set("center", "1,0.5,-1");
+    potParams.set("orientation", utils::toString(alpha) + "," + utils::toString(beta) + "," + utils::toString(gamma));
+    potential::PtrPotential potFactory = potential::createPotential(potParams);
+    double phiFactory = potFactory->value(points[0]), phiNested = potNested->value(points[0]);
+    if(potFactory->name() != potNested->name() || !(fabs(phiFactory - phiNested) < 1e-14)) {
+        std::cout << "factory-created modifiers inconsistent: " << potFactory->name() << " " <<
+            phiFactory << " vs " << phiNested << "\033[1;31m **\033[0m\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// test the memoizing wrapper: results should be identical to the original potential,
+// and repeated evaluations at the same point and time should be served from the cache
+bool testMemoized()
+{
+    potential::PtrPotential potOrig = potential::createPotential(
+        utils::KeyValueMap("type=Ferrers, scaleRadius=2, axisRatioY=0.8, axisRatioZ=0.6"));
+    const unsigned int capacity = 4;
+    shared_ptr<const potential::Memoized> potMemo(new potential::Memoized(potOrig, capacity));
+    const coord::PosCar points[3] = {
+        coord::PosCar(1.0, 0.5, 0.3), coord::PosCar(-0.4, 1.2, 0.8), coord::PosCar(0.2,-0.7, 1.1) };
+    double difVal = 0;
+    // each point is first evaluated without derivatives and then with derivatives (a partial hit),
+    // then once more with both derivatives (a full hit), in Cartesian and cylindrical coordinates
+    for(int k=0; k<3; k++) {
+        double valOrig, valMemo;
+        coord::GradCar gradOrig, gradMemo;
+        coord::HessCar hessOrig, hessMemo;
+        potOrig->eval(points[k], &valOrig, &gradOrig, &hessOrig, /*time*/ 1.0);
+        potMemo->eval(points[k], &valMemo, NULL, NULL, 1.0);
+        difVal = fmax(difVal, fabs(valOrig - valMemo));
+        for(int rep=0; rep<2; rep++) {
+            potMemo->eval(points[k], &valMemo, &gradMemo, &hessMemo, 1.0);
+            difVal = fmax(difVal, fabs(valOrig - valMemo) + fabs(gradOrig.dx - gradMemo.dx) +
+                fabs(gradOrig.dy - gradMemo.dy) + fabs(gradOrig.dz - gradMemo.dz) +
+                fabs(hessOrig.dx2 - hessMemo.dx2) + fabs(hessOrig.dydz - hessMemo.dydz));
+        }
+        coord::PosCyl pcyl = coord::toPosCyl(points[k]);
+        coord::GradCyl gcylOrig, gcylMemo;
+        potOrig->eval(pcyl, &valOrig, &gcylOrig);
+        potMemo->eval(pcyl, &valMemo, &gcylMemo);
+        potMemo->eval(pcyl, &valMemo, &gcylMemo);
+        difVal = fmax(difVal, fabs(valOrig - valMemo) + fabs(gcylOrig.dR - gcylMemo.dR) +
+            fabs(gcylOrig.dz - gcylMemo.dz) + fabs(gcylOrig.dphi - gcylMemo.dphi));
+    }
+    // a different time is a different key
+    potMemo->value(points[0], /*time*/ 2.0);
+    size_t numCalls, numHits;
+    potMemo->statistics(numCalls, numHits);
+    bool ok = difVal == 0 && numCalls == 3*5+1 && numHits == 3*2;
+
+    // least recently used entries are evicted when the table is full
+    potMemo->resetStatistics();
+    for(unsigned int i=0; i<=capacity; i++)
+        potMemo->value(coord::PosCar(0.1 * i, 0, 0));
+    potMemo->value(coord::PosCar(0.1 * capacity, 0, 0));  // hit
+    potMemo->value(coord::PosCar(0, 0, 0));               // miss (evicted)
+    size_t numCalls2, numHits2;
+    potMemo->statistics(numCalls2, numHits2);
+    ok &= numCalls2 == capacity+3 && numHits2 == 1;
+
+    // evaluations from multiple threads use separate tables and produce the same results
+    const int npoints = 1000;
+    std::vector<double> valOrig(npoints), valMemo(npoints);
+    for(int i=0; i<npoints; i++)
+        valOrig[i] = potOrig->value(coord::PosCar(i * 0.001, (i % 7) * 0.1, 0.5));
+    potMemo->resetStatistics();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int i=0; i<npoints; i++) {
+        coord::PosCar point(i * 0.001, (i % 7) * 0.1, 0.5);
+        valMemo[i] = potMemo->value(point);
+        if(potMemo->value(point) != valMemo[i])
+            valMemo[i] = NAN;
+    }
+    size_t numCalls3, numHits3;
+    potMemo->statistics(numCalls3, numHits3);
+    ok &= valOrig == valMemo && numCalls3 == 2*npoints && numHits3 == npoints;
+
+    // evaluations from (inactive or active) nested parallel regions, where several threads have
+    // the same index, should bypass the cache or use it exclusively, producing the same results
+    int numErrors = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(4)
+#endif
+    for(int i=0; i<npoints; i++) {
+#ifdef _OPENMP
+#pragma omp parallel num_threads(2)
+#endif
+        {
+            coord::PosCar point(i * 0.001, (i % 7) * 0.1, 0.5);
+            double valCar = potMemo->value(point), valCyl;
+            potMemo->eval(coord::toPosCyl(point), &valCyl);
+            if(valCar != valOrig[i] || valCyl != potMemo->value(coord::toPosCyl(point))) {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+                numErrors++;
+            }
+        }
+    }
+    ok &= numErrors == 0;
+    if(!ok) {
+        std::cout << "memoized potential: max deviation=" << difVal << ", calls/hits: " <<
+            numCalls << "/" << numHits << ", " << numCalls2 << "/" << numHits2 << ", " <<
+            numCalls3 << "/" << numHits3 << ", errors in nested regions: " << numErrors <<
+            "\033[1;31m **\033[0m\n";
+    }
+    return ok;
+}
+
 const double totalTime = 100.0, timeStep = 0.005 * totalTime;
 const double Omega = -0.1;  // rotation frequency (arbitrary)
 
@@ -366,6 +595,8 @@ template<typename CoordT> bool test(
 int main()
 {
     bool allok = testTiltedRotating();
+    allok &= testFusedModifiers();
+    allok &= testMemoized();
 
     const double v0 = 1.0;  // amplitude of the circular velocity for the logarithmic potential
     utils::KeyValueMap potParams("type=Logarithmic, scaleRadius=0, axisRatioY=0.8, axisRatioZ=0.6");
@@ -8,9 +8,14 @@
 #include "potential_composite.h"
 #include "potential_cylspline.h"
 #include "potential_multipole.h"
+#include "potential_dehnen.h"
+#include "potential_disk.h"
 #include "potential_factory.h"
+#include "potential_ferrers.h"
+#include "potential_mge.h"
 #include "potential_utils.h"
 #include "utils.h"
+#include "math_core.h"
 #include "math_random.h"
 #include "debug_utils.h"
 #include <iostream>
@@ -184,14 +189,15 @@ bool testPotential(const potential::BasePotential& potential)
         errPhiI= sqrt(errPhiI/ sumw);
         errdPhiI=sqrt(errdPhiI/sumw);
         // check if the errors are within design tolerance;
-        // for the composite potential (aka GalPot = Multipole + DiskAnsatz) or Multipole
+        // for the composite potential or GalPot (Multipole + DiskAnsatz) or Multipole
         // we loosen the tolerance limits, as the Multipole potential is intrinsically
         // only an approximation and not infinitely smooth, thus its interpolated version
         // is not required to be exceedingly accurate
         double tol =
             potential.name() == potential::CylSpline::myName() ? 5.0 :
             potential.name() == potential::Multipole::myName() ? 10. :
-            potential.name().substr(0,9) == "Composite"        ? 200 : 1.;
+            potential.name().substr(0,9) == "Composite" ||
+            potential.name().substr(0,6) == potential::GalPot::myName() ? 200 : 1.;
         std::cout << "Density-weighted RMS errors"
         ": Phi(r)="     + checkLess(errPhiI, 1e-10 * tol, ok) +
         ", dPhi/dr="    + checkLess(errdPhiI,1e-08 * tol, ok) +
@@ -360,10 +366,179 @@ const double posvel_sph[numtestpoints][6] = {   // order: R, theta, phi
     {1,3.14159, 2, 0.5, 0.3, 1e-4},   // point almost along z axis, vphi must be small, but vtheta is non-zero
     {0, 2,-1, 0.5, 0,   0  }};  // point at origin with nonzero velocity in R
 
+/// compare the fast (interpolated or fixed-quadrature) evaluation of a triaxial potential
+/// with a more accurate evaluation at random points spanning a wide range of radii
+bool testFastVsExact(const potential::BasePotential& fast, const potential::BasePotential& exact,
+    const char* label, double tolPhi, double tolForce)
+{
+    double maxdevPhi = 0, maxdevF = 0;
+    for(int i=0; i<1000; i++) {
+        double r = pow(10., math::random()*6-3), costh = math::random()*2-1,
+            sinth = sqrt(1-costh*costh), phi = math::random()*2*M_PI;
+        coord::PosCar pos(r*sinth*cos(phi), r*sinth*sin(phi), r*costh);
+        double Phi0, Phi1;
+        coord::GradCar grad0, grad1;
+        exact.eval(pos, &Phi0, &grad0);
+        fast .eval(pos, &Phi1, &grad1);
+        double F0 = sqrt(pow_2(grad0.dx) + pow_2(grad0.dy) + pow_2(grad0.dz));
+        maxdevPhi = fmax(maxdevPhi, fabs(Phi1 / Phi0 - 1));
+        maxdevF   = fmax(maxdevF, sqrt(pow_2(grad1.dx-grad0.dx) + pow_2(grad1.dy-grad0.dy) +
+            pow_2(grad1.dz-grad0.dz)) / F0);
+    }
+    bool ok = true;
+    std::cout << fast.name() << " " << label << ": potential " << checkLess(maxdevPhi, tolPhi, ok) <<
+        ", force " << checkLess(maxdevF, tolForce, ok) << "\n";
+    return ok;
+}
+
+/// integrand for the potential of a single triaxial Gaussian with unit mass (reference solution)
+class GaussianPotentialIntegrand: public math::IFunctionNoDeriv {
+    double s2, e[3], x2[3];
+public:
+    GaussianPotentialIntegrand(const double sigma[3], const coord::PosCar& pos) {
+        s2 = pow_2(fmax(fmax(sigma[0], sigma[1]), sigma[2]));
+        for(int i=0; i<3; i++)
+            e[i] = 1 - pow_2(sigma[i]) / s2;
+        x2[0] = pow_2(pos.x);  x2[1] = pow_2(pos.y);  x2[2] = pow_2(pos.z);
+    }
+    virtual double value(double u) const {
+        double d0 = 1 - e[0]*u*u, d1 = 1 - e[1]*u*u, d2 = 1 - e[2]*u*u;
+        return -sqrt(2/M_PI / s2) * exp(-0.5*u*u/s2 * (x2[0]/d0 + x2[1]/d1 + x2[2]/d2)) /
+            sqrt(d0 * d1 * d2);
+    }
+};
+
+/// compare the potential of a Multi-Gaussian Expansion computed with the fixed-order quadrature
+/// against an adaptive integration, check the Poisson equation, and compare the analytic
+/// projected density with the generic routine that integrates the density along the line of sight
+bool testMGE()
+{
+    const int NC = 4;
+    const double masses[NC] = {1.0, 2.0, 0.5, 3.0};
+    const double sigma[NC][3] = { {0.5, 0.4, 0.2}, {1.5, 1.2, 0.6}, {4.0, 4.0, 0.4}, {10., 8., 7.} };
+    std::vector<double> m(masses, masses+NC), sx(NC), sy(NC), sz(NC);
+    for(int k=0; k<NC; k++) {
+        sx[k] = sigma[k][0];  sy[k] = sigma[k][1];  sz[k] = sigma[k][2];
+    }
+    const potential::MGE mge(m, sx, sy, sz);
+    double maxdevPhi = 0, maxdevF = 0, maxdevPoisson = 0, maxdevProj = 0;
+    for(int i=0; i<200; i++) {
+        double r = pow(10., math::random()*5-2), costh = math::random()*2-1,
+            sinth = sqrt(1-costh*costh), phi = math::random()*2*M_PI;
+        coord::PosCar pos(r*sinth*cos(phi), r*sinth*sin(phi), r*costh);
+        double Phi, Phiref = 0, rho = mge.density(pos);
+        coord::GradCar grad;
+        coord::HessCar hess;
+        mge.eval(pos, &Phi, &grad, &hess);
+        for(int k=0; k<NC; k++)
+            Phiref += masses[k] *
+                math::integrateAdaptive(GaussianPotentialIntegrand(sigma[k], pos), 0, 1, 1e-12);
+        maxdevPhi = fmax(maxdevPhi, fabs(Phi / Phiref - 1));
+        // compare the force with the finite-difference estimate
+        double delta = 1e-6 * fmax(r, 1), Phip, Phim;
+        mge.eval(coord::PosCar(pos.x + delta, pos.y, pos.z), &Phip);
+        mge.eval(coord::PosCar(pos.x - delta, pos.y, pos.z), &Phim);
+        maxdevF = fmax(maxdevF, fabs((Phip - Phim) / (2*delta) - grad.dx) /
+            sqrt(pow_2(grad.dx) + pow_2(grad.dy) + pow_2(grad.dz)));
+        // Laplacian of the potential should be equal to 4 pi rho
+        if(r < 20)
+            maxdevPoisson = fmax(maxdevPoisson,
+                fabs(hess.dx2 + hess.dy2 + hess.dz2 - 4*M_PI * rho) / (4*M_PI * mge.density(coord::PosCar(0,0,0))));
+    }
+    for(int i=0; i<20; i++) {
+        coord::Orientation orientation(math::random()*M_PI, math::random()*M_PI, math::random()*M_PI);
+        double X = math::random()*4-2, Y = math::random()*4-2,
+        proj = mge.projectedDensity(X, Y, orientation),
+        projnum = potential::projectedDensity(mge, X, Y, orientation);
+        maxdevProj = fmax(maxdevProj, fabs(proj / projnum - 1));
+    }
+    bool ok = true;
+    std::cout << "MGE potential: " << checkLess(maxdevPhi, 1e-9, ok) <<
+        ", force: " << checkLess(maxdevF, 1e-6, ok) <<
+        ", Poisson equation: " << checkLess(maxdevPoisson, 1e-9, ok) <<
+        ", projected density: " << checkLess(maxdevProj, 1e-4, ok) << "\n";
+    return ok;
+}
+
+/// check that the combined GalPot potential agrees with the Composite potential made of
+/// the same DiskAnsatz and Multipole components evaluated separately
+bool testGalPot()
+{
+    std::vector<potential::DiskParam> disks;
+    // the first two disks share the radial profile, the last two share the vertical profile
+    disks.push_back(potential::DiskParam(1e9, 2.5, 0.3));
+    disks.push_back(potential::DiskParam(3e8, 2.5, 0.9));
+    disks.push_back(potential::DiskParam(5e7, 7.0,-0.1, 4.0));
+    disks.push_back(potential::DiskParam(2e8, 1.5,-0.1, 12., 0.1, 2.0));
+    std::vector<potential::PtrDensity> dens;
+    for(size_t d=0; d<disks.size(); d++) {
+        dens.push_back(potential::PtrDensity(new potential::DiskDensity(disks[d])));
+        potential::DiskParam negParam = disks[d];
+        negParam.surfaceDensity *= -1;
+        dens.push_back(potential::PtrDensity(new potential::DiskAnsatz(negParam)));
+    }
+    potential::PtrPotential residual = potential::Multipole::create(
+        potential::CompositeDensity(dens), 8, 0, 40);
+    potential::GalPot galpot(disks, residual);
+    std::vector<potential::PtrPotential> comps;
+    for(unsigned int c=0; c<galpot.size(); c++)
+        comps.push_back(galpot.component(c));
+    potential::Composite composite(comps);
+    bool ok = comps.size() == disks.size()+1 && comps.back() == residual;
+    double maxdif = 0;
+    for(int ic=0; ic<numtestpoints; ic++) {
+        for(int s=0; s<2; s++) {
+            // test points at the original and at a 3x larger scale
+            const coord::PosCyl pos(posvel_cyl[ic][0] * (1+2*s), posvel_cyl[ic][1] * (1+2*s), posvel_cyl[ic][2]);
+            double Phi1, Phi2;
+            coord::GradCyl grad1, grad2;
+            coord::HessCyl hess1, hess2;
+            galpot.eval(pos, &Phi1, &grad1, &hess1);
+            composite.eval(pos, &Phi2, &grad2, &hess2);
+            double scale = fabs(Phi2);
+            maxdif = fmax(maxdif, (fabs(Phi1-Phi2) + fabs(grad1.dR-grad2.dR) + fabs(grad1.dz-grad2.dz) +
+                fabs(hess1.dR2-hess2.dR2) + fabs(hess1.dz2-hess2.dz2) + fabs(hess1.dRdz-hess2.dRdz)) / scale);
+            maxdif = fmax(maxdif, fabs(galpot.density(pos) / composite.density(pos) - 1));
+        }
+    }
+    std::cout << "GalPot vs. Composite: max relative difference = " << checkLess(maxdif, 1e-13, ok) << "\n";
+    return ok;
+}
+
 // save a few keystrokes
 inline void addPot(std::vector<potential::PtrPotential>& pots, const char* params) {
     pots.push_back(potential::createPotential(utils::KeyValueMap(params))); }
 
+/// check that the vectorized evaluation of potential and gradient agrees with individual calls
+bool testEvalmany(const potential::BasePotential& potential)
+{
+    std::vector<coord::PosCar> poscar(numtestpoints);
+    std::vector<coord::PosCyl> poscyl(numtestpoints);
+    for(int ic=0; ic<numtestpoints; ic++) {
+        poscar[ic] = coord::PosVelCar(posvel_car[ic]);
+        poscyl[ic] = coord::PosVelCyl(posvel_cyl[ic]);
+    }
+    std::vector<double> potcar(numtestpoints), potcyl(numtestpoints);
+    std::vector<coord::GradCar> gradcar(numtestpoints);
+    std::vector<coord::GradCyl> gradcyl(numtestpoints);
+    potential.evalmanyPotentialCar(numtestpoints, &poscar[0], &potcar[0], &gradcar[0]);
+    potential.evalmanyPotentialCyl(numtestpoints, &poscyl[0], &potcyl[0], &gradcyl[0]);
+    bool ok = true;
+    for(int ic=0; ic<numtestpoints; ic++) {
+        double Phicar, Phicyl;
+        coord::GradCar gcar;
+        coord::GradCyl gcyl;
+        potential.eval(poscar[ic], &Phicar, &gcar);
+        potential.eval(poscyl[ic], &Phicyl, &gcyl);
+        ok &= math::fcmp(Phicar, potcar[ic], 1e-14) == 0 && math::fcmp(Phicyl, potcyl[ic], 1e-14) == 0 &&
+            math::fcmp(gcar.dx, gradcar[ic].dx, 1e-12) == 0 && math::fcmp(gcyl.dR, gradcyl[ic].dR, 1e-12) == 0 &&
+            math::fcmp(gcar.dz, gradcar[ic].dz, 1e-12) == 0 && math::fcmp(gcyl.dz, gradcyl[ic].dz, 1e-12) == 0;
+    }
+    if(!ok)
+        std::cout << potential.name() << ": vectorized evaluation\033[1;31m failed\033[0m\n";
+    return ok;
+}
+
 int main() {
     bool allok=true;
 
@@ -383,6 +558,34 @@ int main() {
     if(!allok)
         std::cout << "\033[1;31mDetermination of principal axes failed\033[0m\n";
 
+    // the exact methods have a relative accuracy of only ~1e-6, so the fast methods with
+    // the default accuracy are compared with them at this level, and with the fast methods
+    // at a much higher accuracy at the level of the requested accuracy
+    allok &= testFastVsExact(potential::Ferrers(1, 0.9, 0.8, 0.5),
+        potential::Ferrers(1, 0.9, 0.8, 0.5, true), "fast vs exact", 1e-5, 1e-4);
+    allok &= testFastVsExact(potential::Dehnen(2, 1, 1, 0.8, 0.6),
+        potential::Dehnen(2, 1, 1, 0.8, 0.6, true), "fast vs exact", 1e-5, 1e-4);
+    allok &= testFastVsExact(potential::Dehnen(1, 2, 0.5, 0.7, 0.3), *potential::createPotential(
+        utils::KeyValueMap("type=Dehnen, mass=1, scaleRadius=2, gamma=0.5, p=0.7, q=0.3, exact=true")),
+        "fast vs exact", 1e-5, 1e-4);
+    // the accuracy of Ferrers is limited by roundoff in the coefficients (~1e-7 in potential,
+    // ~1e-6 in force)
+    allok &= testFastVsExact(potential::Ferrers(1, 0.9, 0.8, 0.5, false, 1e-4),
+        potential::Ferrers(1, 0.9, 0.8, 0.5, false, 1e-12), "accuracy=1e-4 vs 1e-12", 1e-4, 1e-4);
+    allok &= testFastVsExact(potential::Ferrers(1, 0.9, 0.8, 0.5),
+        potential::Ferrers(1, 0.9, 0.8, 0.5, false, 1e-12), "accuracy=1e-8 vs 1e-12", 5e-7, 5e-6);
+    for(int a=4; a<=8; a+=4) {
+        double acc = pow(10., -a);
+        std::string label = "accuracy=1e-" + utils::toString(a) + " vs 1e-12";
+        allok &= testFastVsExact(potential::Dehnen(2, 1, 1, 0.8, 0.6, false, acc),
+            potential::Dehnen(2, 1, 1, 0.8, 0.6, false, 1e-12), label.c_str(), acc, acc);
+        allok &= testFastVsExact(*potential::createPotential(utils::KeyValueMap(
+            "type=Dehnen, mass=1, scaleRadius=2, gamma=0.5, p=0.7, q=0.3, accuracy=" + utils::toString(acc))),
+            potential::Dehnen(1, 2, 0.5, 0.7, 0.3, false, 1e-12), label.c_str(), acc, acc);
+    }
+    allok &= testMGE();
+    allok &= testGalPot();
+
     std::vector<potential::PtrPotential> pots;
     addPot(pots, "type=Plummer, mass=10, scaleRadius=5");
     addPot(pots, "type=Isochrone, mass=1, scaleRadius=");
@@ -391,7 +594,13 @@ int main() {
     addPot(pots, "type=Logarithmic, mass=1, scaleRadius=0.01, p=0.8, q=0.5");
     addPot(pots, "type=Ferrers, mass=1, scaleRadius=0.9, p=0.8, q=0.5");
     addPot(pots, "type=Dehnen, mass=2, scaleRadius=1, gamma=1.5");
+    addPot(pots, "type=Dehnen, mass=2, scaleRadius=1, gamma=1, p=0.8, q=0.6");
     addPot(pots, "type=PerfectEllipsoid, q=0.6");
+    {   // the table of MGE parameters contains commas, so cannot be given in a single-line string
+        utils::KeyValueMap params("type=MGE");
+        params.set("table", "[[1, 0.5, 0.4, 0.2], [2, 1.5, 1.5, 0.6], [0.5, 4, 3, 3]]");
+        pots.push_back(potential::createPotential(params));
+    }
     addPot(pots, "type=Multipole, density=Spheroid, densityNorm=1e5, scaleRadius=1.234e-5, "
         "gamma=-2.0, beta=2.99, alpha=2.5, gridSizeR=64");
     addPot(pots, "density=Disk, surfaceDensity=1, scaleRadius=2, scaleHeight=-0.2, "
@@ -400,6 +609,7 @@ int main() {
     pots.push_back(make_galpot(test_galpot_params[1]));
     //pots.push_back(make_galpot(test_galpot_params[2]));
     std::cout << std::setprecision(10);
+    allok &= testEvalmany(potential::Composite(pots));
     for(unsigned int ip=0; ip<pots.size(); ip++) {
         allok &= testPotential(*pots[ip]);
         for(int ic=0; ic<numtestpoints; ic++) {
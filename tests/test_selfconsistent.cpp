@@ -0,0 +1,166 @@
+/** \file    test_selfconsistent.cpp
+    \date    2026
+
+    This test checks the self-consistent modelling machinery: the joint update of several
+    DF-based components with compatible grids, and the concurrent update of several such groups,
+    must produce the same densities and total potential as the update of each component
+    separately, up to the accuracy of density computation; the construction of the Multipole
+    expansion overlapped with the computation of disk densities must give the same result
+    as a single-threaded update; and the model state saved to a file and restored into a fresh
+    model must reproduce the densities and the potential.
+*/
+#include "galaxymodel_selfconsistent.h"
+#include "df_halo.h"
+#include "potential_analytic.h"
+#include "potential_utils.h"
+#include "utils.h"
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+const char* errmsg = "\033[1;31m **\033[0m";
+
+std::string checkLess(double val, double max, bool &ok)
+{
+    if(!(val<max))
+        ok = false;
+    return utils::pp(val, 7) + (val<max ? "" : errmsg);
+}
+
+/// DF of a spheroidal component with the given normalization and break action
+df::PtrDistributionFunction makeDF(double norm, double J0, double slopeIn, double coefJzIn)
+{
+    df::DoublePowerLawParam par;
+    par.norm     = norm;
+    par.J0       = J0;
+    par.slopeIn  = slopeIn;
+    par.slopeOut = 5;
+    par.coefJzIn = coefJzIn;
+    return df::PtrDistributionFunction(new df::DoublePowerLaw(par));
+}
+
+/// create a model with two spheroidal DF-based components sharing the same grid,
+/// and optionally a third, disklike one, which forms a separate group in the joint update
+galaxymodel::SelfConsistentModel makeModel(bool useJointUpdate, bool withDisk=false)
+{
+    galaxymodel::SelfConsistentModel model;
+    model.verbose = false;
+    model.useJointUpdate = useJointUpdate;
+    model.lmaxAngularSph = 4;
+    model.sizeRadialSph  = 20;
+    model.rminSph = 0.02;
+    model.rmaxSph = 100;
+    model.sizeRadialCyl   = 12;
+    model.RminCyl = 0.1;
+    model.RmaxCyl = 20;
+    model.sizeVerticalCyl = 10;
+    model.zminCyl = 0.05;
+    model.zmaxCyl = 10;
+    potential::PtrDensity init(new potential::Plummer(1., 1.));
+    model.components.push_back(galaxymodel::PtrComponent(new galaxymodel::ComponentWithSpheroidalDF(
+        makeDF(1.0, 1.0, 1.5, 1.2), init, 4, 0, 12, 0.05, 50., 1e-3, 20000)));
+    model.components.push_back(galaxymodel::PtrComponent(new galaxymodel::ComponentWithSpheroidalDF(
+        makeDF(0.3, 0.5, 0.5, 0.8), init, 4, 0, 12, 0.05, 50., 1e-3, 20000)));
+    if(withDisk)
+        model.components.push_back(galaxymodel::PtrComponent(new galaxymodel::ComponentWithDisklikeDF(
+            makeDF(0.2, 1.0, 0.5, 0.3), potential::PtrDensity(new potential::MiyamotoNagai(0.2, 1., 0.2)),
+            0, 8, 0.2, 10., 6, 0.05, 3., 1e-3, 20000)));
+    return model;
+}
+
+/// compare the densities of all components and the total potentials of two models
+bool compareModels(const galaxymodel::SelfConsistentModel& model1,
+    const galaxymodel::SelfConsistentModel& model2, double tolerance)
+{
+    double maxdevRho = 0, maxdevPhi = 0;
+    for(double r=0.1; r<=30; r*=1.7) {
+        for(int t=0; t<3; t++) {
+            coord::PosCyl pos(r * sin(0.5*t+0.2), r * cos(0.5*t+0.2), 0);
+            for(size_t c=0; c<model1.components.size(); c++) {
+                double rho1 = model1.components[c]->getDensity()->density(pos);
+                double rho2 = model2.components[c]->getDensity()->density(pos);
+                maxdevRho = fmax(maxdevRho, fabs(rho1/rho2-1));
+            }
+            double Phi1 = model1.totalPotential->value(pos), Phi2 = model2.totalPotential->value(pos);
+            maxdevPhi = fmax(maxdevPhi, fabs(Phi1/Phi2-1));
+        }
+    }
+    bool ok = true;
+    std::cout << "density: " << checkLess(maxdevRho, tolerance, ok) <<
+        ", potential: " << checkLess(maxdevPhi, tolerance, ok) << "\n";
+    return ok;
+}
+
+int main()
+{
+    bool allok = true;
+    galaxymodel::SelfConsistentModel modelSep = makeModel(false), modelJoint = makeModel(true);
+    for(int iter=0; iter<2; iter++) {
+        galaxymodel::doIteration(modelSep);
+        galaxymodel::doIteration(modelJoint);
+        std::cout << "Iteration " << iter << ": joint vs separate update: ";
+        allok &= compareModels(modelSep, modelJoint, 2e-3);
+    }
+
+    // two groups of components (spheroidal and disklike) updated concurrently
+    galaxymodel::SelfConsistentModel modelSepDisk = makeModel(false, true),
+        modelJointDisk = makeModel(true, true);
+    galaxymodel::doIteration(modelSepDisk);
+    galaxymodel::doIteration(modelJointDisk);
+    std::cout << "Model with a disk: concurrent vs sequential update: ";
+    allok &= compareModels(modelSepDisk, modelJointDisk, 3e-3);
+
+    // the same update performed by a single thread, in which the Multipole expansion is constructed
+    // only after all spheroidal densities and before any disklike ones, must give identical results
+    // to the multi-threaded one, in which it is constructed while other threads compute disk densities
+    galaxymodel::SelfConsistentModel modelJointDiskSeq = makeModel(true, true);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(1)
+#endif
+    galaxymodel::doIteration(modelJointDiskSeq);
+    std::cout << "Model with a disk: multi-threaded vs single-threaded update: ";
+    allok &= compareModels(modelJointDiskSeq, modelJointDisk, 1e-12);
+
+    // save the state of the model, restore it into a new model with the same components,
+    // and check that the new model is identical (up to the conversion to binary format),
+    // and that truncated or foreign files are rejected
+    const char* fileName = "test_selfconsistent.state";
+    galaxymodel::writeModelState(modelJoint, fileName);
+    galaxymodel::SelfConsistentModel modelRestored = makeModel(true);
+    galaxymodel::readModelState(modelRestored, fileName);
+    std::cout << "Restored vs saved model: ";
+    allok &= compareModels(modelJoint, modelRestored, 1e-12);
+    std::string content;
+    {
+        std::ifstream in(fileName, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    for(int t=0; t<2; t++) {
+        {
+            std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+            if(t==0)  // truncated file
+                out.write(content.data(), content.size()/2);
+            else      // a file with a different signature
+                out.write(("X" + content.substr(1)).data(), content.size());
+        }
+        try{
+            galaxymodel::readModelState(modelRestored, fileName);
+            std::cout << "Corrupted model state not detected" << errmsg << "\n";
+            allok = false;
+        }
+        catch(std::runtime_error&) {}
+    }
+    std::remove(fileName);
+    // the model restored from the state continues to iterate in the same way as the original one
+    galaxymodel::doIteration(modelJoint);
+    galaxymodel::doIteration(modelRestored);
+    std::cout << "Next iteration of restored vs saved model: ";
+    allok &= compareModels(modelJoint, modelRestored, 1e-6);
+
+    if(allok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}